@@ -0,0 +1,189 @@
+/*
+ * Copyright (c) 2015, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+
+/**
+ * \file
+ *         Anchor positions keyed by ranging address
+ */
+
+#include "contiki.h"
+#include "anchor-db.h"
+#include <string.h>
+
+// anchor_db_nearest() returns at most this many anchors
+#define ANCHOR_DB_MAX_NEAREST 16
+
+/*---------------------------------------------------------------------------*/
+const struct anchor_db_anchor *anchor_db_get(const struct anchor_db *db, ranging_addr_t addr) {
+    uint8_t i = db->index[addr];
+    return i == 0 ? NULL : &db->anchors[i - 1];
+}
+/*---------------------------------------------------------------------------*/
+// grid cell of a position, positions outside of the grid belong to the closest edge cell
+static void get_cell(const struct anchor_db *db, int16_t x, int16_t y, int16_t *cx, int16_t *cy) {
+    int32_t i = ((int32_t)x - db->grid_x) / db->cell_cm;
+    int32_t j = ((int32_t)y - db->grid_y) / db->cell_cm;
+
+    *cx = i < 0 ? 0 : (i >= db->grid_w ? db->grid_w - 1 : i);
+    *cy = j < 0 ? 0 : (j >= db->grid_h ? db->grid_h - 1 : j);
+}
+/*---------------------------------------------------------------------------*/
+static uint64_t square_distance(const struct anchor_db_anchor *a, int16_t x, int16_t y, int16_t z) {
+    int32_t dx = (int32_t)a->x - x;
+    int32_t dy = (int32_t)a->y - y;
+    int32_t dz = (int32_t)a->z - z;
+    return (uint64_t)((int64_t)dx * dx) + (uint64_t)((int64_t)dy * dy) + (uint64_t)((int64_t)dz * dz);
+}
+/*---------------------------------------------------------------------------*/
+uint8_t anchor_db_nearest(const struct anchor_db *db, int16_t x, int16_t y, int16_t z,
+    const struct anchor_db_anchor **out, uint8_t num) {
+    uint64_t best[ANCHOR_DB_MAX_NEAREST], d;
+    const struct anchor_db_anchor *a;
+    int16_t cx, cy, i, j, r, max_r;
+    int32_t border, edge;
+    uint16_t c;
+    uint8_t count = 0, k, n;
+
+    if(num > ANCHOR_DB_MAX_NEAREST) {
+        num = ANCHOR_DB_MAX_NEAREST;
+    }
+    if(db->num_anchors == 0 || num == 0) {
+        return 0;
+    }
+
+    get_cell(db, x, y, &cx, &cy);
+    max_r = db->grid_w > db->grid_h ? db->grid_w : db->grid_h;
+
+    // visit the cells ring by ring around the cell of the position
+    for(r = 0; r < max_r; r++) {
+        for(j = cy - r; j <= cy + r; j++) {
+            if(j < 0 || j >= db->grid_h) {
+                continue;
+            }
+            // inner rows of the ring only have the cells on its left and right edge
+            for(i = cx - r; i <= cx + r; i += (j == cy - r || j == cy + r) ? 1 : 2 * r) {
+                if(i < 0 || i >= db->grid_w) {
+                    continue;
+                }
+                c = j * db->grid_w + i;
+                for(n = db->cell_start[c]; n < db->cell_start[c + 1]; n++) {
+                    a = &db->anchors[db->cell_anchors[n]];
+                    d = square_distance(a, x, y, z);
+                    if(count == num && d >= best[num - 1]) {
+                        continue;
+                    }
+                    // insertion into the sorted list of the nearest anchors
+                    k = count < num ? count++ : num - 1;
+                    for(; k > 0 && best[k - 1] > d; k--) {
+                        best[k] = best[k - 1];
+                        out[k] = out[k - 1];
+                    }
+                    best[k] = d;
+                    out[k] = a;
+                }
+            }
+        }
+
+        if(count == num) {
+            // the cells of the next ring are at least as far away as the edge of this one
+            border = (int32_t)x - (db->grid_x + (int32_t)(cx - r) * db->cell_cm);
+            edge = db->grid_x + (int32_t)(cx + r + 1) * db->cell_cm - x;
+            border = edge < border ? edge : border;
+            edge = (int32_t)y - (db->grid_y + (int32_t)(cy - r) * db->cell_cm);
+            border = edge < border ? edge : border;
+            edge = db->grid_y + (int32_t)(cy + r + 1) * db->cell_cm - y;
+            border = edge < border ? edge : border;
+            if(border > 0 && (uint64_t)((int64_t)border * border) >= best[num - 1]) {
+                break;
+            }
+        }
+    }
+    return count;
+}
+/*---------------------------------------------------------------------------*/
+void anchor_db_build(struct anchor_db *db, struct anchor_db_storage *storage,
+    const struct anchor_db_anchor *anchors, uint8_t num, uint16_t cell_cm) {
+    int16_t min_x = 0, max_x = 0, min_y = 0, max_y = 0, cx, cy;
+    uint32_t cell = cell_cm > 0 ? cell_cm : 1;
+    uint16_t cells;
+    uint8_t i;
+
+    memset(storage->index, 0, sizeof(storage->index));
+    for(i = 0; i < num; i++) {
+        storage->index[anchors[i].addr] = i + 1;
+        if(i == 0 || anchors[i].x < min_x) {
+            min_x = anchors[i].x;
+        }
+        if(i == 0 || anchors[i].x > max_x) {
+            max_x = anchors[i].x;
+        }
+        if(i == 0 || anchors[i].y < min_y) {
+            min_y = anchors[i].y;
+        }
+        if(i == 0 || anchors[i].y > max_y) {
+            max_y = anchors[i].y;
+        }
+    }
+    while((((int32_t)max_x - min_x) / cell + 1) * (((int32_t)max_y - min_y) / cell + 1) > ANCHOR_DB_MAX_CELLS) {
+        cell *= 2;
+    }
+
+    db->anchors = anchors;
+    db->num_anchors = num;
+    db->index = storage->index;
+    db->grid_x = min_x;
+    db->grid_y = min_y;
+    db->cell_cm = cell > UINT16_MAX ? UINT16_MAX : cell;
+    db->grid_w = ((int32_t)max_x - min_x) / db->cell_cm + 1;
+    db->grid_h = ((int32_t)max_y - min_y) / db->cell_cm + 1;
+    db->cell_start = storage->cell_start;
+    db->cell_anchors = storage->cell_anchors;
+
+    // counting sort of the anchors by cell
+    cells = db->grid_w * db->grid_h;
+    memset(storage->cell_start, 0, cells + 1);
+    for(i = 0; i < num; i++) {
+        get_cell(db, anchors[i].x, anchors[i].y, &cx, &cy);
+        storage->cell_start[cy * db->grid_w + cx + 1]++;
+    }
+    for(cells = 1; cells <= db->grid_w * db->grid_h; cells++) {
+        storage->cell_start[cells] += storage->cell_start[cells - 1];
+    }
+    // cell_start[c] moves to the end of cell c while it is filled, which is the start of c + 1
+    for(i = 0; i < num; i++) {
+        get_cell(db, anchors[i].x, anchors[i].y, &cx, &cy);
+        storage->cell_anchors[storage->cell_start[cy * db->grid_w + cx]++] = i;
+    }
+    for(cells = db->grid_w * db->grid_h; cells > 0; cells--) {
+        storage->cell_start[cells] = storage->cell_start[cells - 1];
+    }
+    storage->cell_start[0] = 0;
+}
+/*---------------------------------------------------------------------------*/
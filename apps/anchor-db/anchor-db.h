@@ -0,0 +1,97 @@
+/*
+ * Copyright (c) 2015, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+
+/**
+ * \file
+ *         Anchor positions keyed by ranging address. The tables of a
+ *         testbed are generated by tools/dwm1001/anchor-db-gen.py into a
+ *         C file of constant tables, which stay in flash:
+ *         anchor_db_get() is a single lookup in an index over all
+ *         ranging addresses, anchor_db_nearest() searches a grid of
+ *         cells around the query position. Anchors only known at run
+ *         time, e.g. in simulations, go through anchor_db_build() into
+ *         RAM tables of the same layout.
+ */
+
+#ifndef __ANCHOR_DB_H__
+#define __ANCHOR_DB_H__
+
+#include "contiki.h"
+#include "net/mac/tsch/tsch-prop.h"
+
+// maximum number of grid cells of a table built with anchor_db_build()
+#ifdef ANCHOR_DB_CONF_MAX_CELLS
+#define ANCHOR_DB_MAX_CELLS ANCHOR_DB_CONF_MAX_CELLS
+#else
+#define ANCHOR_DB_MAX_CELLS 64
+#endif
+
+#define ANCHOR_DB_ADDR_SPACE (1 << (8 * sizeof(ranging_addr_t)))
+
+// position in centimeters
+struct anchor_db_anchor {
+    ranging_addr_t addr;
+    int16_t x, y, z;
+};
+
+struct anchor_db {
+    const struct anchor_db_anchor *anchors;
+    uint8_t num_anchors;
+    // ANCHOR_DB_ADDR_SPACE entries, position in anchors + 1, 0 for unknown nodes
+    const uint8_t *index;
+    // Grid of grid_w * grid_h cells of cell_cm, lower left corner at grid_x, grid_y. The
+    // anchors of cell c are cell_anchors[cell_start[c]] to cell_anchors[cell_start[c + 1] - 1],
+    // as position in anchors. Cells are numbered row by row.
+    int16_t grid_x, grid_y;
+    uint16_t cell_cm;
+    uint8_t grid_w, grid_h;
+    const uint8_t *cell_start;
+    const uint8_t *cell_anchors;
+};
+
+// RAM for the tables of anchor_db_build()
+struct anchor_db_storage {
+    uint8_t index[ANCHOR_DB_ADDR_SPACE];
+    uint8_t cell_start[ANCHOR_DB_MAX_CELLS + 1];
+    uint8_t cell_anchors[ANCHOR_DB_ADDR_SPACE - 1];
+};
+
+// returns NULL for nodes without known position
+const struct anchor_db_anchor *anchor_db_get(const struct anchor_db *db, ranging_addr_t addr);
+// Writes the up to num anchors closest to the position (in cm) to out, nearest first.
+// Returns the number of anchors written.
+uint8_t anchor_db_nearest(const struct anchor_db *db, int16_t x, int16_t y, int16_t z,
+    const struct anchor_db_anchor **out, uint8_t num);
+// Sets up db for the anchors, which are not copied, with the tables in storage. The cells
+// are cell_cm wide, or wider if the anchors would need more than ANCHOR_DB_MAX_CELLS.
+void anchor_db_build(struct anchor_db *db, struct anchor_db_storage *storage,
+    const struct anchor_db_anchor *anchors, uint8_t num, uint16_t cell_cm);
+
+#endif /* __ANCHOR_DB_H__ */
@@ -0,0 +1,348 @@
+/*
+ * Copyright (c) 2015, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+
+/**
+ * \file
+ *         Position solver for mobile nodes based on MTM measurements
+ */
+
+#include "contiki.h"
+#include "mtm-locate.h"
+#if !TSCH_MTM_DEFERRED_PROCESSING
+#include "lib/ringbufindex.h"
+#endif
+#include <math.h>
+#include <string.h>
+
+// lower bound for the uncertainty of the first position, which is the center of the anchors
+#define MTM_LOCATE_MIN_INIT_STD_M 1.0f
+// the gate only applies once the filter had this many updates
+#define MTM_LOCATE_CONVERGED_UPDATES 16
+// Every gated measurement counts up, every used one down. When the count reaches this limit,
+// the filter lost the node and starts over.
+#define MTM_LOCATE_MAX_GATED 32
+
+static const struct anchor_db *anchors;
+static float center[MTM_LOCATE_DIM];
+
+// filter state, position in meters and its covariance
+static float state[MTM_LOCATE_DIM];
+static float cov[MTM_LOCATE_DIM][MTM_LOCATE_DIM];
+static uint8_t initialized;
+static uint16_t updates;
+static uint8_t gated_count;
+static clock_time_t last_time;
+
+static struct mtm_locate_stats stats;
+
+#if !TSCH_MTM_DEFERRED_PROCESSING
+// The measurements arrive in the slot operation, which must not run the float math of
+// the filter. The slot operation is the only producer and mtm_locate_process the only
+// consumer of the queue.
+struct queued_measurement {
+    enum measurement_type type;
+    ranging_addr_t addr_A;
+    ranging_addr_t addr_B;
+    float time;
+    clock_time_t received;
+};
+static struct ringbufindex queue_ringbuf;
+static struct queued_measurement queue[MTM_LOCATE_QUEUE_LEN];
+
+PROCESS(mtm_locate_process, "MTM locate");
+#endif
+
+/*---------------------------------------------------------------------------*/
+void mtm_locate_init(const struct anchor_db *db) {
+    uint8_t i;
+
+    anchors = db;
+    memset(center, 0, sizeof(center));
+    for(i = 0; i < db->num_anchors; i++) {
+        center[0] += db->anchors[i].x * 0.01f;
+        center[1] += db->anchors[i].y * 0.01f;
+#if MTM_LOCATE_DIM == 3
+        center[2] += db->anchors[i].z * 0.01f;
+#endif
+    }
+    for(i = 0; db->num_anchors > 0 && i < MTM_LOCATE_DIM; i++) {
+        center[i] /= db->num_anchors;
+    }
+    memset(&stats, 0, sizeof(stats));
+    mtm_locate_reset();
+#if !TSCH_MTM_DEFERRED_PROCESSING
+    if(!process_is_running(&mtm_locate_process)) {
+        ringbufindex_init(&queue_ringbuf, MTM_LOCATE_QUEUE_LEN);
+        process_start(&mtm_locate_process, NULL);
+    }
+#endif
+}
+/*---------------------------------------------------------------------------*/
+void mtm_locate_reset(void) {
+    initialized = 0;
+    updates = 0;
+}
+/*---------------------------------------------------------------------------*/
+// Distance between the position and the anchor. unit receives the derivative of the
+// distance by the position, the unit vector from the anchor towards the position.
+static float anchor_distance(const struct anchor_db_anchor *a, float *unit) {
+    float d[3], dist;
+    uint8_t i;
+
+    d[0] = state[0] - a->x * 0.01f;
+    d[1] = state[1] - a->y * 0.01f;
+#if MTM_LOCATE_DIM == 3
+    d[2] = state[2] - a->z * 0.01f;
+#else
+    d[2] = (MTM_LOCATE_Z_CM - a->z) * 0.01f;
+#endif
+    dist = sqrtf(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+
+    for(i = 0; i < MTM_LOCATE_DIM; i++) {
+        // right on the anchor the direction is undefined, the measurement is then not used
+        unit[i] = dist > 1e-3f ? d[i] / dist : 0.0f;
+    }
+    return dist;
+}
+/*---------------------------------------------------------------------------*/
+// Starts in the center of the anchors with an uncertainty that covers all of them. A start
+// inside the anchor constellation keeps the linearization of the first updates sane.
+static void init_state(void) {
+    float spread = 0.0f, d;
+    uint8_t i, j;
+
+    for(i = 0; i < MTM_LOCATE_DIM; i++) {
+        state[i] = center[i];
+    }
+    for(i = 0; i < anchors->num_anchors; i++) {
+        d = fabsf(anchors->anchors[i].x * 0.01f - center[0]) + fabsf(anchors->anchors[i].y * 0.01f - center[1]);
+        if(d > spread) {
+            spread = d;
+        }
+    }
+    if(spread < MTM_LOCATE_MIN_INIT_STD_M) {
+        spread = MTM_LOCATE_MIN_INIT_STD_M;
+    }
+
+    for(i = 0; i < MTM_LOCATE_DIM; i++) {
+        for(j = 0; j < MTM_LOCATE_DIM; j++) {
+            cov[i][j] = i == j ? spread * spread : 0.0f;
+        }
+    }
+    updates = 0;
+    gated_count = 0;
+    initialized = 1;
+}
+/*---------------------------------------------------------------------------*/
+// the node may have moved by up to MTM_LOCATE_SPEED_CM_S since the last measurement
+static void predict(clock_time_t now) {
+    float move = (MTM_LOCATE_SPEED_CM_S * 0.01f) * (float)(now - last_time) / CLOCK_SECOND;
+    uint8_t i;
+
+    for(i = 0; i < MTM_LOCATE_DIM; i++) {
+        cov[i][i] += move * move;
+    }
+}
+/*---------------------------------------------------------------------------*/
+// Kalman update with a scalar measurement: h is the derivative of the measurement by the
+// position, innovation the difference between the measured and the predicted value and
+// r the variance of the measurement
+static void update(const float *h, float innovation, float r) {
+    float ph[MTM_LOCATE_DIM], k[MTM_LOCATE_DIM], s;
+    uint8_t i, j;
+
+    s = r;
+    for(i = 0; i < MTM_LOCATE_DIM; i++) {
+        ph[i] = 0.0f;
+        for(j = 0; j < MTM_LOCATE_DIM; j++) {
+            ph[i] += cov[i][j] * h[j];
+        }
+        s += h[i] * ph[i];
+    }
+    if(updates < MTM_LOCATE_CONVERGED_UPDATES) {
+        // far from the node, the linearization is poor: only take half the step
+        s += s - r;
+    }
+
+#if MTM_LOCATE_GATE
+    if(updates >= MTM_LOCATE_CONVERGED_UPDATES
+        && innovation * innovation > (float)(MTM_LOCATE_GATE * MTM_LOCATE_GATE) * s) {
+        stats.gated++;
+        if(++gated_count >= MTM_LOCATE_MAX_GATED) {
+            stats.restarts++;
+            initialized = 0;
+        }
+        return;
+    }
+    if(gated_count > 0) {
+        gated_count--;
+    }
+#endif
+
+    for(i = 0; i < MTM_LOCATE_DIM; i++) {
+        k[i] = ph[i] / s;
+        state[i] += k[i] * innovation;
+    }
+    // cov -= k * (h cov), cov is symmetric so h cov is ph. Only the upper triangle is
+    // computed and mirrored, this keeps cov symmetric despite rounding.
+    for(i = 0; i < MTM_LOCATE_DIM; i++) {
+        for(j = i; j < MTM_LOCATE_DIM; j++) {
+            cov[i][j] -= k[i] * ph[j];
+            cov[j][i] = cov[i][j];
+        }
+    }
+
+    if(updates < UINT16_MAX) {
+        updates++;
+    }
+    stats.accepted++;
+}
+/*---------------------------------------------------------------------------*/
+static void locate(enum measurement_type type, ranging_addr_t addr_A, ranging_addr_t addr_B,
+                   float time, clock_time_t now) {
+    const struct anchor_db_anchor *a, *b = NULL;
+    float h[MTM_LOCATE_DIM], unit_b[MTM_LOCATE_DIM];
+    float predicted, r;
+    uint8_t i;
+
+    if(type == TWR) {
+        // addr_A is ourselves
+        a = anchor_db_get(anchors, addr_B);
+    } else {
+        a = anchor_db_get(anchors, addr_A);
+        b = anchor_db_get(anchors, addr_B);
+        if(b == NULL) {
+            a = NULL;
+        }
+    }
+    if(a == NULL) {
+        stats.ignored++;
+        return;
+    }
+
+    if(!initialized) {
+        init_state();
+    } else {
+        predict(now);
+    }
+    last_time = now;
+
+    predicted = anchor_distance(a, h);
+    if(type == TWR) {
+        r = (MTM_LOCATE_TWR_SIGMA_CM * 0.01f) * (MTM_LOCATE_TWR_SIGMA_CM * 0.01f);
+    } else {
+        // the TDoA is the distance to A minus the distance to B
+        predicted -= anchor_distance(b, unit_b);
+        for(i = 0; i < MTM_LOCATE_DIM; i++) {
+            h[i] -= unit_b[i];
+        }
+        r = (MTM_LOCATE_TDOA_SIGMA_CM * 0.01f) * (MTM_LOCATE_TDOA_SIGMA_CM * 0.01f);
+    }
+
+    update(h, time_to_dist(time) - predicted, r);
+}
+/*---------------------------------------------------------------------------*/
+void mtm_locate_input(const struct distance_measurement *m) {
+#if !TSCH_MTM_DEFERRED_PROCESSING
+    int16_t index;
+    struct queued_measurement *q;
+#endif
+
+    if(anchors == NULL) {
+        return;
+    }
+
+#if TSCH_MTM_DEFERRED_PROCESSING
+    // called by TSCH_MTM_PROCESS, outside of the slot operation
+    locate(m->type, m->addr_A, m->addr_B, m->time, clock_time());
+#else
+    index = ringbufindex_peek_put(&queue_ringbuf);
+    if(index == -1) {
+        stats.dropped++;
+        return;
+    }
+    q = &queue[index];
+    q->type = m->type;
+    q->addr_A = m->addr_A;
+    q->addr_B = m->addr_B;
+    q->time = m->time;
+    q->received = clock_time();
+    ringbufindex_put(&queue_ringbuf);
+    process_poll(&mtm_locate_process);
+#endif
+}
+/*---------------------------------------------------------------------------*/
+int mtm_locate_get_position(struct mtm_locate_position *pos) {
+    float var = 0.0f;
+    uint8_t i;
+
+    if(!initialized) {
+        return 0;
+    }
+
+    pos->x = state[0];
+    pos->y = state[1];
+#if MTM_LOCATE_DIM == 3
+    pos->z = state[2];
+#else
+    pos->z = MTM_LOCATE_Z_CM * 0.01f;
+#endif
+    for(i = 0; i < MTM_LOCATE_DIM; i++) {
+        var += cov[i][i];
+    }
+    pos->std = sqrtf(var);
+    pos->time = last_time;
+    return 1;
+}
+/*---------------------------------------------------------------------------*/
+void mtm_locate_get_stats(struct mtm_locate_stats *s) {
+    *s = stats;
+}
+/*---------------------------------------------------------------------------*/
+#if !TSCH_MTM_DEFERRED_PROCESSING
+PROCESS_THREAD(mtm_locate_process, ev, data)
+{
+    int16_t index;
+
+    PROCESS_BEGIN();
+
+    while(1) {
+        PROCESS_YIELD_UNTIL(ev == PROCESS_EVENT_POLL);
+        while((index = ringbufindex_peek_get(&queue_ringbuf)) != -1) {
+            struct queued_measurement *q = &queue[index];
+            locate(q->type, q->addr_A, q->addr_B, q->time, q->received);
+            ringbufindex_get(&queue_ringbuf);
+        }
+    }
+
+    PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
+#endif
@@ -0,0 +1,126 @@
+/*
+ * Copyright (c) 2015, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+
+/**
+ * \file
+ *         Position solver for mobile nodes, fed with the TWR and TDoA
+ *         measurements of the MTM engine (tsch-prop.h). The position is
+ *         tracked with an extended Kalman filter, every measurement is a
+ *         scalar update, so the work per measurement and the memory
+ *         footprint are fixed. The anchor coordinates come from an
+ *         anchor database (apps/anchor-db) given to mtm_locate_init().
+ *
+ *         To feed the solver, set in project-conf.h
+ *           #define TSCH_CALLBACK_MTM_MEASUREMENT mtm_locate_input
+ *
+ *         Without TSCH_MTM_DEFERRED_PROCESSING the callback runs in the
+ *         slot operation, the measurements are then queued and the filter
+ *         runs in the process of the solver.
+ */
+
+#ifndef __MTM_LOCATE_H__
+#define __MTM_LOCATE_H__
+
+#include "contiki.h"
+#include "net/mac/tsch/tsch-prop.h"
+#include "anchor-db.h"
+
+// Solve for x and y only (2) or for x, y and z (3). In 2D the height of the node is
+// fixed to MTM_LOCATE_Z_CM, which suits anchors that are all mounted at the same height.
+#ifdef MTM_LOCATE_CONF_DIM
+#define MTM_LOCATE_DIM MTM_LOCATE_CONF_DIM
+#else
+#define MTM_LOCATE_DIM 2
+#endif
+#if MTM_LOCATE_DIM != 2 && MTM_LOCATE_DIM != 3
+#error "MTM_LOCATE_DIM must be 2 or 3"
+#endif
+#ifdef MTM_LOCATE_CONF_Z_CM
+#define MTM_LOCATE_Z_CM MTM_LOCATE_CONF_Z_CM
+#else
+#define MTM_LOCATE_Z_CM 0
+#endif
+
+// standard deviation of the TWR ranges and TDoA range differences
+#ifdef MTM_LOCATE_CONF_TWR_SIGMA_CM
+#define MTM_LOCATE_TWR_SIGMA_CM MTM_LOCATE_CONF_TWR_SIGMA_CM
+#else
+#define MTM_LOCATE_TWR_SIGMA_CM 10
+#endif
+#ifdef MTM_LOCATE_CONF_TDOA_SIGMA_CM
+#define MTM_LOCATE_TDOA_SIGMA_CM MTM_LOCATE_CONF_TDOA_SIGMA_CM
+#else
+#define MTM_LOCATE_TDOA_SIGMA_CM 15
+#endif
+// expected speed of the node, the position uncertainty grows with it between measurements
+#ifdef MTM_LOCATE_CONF_SPEED_CM_S
+#define MTM_LOCATE_SPEED_CM_S MTM_LOCATE_CONF_SPEED_CM_S
+#else
+#define MTM_LOCATE_SPEED_CM_S 100
+#endif
+// Measurements further than this many standard deviations off the predicted value are
+// dropped once the filter converged, 0 disables the gate
+#ifdef MTM_LOCATE_CONF_GATE
+#define MTM_LOCATE_GATE MTM_LOCATE_CONF_GATE
+#else
+#define MTM_LOCATE_GATE 5
+#endif
+
+// measurements waiting for the filter without TSCH_MTM_DEFERRED_PROCESSING, must be a power of two
+#ifdef MTM_LOCATE_CONF_QUEUE_LEN
+#define MTM_LOCATE_QUEUE_LEN MTM_LOCATE_CONF_QUEUE_LEN
+#else
+#define MTM_LOCATE_QUEUE_LEN 8
+#endif
+
+struct mtm_locate_position {
+    float x, y, z;      // in meters
+    float std;          // standard deviation of the position in meters
+    clock_time_t time;  // of the last measurement
+};
+
+struct mtm_locate_stats {
+    uint32_t accepted;  // measurements used for the position
+    uint32_t gated;     // measurements dropped by MTM_LOCATE_GATE
+    uint32_t ignored;   // measurements towards nodes without known position
+    uint32_t restarts;  // the filter lost the node and started over
+    uint32_t dropped;   // measurements not used, the queue was full
+};
+
+// The database has to stay valid as long as the solver is used, it is not copied
+void mtm_locate_init(const struct anchor_db *db);
+// forget the position, e.g. after the node was moved
+void mtm_locate_reset(void);
+void mtm_locate_input(const struct distance_measurement *m);
+// returns 0 as long as there is no position
+int mtm_locate_get_position(struct mtm_locate_position *pos);
+void mtm_locate_get_stats(struct mtm_locate_stats *stats);
+
+#endif /* __MTM_LOCATE_H__ */
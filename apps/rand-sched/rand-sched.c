@@ -51,6 +51,7 @@
 #include "tsch-slot-operation.h"
 #include "tsch.h"
 #include <stdint.h>
+#include <string.h>
 
 /* #define DEBUG DEBUG_PRINT */
 /* #include "net/ip/uip-debug.h" */
@@ -107,8 +108,19 @@ static struct rand_schedule_node_state {
 
     uint8_t backoff_active;
     clock_time_t current_backoff;
+
+    // start of the current search for a slot, for the convergence stats
+    clock_time_t unsettled_since;
+    uint32_t unsettled_since_round;
+    uint32_t picked_timeslot_round;
+
+    // only used by RAND_SCHED_ALLOCATOR_CLAIM
+    uint8_t listen_rounds;
+    uint8_t claim_attempts;
 } node_state;
 
+static struct rand_sched_stats stats;
+
 static void reset_rand_schedule_state () {
     node_state.neighbor_discovery_running = 0;
     node_state.node_is_fixed = 0;
@@ -119,6 +131,12 @@ static void reset_rand_schedule_state () {
     node_state.backoff_active = 0;
     node_state.rank = 0;
     node_state.current_backoff = RAND_SCHED_INITIAL_BACKOFF_TIME;
+    node_state.unsettled_since = clock_time();
+    node_state.unsettled_since_round = mtm_get_round_counter();
+    node_state.picked_timeslot_round = 0;
+    node_state.listen_rounds = 0;
+    node_state.claim_attempts = 0;
+    memset(&stats, 0, sizeof(stats));
 }
 
 #if RAND_SCHED_WITH_BACKOFF_TIMER
@@ -196,27 +214,20 @@ void rand_sched_set_mobile(uint8_t enable) {
 
 void maybe_reroll_timeslot() {
     uint8_t our_timeslot = check_have_timeslot();
-    clock_time_t now = clock_time();
 
     if(node_state.node_is_fixed)
         return;
 
-    /* // iterate over tsch_prop_get_neighbor_list(); */
-    struct mtm_neighbor *n = NULL;
-    for(n = list_head(tsch_prop_get_neighbor_list()); n != NULL; n = list_item_next(n)) {
-        if((now - n->last_observed_direct) < MAX_LAST_SEEN_INTERVAL || (now - n->last_observed_indirect) < MAX_LAST_SEEN_INTERVAL) {
-            if(n->observed_timeslot == our_timeslot) {
-                PRINTF("rerolling timeslot\n");
-                remove_transmit_link(our_timeslot);
-                break;
-            }
-        }
+    uint32_t occupied[TSCH_MTM_OCCUPANCY_WORDS];
+    tsch_prop_get_slot_occupancy(occupied);
+    if(our_timeslot < TSCH_MTM_OCCUPANCY_SLOTS && ((occupied[our_timeslot / 32] >> (our_timeslot % 32)) & 1)) {
+        PRINTF("rerolling timeslot\n");
+        remove_transmit_link(our_timeslot);
     }
 }
 
 static void discovery_recv(struct neighbor_discovery_conn *c,
     const linkaddr_t *from, uint16_t val) {
-    clock_time_t now = clock_time();
     uint8_t our_timeslot = check_have_timeslot();
 
     uint8_t other_rank = val & 0xFF;
@@ -229,15 +240,13 @@ static void discovery_recv(struct neighbor_discovery_conn *c,
     if(!our_timeslot || node_state.node_is_fixed)
         return;
 
+#if RAND_SCHED_ALLOCATOR == RAND_SCHED_ALLOCATOR_LOTTERY
+    clock_time_t now = clock_time();
+
     // Alternative Idea: When we get a neighbor message, and we are an active node, and we did not
     // observe the neighbor through mtm, than we directly know something is wrong and we backoff
     // from our decision
-    struct mtm_neighbor *n = NULL;
-    for(n = list_head(tsch_prop_get_neighbor_list()); n != NULL; n = list_item_next(n)) {
-        if (n->neighbor_addr == from->u8[LINKADDR_SIZE-1]) {
-            break;
-        }
-    }
+    struct mtm_neighbor *n = tsch_prop_get_neighbor(from->u8[LINKADDR_SIZE-1]);
 
     #define RAND_SCHED_NODE_ADDR_TIE_BREAKER 0
     #if RAND_SCHED_NODE_ADDR_TIE_BREAKER
@@ -260,7 +269,8 @@ static void discovery_recv(struct neighbor_discovery_conn *c,
         ) {
         
         sched_neighbor_discovery_set_listen_only();
-        
+
+        stats.conflicts++;
         remove_transmit_link(our_timeslot);
 
         /* tsch_set_send_beacons(0); */
@@ -279,6 +289,7 @@ static void discovery_recv(struct neighbor_discovery_conn *c,
         ctimer_set(&backoff_timer, node_state.current_backoff + random_offset, backoff_callback, NULL);
         ctimer_stop(&backoff_reset_timer);
     }
+#endif
 }
 
 void rand_set_timeslot_fixed(uint8_t enable) {
@@ -388,6 +399,7 @@ void rand_sched_init(uint8_t max_mtm_slots) {
     }
 
     mtm_set_round_slots(MTM_ROUND_START, MTM_ROUND_START + node_state.max_slots - 1);
+    mtm_set_slot_timing(sf_eb->size.val, RTIMERTICKS_TO_US(tsch_timing[tsch_ts_timeslot_length]));
 
     tsch_schedule_add_link(
         sf_eb,
@@ -413,6 +425,10 @@ void rand_sched_start() {
 #endif
    process_start(&rand_sched_process, NULL);
 
+  node_state.unsettled_since = clock_time();
+  node_state.unsettled_since_round = mtm_get_round_counter();
+
+#if RAND_SCHED_ALLOCATOR == RAND_SCHED_ALLOCATOR_LOTTERY
   // we start with an initial random delay
   node_state.backoff_active = 1;
   clock_time_t max_rand_jitter = node_state.current_backoff;
@@ -422,6 +438,7 @@ void rand_sched_start() {
 
   clock_time_t random_offset = (random_rand() % (uint16_t) max_rand_jitter);
   ctimer_set(&backoff_timer, node_state.current_backoff + random_offset, backoff_callback, NULL);
+#endif
 }
 
 void rand_sched_stop() {
@@ -441,77 +458,97 @@ void rand_sched_stop() {
 #endif
 }
 
-// returns a free timeslot, or 0 if no free timeslot exists.  Note that timeslot 0 is always our
-// shared timeslot, so it may never be associated for mtm usage
-static uint8_t choose_free_timeslot() {
-    clock_time_t now = clock_time();
-    // pick randomly free slot from occupied_slots
-    uint8_t occupied_slots[node_state.max_slots+MTM_ROUND_START];
-
-    /* memset(occupied_slots, 0, node_state.max_slots+MTM_ROUND_START); */
-    for (uint8_t i = 0; i < node_state.max_slots+MTM_ROUND_START; i++) {
-        occupied_slots[i] = 0;
+// bits of word w of an occupancy bitmap for the timeslots from begin to end (exclusive)
+static uint32_t slot_range_bits(uint8_t w, uint8_t begin, uint8_t end) {
+    uint32_t bits = 0xFFFFFFFF;
+    if(begin > w * 32) {
+        bits = begin >= (w + 1) * 32 ? 0 : bits << (begin - w * 32);
+    }
+    if(end < (w + 1) * 32) {
+        bits &= end <= w * 32 ? 0 : 0xFFFFFFFF >> ((w + 1) * 32 - end);
     }
+    return bits;
+}
 
-    // mark all timeslots below MTM_ROUND_START as occupied
-    for (uint8_t i = 0; i < MTM_ROUND_START; i++) {
-        occupied_slots[i] = 1;
+// end of the timeslots we may pick, slots beyond TSCH_MTM_OCCUPANCY_SLOTS are not tracked and never picked
+static uint8_t round_end_tracked() {
+    uint8_t end = node_state.max_slots + MTM_ROUND_START;
+    if(end > TSCH_MTM_OCCUPANCY_SLOTS) {
+        end = TSCH_MTM_OCCUPANCY_SLOTS;
     }
+    return end;
+}
 
-    /* // iterate over tsch_prop_get_neighbor_list(); */
+// returns free timeslot number pick % (number of free timeslots), or 0 if no free timeslot exists.
+// Note that timeslot 0 is always our shared timeslot, so it may never be associated for mtm usage
+static uint8_t choose_free_timeslot(uint16_t pick) {
+    uint32_t occupied[TSCH_MTM_OCCUPANCY_WORDS];
+    uint8_t end = round_end_tracked();
+
+#if RAND_SCHED_WITH_RANK
+    // only nodes that outrank us occupy a slot, this needs the neighbor list
+    clock_time_t now = clock_time();
+    memset(occupied, 0, sizeof(occupied));
     struct mtm_neighbor *n = NULL;
     for(n = list_head(tsch_prop_get_neighbor_list()); n != NULL; n = list_item_next(n)) {
-        if((now - n->last_observed_direct) < MAX_LAST_SEEN_INTERVAL || (now - n->last_observed_indirect) < MAX_LAST_SEEN_INTERVAL) {
-#if RAND_SCHED_WITH_RANK
-            if(node_state.rank > get_node_rank(n->neighbor_addr)) {
-                continue;
-            }
-#endif
-            occupied_slots[n->observed_timeslot] = 1;            
+        if(((now - n->last_observed_direct) < MAX_LAST_SEEN_INTERVAL || (now - n->last_observed_indirect) < MAX_LAST_SEEN_INTERVAL)
+            && node_state.rank <= get_node_rank(n->neighbor_addr) && n->observed_timeslot < end) {
+            occupied[n->observed_timeslot / 32] |= (uint32_t)1 << (n->observed_timeslot % 32);
         }
     }
-
-#if RAND_SCHED_WITH_RANK
 #if WITH_NEIGHBOR_TABLE_OCCUPANCY
     struct rand_neighbor_state *neighbor = NULL;
     for(neighbor = list_head(direct_neighbor_list); neighbor != NULL; neighbor = list_item_next(neighbor)) {
-        if (neighbor->rank >= node_state.rank && (now - neighbor->last_seen) < CLOCK_SECOND*4) {
-            occupied_slots[neighbor->timeslot] = 1;
+        if (neighbor->rank >= node_state.rank && (now - neighbor->last_seen) < CLOCK_SECOND*4 && neighbor->timeslot < end) {
+            occupied[neighbor->timeslot / 32] |= (uint32_t)1 << (neighbor->timeslot % 32);
         }
     }
 #endif
+#else
+    // kept up to date by the MTM engine, a slot is occupied for MAX_LAST_SEEN_INTERVAL
+    // (TSCH_MTM_OCCUPANCY_TIMEOUT) after a neighbor was last observed in it
+    tsch_prop_get_slot_occupancy(occupied);
+#if TSCH_MTM_SLOT_CLAIMS
+    // slots our neighbors receive or see collisions in are taken by nodes we may not hear
+    uint32_t claimed[TSCH_MTM_OCCUPANCY_WORDS], collided[TSCH_MTM_OCCUPANCY_WORDS];
+    tsch_prop_get_slot_claims(claimed, collided);
+    for (uint8_t w = 0; w < TSCH_MTM_OCCUPANCY_WORDS; w++) {
+        occupied[w] |= claimed[w] | collided[w];
+    }
 #endif
-    
+#endif
+
     // print occupancy map
     PRINTF("occupancy map: ");
-    for (uint8_t i = 0; i < node_state.max_slots+MTM_ROUND_START; i++) {
-        PRINTF("%d", occupied_slots[i]);
+    for (uint8_t i = 0; i < end; i++) {
+        PRINTF("%d", (int)((occupied[i / 32] >> (i % 32)) & 1));
     }
     PRINTF("\n");
-    
+
+    // all timeslots below MTM_ROUND_START and after the round count as occupied
     uint8_t free_slot_count = 0;
-    for (uint8_t i = 0; i < node_state.max_slots+MTM_ROUND_START; i++) {
-        if (occupied_slots[i] == 0) {
-            free_slot_count++;
-        }
+    for (uint8_t w = 0; w < TSCH_MTM_OCCUPANCY_WORDS; w++) {
+        occupied[w] |= ~slot_range_bits(w, MTM_ROUND_START, end);
+        free_slot_count += __builtin_popcount(~occupied[w]);
     }
 
     if(free_slot_count == 0) {
         return 0;
     }
 
-    // pick random number
-    uint8_t random_number = random_rand() % free_slot_count;
+    uint8_t random_number = pick % free_slot_count;
 
     // return slot number
-    uint8_t free_slot_number = 0;
-    for (uint8_t i = MTM_ROUND_START; i < node_state.max_slots+MTM_ROUND_START; i++) {
-        if (occupied_slots[i] == 0) {
-            if (free_slot_number == random_number) {
-                return i;
+    for (uint8_t w = 0; w < TSCH_MTM_OCCUPANCY_WORDS; w++) {
+        uint32_t free_bits = ~occupied[w];
+        uint8_t count = __builtin_popcount(free_bits);
+        if (random_number < count) {
+            for(; random_number > 0; random_number--) {
+                free_bits &= free_bits - 1;
             }
-            free_slot_number++;
+            return w * 32 + __builtin_ctz(free_bits);
         }
+        random_number -= count;
     }
 
     return 0;
@@ -544,7 +581,7 @@ static uint8_t check_have_timeslot() {
 
 static void handle_won_lottery() {
     // uniformly pick timeslot
-    uint8_t timeslot = choose_free_timeslot();
+    uint8_t timeslot = choose_free_timeslot(random_rand());
     if(timeslot) {
         PRINTF("Picked timeslot %d\n", timeslot);
         rand_sched_set_timeslot(timeslot);
@@ -577,6 +614,11 @@ uint8_t check_eligibility(clock_time_t now) {
 #if RAND_SCHED_RULES_WITH_PLANARITY_CHECK            
             node_count++;
             edge_count++; // TODO  compare with other version without
+#else
+            // without the planarity check the count is only compared with the minimum
+            if(num_active_neighbors >= RAND_SCHED_RULES_MIN_NEIGHBORS) {
+                break;
+            }
 #endif
             
         }
@@ -617,12 +659,24 @@ static void remove_transmit_link(uint8_t timeslot) {
     /* } */
     uint8_t success = tsch_schedule_remove_link_by_timeslot(sf_eb, timeslot);
     tsch_schedule_add_link(sf_eb, LINK_OPTION_RX, LINK_TYPE_PROP_MTM, &tsch_broadcast_address, timeslot, 0);
+
+    stats.releases++;
+    if(stats.settled) {
+        // we lost our slot, the search starts over
+        stats.settled = 0;
+        node_state.unsettled_since = clock_time();
+        node_state.unsettled_since_round = mtm_get_round_counter();
+    }
 }
 
 static void add_transmit_link(uint8_t timeslot) {
     struct tsch_slotframe *sf_eb = tsch_schedule_get_slotframe_by_handle(0);
     uint8_t success = tsch_schedule_remove_link_by_timeslot(sf_eb, timeslot);
     tsch_schedule_add_link(sf_eb, LINK_OPTION_TX, LINK_TYPE_PROP_MTM, &tsch_broadcast_address, timeslot, 0);
+
+    stats.claims++;
+    stats.settled = 0;
+    node_state.picked_timeslot_round = mtm_get_round_counter();
 }
 
 static void eval_print_rand_sched_status() {
@@ -631,6 +685,117 @@ static void eval_print_rand_sched_status() {
     printf("ts, %u\n", timeslot);
 }
 
+void rand_sched_get_stats(struct rand_sched_stats *s) {
+    uint32_t occupied[TSCH_MTM_OCCUPANCY_WORDS];
+    uint8_t our_timeslot = check_have_timeslot();
+    uint8_t end = round_end_tracked();
+
+    *s = stats;
+    tsch_prop_get_slot_occupancy(occupied);
+    if(our_timeslot < TSCH_MTM_OCCUPANCY_SLOTS) {
+        occupied[our_timeslot / 32] |= (uint32_t)1 << (our_timeslot % 32);
+    }
+    s->used_slots = 0;
+    for (uint8_t w = 0; w < TSCH_MTM_OCCUPANCY_WORDS; w++) {
+        s->used_slots += __builtin_popcount(occupied[w] & slot_range_bits(w, MTM_ROUND_START, end));
+    }
+    s->max_slots = node_state.max_slots;
+}
+
+// called once per round, the slot is settled once we held it for RAND_SCHED_SETTLE_ROUNDS rounds
+static void update_convergence() {
+    struct rand_sched_stats s;
+    uint8_t our_timeslot = check_have_timeslot();
+
+    if(stats.settled || !our_timeslot
+        || mtm_get_round_counter() - node_state.picked_timeslot_round < RAND_SCHED_SETTLE_ROUNDS) {
+        return;
+    }
+
+    stats.settled = 1;
+    stats.convergence_time = node_state.picked_timeslot_at - node_state.unsettled_since;
+    stats.convergence_rounds = node_state.picked_timeslot_round - node_state.unsettled_since_round;
+
+    rand_sched_get_stats(&s);
+    printf("rss, %u, %lu, %lu, %u, %u, %u, %u\n", our_timeslot,
+        (unsigned long)(s.convergence_time * 1000 / CLOCK_SECOND), (unsigned long)s.convergence_rounds,
+        s.used_slots, s.max_slots, s.claims, s.releases);
+}
+
+#if RAND_SCHED_ALLOCATOR == RAND_SCHED_ALLOCATOR_CLAIM
+#if !WITH_MTM_SLOT_END_PROCESS
+#error "RAND_SCHED_ALLOCATOR_CLAIM requires WITH_MTM_SLOT_END_PROCESS"
+#endif
+
+// a contested slot stays with the higher rank, on equal ranks with the lower address
+static uint8_t claim_outranked_by(ranging_addr_t other) {
+    uint8_t other_rank = get_node_rank(other);
+    return other_rank > node_state.rank
+        || (other_rank == node_state.rank && other < linkaddr_node_addr.u8[LINKADDR_SIZE-1]);
+}
+
+static uint8_t claim_collided(uint8_t timeslot) {
+#if TSCH_MTM_SLOT_CLAIMS
+    uint32_t claimed[TSCH_MTM_OCCUPANCY_WORDS], collided[TSCH_MTM_OCCUPANCY_WORDS];
+    tsch_prop_get_slot_claims(claimed, collided);
+    return timeslot < TSCH_MTM_OCCUPANCY_SLOTS && ((collided[timeslot / 32] >> (timeslot % 32)) & 1);
+#else
+    return 0;
+#endif
+}
+
+static void claim_round_end(clock_time_t now) {
+    uint8_t our_timeslot = check_have_timeslot();
+    uint8_t our_addr = linkaddr_node_addr.u8[LINKADDR_SIZE-1];
+    uint32_t round = mtm_get_round_counter();
+
+    if(our_timeslot) {
+        ranging_addr_t owner = tsch_prop_get_slot_owner(our_timeslot);
+
+        if(node_state.node_is_fixed) {
+            return;
+        }
+        // We never hear a node sending in our own slot, it shows up through the timestamps
+        // of our neighbors. Hidden nodes only show up as collisions, then the node that
+        // claimed last gives up the slot.
+        if(owner != 0 && claim_outranked_by(owner)) {
+            stats.conflicts++;
+        } else if(round - node_state.picked_timeslot_round < RAND_SCHED_SETTLE_ROUNDS && claim_collided(our_timeslot)) {
+            stats.collisions++;
+        } else {
+            return;
+        }
+        PRINTF("releasing timeslot %u, owner %u\n", our_timeslot, owner);
+        remove_transmit_link(our_timeslot);
+        sched_neighbor_discovery_set_listen_only();
+        node_state.listen_rounds = 0;
+        node_state.claim_attempts++;
+        return;
+    }
+
+    if(node_state.node_is_mobile || !check_eligibility(now)) {
+        return;
+    }
+    // the occupancy needs a few rounds to fill after joining or releasing a slot
+    if(node_state.listen_rounds < RAND_SCHED_CLAIM_LISTEN_ROUNDS) {
+        node_state.listen_rounds++;
+        return;
+    }
+    if(round % RAND_SCHED_CLAIM_TURNS != our_addr % RAND_SCHED_CLAIM_TURNS) {
+        return;
+    }
+
+    // The first claim spreads the nodes by address. Two nodes of the same turn whose
+    // addresses are congruent modulo the number of free slots pick the same one though,
+    // and would keep doing so, hence retries after a release pick at random.
+    uint8_t timeslot = choose_free_timeslot(node_state.claim_attempts == 0 ? our_addr : random_rand());
+    if(timeslot) {
+        PRINTF("claiming timeslot %u\n", timeslot);
+        rand_sched_set_timeslot(timeslot);
+    }
+}
+#endif
+
 void rand_sched_set_join_prob(uint16_t denominator) {
     node_state.join_prob = denominator;
 }
@@ -669,7 +834,10 @@ PROCESS_THREAD(TSCH_MTM_SLOT_END_PROCESS, ev, data)
           if (*slot_type == MTM_ROUND_END) {
               // play the lottery
               if(tsch_is_associated) {
-                  clock_time_t now = clock_time();              
+                  clock_time_t now = clock_time();
+#if RAND_SCHED_ALLOCATOR == RAND_SCHED_ALLOCATOR_CLAIM
+                  claim_round_end(now);
+#else
                   uint8_t our_timeslot = check_have_timeslot();
 
 
@@ -698,6 +866,8 @@ PROCESS_THREAD(TSCH_MTM_SLOT_END_PROCESS, ev, data)
                       clock_time_t random_offset = (random_rand() % (uint16_t) max_rand_jitter);
                       ctimer_set(&backoff_timer, node_state.current_backoff + random_offset, backoff_callback, NULL);
                   }
+#endif
+                  update_convergence();
                   eval_print_rand_sched_status();
               }
           }
@@ -748,6 +918,7 @@ PROCESS_THREAD(rand_sched_process, ev, data)
               /* else if (our_timeslot) { */
               /*     maybe_reroll_timeslot(); */
               /* } */
+              update_convergence();
           }
           
           etimer_reset(&rand_schedule_phase_timer);                          
@@ -42,6 +42,51 @@
 #include "net/mac/tsch/tsch-conf.h"
 #include "net/mac/tsch/tsch-schedule.h"
 
+// How a node picks its MTM transmit slot.
+// LOTTERY: a random free slot, on conflicts the node backs off for a random, growing time.
+// CLAIM: after listening for RAND_SCHED_CLAIM_LISTEN_ROUNDS rounds, the node claims in its
+// turn (every RAND_SCHED_CLAIM_TURNS rounds, staggered by address) a free slot picked
+// deterministically from its address. A node in the same slot with a higher rank, or the
+// same rank and a lower address, keeps the slot. Collisions reported in the slot make the
+// node give it up again within the first RAND_SCHED_SETTLE_ROUNDS rounds. Needs
+// WITH_MTM_SLOT_END_PROCESS and uses the slot claims of TSCH_MTM_SLOT_CLAIMS if enabled.
+#define RAND_SCHED_ALLOCATOR_LOTTERY 0
+#define RAND_SCHED_ALLOCATOR_CLAIM 1
+#ifdef RAND_SCHED_CONF_ALLOCATOR
+#define RAND_SCHED_ALLOCATOR RAND_SCHED_CONF_ALLOCATOR
+#else
+#define RAND_SCHED_ALLOCATOR RAND_SCHED_ALLOCATOR_LOTTERY
+#endif
+#ifdef RAND_SCHED_CONF_CLAIM_LISTEN_ROUNDS
+#define RAND_SCHED_CLAIM_LISTEN_ROUNDS RAND_SCHED_CONF_CLAIM_LISTEN_ROUNDS
+#else
+#define RAND_SCHED_CLAIM_LISTEN_ROUNDS 4
+#endif
+#ifdef RAND_SCHED_CONF_CLAIM_TURNS
+#define RAND_SCHED_CLAIM_TURNS RAND_SCHED_CONF_CLAIM_TURNS
+#else
+#define RAND_SCHED_CLAIM_TURNS 4
+#endif
+// a slot held this many rounds counts as settled, for both allocators
+#ifdef RAND_SCHED_CONF_SETTLE_ROUNDS
+#define RAND_SCHED_SETTLE_ROUNDS RAND_SCHED_CONF_SETTLE_ROUNDS
+#else
+#define RAND_SCHED_SETTLE_ROUNDS 8
+#endif
+
+// Convergence of a node: the time from the start, or from losing its slot, until it took
+// the slot it then kept for RAND_SCHED_SETTLE_ROUNDS rounds
+struct rand_sched_stats {
+    uint16_t claims;              // transmit slots taken
+    uint16_t releases;            // transmit slots given up
+    uint16_t conflicts;           // releases because another node sends in the slot
+    uint16_t collisions;          // releases because of collisions reported in the slot
+    uint8_t settled;              // the current slot is settled
+    clock_time_t convergence_time;
+    uint32_t convergence_rounds;
+    uint8_t used_slots, max_slots; // slots of the round in use around us, including ours
+};
+
 enum mtm_node_role {
     MTM_PASSIVE,
     MTM_ACTIVE,
@@ -56,6 +101,7 @@ void rand_sched_set_join_prob(uint16_t denominator);
 void rand_sched_set_rank(uint8_t rank);
 void rand_sched_start();
 void rand_sched_stop();
+void rand_sched_get_stats(struct rand_sched_stats *stats);
 
 // If timeslot is set fixed, a node with never backoff from its choice.
 // This is used for nodes that should act as anchors
@@ -189,6 +189,22 @@ enum {
    * */
   RADIO_LOC_TX_DELAYED_US_MTM,
 
+  /*
+   * Set a delayed transmission based on the previous delayed transmission,
+   * used for the following frames of a MTM burst.
+   * The delay is set in micro second.
+   * */
+  RADIO_LOC_TX_DELAYED_US_MTM_BURST,
+
+  /*
+   * Set a one-shot header filter for the next radio.read(). The radio reads
+   * the first bytes of the frame into the read buffer and passes them to the
+   * filter. The rest of the frame is only read when the filter accepts it,
+   * otherwise read() drops the frame and returns 0.
+   * The value is a radio_rx_header_filter_t, NULL removes the filter.
+   * */
+  RADIO_LOC_RX_HEADER_FILTER,
+
   /*
    * Set a delayed reception based on the previews transmission.
    * The delay is set in micro second.
@@ -310,6 +326,12 @@ typedef enum {
   RADIO_RESULT_ERROR
 } radio_result_t;
 
+/* Header filter of RADIO_LOC_RX_HEADER_FILTER. Gets the first header_len
+ * bytes of a frame of frame_len bytes, returns non-zero to keep the frame. */
+typedef int (* radio_rx_header_filter_t)(const void *header,
+                                         unsigned short header_len,
+                                         unsigned short frame_len);
+
 /* Radio return values for transmissions. */
 enum {
   RADIO_TX_OK,
@@ -208,55 +208,50 @@ create(void)
   return create_frame(FRAME802154_DATAFRAME, 1);
 }
 /*---------------------------------------------------------------------------*/
-static int
-parse(void)
+int
+framer_802154_parse_frame(const frame802154_t *frame, int hdr_len)
 {
-  frame802154_t frame;
-  int hdr_len;
-
-  hdr_len = frame802154_parse(packetbuf_dataptr(), packetbuf_datalen(), &frame);
-
   if(hdr_len && packetbuf_hdrreduce(hdr_len)) {
-    packetbuf_set_attr(PACKETBUF_ATTR_FRAME_TYPE, frame.fcf.frame_type);
+    packetbuf_set_attr(PACKETBUF_ATTR_FRAME_TYPE, frame->fcf.frame_type);
 
-    if(frame.fcf.dest_addr_mode) {
-      if(frame.dest_pid != frame802154_get_pan_id() &&
-         frame.dest_pid != FRAME802154_BROADCASTPANDID) {
+    if(frame->fcf.dest_addr_mode) {
+      if(frame->dest_pid != frame802154_get_pan_id() &&
+         frame->dest_pid != FRAME802154_BROADCASTPANDID) {
         /* Packet to another PAN */
-        PRINTF("15.4: for another pan %u\n", frame.dest_pid);
+        PRINTF("15.4: for another pan %u\n", frame->dest_pid);
         return FRAMER_FAILED;
       }
-      if(!frame802154_is_broadcast_addr(frame.fcf.dest_addr_mode, frame.dest_addr)) {
-        packetbuf_set_addr(PACKETBUF_ADDR_RECEIVER, (linkaddr_t *)&frame.dest_addr);
+      if(!frame802154_is_broadcast_addr(frame->fcf.dest_addr_mode, (uint8_t *)frame->dest_addr)) {
+        packetbuf_set_addr(PACKETBUF_ADDR_RECEIVER, (const linkaddr_t *)&frame->dest_addr);
       }
     }
-    packetbuf_set_addr(PACKETBUF_ADDR_SENDER, (linkaddr_t *)&frame.src_addr);
-    packetbuf_set_attr(PACKETBUF_ATTR_PENDING, frame.fcf.frame_pending);
-    if(frame.fcf.sequence_number_suppression == 0) {
-      packetbuf_set_attr(PACKETBUF_ATTR_MAC_SEQNO, frame.seq);
+    packetbuf_set_addr(PACKETBUF_ADDR_SENDER, (const linkaddr_t *)&frame->src_addr);
+    packetbuf_set_attr(PACKETBUF_ATTR_PENDING, frame->fcf.frame_pending);
+    if(frame->fcf.sequence_number_suppression == 0) {
+      packetbuf_set_attr(PACKETBUF_ATTR_MAC_SEQNO, frame->seq);
     } else {
       packetbuf_set_attr(PACKETBUF_ATTR_MAC_SEQNO, 0xffff);
     }
 #if NETSTACK_CONF_WITH_RIME
-    packetbuf_set_attr(PACKETBUF_ATTR_PACKET_ID, frame.seq);
+    packetbuf_set_attr(PACKETBUF_ATTR_PACKET_ID, frame->seq);
 #endif
 
 #if LLSEC802154_USES_AUX_HEADER
-    if(frame.fcf.security_enabled) {
-      packetbuf_set_attr(PACKETBUF_ATTR_SECURITY_LEVEL, frame.aux_hdr.security_control.security_level);
+    if(frame->fcf.security_enabled) {
+      packetbuf_set_attr(PACKETBUF_ATTR_SECURITY_LEVEL, frame->aux_hdr.security_control.security_level);
 #if LLSEC802154_USES_FRAME_COUNTER
-      packetbuf_set_attr(PACKETBUF_ATTR_FRAME_COUNTER_BYTES_0_1, frame.aux_hdr.frame_counter.u16[0]);
-      packetbuf_set_attr(PACKETBUF_ATTR_FRAME_COUNTER_BYTES_2_3, frame.aux_hdr.frame_counter.u16[1]);
+      packetbuf_set_attr(PACKETBUF_ATTR_FRAME_COUNTER_BYTES_0_1, frame->aux_hdr.frame_counter.u16[0]);
+      packetbuf_set_attr(PACKETBUF_ATTR_FRAME_COUNTER_BYTES_2_3, frame->aux_hdr.frame_counter.u16[1]);
 #endif /* LLSEC802154_USES_FRAME_COUNTER */
 #if LLSEC802154_USES_EXPLICIT_KEYS
-      packetbuf_set_attr(PACKETBUF_ATTR_KEY_ID_MODE, frame.aux_hdr.security_control.key_id_mode);
-      packetbuf_set_attr(PACKETBUF_ATTR_KEY_INDEX, frame.aux_hdr.key_index);
-      packetbuf_set_attr(PACKETBUF_ATTR_KEY_SOURCE_BYTES_0_1, frame.aux_hdr.key_source.u16[0]);
+      packetbuf_set_attr(PACKETBUF_ATTR_KEY_ID_MODE, frame->aux_hdr.security_control.key_id_mode);
+      packetbuf_set_attr(PACKETBUF_ATTR_KEY_INDEX, frame->aux_hdr.key_index);
+      packetbuf_set_attr(PACKETBUF_ATTR_KEY_SOURCE_BYTES_0_1, frame->aux_hdr.key_source.u16[0]);
 #endif /* LLSEC802154_USES_EXPLICIT_KEYS */
     }
 #endif /* LLSEC802154_USES_AUX_HEADER */
 
-    PRINTF("15.4-IN: %2X", frame.fcf.frame_type);
+    PRINTF("15.4-IN: %2X", frame->fcf.frame_type);
     PRINTADDR(packetbuf_addr(PACKETBUF_ADDR_SENDER));
     PRINTADDR(packetbuf_addr(PACKETBUF_ADDR_RECEIVER));
     PRINTF("%d %u (%u)\n", hdr_len, packetbuf_datalen(), packetbuf_totlen());
@@ -266,6 +261,17 @@ parse(void)
   return FRAMER_FAILED;
 }
 /*---------------------------------------------------------------------------*/
+static int
+parse(void)
+{
+  frame802154_t frame;
+  int hdr_len;
+
+  hdr_len = frame802154_parse(packetbuf_dataptr(), packetbuf_datalen(), &frame);
+
+  return framer_802154_parse_frame(&frame, hdr_len);
+}
+/*---------------------------------------------------------------------------*/
 const struct framer framer_802154 = {
   hdr_length,
   create,
@@ -40,7 +40,12 @@
 #define FRAMER_802154_H_
 
 #include "net/mac/framer.h"
+#include "net/mac/frame802154.h"
 
 extern const struct framer framer_802154;
 
+/* Same as framer_802154.parse, for a packetbuf whose header was already
+ * parsed into frame (hdr_len bytes long) by the MAC layer */
+int framer_802154_parse_frame(const frame802154_t *frame, int hdr_len);
+
 #endif /* FRAMER_802154_H_ */
@@ -38,6 +38,9 @@
  *
  */
 
+/* Source file of the message logs in binary trace mode (tsch-log.h) */
+#define TSCH_LOG_FILE_ID TSCH_LOG_FILE_ID_ADAPTIVE_TIMESYNC
+
 #include "net/mac/tsch/tsch.h"
 #include "net/mac/tsch/tsch-conf.h"
 #include "net/mac/tsch/tsch-queue.h"
@@ -59,57 +62,89 @@
 static int32_t drift_ppm;
 /* Ticks compensated locally since the last timesync time */
 static int32_t compensated_ticks;
-/* Number of already recorded timesync history entries */
-static uint8_t timesync_entry_count;
 /* Since last learning of the  drift; may be more than time since last timesync */
 static uint32_t asn_since_last_learning;
 
-/* Units in which drift is stored: ppm * 256 */
-#define TSCH_DRIFT_UNIT (1000L * 1000 * 256)
-
 /*---------------------------------------------------------------------------*/
-/* Add a value to a moving average estimator */
-static int32_t
-timesync_entry_add(int32_t val, uint32_t time_delta)
+/* Add a drift measurement to the neighbor history and fit the drift rate.
+ * Each entry is the drift (in ticks) seen over an interval (in ASN), the
+ * drift rate is the weighted least-squares slope through the origin:
+ * sum(w * interval * drift) / sum(w * interval^2). Longer intervals weigh
+ * more as their relative measurement error is smaller, and recent entries
+ * weigh more (w grows from 1 for the oldest to count for the newest) so
+ * that the estimate follows temperature changes. */
+static void
+timesync_drift_add(struct tsch_timesync_drift *d, uint32_t time_delta_asn, int32_t drift_ticks)
 {
-#define NUM_TIMESYNC_ENTRIES 8
-  static int32_t buffer[NUM_TIMESYNC_ENTRIES];
-  static uint8_t pos;
-  int i;
-  if(timesync_entry_count == 0) {
-    pos = 0;
+  int64_t num = 0;
+  int64_t den = 0;
+  uint16_t max_error = 0;
+  int32_t max_error_ppm = 0;
+  uint8_t i;
+  uint8_t idx;
+
+  d->drift_ticks[d->pos] = drift_ticks;
+  d->interval_asn[d->pos] = time_delta_asn;
+  d->pos = (d->pos + 1) % TSCH_ADAPTIVE_TIMESYNC_HISTORY;
+  if(d->count < TSCH_ADAPTIVE_TIMESYNC_HISTORY) {
+    d->count++;
   }
-  buffer[pos] = val;
-  if(timesync_entry_count < NUM_TIMESYNC_ENTRIES) {
-    timesync_entry_count++;
-  } else {
-    /* We now have accurate drift compensation.
-     * Increase keep-alive timeout. */
-    tsch_set_ka_timeout(TSCH_MAX_KEEPALIVE_TIMEOUT);
+
+  /* Oldest entry first */
+  idx = (d->pos + TSCH_ADAPTIVE_TIMESYNC_HISTORY - d->count) % TSCH_ADAPTIVE_TIMESYNC_HISTORY;
+  for(i = 1; i <= d->count; i++) {
+    num += (int64_t)i * d->interval_asn[idx] * d->drift_ticks[idx];
+    den += (int64_t)i * d->interval_asn[idx] * d->interval_asn[idx];
+    idx = (idx + 1) % TSCH_ADAPTIVE_TIMESYNC_HISTORY;
+  }
+  if(den == 0) {
+    return;
+  }
+
+  /* Ticks per ASN to ppm * 256, keeping the product within 64 bits */
+  while(ABS(num) >= INT64_MAX / TSCH_DRIFT_UNIT) {
+    num /= 2;
+    den /= 2;
   }
-  pos = (pos + 1) % NUM_TIMESYNC_ENTRIES;
+  d->drift_ppm = (int32_t)(num * TSCH_DRIFT_UNIT / (den * tsch_timing[tsch_ts_timeslot_length]));
 
-  val = 0;
-  for(i = 0; i < timesync_entry_count; ++i) {
-    val += buffer[i];
+  /* Residuals of the estimate, used to bound the prediction error */
+  for(i = 0; i < d->count; i++) {
+    int64_t predicted = (int64_t)d->drift_ppm * d->interval_asn[i]
+      * tsch_timing[tsch_ts_timeslot_length] / TSCH_DRIFT_UNIT;
+    int32_t error = ABS(d->drift_ticks[i] - (int32_t)predicted);
+    int64_t error_ppm = (int64_t)error * TSCH_DRIFT_UNIT
+      / ((int64_t)d->interval_asn[i] * tsch_timing[tsch_ts_timeslot_length]);
+    if(error > max_error) {
+      max_error = MIN(error, 0xffff);
+    }
+    if(error_ppm > max_error_ppm) {
+      max_error_ppm = MIN(error_ppm, INT32_MAX);
+    }
   }
-  return val / timesync_entry_count;
+  d->error_ticks = max_error;
+  d->error_ppm = max_error_ppm;
 }
 /*---------------------------------------------------------------------------*/
 /* Learn the neighbor drift rate at ppm */
 static void
-timesync_learn_drift_ticks(uint32_t time_delta_asn, int32_t drift_ticks)
+timesync_learn_drift_ticks(struct tsch_neighbor *n, uint32_t time_delta_asn, int32_t drift_ticks)
 {
-  /* should fit in a 32-bit integer */
-  int32_t time_delta_ticks = time_delta_asn * tsch_timing[tsch_ts_timeslot_length];
   int32_t real_drift_ticks = drift_ticks + compensated_ticks;
-  int32_t last_drift_ppm = (int32_t)((int64_t)real_drift_ticks * TSCH_DRIFT_UNIT / time_delta_ticks);
 
-  drift_ppm = timesync_entry_add(last_drift_ppm, time_delta_ticks);
+  timesync_drift_add(&n->timesync_drift, time_delta_asn, real_drift_ticks);
+  drift_ppm = n->timesync_drift.drift_ppm;
 
-  TSCH_LOG_ADD(tsch_log_message,
+  if(n->timesync_drift.count >= TSCH_ADAPTIVE_TIMESYNC_HISTORY) {
+    /* We now have accurate drift compensation.
+     * Increase keep-alive timeout. */
+    tsch_set_ka_timeout(TSCH_MAX_KEEPALIVE_TIMEOUT);
+  }
+
+  TSCH_LOG_ADD_ARGS(tsch_log_message,
       snprintf(log->message, sizeof(log->message),
-          "drift %ld", drift_ppm / 256));
+          "drift %ld err %u", drift_ppm / 256, n->timesync_drift.error_ticks),
+      drift_ppm / 256, n->timesync_drift.error_ticks, 0);
 }
 /*---------------------------------------------------------------------------*/
 /* Either reset or update the neighbor's drift */
@@ -122,14 +157,19 @@ tsch_timesync_update(struct tsch_neighbor *n, uint16_t time_delta_asn, int32_t d
   if(last_timesource_neighbor != n) {
     last_timesource_neighbor = n;
     /* printf("tsu, %u\n", last_timesource_neighbor->addr.u8[LINKADDR_SIZE-1]);     */
-    drift_ppm = 0;
-    timesync_entry_count = 0;
+    /* This correction was measured against the previous time source and is
+     * not used, but the drift learnt from n the last time it was our time
+     * source is kept and compensated for right away. */
+    drift_ppm = n->timesync_drift.drift_ppm;
     compensated_ticks = 0;
     asn_since_last_learning = 0;
+    if(n->timesync_drift.count >= TSCH_ADAPTIVE_TIMESYNC_HISTORY) {
+      tsch_set_ka_timeout(TSCH_MAX_KEEPALIVE_TIMEOUT);
+    }
   } else {
     asn_since_last_learning += time_delta_asn;
     if(asn_since_last_learning >= 4 * TSCH_SLOTS_PER_SECOND) {
-      timesync_learn_drift_ticks(asn_since_last_learning, drift_correction);
+      timesync_learn_drift_ticks(n, asn_since_last_learning, drift_correction);
       compensated_ticks = 0;
       asn_since_last_learning = 0;
     } else {
@@ -139,6 +179,22 @@ tsch_timesync_update(struct tsch_neighbor *n, uint16_t time_delta_asn, int32_t d
   }
 }
 /*---------------------------------------------------------------------------*/
+/* Get the drift estimated for a neighbor */
+int
+tsch_timesync_get_drift(const struct tsch_neighbor *n, int32_t *drift, int32_t *error_ppm)
+{
+  if(n == NULL || n->timesync_drift.count == 0) {
+    return 0;
+  }
+  if(drift != NULL) {
+    *drift = n->timesync_drift.drift_ppm;
+  }
+  if(error_ppm != NULL) {
+    *error_ppm = n->timesync_drift.error_ppm;
+  }
+  return n->timesync_drift.count;
+}
+/*---------------------------------------------------------------------------*/
 /* Error-accumulation free compensation algorithm */
 static int32_t
 compensate_internal(uint32_t time_delta_usec, int32_t drift_ppm, int32_t *remainder, int16_t *tick_conversion_error)
@@ -154,9 +210,10 @@ compensate_internal(uint32_t time_delta_usec, int32_t drift_ppm, int32_t *remain
   *tick_conversion_error = amount - RTIMERTICKS_TO_US(amount_ticks);
 
   if(ABS(amount_ticks) > RTIMER_ARCH_SECOND / 128) {
-    TSCH_LOG_ADD(tsch_log_message,
+    TSCH_LOG_ADD_ARGS(tsch_log_message,
         snprintf(log->message, sizeof(log->message),
-            "!too big compensation %ld delta %ld", amount_ticks, time_delta_usec));
+            "!too big compensation %ld delta %ld", amount_ticks, time_delta_usec),
+        amount_ticks, time_delta_usec, 0);
     amount_ticks = (amount_ticks > 0 ? RTIMER_ARCH_SECOND : -RTIMER_ARCH_SECOND) / 128;
   }
 
@@ -196,6 +253,12 @@ tsch_timesync_update(struct tsch_neighbor *n, uint16_t time_delta_asn, int32_t d
 {
 }
 /*---------------------------------------------------------------------------*/
+int
+tsch_timesync_get_drift(const struct tsch_neighbor *n, int32_t *drift, int32_t *error_ppm)
+{
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
 int32_t
 tsch_timesync_adaptive_compensate(rtimer_clock_t delta_ticks)
 {
@@ -72,6 +72,9 @@
 #define TSCH_BASE_DRIFT_PPM 0
 #endif
 
+/* Units in which drift is stored: ppm * 256 */
+#define TSCH_DRIFT_UNIT (1000L * 1000 * 256)
+
 /* The approximate number of slots per second */
 #define TSCH_SLOTS_PER_SECOND (1000000 / TSCH_DEFAULT_TS_TIMESLOT_LENGTH)
 
@@ -86,4 +89,10 @@ void tsch_timesync_update(struct tsch_neighbor *n, uint16_t time_delta_asn, int3
 
 int32_t tsch_timesync_adaptive_compensate(rtimer_clock_t delta_ticks);
 
+/* Get the drift estimated for a time source neighbor and the largest
+ * error rate of the estimate over the measurements it is based on, both
+ * in ppm multiplied by 256. Returns the number of measurements, 0 if
+ * there is no estimate for this neighbor. */
+int tsch_timesync_get_drift(const struct tsch_neighbor *n, int32_t *drift, int32_t *error_ppm);
+
 #endif /* __TSCH_ADAPTIVE_TIMESYNC_H__ */
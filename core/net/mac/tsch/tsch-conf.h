@@ -326,6 +326,35 @@
 #define TSCH_ADAPTIVE_TIMESYNC 1
 #endif
 
+/* Number of drift measurements kept per time source neighbor
+ * for the adaptive timesync regression */
+#ifdef TSCH_CONF_ADAPTIVE_TIMESYNC_HISTORY
+#define TSCH_ADAPTIVE_TIMESYNC_HISTORY TSCH_CONF_ADAPTIVE_TIMESYNC_HISTORY
+#else
+#define TSCH_ADAPTIVE_TIMESYNC_HISTORY 8
+#endif
+
+/* Listen in RX and MTM RX slots only as long as the worst-case drift since
+ * the last sync requires, instead of the whole rx_wait window. Requires the
+ * adaptive timesync drift estimate of the time source. */
+#ifdef TSCH_CONF_DYNAMIC_GUARD_TIME
+#define TSCH_DYNAMIC_GUARD_TIME TSCH_CONF_DYNAMIC_GUARD_TIME
+#else
+#define TSCH_DYNAMIC_GUARD_TIME 0
+#endif
+
+#if TSCH_DYNAMIC_GUARD_TIME && !TSCH_ADAPTIVE_TIMESYNC
+#error "TSCH_DYNAMIC_GUARD_TIME requires TSCH_ADAPTIVE_TIMESYNC"
+#endif
+
+/* Guard time (us) always added on each side of the expected TX time,
+ * to cover the radio start and the detection of the preamble */
+#ifdef TSCH_CONF_DYNAMIC_GUARD_MIN_US
+#define TSCH_DYNAMIC_GUARD_MIN_US TSCH_CONF_DYNAMIC_GUARD_MIN_US
+#else
+#define TSCH_DYNAMIC_GUARD_MIN_US 50
+#endif
+
 /* HW frame filtering enabled */
 #ifdef TSCH_CONF_HW_FRAME_FILTERING
 #define TSCH_HW_FRAME_FILTERING TSCH_CONF_HW_FRAME_FILTERING
@@ -410,4 +439,27 @@
 #define TSCH_CHORUS_REPLY_TIME 1000
 #endif
 
+/* Output the whole accumulator (4 KB) after a Chorus reception instead of
+ * the peaks found in it. Writing it out takes hundreds of ms. */
+#ifdef TSCH_CONF_CHORUS_RAW_CIR
+#define TSCH_CHORUS_RAW_CIR TSCH_CONF_CHORUS_RAW_CIR
+#else
+#define TSCH_CHORUS_RAW_CIR 0
+#endif
+
+/* Number of CIR peaks to output, one per anchor */
+#ifdef TSCH_CONF_CHORUS_CIR_PEAKS
+#define TSCH_CHORUS_CIR_PEAKS TSCH_CONF_CHORUS_CIR_PEAKS
+#else
+#define TSCH_CHORUS_CIR_PEAKS 4
+#endif
+
+/* Samples of the CIR searched behind the first path. A sample is about 1 ns,
+ * by default the window covers the TX offsets of all anchors. */
+#ifdef TSCH_CONF_CHORUS_CIR_WINDOW
+#define TSCH_CHORUS_CIR_WINDOW TSCH_CONF_CHORUS_CIR_WINDOW
+#else
+#define TSCH_CHORUS_CIR_WINDOW (TSCH_CHORUS_CIR_PEAKS * TSCH_CHORUS_TX_OFFSET + 16)
+#endif
+
 #endif /* __TSCH_CONF_H__ */
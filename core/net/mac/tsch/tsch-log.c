@@ -50,6 +50,13 @@
 #include "net/mac/tsch/tsch-schedule.h"
 #include "net/mac/tsch/tsch-slot-operation.h"
 #include "lib/ringbufindex.h"
+#if TSCH_LOG_BINARY
+#include "net/mac/tsch/tsch-prop-export.h"
+#include <string.h>
+#if TSCH_LOG_LEVEL >= 2 && !TSCH_PROP_EXPORT
+#error TSCH_LOG_BINARY writes through the measurement export, set TSCH_PROP_CONF_EXPORT
+#endif
+#endif /* TSCH_LOG_BINARY */
 
 #if TSCH_LOG_LEVEL >= 1
 #define DEBUG DEBUG_PRINT
@@ -70,6 +77,86 @@ static struct ringbufindex log_ringbuf;
 static struct tsch_log_t log_array[TSCH_LOG_QUEUE_LEN];
 static int log_dropped = 0;
 
+#if TSCH_LOG_BINARY
+/*---------------------------------------------------------------------------*/
+static void
+put_le16(uint8_t *p, uint16_t v)
+{
+  p[0] = v;
+  p[1] = v >> 8;
+}
+/*---------------------------------------------------------------------------*/
+/* Serializes a log into a binary record and queues it for export */
+static void
+binary_log_output(const struct tsch_log_t *log)
+{
+  uint8_t payload[TSCH_PROP_EXPORT_TSCH_LOG_LEN];
+  uint8_t *args = &payload[10];
+  int i;
+
+  memset(payload, 0, sizeof(payload));
+  put_le16(&payload[0], log->asn.ls4b);
+  put_le16(&payload[2], log->asn.ls4b >> 16);
+  payload[4] = log->asn.ms1b;
+  if(log->link == NULL) {
+    payload[5] = 0xff;
+  } else {
+    payload[5] = log->link->slotframe_handle;
+    put_le16(&payload[6], log->link->timeslot);
+    payload[8] = log->link->channel_offset;
+  }
+  payload[9] = log->type;
+
+  switch(log->type) {
+    case tsch_log_tx:
+      args[0] = log->tx.dest;
+      args[1] = log->tx.mac_tx_status;
+      args[2] = log->tx.num_tx;
+      args[3] = log->tx.datalen;
+      args[4] = log->tx.is_data | (log->tx.drift_used << 1) | (log->tx.sec_level << 2);
+      put_le16(&args[5], log->tx.drift);
+      break;
+    case tsch_log_rx:
+      args[0] = log->rx.src;
+      args[1] = log->rx.datalen;
+      args[2] = log->rx.is_data | (log->rx.drift_used << 1)
+        | (log->rx.is_unicast << 2) | (log->rx.sec_level << 3);
+      put_le16(&args[3], log->rx.drift);
+      put_le16(&args[5], log->rx.estimated_drift);
+      break;
+    case tsch_log_message:
+      args[0] = log->message_id.file;
+      put_le16(&args[1], log->message_id.line);
+      for(i = 0; i < TSCH_LOG_MESSAGE_ARGS; i++) {
+        put_le16(&args[3 + 4 * i], log->message_id.args[i]);
+        put_le16(&args[5 + 4 * i], (uint32_t)log->message_id.args[i] >> 16);
+      }
+      memcpy(&payload[25], log->message_id.tag, TSCH_LOG_MESSAGE_TAG_LEN);
+      break;
+  }
+
+  tsch_prop_export_record(TSCH_PROP_EXPORT_TYPE_TSCH_LOG, payload, sizeof(payload));
+}
+/*---------------------------------------------------------------------------*/
+/* Queue all pending logs as binary records. This runs in
+ * tsch_pending_events_process, the only context the export queue is
+ * written from */
+void
+tsch_log_process_pending(void)
+{
+  static int last_log_dropped = 0;
+  int16_t log_index;
+  /* Dropped logs are not written, the host sees the sequence number gap */
+  if(log_dropped != last_log_dropped) {
+    tsch_prop_export_lost(log_dropped - last_log_dropped);
+    last_log_dropped = log_dropped;
+  }
+  while((log_index = ringbufindex_peek_get(&log_ringbuf)) != -1) {
+    binary_log_output(&log_array[log_index]);
+    ringbufindex_get(&log_ringbuf);
+  }
+}
+#else /* TSCH_LOG_BINARY */
 /*---------------------------------------------------------------------------*/
 /* Process pending log messages */
 void
@@ -123,6 +210,7 @@ tsch_log_process_pending(void)
     ringbufindex_get(&log_ringbuf);
   }
 }
+#endif /* TSCH_LOG_BINARY */
 /*---------------------------------------------------------------------------*/
 /* Prepare addition of a new log.
  * Returns pointer to log structure if success, NULL otherwise */
@@ -141,6 +229,19 @@ tsch_log_prepare_add(void)
   }
 }
 /*---------------------------------------------------------------------------*/
+#if TSCH_LOG_BINARY
+void
+tsch_log_set_tag(struct tsch_log_t *log, const char *tag)
+{
+  /* called in the slot operation, copies at most the tag length */
+  if(tag != NULL) {
+    strncpy(log->message_id.tag, tag, TSCH_LOG_MESSAGE_TAG_LEN);
+  } else {
+    memset(log->message_id.tag, 0, TSCH_LOG_MESSAGE_TAG_LEN);
+  }
+}
+#endif /* TSCH_LOG_BINARY */
+/*---------------------------------------------------------------------------*/
 /* Actually add the previously prepared log */
 void
 tsch_log_commit(void)
@@ -154,6 +255,9 @@ void
 tsch_log_init(void)
 {
   ringbufindex_init(&log_ringbuf, TSCH_LOG_QUEUE_LEN);
+#if TSCH_LOG_BINARY
+  tsch_prop_export_init();
+#endif /* TSCH_LOG_BINARY */
 }
 
 #endif /* TSCH_LOG_LEVEL */
@@ -65,16 +65,47 @@
 #define TSCH_LOG_LEVEL 2
 #endif /* TSCH_LOG_CONF_LEVEL */
 
+/* Binary trace mode: instead of being formatted to text, logs are written
+ * out as fixed-size records framed like the measurement export
+ * (tsch-prop-export.h), and decoded on the host by
+ * tools/dwm1001/measurement-decode.py. Message logs do not run their
+ * snprintf at all, the source file and line of the call site are recorded
+ * instead, and the values and the tag given to TSCH_LOG_ADD_ARGS and
+ * TSCH_LOG_ADD_TAG. The records go through the queue of the measurement
+ * export, which needs TSCH_PROP_EXPORT, and are written with its
+ * TSCH_PROP_CONF_EXPORT_WRITE. Requires TSCH_LOG_LEVEL 2. */
+#ifdef TSCH_LOG_CONF_BINARY
+#define TSCH_LOG_BINARY TSCH_LOG_CONF_BINARY
+#else /* TSCH_LOG_CONF_BINARY */
+#define TSCH_LOG_BINARY 0
+#endif /* TSCH_LOG_CONF_BINARY */
+
+/* Identifies the source file of message logs in binary trace mode.
+ * Files calling TSCH_LOG_ADD define it, the host decoder maps it back
+ * to the file (0: unknown) */
+#ifndef TSCH_LOG_FILE_ID
+#define TSCH_LOG_FILE_ID 0
+#endif
+#define TSCH_LOG_FILE_ID_SLOT_OPERATION 1
+#define TSCH_LOG_FILE_ID_ADAPTIVE_TIMESYNC 2
+
 #if TSCH_LOG_LEVEL < 2 /* For log level 0 or 1, the logging functions do nothing */
 
 #define tsch_log_init()
 #define tsch_log_process_pending()
 #define TSCH_LOG_ADD(log_type, init_code)
+#define TSCH_LOG_ADD_ARGS(log_type, init_code, a0, a1, a2)
+#define TSCH_LOG_ADD_TAG(log_type, init_code, tag, a0, a1, a2)
 
 #else /* TSCH_LOG_LEVEL */
 
 /************ Types ***********/
 
+/* Number of values recorded with a message log in binary trace mode */
+#define TSCH_LOG_MESSAGE_ARGS 3
+/* Characters of the string recorded with a message log in binary trace mode */
+#define TSCH_LOG_MESSAGE_TAG_LEN 8
+
 /* Structure for a log. Union of different types of logs */
 struct tsch_log_t {
   enum { tsch_log_tx,
@@ -85,6 +116,12 @@ struct tsch_log_t {
   struct tsch_link *link;
   union {
     char message[48];
+    struct {
+      int32_t args[TSCH_LOG_MESSAGE_ARGS]; /* values of the message */
+      uint16_t line;
+      uint8_t file;
+      char tag[TSCH_LOG_MESSAGE_TAG_LEN]; /* string of the message, not terminated */
+    } message_id; /* call site of a message log in binary trace mode */
     struct {
       int mac_tx_status;
       int dest;
@@ -117,6 +154,10 @@ struct tsch_log_t *tsch_log_prepare_add(void);
 void tsch_log_commit(void);
 /* Initialize log module */
 void tsch_log_init(void);
+#if TSCH_LOG_BINARY
+/* Records the tag of a message log in binary trace mode */
+void tsch_log_set_tag(struct tsch_log_t *log, const char *tag);
+#endif /* TSCH_LOG_BINARY */
 /* Process pending log messages */
 void tsch_log_process_pending(void);
 
@@ -124,6 +165,33 @@ void tsch_log_process_pending(void);
 
 /* Use this macro to add a log to the queue (will be printed out
  * later, after leaving interrupt context) */
+#if TSCH_LOG_BINARY
+#define TSCH_LOG_ADD(log_type, init_code) TSCH_LOG_ADD_TAG(log_type, init_code, NULL, 0, 0, 0)
+/* Same as TSCH_LOG_ADD, in binary trace mode the values a0 to a2 of a
+ * message log are recorded in place of its text. They are given in the
+ * order of the numeric conversions of the message format */
+#define TSCH_LOG_ADD_ARGS(log_type, init_code, a0, a1, a2) \
+  TSCH_LOG_ADD_TAG(log_type, init_code, NULL, a0, a1, a2)
+/* Same as TSCH_LOG_ADD_ARGS, the first TSCH_LOG_MESSAGE_TAG_LEN characters
+ * of tag (may be NULL) are recorded for the %s conversion of the format */
+#define TSCH_LOG_ADD_TAG(log_type, init_code, tag, a0, a1, a2) do { \
+    struct tsch_log_t *log = tsch_log_prepare_add(); \
+    if(log != NULL) { \
+      log->type = (log_type); \
+      if((log_type) == tsch_log_message) { \
+        log->message_id.args[0] = (int32_t)(a0); \
+        log->message_id.args[1] = (int32_t)(a1); \
+        log->message_id.args[2] = (int32_t)(a2); \
+        log->message_id.line = __LINE__; \
+        log->message_id.file = TSCH_LOG_FILE_ID; \
+        tsch_log_set_tag(log, (tag)); \
+      } else { \
+        init_code; \
+      } \
+      tsch_log_commit(); \
+    } \
+} while(0);
+#else /* TSCH_LOG_BINARY */
 #define TSCH_LOG_ADD(log_type, init_code) do { \
     struct tsch_log_t *log = tsch_log_prepare_add(); \
     if(log != NULL) { \
@@ -132,6 +200,9 @@ void tsch_log_process_pending(void);
       tsch_log_commit(); \
     } \
 } while(0);
+#define TSCH_LOG_ADD_ARGS(log_type, init_code, a0, a1, a2) TSCH_LOG_ADD(log_type, init_code)
+#define TSCH_LOG_ADD_TAG(log_type, init_code, tag, a0, a1, a2) TSCH_LOG_ADD(log_type, init_code)
+#endif /* TSCH_LOG_BINARY */
 
 #endif /* TSCH_LOG_LEVEL */
 
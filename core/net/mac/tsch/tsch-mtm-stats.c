@@ -0,0 +1,212 @@
+/*
+ * Copyright (c) 2015, SICS Swedish ICT.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         Statistics of the MTM ranging engine
+ *
+ */
+
+#include "contiki.h"
+#include "net/mac/tsch/tsch-private.h"
+#include "net/mac/tsch/tsch-prop.h"
+#include "net/mac/tsch/tsch-mtm-stats.h"
+#include <stdio.h>
+#include <string.h>
+
+#if TSCH_MTM_STATS
+
+/* not every rtimer-arch provides it, e.g. native */
+#ifndef RTIMERTICKS_TO_US
+#define RTIMERTICKS_TO_US(T) ((uint32_t)(((uint64_t)(T) * 1000000) / RTIMER_SECOND))
+#endif
+
+struct tsch_mtm_stats tsch_mtm_stats;
+
+/*---------------------------------------------------------------------------*/
+void
+tsch_mtm_stats_reset(void)
+{
+  memset(&tsch_mtm_stats, 0, sizeof(tsch_mtm_stats));
+  tsch_mtm_stats.since = clock_time();
+}
+/*---------------------------------------------------------------------------*/
+void
+tsch_mtm_stats_record_processing(rtimer_clock_t start, rtimer_clock_t end)
+{
+  uint32_t duration_us = RTIMERTICKS_TO_US(RTIMER_CLOCK_DIFF(end, start));
+  uint16_t b;
+  int i;
+
+  if(duration_us > UINT16_MAX) {
+    duration_us = UINT16_MAX;
+  }
+  b = duration_us / TSCH_MTM_STATS_BUCKET_US;
+  if(b >= TSCH_MTM_STATS_BUCKETS) {
+    b = TSCH_MTM_STATS_BUCKETS - 1;
+  }
+  if(tsch_mtm_stats.processing_hist[b] == UINT16_MAX) {
+    /* halve all buckets, older samples lose weight */
+    for(i = 0; i < TSCH_MTM_STATS_BUCKETS; i++) {
+      tsch_mtm_stats.processing_hist[i] >>= 1;
+    }
+  }
+  tsch_mtm_stats.processing_hist[b]++;
+  if(duration_us > tsch_mtm_stats.processing_max_us) {
+    tsch_mtm_stats.processing_max_us = duration_us;
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Upper edge of the bucket holding the given fraction (in permille) of the samples */
+static uint16_t
+processing_percentile(uint32_t total, uint16_t permille)
+{
+  uint32_t threshold = (total * permille + 999) / 1000;
+  uint32_t sum = 0;
+  int i;
+
+  for(i = 0; i < TSCH_MTM_STATS_BUCKETS; i++) {
+    sum += tsch_mtm_stats.processing_hist[i];
+    if(sum >= threshold) {
+      break;
+    }
+  }
+  if(i >= TSCH_MTM_STATS_BUCKETS - 1) {
+    return tsch_mtm_stats.processing_max_us;
+  }
+  return (i + 1) * TSCH_MTM_STATS_BUCKET_US;
+}
+/*---------------------------------------------------------------------------*/
+static uint32_t
+rate_x100(uint32_t count, clock_time_t elapsed)
+{
+  return elapsed == 0 ? 0 : (uint32_t)(((uint64_t)count * 100 * CLOCK_SECOND) / elapsed);
+}
+/*---------------------------------------------------------------------------*/
+void
+tsch_mtm_stats_get_summary(struct tsch_mtm_stats_summary *summary)
+{
+  clock_time_t elapsed = clock_time() - tsch_mtm_stats.since;
+  uint32_t total = 0;
+  int i;
+
+  for(i = 0; i < TSCH_MTM_STATS_BUCKETS; i++) {
+    total += tsch_mtm_stats.processing_hist[i];
+  }
+
+  summary->elapsed_s = elapsed / CLOCK_SECOND;
+  summary->frame_rate_x100 = rate_x100(tsch_mtm_stats.frame_receptions, elapsed);
+  summary->twr_rate_x100 = rate_x100(tsch_mtm_stats.twr_measurements, elapsed);
+  summary->tdoa_rate_x100 = rate_x100(tsch_mtm_stats.tdoa_measurements, elapsed);
+  summary->processing_p50_us = total ? processing_percentile(total, 500) : 0;
+  summary->processing_p99_us = total ? processing_percentile(total, 990) : 0;
+  summary->processing_max_us = tsch_mtm_stats.processing_max_us;
+}
+/*---------------------------------------------------------------------------*/
+static void
+neighbor_stats(const struct mtm_neighbor *n, uint32_t round, struct tsch_mtm_neighbor_stats *s)
+{
+  s->addr = n->neighbor_addr;
+  s->type = n->type;
+  s->rx_count = n->rx_count;
+  /* a direct neighbor sends one frame per burst lane and round */
+  s->expected = (round - n->first_round) * TSCH_MTM_BURST_LEN;
+  s->twr_count = n->total_found_ours_counter;
+  if(s->expected == 0) {
+    s->success_permille = 0;
+  } else if(s->rx_count >= s->expected) {
+    s->success_permille = 1000;
+  } else {
+    s->success_permille = ((uint64_t)s->rx_count * 1000) / s->expected;
+  }
+}
+/*---------------------------------------------------------------------------*/
+int
+tsch_mtm_stats_get_neighbors(struct tsch_mtm_neighbor_stats *neighbors, int max)
+{
+  uint32_t round = mtm_get_round_counter();
+  struct mtm_neighbor *n;
+  int count = 0;
+
+  for(n = list_head(tsch_prop_get_neighbor_list()); n != NULL; n = list_item_next(n)) {
+    if(count < max) {
+      neighbor_stats(n, round, &neighbors[count]);
+    }
+    count++;
+  }
+  return count;
+}
+/*---------------------------------------------------------------------------*/
+void
+tsch_mtm_stats_print(void)
+{
+  struct tsch_mtm_stats_summary summary;
+  struct tsch_mtm_neighbor_stats s;
+  struct mtm_neighbor *n;
+  int i;
+
+  tsch_mtm_stats_get_summary(&summary);
+
+  printf("mtmst, %lu, %lu, %lu, %lu, %lu, %lu, %lu, %lu, %lu, %lu, %lu\n",
+         (unsigned long)tsch_mtm_stats.frame_receptions,
+         (unsigned long)tsch_mtm_stats.failed_frame_receptions,
+         (unsigned long)tsch_mtm_stats.no_frame_detected,
+         (unsigned long)tsch_mtm_stats.rounds,
+         (unsigned long)tsch_mtm_stats.twr_measurements,
+         (unsigned long)tsch_mtm_stats.tdoa_measurements,
+         (unsigned long)tsch_mtm_stats.rx_queue_drops,
+         (unsigned long)tsch_mtm_stats.pending_drops,
+         (unsigned long)tsch_mtm_stats.neighbor_evictions,
+         (unsigned long)tsch_mtm_stats.tdoa_evictions,
+         (unsigned long)tsch_mtm_stats.tdoa_alloc_failures);
+  printf("mtmsr, %lu, %lu, %lu, %lu, %u, %u, %u\n",
+         (unsigned long)summary.elapsed_s,
+         (unsigned long)summary.frame_rate_x100,
+         (unsigned long)summary.twr_rate_x100,
+         (unsigned long)summary.tdoa_rate_x100,
+         summary.processing_p50_us, summary.processing_p99_us, summary.processing_max_us);
+
+  printf("mtmsh");
+  for(i = 0; i < TSCH_MTM_STATS_BUCKETS; i++) {
+    printf(", %u", tsch_mtm_stats.processing_hist[i]);
+  }
+  printf("\n");
+
+  for(n = list_head(tsch_prop_get_neighbor_list()); n != NULL; n = list_item_next(n)) {
+    neighbor_stats(n, mtm_get_round_counter(), &s);
+    printf("mtmsn, %u, %u, %lu, %lu, %lu, %u\n", s.addr, s.type,
+           (unsigned long)s.rx_count, (unsigned long)s.expected,
+           (unsigned long)s.twr_count, s.success_permille);
+  }
+}
+/*---------------------------------------------------------------------------*/
+#endif /* TSCH_MTM_STATS */
@@ -0,0 +1,140 @@
+/*
+ * Copyright (c) 2015, SICS Swedish ICT.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         Statistics of the MTM ranging engine: frame receptions, measurement
+ *         rates, drops and evictions in the ranging tables, per-neighbor
+ *         reception ratios and a histogram of the time spent processing a
+ *         received frame. Meant to tell apart measurements lost on the air,
+ *         to table pressure, or to the CPU.
+ *
+ */
+
+#ifndef __TSCH_MTM_STATS_H__
+#define __TSCH_MTM_STATS_H__
+
+/********** Includes **********/
+
+#include "contiki.h"
+#include "net/mac/tsch/tsch-prop.h"
+
+/******** Configuration *******/
+
+/* Keep the MTM statistics */
+#ifdef TSCH_MTM_CONF_STATS
+#define TSCH_MTM_STATS TSCH_MTM_CONF_STATS
+#else
+#define TSCH_MTM_STATS 1
+#endif
+
+/* Width of a bucket of the processing time histogram in us */
+#ifdef TSCH_MTM_CONF_STATS_BUCKET_US
+#define TSCH_MTM_STATS_BUCKET_US TSCH_MTM_CONF_STATS_BUCKET_US
+#else
+#define TSCH_MTM_STATS_BUCKET_US 32
+#endif
+
+/* Number of buckets, longer processing times end up in the last one */
+#ifdef TSCH_MTM_CONF_STATS_BUCKETS
+#define TSCH_MTM_STATS_BUCKETS TSCH_MTM_CONF_STATS_BUCKETS
+#else
+#define TSCH_MTM_STATS_BUCKETS 32
+#endif
+
+/********** Data types **********/
+
+struct tsch_mtm_stats {
+  /* slot operation */
+  uint32_t frame_receptions;        /* MTM frames received and parsed */
+  uint32_t failed_frame_receptions; /* frames detected but not received or not parsed */
+  uint32_t no_frame_detected;       /* MTM rx slots without any frame */
+  /* ranging engine */
+  uint32_t rounds;                  /* DS-TWR rounds closed with a neighbor */
+  uint32_t twr_measurements;
+  uint32_t tdoa_measurements;
+  uint32_t rx_queue_drops;          /* rx timestamps not sent, the outgoing rx queue was full */
+  uint32_t pending_drops;           /* frames not processed, the pending queue was full */
+  uint32_t neighbor_evictions;      /* neighbors replaced in the full neighbor table */
+  uint32_t tdoa_evictions;          /* TDoA pairs replaced in the full TDoA table */
+  uint32_t tdoa_alloc_failures;     /* TDoA pairs not tracked, no entry could be replaced */
+  /* time to process a received frame */
+  uint16_t processing_hist[TSCH_MTM_STATS_BUCKETS];
+  uint16_t processing_max_us;
+  clock_time_t since;               /* time of the last reset */
+};
+
+struct tsch_mtm_neighbor_stats {
+  ranging_addr_t addr;
+  enum mtm_neighbor_type type;
+  uint32_t rx_count;                /* frames received from the neighbor */
+  uint32_t expected;                /* frames the neighbor sent since we know it */
+  uint32_t twr_count;               /* DS-TWR rounds closed with the neighbor */
+  uint16_t success_permille;        /* rx_count / expected */
+};
+
+/* Summary with rates in 1/100 per second and the processing time percentiles */
+struct tsch_mtm_stats_summary {
+  uint32_t elapsed_s;
+  uint32_t frame_rate_x100;
+  uint32_t twr_rate_x100;
+  uint32_t tdoa_rate_x100;
+  uint16_t processing_p50_us;
+  uint16_t processing_p99_us;
+  uint16_t processing_max_us;
+};
+
+/********** Functions *********/
+
+#if TSCH_MTM_STATS
+
+extern struct tsch_mtm_stats tsch_mtm_stats;
+
+#define TSCH_MTM_STATS_INC(field) (tsch_mtm_stats.field++)
+
+void tsch_mtm_stats_reset(void);
+void tsch_mtm_stats_record_processing(rtimer_clock_t start, rtimer_clock_t end);
+void tsch_mtm_stats_get_summary(struct tsch_mtm_stats_summary *summary);
+/* Fills up to max entries, returns the number of neighbors */
+int tsch_mtm_stats_get_neighbors(struct tsch_mtm_neighbor_stats *neighbors, int max);
+/* Prints the statistics as text lines, prefix "mtmst" */
+void tsch_mtm_stats_print(void);
+
+#else
+
+#define TSCH_MTM_STATS_INC(field)
+#define tsch_mtm_stats_reset()
+#define tsch_mtm_stats_record_processing(start, end)
+
+#endif /* TSCH_MTM_STATS */
+
+#endif /* __TSCH_MTM_STATS_H__ */
@@ -0,0 +1,291 @@
+/*
+ * Copyright (c) 2015, SICS Swedish ICT.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         Histograms of the MTM slot phases and the timing derived from them
+ *
+ */
+
+#include "contiki.h"
+#include "net/mac/tsch/tsch.h"
+#include "net/mac/tsch/tsch-private.h"
+#include "net/mac/tsch/tsch-packet.h"
+#include "net/mac/tsch/tsch-prop.h"
+#include "net/mac/tsch/tsch-mtm-timing.h"
+#include <stdio.h>
+#include <string.h>
+
+#if TSCH_MTM_TIMING_STATS
+
+#ifndef RADIO_DELAY_BEFORE_TX
+#define RADIO_DELAY_BEFORE_TX 0
+#endif
+#ifndef RADIO_DELAY_BEFORE_RX
+#define RADIO_DELAY_BEFORE_RX 0
+#endif
+
+struct phase_histogram {
+  uint16_t bucket[TSCH_MTM_TIMING_BUCKETS];
+  uint32_t count;
+  uint16_t min_us, max_us;
+  uint8_t max_entries;
+  /* sums for the least squares fit of the duration over the amount of entries */
+  uint64_t sum_us, sum_entries, sum_entries_sq, sum_entries_us;
+};
+
+static struct phase_histogram histograms[TSCH_MTM_TIMING_PHASE_COUNT];
+
+static const char *phase_names[TSCH_MTM_TIMING_PHASE_COUNT] = {
+  "tx-prepare", "tx", "tx-handling", "rx-arrival", "rx", "rx-handling", "slot-end"
+};
+
+/*---------------------------------------------------------------------------*/
+/* Halves all counters once a bucket is about to overflow, older samples
+ * therefore lose weight over time. */
+static void
+histogram_age(struct phase_histogram *h)
+{
+  int i;
+
+  h->count = 0;
+  for(i = 0; i < TSCH_MTM_TIMING_BUCKETS; i++) {
+    h->bucket[i] >>= 1;
+    h->count += h->bucket[i];
+  }
+  h->sum_us >>= 1;
+  h->sum_entries >>= 1;
+  h->sum_entries_sq >>= 1;
+  h->sum_entries_us >>= 1;
+}
+/*---------------------------------------------------------------------------*/
+void
+tsch_mtm_timing_record_us(enum tsch_mtm_timing_phase phase, uint16_t duration_us, uint8_t entries)
+{
+  struct phase_histogram *h;
+  uint16_t b;
+
+  if(phase >= TSCH_MTM_TIMING_PHASE_COUNT) {
+    return;
+  }
+  h = &histograms[phase];
+
+  b = duration_us / TSCH_MTM_TIMING_BUCKET_US;
+  if(b >= TSCH_MTM_TIMING_BUCKETS) {
+    b = TSCH_MTM_TIMING_BUCKETS - 1;
+  }
+  if(h->bucket[b] == UINT16_MAX) {
+    histogram_age(h);
+  }
+  h->bucket[b]++;
+
+  if(h->count == 0 || duration_us < h->min_us) {
+    h->min_us = duration_us;
+  }
+  if(duration_us > h->max_us) {
+    h->max_us = duration_us;
+  }
+  if(entries > h->max_entries) {
+    h->max_entries = entries;
+  }
+  h->count++;
+  h->sum_us += duration_us;
+  h->sum_entries += entries;
+  h->sum_entries_sq += (uint32_t)entries * entries;
+  h->sum_entries_us += (uint32_t)entries * duration_us;
+}
+/*---------------------------------------------------------------------------*/
+void
+tsch_mtm_timing_record(enum tsch_mtm_timing_phase phase, rtimer_clock_t start, rtimer_clock_t end, uint8_t entries)
+{
+  uint32_t duration_us = RTIMERTICKS_TO_US((rtimer_clock_t)(end - start));
+
+  tsch_mtm_timing_record_us(phase, duration_us > UINT16_MAX ? UINT16_MAX : duration_us, entries);
+}
+/*---------------------------------------------------------------------------*/
+void
+tsch_mtm_timing_reset(void)
+{
+  memset(histograms, 0, sizeof(histograms));
+}
+/*---------------------------------------------------------------------------*/
+/* Upper edge of the bucket holding the given percentile, capped by the maximum */
+static uint16_t
+histogram_percentile(const struct phase_histogram *h, uint8_t percent)
+{
+  uint32_t target, seen = 0;
+  int i;
+
+  target = (h->count * percent + 99) / 100;
+  for(i = 0; i < TSCH_MTM_TIMING_BUCKETS - 1; i++) {
+    seen += h->bucket[i];
+    if(seen >= target) {
+      return MIN((uint32_t)(i + 1) * TSCH_MTM_TIMING_BUCKET_US, h->max_us);
+    }
+  }
+  return h->max_us;
+}
+/*---------------------------------------------------------------------------*/
+int
+tsch_mtm_timing_get_stats(enum tsch_mtm_timing_phase phase, struct tsch_mtm_timing_stats *stats)
+{
+  const struct phase_histogram *h;
+
+  if(phase >= TSCH_MTM_TIMING_PHASE_COUNT || stats == NULL) {
+    return 0;
+  }
+  h = &histograms[phase];
+
+  memset(stats, 0, sizeof(*stats));
+  if(h->count == 0) {
+    return 0;
+  }
+  stats->count = h->count;
+  stats->min_us = h->min_us;
+  stats->avg_us = h->sum_us / h->count;
+  stats->p99_us = histogram_percentile(h, 99);
+  stats->max_us = h->max_us;
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+/* 99th percentile of a phase for frames with the given amount of entries.
+ * Beyond the largest frame seen so far the percentile is extrapolated with
+ * the slope of the least squares fit over the amount of entries. */
+static uint32_t
+phase_budget(enum tsch_mtm_timing_phase phase, uint8_t entries)
+{
+  const struct phase_histogram *h = &histograms[phase];
+  uint32_t budget = histogram_percentile(h, 99);
+  int64_t num, den;
+
+  if(entries > h->max_entries) {
+    num = (int64_t)h->count * h->sum_entries_us - (int64_t)h->sum_entries * h->sum_us;
+    den = (int64_t)h->count * h->sum_entries_sq - (int64_t)h->sum_entries * h->sum_entries;
+    if(num > 0 && den > 0) {
+      budget += (num * (entries - h->max_entries) + den - 1) / den;
+    }
+  }
+  return budget;
+}
+/*---------------------------------------------------------------------------*/
+int
+tsch_mtm_timing_compute(uint8_t num_nodes, struct tsch_mtm_timing *timing)
+{
+  uint8_t entries;
+  int i;
+  int32_t lead, arrival_min, arrival_p99;
+  uint32_t tx_offset, rx_offset, rx_wait, tx_end, rx_end, std_end, length;
+
+  if(timing == NULL || num_nodes == 0) {
+    return 0;
+  }
+  for(i = 0; i < TSCH_MTM_TIMING_PHASE_COUNT; i++) {
+    if(histograms[i].count < TSCH_MTM_TIMING_MIN_SAMPLES) {
+      return 0;
+    }
+  }
+
+  /* a frame carries at most one timestamp of every other node */
+  entries = MIN(num_nodes - 1, TSCH_MTM_PROP_MAX_MEASUREMENT);
+
+  /* The arrivals are recorded relative to the current rx window. Move the
+   * window so that it covers them with a margin on both sides. */
+  lead = RTIMERTICKS_TO_US(tsch_timing[tsch_ts_loc_tx_offset])
+    - RTIMERTICKS_TO_US(tsch_timing[tsch_ts_loc_rx_offset]);
+  arrival_min = histograms[TSCH_MTM_TIMING_RX_ARRIVAL].min_us;
+  arrival_p99 = histogram_percentile(&histograms[TSCH_MTM_TIMING_RX_ARRIVAL], 99);
+  lead = MAX(lead - arrival_min + TSCH_MTM_TIMING_MARGIN_US, TSCH_MTM_TIMING_MARGIN_US);
+  rx_wait = arrival_p99 - arrival_min + 2 * TSCH_MTM_TIMING_MARGIN_US;
+
+  /* the frame has to be ready and the receivers listening before the transmission */
+  tx_offset = phase_budget(TSCH_MTM_TIMING_TX_PREPARE, entries)
+    + RTIMERTICKS_TO_US(RADIO_DELAY_BEFORE_TX) + TSCH_MTM_TIMING_MARGIN_US;
+  tx_offset = MAX(tx_offset, lead + RTIMERTICKS_TO_US(RADIO_DELAY_BEFORE_RX) + TSCH_MTM_TIMING_MARGIN_US);
+  rx_offset = tx_offset - lead;
+
+  /* the frames of a burst follow the first one at a fixed interval */
+  tx_end = tx_offset + (TSCH_MTM_BURST_LEN - 1) * TSCH_MTM_BURST_INTERVAL_US + phase_budget(TSCH_MTM_TIMING_TX, entries)
+    + phase_budget(TSCH_MTM_TIMING_TX_HANDLING, entries)
+    + phase_budget(TSCH_MTM_TIMING_SLOT_END, entries);
+  rx_end = rx_offset + rx_wait + (TSCH_MTM_BURST_LEN - 1) * TSCH_MTM_BURST_INTERVAL_US + phase_budget(TSCH_MTM_TIMING_RX, entries)
+    + phase_budget(TSCH_MTM_TIMING_RX_HANDLING, entries)
+    + phase_budget(TSCH_MTM_TIMING_SLOT_END, entries);
+  /* the other slots of the schedule have to fit as well */
+  std_end = RTIMERTICKS_TO_US(tsch_timing[tsch_ts_rx_offset] + tsch_timing[tsch_ts_rx_wait]
+                              + tsch_timing[tsch_ts_max_tx] + tsch_timing[tsch_ts_tx_ack_delay]
+                              + tsch_timing[tsch_ts_max_ack]);
+
+  length = MAX(MAX(tx_end, rx_end), std_end) + TSCH_MTM_TIMING_MARGIN_US;
+  length = (length + TSCH_MTM_TIMING_GRANULARITY_US - 1)
+    / TSCH_MTM_TIMING_GRANULARITY_US * TSCH_MTM_TIMING_GRANULARITY_US;
+  if(length > UINT16_MAX) {
+    return 0;
+  }
+
+  timing->loc_tx_offset = tx_offset;
+  timing->loc_rx_offset = rx_offset;
+  timing->loc_rx_wait = rx_wait;
+  timing->timeslot_length = length;
+  timing->round_length = length * num_nodes;
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+int
+tsch_mtm_timing_apply(const struct tsch_mtm_timing *timing)
+{
+  if(timing == NULL || !tsch_is_coordinator || !TSCH_PACKET_EB_WITH_TIMESLOT_TIMING) {
+    return 0;
+  }
+  tsch_timing[tsch_ts_loc_tx_offset] = US_TO_RTIMERTICKS(timing->loc_tx_offset);
+  tsch_timing[tsch_ts_loc_rx_offset] = US_TO_RTIMERTICKS(timing->loc_rx_offset);
+  tsch_timing[tsch_ts_loc_rx_wait] = US_TO_RTIMERTICKS(timing->loc_rx_wait);
+  tsch_timing[tsch_ts_timeslot_length] = US_TO_RTIMERTICKS(timing->timeslot_length);
+  mtm_set_slot_length(timing->timeslot_length);
+  /* the arrivals were recorded relative to the old rx window */
+  memset(&histograms[TSCH_MTM_TIMING_RX_ARRIVAL], 0, sizeof(struct phase_histogram));
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+void
+tsch_mtm_timing_print(void)
+{
+  struct tsch_mtm_timing_stats stats;
+  int i;
+
+  for(i = 0; i < TSCH_MTM_TIMING_PHASE_COUNT; i++) {
+    tsch_mtm_timing_get_stats(i, &stats);
+    printf("mtmtiming, %s, %lu, %u, %u, %u, %u\n", phase_names[i],
+           (unsigned long)stats.count, stats.min_us, stats.avg_us, stats.p99_us, stats.max_us);
+  }
+}
+/*---------------------------------------------------------------------------*/
+#endif /* TSCH_MTM_TIMING_STATS */
@@ -0,0 +1,161 @@
+/*
+ * Copyright (c) 2015, SICS Swedish ICT.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         Processing budgets of the MTM slots. The slot operation records
+ *         how long each phase of a MTM slot took, this module keeps a
+ *         histogram per phase and derives the tightest timing that still
+ *         covers the 99th percentile of every phase.
+ *
+ */
+
+#ifndef __TSCH_MTM_TIMING_H__
+#define __TSCH_MTM_TIMING_H__
+
+/********** Includes **********/
+
+#include "contiki.h"
+#include "net/mac/tsch/tsch-private.h"
+
+/******** Configuration *******/
+
+/* Record the duration of the MTM slot phases */
+#ifdef TSCH_MTM_CONF_TIMING_STATS
+#define TSCH_MTM_TIMING_STATS TSCH_MTM_CONF_TIMING_STATS
+#else
+#define TSCH_MTM_TIMING_STATS 0
+#endif
+
+/* Width of a histogram bucket in us */
+#ifdef TSCH_MTM_CONF_TIMING_BUCKET_US
+#define TSCH_MTM_TIMING_BUCKET_US TSCH_MTM_CONF_TIMING_BUCKET_US
+#else
+#define TSCH_MTM_TIMING_BUCKET_US 16
+#endif
+
+/* Number of buckets per phase, longer durations end up in the last one */
+#ifdef TSCH_MTM_CONF_TIMING_BUCKETS
+#define TSCH_MTM_TIMING_BUCKETS TSCH_MTM_CONF_TIMING_BUCKETS
+#else
+#define TSCH_MTM_TIMING_BUCKETS 64
+#endif
+
+/* Safety margin added to every derived offset and duration, in us */
+#ifdef TSCH_MTM_CONF_TIMING_MARGIN_US
+#define TSCH_MTM_TIMING_MARGIN_US TSCH_MTM_CONF_TIMING_MARGIN_US
+#else
+#define TSCH_MTM_TIMING_MARGIN_US 50
+#endif
+
+/* Derived timeslot lengths are rounded up to a multiple of this, in us */
+#ifdef TSCH_MTM_CONF_TIMING_GRANULARITY_US
+#define TSCH_MTM_TIMING_GRANULARITY_US TSCH_MTM_CONF_TIMING_GRANULARITY_US
+#else
+#define TSCH_MTM_TIMING_GRANULARITY_US 100
+#endif
+
+/* Samples required per phase before timings are derived */
+#ifdef TSCH_MTM_CONF_TIMING_MIN_SAMPLES
+#define TSCH_MTM_TIMING_MIN_SAMPLES TSCH_MTM_CONF_TIMING_MIN_SAMPLES
+#else
+#define TSCH_MTM_TIMING_MIN_SAMPLES 100
+#endif
+
+/********** Data types **********/
+
+enum tsch_mtm_timing_phase {
+  /* TX slot */
+  TSCH_MTM_TIMING_TX_PREPARE,   /* slot start until the frame is handed to the radio */
+  TSCH_MTM_TIMING_TX,           /* transmission */
+  TSCH_MTM_TIMING_TX_HANDLING,  /* handling of the tx timestamp */
+  /* RX slot */
+  TSCH_MTM_TIMING_RX_ARRIVAL,   /* start of the rx window until the frame is detected */
+  TSCH_MTM_TIMING_RX,           /* reception */
+  TSCH_MTM_TIMING_RX_HANDLING,  /* parsing and handling of the frame */
+  /* both */
+  TSCH_MTM_TIMING_SLOT_END,     /* radio off and slot end handler */
+  TSCH_MTM_TIMING_PHASE_COUNT
+};
+
+struct tsch_mtm_timing_stats {
+  uint32_t count;
+  uint16_t min_us;
+  uint16_t avg_us;
+  uint16_t p99_us;
+  uint16_t max_us;
+};
+
+/* Timing for the MTM slots, all values in us */
+struct tsch_mtm_timing {
+  uint16_t loc_tx_offset;
+  uint16_t loc_rx_offset;
+  uint16_t loc_rx_wait;
+  uint16_t timeslot_length;
+  uint32_t round_length;  /* timeslot_length times the cluster size */
+};
+
+/********** Functions *********/
+
+#if TSCH_MTM_TIMING_STATS
+
+/* Record one phase. entries is the amount of timestamps in the frame,
+ * it is used to extrapolate to larger clusters. */
+void tsch_mtm_timing_record(enum tsch_mtm_timing_phase phase, rtimer_clock_t start, rtimer_clock_t end, uint8_t entries);
+void tsch_mtm_timing_record_us(enum tsch_mtm_timing_phase phase, uint16_t duration_us, uint8_t entries);
+void tsch_mtm_timing_reset(void);
+int tsch_mtm_timing_get_stats(enum tsch_mtm_timing_phase phase, struct tsch_mtm_timing_stats *stats);
+
+/* Derives the tightest timing for a cluster of num_nodes nodes from the
+ * recorded phases and the timing currently in use. Returns 0 as long as
+ * a phase has less than TSCH_MTM_TIMING_MIN_SAMPLES samples. */
+int tsch_mtm_timing_compute(uint8_t num_nodes, struct tsch_mtm_timing *timing);
+
+/* Applies a timing to tsch_timing. The timeslot length is shared by all
+ * nodes, so only the coordinator may apply a timing, and only with
+ * TSCH_PACKET_EB_WITH_TIMESLOT_TIMING: its EBs then advertise the new
+ * timing. Joining nodes take it from the EB, nodes that already joined
+ * leave the network when the EB timing of their time source differs from
+ * theirs and join again with it. Returns 0 if the timing was not applied. */
+int tsch_mtm_timing_apply(const struct tsch_mtm_timing *timing);
+
+void tsch_mtm_timing_print(void);
+
+#else
+
+#define tsch_mtm_timing_record(phase, start, end, entries)
+#define tsch_mtm_timing_record_us(phase, duration_us, entries)
+#define tsch_mtm_timing_reset()
+
+#endif /* TSCH_MTM_TIMING_STATS */
+
+#endif /* __TSCH_MTM_TIMING_H__ */
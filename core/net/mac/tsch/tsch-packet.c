@@ -349,7 +349,6 @@ int
 tsch_packet_parse_eb(const uint8_t *buf, int buf_size,
                      frame802154_t *frame, struct ieee802154_ies *ies, uint8_t *hdr_len, int frame_without_mic)
 {
-  uint8_t curr_len = 0;
   int ret;
 
   if(frame == NULL || buf_size < 0) {
@@ -362,6 +361,23 @@ tsch_packet_parse_eb(const uint8_t *buf, int buf_size,
     return 0;
   }
 
+  return tsch_packet_parse_eb_frame(buf, buf_size, frame, ret, ies, hdr_len, frame_without_mic);
+}
+/*---------------------------------------------------------------------------*/
+/* Parse the Information Elements of an EB whose 802.15.4 header was
+ * already parsed into frame (frame_hdr_len bytes long) */
+int
+tsch_packet_parse_eb_frame(const uint8_t *buf, int buf_size,
+                           const frame802154_t *frame, int frame_hdr_len,
+                           struct ieee802154_ies *ies, uint8_t *hdr_len, int frame_without_mic)
+{
+  uint8_t curr_len = 0;
+  int ret = frame_hdr_len;
+
+  if(frame == NULL || buf_size < 0 || frame_hdr_len <= 0) {
+    return 0;
+  }
+
   if(frame->fcf.frame_version < FRAME802154_IEEE802154E_2012
      || frame->fcf.frame_type != FRAME802154_BEACONFRAME) {
     PRINTF("TSCH:! parse_eb: frame is not a valid TSCH beacon. Frame version %u, type %u, FCF %02x %02x\n",
@@ -101,6 +101,10 @@ int tsch_packet_update_eb(uint8_t *buf, int buf_size, uint8_t tsch_sync_ie_offse
 int tsch_packet_parse_eb(const uint8_t *buf, int buf_size,
     frame802154_t *frame, struct ieee802154_ies *ies,
     uint8_t *hdrlen, int frame_without_mic);
+/* Same as tsch_packet_parse_eb, for an EB whose header was already parsed */
+int tsch_packet_parse_eb_frame(const uint8_t *buf, int buf_size,
+    const frame802154_t *frame, int frame_hdr_len, struct ieee802154_ies *ies,
+    uint8_t *hdrlen, int frame_without_mic);
 /* Construct ACK packet and return ACK length */
 int tsch_packet_create_ack(uint8_t *buf, int buf_size, uint8_t seqno);
 /* Construct a ranging data packet. This packet contains the real reply time and
@@ -0,0 +1,301 @@
+/*
+ * Copyright (c) 2015, SICS Swedish ICT.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         Binary, COBS-framed export of distance measurements
+ *
+ */
+
+#include "contiki.h"
+#include "lib/crc16.h"
+#include "lib/ringbufindex.h"
+#include "net/mac/tsch/tsch-prop-export.h"
+#include "net/mac/tsch/tsch-mtm-stats.h"
+#include <stdio.h>
+#include <string.h>
+
+/*---------------------------------------------------------------------------*/
+/* Encodes len bytes of src, which must not exceed 254, with COBS into dst.
+ * dst needs len + 1 bytes. Returns the encoded length */
+static int
+cobs_encode(const uint8_t *src, int len, uint8_t *dst)
+{
+  int code_pos = 0;
+  int out = 1;
+  uint8_t code = 1;
+  int i;
+
+  for(i = 0; i < len; i++) {
+    if(src[i] == 0) {
+      dst[code_pos] = code;
+      code_pos = out++;
+      code = 1;
+    } else {
+      dst[out++] = src[i];
+      code++;
+    }
+  }
+  dst[code_pos] = code;
+  return out;
+}
+/*---------------------------------------------------------------------------*/
+static void
+put_le32(uint8_t *p, uint32_t v)
+{
+  p[0] = v;
+  p[1] = v >> 8;
+  p[2] = v >> 16;
+  p[3] = v >> 24;
+}
+/*---------------------------------------------------------------------------*/
+int
+tsch_prop_export_frame(uint8_t type, const uint8_t *payload, int len, uint8_t seqno, uint8_t *buf)
+{
+  uint8_t record[TSCH_PROP_EXPORT_MAX_PAYLOAD + TSCH_PROP_EXPORT_OVERHEAD];
+  uint16_t crc;
+  int record_len;
+
+  record[0] = (TSCH_PROP_EXPORT_VERSION << 4) | (type & 0x0f);
+  record[1] = seqno;
+  memcpy(&record[2], payload, len);
+  record_len = len + 2;
+  crc = crc16_data(record, record_len, 0);
+  record[record_len++] = crc;
+  record[record_len++] = crc >> 8;
+
+  buf[0] = 0;
+  len = 1 + cobs_encode(record, record_len, &buf[1]);
+  buf[len++] = 0;
+  return len;
+}
+/*---------------------------------------------------------------------------*/
+int
+tsch_prop_export_encode(const struct distance_measurement *m, uint8_t seqno, uint8_t *buf)
+{
+  uint8_t payload[TSCH_PROP_EXPORT_MEASUREMENT_LEN];
+  uint32_t time_bits;
+
+  memcpy(&time_bits, &m->time, sizeof(time_bits));
+
+  put_le32(&payload[0], m->asn.ls4b);
+  payload[4] = m->asn.ms1b;
+  payload[5] = m->addr_A;
+  payload[6] = m->addr_B;
+  put_le32(&payload[7], time_bits);
+  put_le32(&payload[11], (uint32_t)m->freq_offset);
+  payload[15] = m->burst_index;
+
+  return tsch_prop_export_frame(m->type, payload, sizeof(payload), seqno, buf);
+}
+/*---------------------------------------------------------------------------*/
+#if TSCH_PROP_EXPORT
+
+#if (TSCH_PROP_EXPORT_QUEUE_LEN & (TSCH_PROP_EXPORT_QUEUE_LEN - 1)) != 0
+#error TSCH_PROP_EXPORT_QUEUE_LEN must be power of two
+#endif
+
+struct export_frame {
+  uint8_t buf[TSCH_PROP_EXPORT_MAX_FRAME_LEN];
+  uint8_t len;
+  uint8_t offset; /* bytes already handed to the serial line */
+};
+
+static struct export_frame queue[TSCH_PROP_EXPORT_QUEUE_LEN];
+static struct ringbufindex queue_ringbuf;
+static struct tsch_prop_export_stats stats;
+static uint8_t seqno;
+
+PROCESS(tsch_prop_export_process, "TSCH measurement export process");
+
+/*---------------------------------------------------------------------------*/
+static int
+export_write(const uint8_t *buf, int len)
+{
+#ifdef TSCH_PROP_CONF_EXPORT_WRITE
+  return TSCH_PROP_CONF_EXPORT_WRITE(buf, len);
+#else
+  int i;
+  for(i = 0; i < len; i++) {
+    putchar(buf[i]);
+  }
+  return len;
+#endif
+}
+/*---------------------------------------------------------------------------*/
+void
+tsch_prop_export_init(void)
+{
+  if(process_is_running(&tsch_prop_export_process)) {
+    return;
+  }
+  ringbufindex_init(&queue_ringbuf, TSCH_PROP_EXPORT_QUEUE_LEN);
+  memset(&stats, 0, sizeof(stats));
+  seqno = 0;
+  process_start(&tsch_prop_export_process, NULL);
+}
+/*---------------------------------------------------------------------------*/
+/* Returns the queue slot for the next record, NULL if the queue is full */
+static struct export_frame *
+queue_peek_put(void)
+{
+  int i;
+
+  /* the sequence number advances for dropped records too, the host
+   * sees the gap */
+  seqno++;
+  i = ringbufindex_peek_put(&queue_ringbuf);
+  if(i == -1) {
+    stats.dropped++;
+    return NULL;
+  }
+  queue[i].offset = 0;
+  return &queue[i];
+}
+/*---------------------------------------------------------------------------*/
+static void
+queue_put(void)
+{
+  ringbufindex_put(&queue_ringbuf);
+  stats.queued++;
+  process_poll(&tsch_prop_export_process);
+}
+/*---------------------------------------------------------------------------*/
+int
+tsch_prop_export_record(uint8_t type, const uint8_t *payload, int len)
+{
+  struct export_frame *f = queue_peek_put();
+
+  if(f == NULL) {
+    return 0;
+  }
+  f->len = tsch_prop_export_frame(type, payload, len, seqno, f->buf);
+  queue_put();
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+void
+tsch_prop_export_lost(int count)
+{
+  seqno += count;
+  stats.dropped += count;
+}
+/*---------------------------------------------------------------------------*/
+int
+tsch_prop_export_measurement(const struct distance_measurement *m)
+{
+  struct export_frame *f = queue_peek_put();
+
+  if(f == NULL) {
+    return 0;
+  }
+  f->len = tsch_prop_export_encode(m, seqno, f->buf);
+  queue_put();
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+int
+tsch_prop_export_mtm_stats(void)
+{
+#if TSCH_MTM_STATS
+  uint8_t payload[TSCH_PROP_EXPORT_MTM_STATS_LEN];
+  const uint32_t counters[] = {
+    tsch_mtm_stats.frame_receptions, tsch_mtm_stats.failed_frame_receptions,
+    tsch_mtm_stats.no_frame_detected, tsch_mtm_stats.rounds,
+    tsch_mtm_stats.twr_measurements, tsch_mtm_stats.tdoa_measurements,
+    tsch_mtm_stats.rx_queue_drops, tsch_mtm_stats.pending_drops,
+    tsch_mtm_stats.neighbor_evictions, tsch_mtm_stats.tdoa_evictions,
+    tsch_mtm_stats.tdoa_alloc_failures
+  };
+  struct tsch_mtm_stats_summary summary;
+  uint8_t *p = payload;
+  int i;
+
+  tsch_mtm_stats_get_summary(&summary);
+  for(i = 0; i < (int)(sizeof(counters) / sizeof(counters[0])); i++, p += 4) {
+    put_le32(p, counters[i]);
+  }
+  put_le32(p, (uint32_t)(((uint64_t)(clock_time() - tsch_mtm_stats.since) * 1000) / CLOCK_SECOND));
+  p += 4;
+  p[0] = summary.processing_p50_us;
+  p[1] = summary.processing_p50_us >> 8;
+  p[2] = summary.processing_p99_us;
+  p[3] = summary.processing_p99_us >> 8;
+  p[4] = summary.processing_max_us;
+  p[5] = summary.processing_max_us >> 8;
+
+  return tsch_prop_export_record(TSCH_PROP_EXPORT_TYPE_MTM_STATS, payload, sizeof(payload));
+#else
+  return 0;
+#endif
+}
+/*---------------------------------------------------------------------------*/
+void
+tsch_prop_export_get_stats(struct tsch_prop_export_stats *s)
+{
+  *s = stats;
+}
+/*---------------------------------------------------------------------------*/
+/* Hands the queued frames to the serial line as far as it accepts them,
+ * and retries every clock tick while frames are left. The write hook
+ * takes a frame as a whole or not at all, offset only matters for
+ * hooks that do not */
+PROCESS_THREAD(tsch_prop_export_process, ev, data)
+{
+  static struct etimer et;
+  struct export_frame *f;
+  int i;
+
+  PROCESS_BEGIN();
+
+  while(1) {
+    PROCESS_WAIT_EVENT_UNTIL(ev == PROCESS_EVENT_POLL || (ev == PROCESS_EVENT_TIMER && data == &et));
+
+    while((i = ringbufindex_peek_get(&queue_ringbuf)) != -1) {
+      f = &queue[i];
+      f->offset += export_write(&f->buf[f->offset], f->len - f->offset);
+      if(f->offset < f->len) {
+        break;
+      }
+      ringbufindex_get(&queue_ringbuf);
+      stats.sent++;
+    }
+
+    if(ringbufindex_elements(&queue_ringbuf) > 0) {
+      etimer_set(&et, 1);
+    }
+  }
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
+#endif /* TSCH_PROP_EXPORT */
@@ -0,0 +1,182 @@
+/*
+ * Copyright (c) 2015, SICS Swedish ICT.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         Binary export of distance measurements. Every measurement is
+ *         serialized into a fixed record, protected by a CRC-16 and
+ *         COBS-framed with a 0x00 byte on both sides, so the frames can
+ *         share the serial line with the regular printf output, as long
+ *         as each frame is written in one piece (see
+ *         TSCH_PROP_CONF_EXPORT_WRITE). Records
+ *         are queued and written out by a process, the producer never
+ *         blocks on the serial line. tools/dwm1001/measurement-decode.py
+ *         decodes the stream on the host.
+ *
+ *         Record layout (little endian):
+ *           0     version (high nibble) and record type (low nibble)
+ *           1     sequence number, gaps show dropped records
+ *           2-    payload
+ *           last  CRC-16 over the header and the payload
+ *
+ *         Measurement payload (types TDOA and TWR of enum measurement_type):
+ *           0-4   ASN (ls4b, ms1b)
+ *           5     addr_A
+ *           6     addr_B
+ *           7-10  time in DW1000 time units (IEEE 754 float)
+ *           11-14 freq_offset
+ *           15    burst_index
+ *
+ *         MTM statistics payload (type TSCH_PROP_EXPORT_TYPE_MTM_STATS):
+ *           0-43  the eleven uint32_t counters of struct tsch_mtm_stats
+ *           44-47 elapsed time since the reset of the statistics in ms
+ *           48-53 processing time p50, p99 and max in us (uint16_t)
+ *
+ *         TSCH log payload (type TSCH_PROP_EXPORT_TYPE_TSCH_LOG, written
+ *         by tsch-log.c in binary trace mode):
+ *           0-4   ASN (ls4b, ms1b)
+ *           5     slotframe handle, 0xff without link
+ *           6-7   timeslot
+ *           8     channel offset
+ *           9     log type (tx, rx or message of struct tsch_log_t)
+ *           10-24 tx:      dest, status, num_tx, datalen, flags
+ *                          (is_data, drift_used, sec_level << 2), drift
+ *                 rx:      src, datalen, flags (is_data, drift_used,
+ *                          is_unicast << 2, sec_level << 3), drift,
+ *                          estimated drift
+ *                 message: file id, line of the call site, three
+ *                          values (TSCH_LOG_ADD_ARGS)
+ *                 drifts are int16_t, the line uint16_t, values int32_t
+ *           25-32 message: tag for the %s conversion, zero padded
+ *                          (TSCH_LOG_ADD_TAG), zero for tx and rx
+ *
+ *         The queue has a single producer: records are only queued from
+ *         processes, which run one at a time, never from the slot
+ *         operation or other interrupts. The TSCH log queues its records
+ *         from tsch_pending_events_process, the measurements are queued
+ *         by the process they are posted to (TSCH_PROP_PROCESS).
+ *
+ */
+
+#ifndef __TSCH_PROP_EXPORT_H__
+#define __TSCH_PROP_EXPORT_H__
+
+/********** Includes **********/
+
+#include "contiki.h"
+#include "net/mac/tsch/tsch-prop.h"
+
+/******** Configuration *******/
+
+/* Enable the binary measurement export */
+#ifdef TSCH_PROP_CONF_EXPORT
+#define TSCH_PROP_EXPORT TSCH_PROP_CONF_EXPORT
+#else
+#define TSCH_PROP_EXPORT 0
+#endif
+
+/* Number of framed records waiting for the serial line. Must be power of two */
+#ifdef TSCH_PROP_CONF_EXPORT_QUEUE_LEN
+#define TSCH_PROP_EXPORT_QUEUE_LEN TSCH_PROP_CONF_EXPORT_QUEUE_LEN
+#else
+#define TSCH_PROP_EXPORT_QUEUE_LEN 16
+#endif
+
+/* Non-blocking write to the serial line, returns the number of bytes
+ * accepted. To keep other output from being inserted into a record, it
+ * must accept either the whole record or nothing (like uart0_write).
+ * Without it, the records are written with putchar() */
+#ifdef TSCH_PROP_CONF_EXPORT_WRITE
+int TSCH_PROP_CONF_EXPORT_WRITE(const uint8_t *buf, int len);
+#endif
+
+/********** Constants *********/
+
+#define TSCH_PROP_EXPORT_VERSION      1
+/* record types beyond enum measurement_type */
+#define TSCH_PROP_EXPORT_TYPE_MTM_STATS 2
+#define TSCH_PROP_EXPORT_TYPE_TSCH_LOG 3
+/* version, sequence number and CRC */
+#define TSCH_PROP_EXPORT_OVERHEAD     4
+#define TSCH_PROP_EXPORT_MEASUREMENT_LEN 16
+#define TSCH_PROP_EXPORT_MTM_STATS_LEN 54
+#define TSCH_PROP_EXPORT_TSCH_LOG_LEN 33
+#define TSCH_PROP_EXPORT_MAX_PAYLOAD  TSCH_PROP_EXPORT_MTM_STATS_LEN
+#define TSCH_PROP_EXPORT_RECORD_LEN   (TSCH_PROP_EXPORT_MEASUREMENT_LEN + TSCH_PROP_EXPORT_OVERHEAD)
+/* leading delimiter, COBS overhead byte and trailing delimiter */
+#define TSCH_PROP_EXPORT_FRAME_LEN    (TSCH_PROP_EXPORT_RECORD_LEN + 3)
+#define TSCH_PROP_EXPORT_MAX_FRAME_LEN (TSCH_PROP_EXPORT_MAX_PAYLOAD + TSCH_PROP_EXPORT_OVERHEAD + 3)
+
+/************ Types ***********/
+
+struct tsch_prop_export_stats {
+  uint32_t queued;  /* records accepted by tsch_prop_export_measurement */
+  uint32_t dropped; /* records dropped because the queue was full, or lost before */
+  uint32_t sent;    /* records completely handed to the serial line */
+};
+
+/********** Functions *********/
+
+/* Frames a record of the given type into buf, which must hold len plus
+ * TSCH_PROP_EXPORT_OVERHEAD + 3 bytes. Returns the frame length */
+int tsch_prop_export_frame(uint8_t type, const uint8_t *payload, int len, uint8_t seqno, uint8_t *buf);
+/* Serializes and frames a measurement into buf, which must hold
+ * TSCH_PROP_EXPORT_FRAME_LEN bytes. Returns the frame length */
+int tsch_prop_export_encode(const struct distance_measurement *m, uint8_t seqno, uint8_t *buf);
+
+#if TSCH_PROP_EXPORT
+
+/* Starts the process draining the queue, once */
+void tsch_prop_export_init(void);
+/* Queues a record of the given type, len at most TSCH_PROP_EXPORT_MAX_PAYLOAD.
+ * Returns 1 if queued, 0 if dropped */
+int tsch_prop_export_record(uint8_t type, const uint8_t *payload, int len);
+/* Accounts for count records that were lost before they could be queued,
+ * the host sees the gap in the sequence numbers */
+void tsch_prop_export_lost(int count);
+/* Queues a measurement for export. Returns 1 if queued, 0 if dropped */
+int tsch_prop_export_measurement(const struct distance_measurement *m);
+/* Queues a snapshot of the MTM statistics (tsch-mtm-stats.h) for export */
+int tsch_prop_export_mtm_stats(void);
+void tsch_prop_export_get_stats(struct tsch_prop_export_stats *stats);
+
+#else
+
+#define tsch_prop_export_init()
+#define tsch_prop_export_record(type, payload, len) 0
+#define tsch_prop_export_lost(count)
+#define tsch_prop_export_measurement(m) 0
+#define tsch_prop_export_mtm_stats() 0
+
+#endif /* TSCH_PROP_EXPORT */
+
+#endif /* __TSCH_PROP_EXPORT_H__ */
@@ -44,11 +44,13 @@
 #include "net/mac/tsch/tsch-asn.h"
 #include "net/mac/tsch/tsch-packet.h"
 #include "net/mac/tsch/tsch-prop.h"
+#include "net/mac/tsch/tsch-mtm-stats.h"
 #include "net/mac/tsch/tsch-queue.h"
 #include "net/mac/tsch/tsch-schedule.h"
 #include "dev/radio.h"
 #include "memb.h"
 #include "lib/random.h"
+#include "lib/ringbufindex.h"
 #include "math.h"
 #include "nrfx_log.h"
 
@@ -83,6 +85,9 @@
 #define SPEED_OF_LIGHT_M_PER_S 299702547.236
 #define SPEED_OF_LIGHT_M_PER_UWB_TU ((SPEED_OF_LIGHT_M_PER_S * 1.0E-15) * 15650.0) // around 0.00469175196
 
+#define MTM_DW_TS_MASK 0xFFFFFFFFFFULL
+#define MTM_US_TO_DW_TICKS(us) (((uint64_t)(us) * 638976) / 10) // 63.8976 GHz
+
 #if !defined(WITH_MTM_TDOA_REPLACE_AFTER_TIMEOUT) && !defined(WITH_MTM_TDOA_REPLACE_OLDEST)
 #define WITH_MTM_TDOA_REPLACE_OLDEST 1
 #endif
@@ -94,16 +99,34 @@
 // and B taking the responder hole. See paper for more details on this measurement method.
 // with L we denote ourself as the passive listener.
 
-float mtm_compute_tdoa(struct mtm_pas_tdoa *ts);
+#if TSCH_MTM_FIXED_POINT
+#define MTM_COMPUTE_TDOA mtm_compute_tdoa_fixed
+#else
+#define MTM_COMPUTE_TDOA mtm_compute_tdoa
+#endif
+#endif
+
+#if TSCH_MTM_FIXED_POINT
+#define MTM_PROPAGATION_TIME calculate_propagation_time_fixed
+#else
+#define MTM_PROPAGATION_TIME calculate_propagation_time_alternative
 #endif
 
 int32_t correctedExpression(struct ds_twr_ts *ts);
-void mtm_compute_dstwr(struct tsch_asn_t *asn, struct mtm_neighbor *mtm_n);
-float calculate_propagation_time_alternative(struct ds_twr_ts *ts);
+void mtm_compute_dstwr(struct tsch_asn_t *asn, uint8_t tsch_channel, int32_t carrier_integrator, struct mtm_neighbor *mtm_n, uint8_t lane);
+#if TSCH_MTM_HALF_ROUND_TWR
+static void mtm_compute_half_round_twr(struct tsch_asn_t *asn, uint8_t tsch_channel, int32_t carrier_integrator, struct mtm_neighbor *mtm_n, uint8_t lane);
+#endif
+#if TSCH_MTM_DRIFT_TRACKING
+static void mtm_drift_init(struct mtm_neighbor *n);
+static void mtm_drift_update(struct mtm_neighbor *n, uint64_t tx_timestamp_B, uint64_t rx_timestamp_A, int16_t clock_offset);
+#endif
+static int64_t mtm_two_tof_fixed(struct ds_twr_ts *ts);
+static int64_t mtm_drift_ratio_q(int64_t num, int64_t den);
+static int64_t mtm_drift_mul_q(int64_t ratio_q, int64_t x);
 
 // in the following we use the value -1 for uninitialized timestamps
 struct mtm_rx_queue_item {
-    struct mtm_rx_queue_item *next;
     ranging_addr_t neighbor_addr;
     uint64_t rx_timestamp;
     uint8_t timeslot_offset;
@@ -115,25 +138,111 @@ struct mtm_timestamp_assoc {
     uint64_t timestamp;
 };
 
+// All lookups done while handling a frame go through tables indexed directly by
+// ranging_addr_t, so the work per frame does not depend on the amount of neighbors.
+// Index tables store position + 1, zero marks a missing entry. This way the
+// tables are valid without an explicit initialisation.
+#define MTM_ADDR_SPACE (1 << (8 * sizeof(ranging_addr_t)))
+#define MTM_INDEX_NONE 0
+
+// The lists are kept for users iterating over all entries (e.g. rand-sched)
 LIST(ranging_neighbor_list);
-LIST(rx_send_queue);
 
 #if WITH_PASSIVE_TDOA
 LIST(pas_tdoa_list);
 #endif
 
-MEMB(mtm_prop_neighbor_memb, struct mtm_neighbor, TSCH_MTM_PROP_MAX_NEIGHBOR_ENTRIES);
-MEMB(mtm_prop_rx_memb, struct mtm_rx_queue_item, TSCH_MTM_PROP_MAX_MEASUREMENT);
+static struct mtm_neighbor neighbor_table[TSCH_MTM_PROP_MAX_NEIGHBOR_ENTRIES];
+static uint8_t neighbor_table_used;
+static uint8_t neighbor_index[MTM_ADDR_SPACE];
+
+// observations per timeslot. slot_map_get() only reports the bits that have not expired and
+// never writes, expired bits are cleared by slot_map_set(). Each map is only written from one
+// context (the slot operation, or TSCH_MTM_PROCESS with deferred processing) and read from
+// any, so a read in process context can not lose a bit set by the rtimer interrupt.
+struct mtm_slot_map {
+    uint32_t bits[TSCH_MTM_OCCUPANCY_WORDS];
+    clock_time_t last_observed[TSCH_MTM_OCCUPANCY_SLOTS];
+};
+
+// slots in which direct and two hop neighbors send
+static struct mtm_slot_map slot_occupancy;
+static ranging_addr_t slot_owner[TSCH_MTM_OCCUPANCY_SLOTS];
+#if TSCH_MTM_SLOT_CLAIMS
+// slots in which we received frames and in which our receptions failed, both go out with
+// our frames. claimed and collided are the same maps as reported by our neighbors.
+static struct mtm_slot_map slot_received, slot_failed, slot_claimed, slot_collided;
+static uint32_t rx_claims[2 * TSCH_MTM_OCCUPANCY_WORDS]; // of the last parsed frame
+static uint8_t rx_claims_valid;
+#endif
+
+// timestamps that go out with our next frame, one queue per burst lane
+struct mtm_rx_queue {
+    struct mtm_rx_queue_item items[TSCH_MTM_PROP_MAX_MEASUREMENT];
+    uint8_t len;
+    uint8_t index[MTM_ADDR_SPACE];
+};
+
+static struct mtm_rx_queue rx_send_queue[TSCH_MTM_BURST_LEN];
 
 #if WITH_PASSIVE_TDOA
-MEMB(mtm_pas_tdoa_memb, struct mtm_pas_tdoa, TSCH_MTM_MAX_TDOA_ENTRIES);
+// TDoA entries are found through a triangular index over the positions of the two
+// nodes in neighbor_table, with one such index per burst lane. Entries are additionally
+// kept in a LRU ring, ordered by last_observed, so that the replacement candidate is
+// always found at its head. The entries themselves are shared by all lanes.
+#define MTM_PAIR_INDEX_SIZE ((TSCH_MTM_PROP_MAX_NEIGHBOR_ENTRIES * (TSCH_MTM_PROP_MAX_NEIGHBOR_ENTRIES - 1)) / 2)
+#define MTM_PAIR_NONE UINT16_MAX
+#if TSCH_MTM_BURST_LEN * MTM_PAIR_INDEX_SIZE >= 65535
+#error "TDoA pair index too large, reduce TSCH_MTM_PROP_MAX_NEIGHBOR_ENTRIES or TSCH_MTM_BURST_LEN"
 #endif
 
-static uint64_t most_recent_tx_timestamp;
+static struct mtm_pas_tdoa tdoa_table[TSCH_MTM_MAX_TDOA_ENTRIES];
+static uint8_t tdoa_table_used;
+static uint8_t tdoa_pair_index[TSCH_MTM_BURST_LEN * MTM_PAIR_INDEX_SIZE];
+static uint16_t tdoa_pair[TSCH_MTM_MAX_TDOA_ENTRIES]; // reverse mapping, MTM_PAIR_NONE for free entries
+static uint8_t tdoa_lru_prev[TSCH_MTM_MAX_TDOA_ENTRIES], tdoa_lru_next[TSCH_MTM_MAX_TDOA_ENTRIES];
+static uint8_t tdoa_lru_head, tdoa_lru_tail;
+#endif
+
+static uint64_t most_recent_tx_timestamp[TSCH_MTM_BURST_LEN];
+static uint8_t burst_index; // lane selected by mtm_set_burst_index() or the last parsed frame
+static int16_t rx_clock_offset = MTM_CLOCK_OFFSET_NONE; // set by mtm_set_rx_clock_offset()
+
+#if TSCH_MTM_DEFERRED_PROCESSING
+// A received frame as seen by the slot operation. Everything that changes until
+// TSCH_MTM_PROCESS gets to run (round counter, our own tx timestamp) is copied.
+struct mtm_rx_pending {
+    ranging_addr_t neighbor_addr;
+    uint8_t timeslot;
+    uint8_t burst_index;
+    uint8_t num_rx_timestamps;
+    struct tsch_asn_t asn;
+    uint8_t tsch_channel;
+    uint32_t round;
+    uint64_t own_tx_timestamp;
+    uint64_t rx_timestamp_A;
+    uint64_t tx_timestamp_B;
+    int16_t clock_offset;
+    int32_t carrier_integrator;
+    struct mtm_packet_timestamp rx_timestamps[TSCH_MTM_PROP_MAX_NEIGHBORS];
+#if TSCH_MTM_SLOT_CLAIMS
+    uint8_t has_claims;
+    uint32_t claims[2 * TSCH_MTM_OCCUPANCY_WORDS];
+#endif
+};
+
+// Filled by the slot operation (producer), emptied by TSCH_MTM_PROCESS (consumer)
+static struct ringbufindex mtm_rx_pending_ringbuf;
+static struct mtm_rx_pending mtm_rx_pending_array[TSCH_MTM_RX_PENDING_LEN];
+#endif
 static uint32_t round_counter = 0;
 static uint8_t our_tx_timeslot;
 static uint8_t mtm_round_begin, mtm_round_end;
-uint32_t mtm_successfull_frame_receptions, mtm_sucessfull_rounds, mtm_failed_frame_receptions, mtm_no_frame_detected;
+// used to derive the timeslot of the timestamps in version 2 frames, a slotframe size of 0 disables the wrap around
+static uint16_t mtm_slotframe_size;
+// follows tsch_timing[tsch_ts_timeslot_length], TSCH updates it through mtm_set_slot_length()
+// whenever the timing changes, the default only covers the time before tsch_reset()
+static uint64_t mtm_slot_ticks = MTM_US_TO_DW_TICKS(TSCH_CONF_DEFAULT_TIMESLOT_LENGTH);
 
 static enum MTM_SLOT_END_TYPE slot_end_type;
 
@@ -151,42 +260,81 @@ list_t tsch_prop_get_neighbor_list() {
     return ranging_neighbor_list;
 }
 
+struct mtm_neighbor *tsch_prop_get_neighbor(ranging_addr_t addr) {
+    uint8_t i = neighbor_index[addr];
+    return i == MTM_INDEX_NONE ? NULL : &neighbor_table[i - 1];
+}
+
 #if WITH_PASSIVE_TDOA
 list_t tsch_prop_get_tdoa_list() {
     return pas_tdoa_list;
 }
 #endif
 
+uint8_t mtm_get_rx_queue_len() {
+    return rx_send_queue[burst_index].len;
+}
+
+uint32_t mtm_get_round_counter() {
+    return round_counter;
+}
+
+static void rx_queue_clear(struct mtm_rx_queue *q) {
+    for(uint8_t i = 0; i < q->len; i++) {
+        q->index[q->items[i].neighbor_addr] = MTM_INDEX_NONE;
+    }
+    q->len = 0;
+}
+
 void mtm_reset_rx_queue() {
-    // free all elements in queue
-    struct mtm_rx_queue_item *item;
-    while((item = list_pop(rx_send_queue)) != NULL) {
-        memb_free(&mtm_prop_rx_memb, item);
+    // drop all elements in the queues of all lanes
+    for(uint8_t lane = 0; lane < TSCH_MTM_BURST_LEN; lane++) {
+        rx_queue_clear(&rx_send_queue[lane]);
+        most_recent_tx_timestamp[lane] = UINT64_MAX;
     }
+}
+
+void mtm_set_burst_index(uint8_t index) {
+    if(index < TSCH_MTM_BURST_LEN) {
+        burst_index = index;
+    }
+}
 
-    most_recent_tx_timestamp = UINT64_MAX;
+void mtm_set_rx_clock_offset(int16_t clock_offset) {
+    rx_clock_offset = clock_offset;
 }
 
 void mtm_reset() {
     // clear all tables
     mtm_reset_rx_queue();
+    burst_index = 0;
+
+#if TSCH_MTM_DEFERRED_PROCESSING
+    // drop pending receptions, they refer to the old tables
+    while(ringbufindex_get(&mtm_rx_pending_ringbuf) != -1);
+#endif
 
 #if WITH_PASSIVE_TDOA
-    struct mtm_pas_tdoa *item;
-    while((item = list_pop(pas_tdoa_list)) != NULL) {
-        memb_free(&mtm_pas_tdoa_memb, item);
-    }
+    list_init(pas_tdoa_list);
+    memset(tdoa_pair_index, MTM_INDEX_NONE, sizeof(tdoa_pair_index));
+    tdoa_table_used = 0;
+    tdoa_lru_head = tdoa_lru_tail = MTM_INDEX_NONE;
 #endif
 
-    struct mtm_neighbor *n;
-    while((n = list_pop(ranging_neighbor_list)) != NULL) {
-        memb_free(&mtm_prop_neighbor_memb, n);
-    }
+    list_init(ranging_neighbor_list);
+    memset(neighbor_index, MTM_INDEX_NONE, sizeof(neighbor_index));
+    neighbor_table_used = 0;
+    memset(&slot_occupancy, 0, sizeof(slot_occupancy));
+    memset(slot_owner, 0, sizeof(slot_owner));
+#if TSCH_MTM_SLOT_CLAIMS
+    memset(&slot_received, 0, sizeof(slot_received));
+    memset(&slot_failed, 0, sizeof(slot_failed));
+    memset(&slot_claimed, 0, sizeof(slot_claimed));
+    memset(&slot_collided, 0, sizeof(slot_collided));
+    rx_claims_valid = 0;
+#endif
 
-    mtm_successfull_frame_receptions = 0;
-    mtm_failed_frame_receptions = 0;
-    mtm_no_frame_detected = 0;
-    mtm_sucessfull_rounds = 0;
+    tsch_mtm_stats_reset();
 
 #if WITH_MTM_BUS_BOARDING
     bus_boarding_begin = 0;
@@ -195,7 +343,7 @@ void mtm_reset() {
 
 // protos
 #if WITH_PASSIVE_TDOA
-void print_tdoa_timestamps(struct mtm_pas_tdoa *ts);
+void print_tdoa_timestamps(struct mtm_tdoa_ts *ts);
 #endif
 
 void debug_output_ds_twr_timestamps(struct ds_twr_ts *ts, ranging_addr_t neighbor_addr);
@@ -237,25 +385,25 @@ void init_ds_twr_struct(struct ds_twr_ts *ds) {
 
 #if WITH_PASSIVE_TDOA
 void init_tdoa_struct(struct mtm_pas_tdoa *tdoa) {
-    tdoa->r_l1 = UINT64_MAX;
-    tdoa->r_l2 = UINT64_MAX;
-    tdoa->r_l3 = UINT64_MAX;
-    tdoa->r_l4 = UINT64_MAX;
-    tdoa->closed_round = 0;
-    init_ds_twr_struct(&tdoa->ds_ts);
+    tdoa->ts.r_l1 = UINT64_MAX;
+    tdoa->ts.r_l2 = UINT64_MAX;
+    tdoa->ts.r_l3 = UINT64_MAX;
+    init_ds_twr_struct(&tdoa->ts.ds_ts);
+    tdoa->newest_tx = UINT64_MAX;
+    tdoa->newest_rx_l = UINT64_MAX;
 }
 
 int pas_tdoa_all_initialized(struct mtm_pas_tdoa *tdoa) {
-    if (tdoa->r_l1 == UINT64_MAX) return 0;
-    if (tdoa->r_l2 == UINT64_MAX) return 0;
-    if (tdoa->r_l3 == UINT64_MAX) return 0;
+    if (tdoa->ts.r_l1 == UINT64_MAX) return 0;
+    if (tdoa->ts.r_l2 == UINT64_MAX) return 0;
+    if (tdoa->ts.r_l3 == UINT64_MAX) return 0;
 
-    if (tdoa->ds_ts.t_a1 == UINT64_MAX) return 0;
-    if (tdoa->ds_ts.r_b1 == UINT64_MAX) return 0;
-    if (tdoa->ds_ts.t_b1 == UINT64_MAX) return 0;
-    if (tdoa->ds_ts.r_a1 == UINT64_MAX) return 0;
-    if (tdoa->ds_ts.t_a2 == UINT64_MAX) return 0;
-    if (tdoa->ds_ts.r_b2 == UINT64_MAX) return 0;
+    if (tdoa->ts.ds_ts.t_a1 == UINT64_MAX) return 0;
+    if (tdoa->ts.ds_ts.r_b1 == UINT64_MAX) return 0;
+    if (tdoa->ts.ds_ts.t_b1 == UINT64_MAX) return 0;
+    if (tdoa->ts.ds_ts.r_a1 == UINT64_MAX) return 0;
+    if (tdoa->ts.ds_ts.t_a2 == UINT64_MAX) return 0;
+    if (tdoa->ts.ds_ts.r_b2 == UINT64_MAX) return 0;
 
     return 1;
 }
@@ -270,21 +418,315 @@ void print_mtm_neighbors() {
     }
 }
 
-void mtm_indirect_observed_node(ranging_addr_t neighbor, uint8_t timeslot_offset) {
-    struct mtm_neighbor *n = NULL;
-    for(n = list_head(ranging_neighbor_list); n != NULL; n = list_item_next(n)) {
-        if (n->neighbor_addr == neighbor) {
-            break;
+#if WITH_PASSIVE_TDOA
+// position of the pair (a, b) of the given lane in tdoa_pair_index, a and b are positions in neighbor_table
+static inline uint16_t tdoa_pair_key(uint8_t lane, uint8_t a, uint8_t b) {
+    if(a < b) {
+        uint8_t tmp = a;
+        a = b;
+        b = tmp;
+    }
+    return lane * MTM_PAIR_INDEX_SIZE + ((uint16_t)a * (a - 1)) / 2 + b;
+}
+
+static void tdoa_lru_unlink(uint8_t i) {
+    uint8_t prev = tdoa_lru_prev[i], next = tdoa_lru_next[i];
+
+    if(prev != MTM_INDEX_NONE) {
+        tdoa_lru_next[prev - 1] = next;
+    } else {
+        tdoa_lru_head = next;
+    }
+
+    if(next != MTM_INDEX_NONE) {
+        tdoa_lru_prev[next - 1] = prev;
+    } else {
+        tdoa_lru_tail = prev;
+    }
+}
+
+// insert as least recently observed entry
+static void tdoa_lru_push_head(uint8_t i) {
+    tdoa_lru_prev[i] = MTM_INDEX_NONE;
+    tdoa_lru_next[i] = tdoa_lru_head;
+    if(tdoa_lru_head != MTM_INDEX_NONE) {
+        tdoa_lru_prev[tdoa_lru_head - 1] = i + 1;
+    } else {
+        tdoa_lru_tail = i + 1;
+    }
+    tdoa_lru_head = i + 1;
+}
+
+// insert as most recently observed entry
+static void tdoa_lru_push_tail(uint8_t i) {
+    tdoa_lru_next[i] = MTM_INDEX_NONE;
+    tdoa_lru_prev[i] = tdoa_lru_tail;
+    if(tdoa_lru_tail != MTM_INDEX_NONE) {
+        tdoa_lru_next[tdoa_lru_tail - 1] = i + 1;
+    } else {
+        tdoa_lru_head = i + 1;
+    }
+    tdoa_lru_tail = i + 1;
+}
+
+// to be called whenever last_observed of an entry is updated
+static void tdoa_touch(struct mtm_pas_tdoa *tdoa) {
+    uint8_t i = tdoa - tdoa_table;
+    tdoa_lru_unlink(i);
+    tdoa_lru_push_tail(i);
+}
+
+static void tdoa_free(uint8_t i) {
+    tdoa_pair_index[tdoa_pair[i]] = MTM_INDEX_NONE;
+    tdoa_pair[i] = MTM_PAIR_NONE;
+    list_remove(pas_tdoa_list, &tdoa_table[i]);
+
+    // free entries are reused first
+    tdoa_lru_unlink(i);
+    tdoa_lru_push_head(i);
+}
+
+static struct mtm_pas_tdoa *tdoa_lookup(uint8_t lane, ranging_addr_t a, ranging_addr_t b) {
+    uint8_t ia = neighbor_index[a], ib = neighbor_index[b];
+    uint8_t i;
+
+    if(ia == MTM_INDEX_NONE || ib == MTM_INDEX_NONE || ia == ib) {
+        return NULL;
+    }
+
+    i = tdoa_pair_index[tdoa_pair_key(lane, ia - 1, ib - 1)];
+    return i == MTM_INDEX_NONE ? NULL : &tdoa_table[i - 1];
+}
+
+static struct mtm_pas_tdoa *tdoa_alloc(uint8_t lane, ranging_addr_t a, ranging_addr_t b) {
+    uint8_t ia = neighbor_index[a], ib = neighbor_index[b];
+    uint8_t i;
+
+    // TDoA pairs can only be tracked for nodes present in the neighbor table
+    if(ia == MTM_INDEX_NONE || ib == MTM_INDEX_NONE || ia == ib) {
+        return NULL;
+    }
+
+    if(tdoa_table_used < TSCH_MTM_MAX_TDOA_ENTRIES) {
+        i = tdoa_table_used++;
+        tdoa_lru_push_head(i);
+    } else {
+        i = tdoa_lru_head - 1;
+        if(tdoa_pair[i] != MTM_PAIR_NONE) {
+#if WITH_MTM_TDOA_REPLACE_OLDEST
+            // replace the oldest entry
+#elif WITH_MTM_TDOA_REPLACE_AFTER_TIMEOUT // only replace entries that are older than some threshold T_remove, otherwise keep entries
+            if(clock_time() - tdoa_table[i].last_observed <= CLOCK_SECOND*15) {
+                TSCH_MTM_STATS_INC(tdoa_alloc_failures);
+                return NULL;
+            }
+#endif
+            tdoa_free(i);
+            TSCH_MTM_STATS_INC(tdoa_evictions);
         }
     }
 
+    tdoa_pair[i] = tdoa_pair_key(lane, ia - 1, ib - 1);
+    tdoa_pair_index[tdoa_pair[i]] = i + 1;
+    // the entry stays at the head of the LRU ring until its first round closes
+    tdoa_table[i].last_observed = 0;
+    list_add(pas_tdoa_list, &tdoa_table[i]);
+
+    return &tdoa_table[i];
+}
+
+// Slides the window of the pair by a frame of A (from_b = 0) or B. tx and rx_l are the tx
+// timestamp of the frame and our rx timestamp, rx_other the rx timestamp the sender reported
+// for the newest frame of the other node. A frame that directly follows one of the other node
+// closes the window: the oldest frame of the window is then from the other node, which is
+// the initiator of the estimate. Consecutive estimates share two of their three frames.
+static void tdoa_add_frame(struct mtm_pas_tdoa *tdoa, struct tsch_asn_t *asn, uint8_t tsch_channel, uint8_t lane, uint8_t from_b,
+        uint32_t round, uint8_t timeslot, uint64_t tx, uint64_t rx_l, uint64_t rx_other) {
+    struct mtm_tdoa_ts *ts = &tdoa->ts;
+    struct distance_measurement *m;
+    float td;
+
+    // the frame has to be sent in the next timeslot of the other node after the newest one,
+    // otherwise we or one of the nodes missed a frame and the window starts over
+    if(tdoa->newest_tx == UINT64_MAX || tdoa->newest_from_b == from_b
+        || !(   (timeslot > tdoa->newest_timeslot && round == tdoa->newest_round    )
+             || (timeslot < tdoa->newest_timeslot && round == tdoa->newest_round + 1))) {
+        init_tdoa_struct(tdoa);
+    } else {
+        // the roles of A and B swap with every frame
+        ts->ds_ts.t_a1 = ts->ds_ts.t_b1;
+        ts->ds_ts.r_b1 = ts->ds_ts.r_a1;
+        ts->r_l1 = ts->r_l2;
+
+        ts->ds_ts.t_b1 = ts->ds_ts.t_a2;
+        ts->ds_ts.r_a1 = ts->ds_ts.r_b2;
+        ts->r_l2 = ts->r_l3;
+
+        ts->ds_ts.t_a2 = tdoa->newest_tx;
+        ts->ds_ts.r_b2 = rx_other;
+        ts->r_l3 = tdoa->newest_rx_l;
+    }
+
+    tdoa->newest_tx = tx;
+    tdoa->newest_rx_l = rx_l;
+    tdoa->newest_round = round;
+    tdoa->newest_timeslot = timeslot;
+    tdoa->newest_from_b = from_b;
+
+    if(!pas_tdoa_all_initialized(tdoa)) {
+        return;
+    }
+
+    tdoa->last_observed = clock_time();
+    tdoa_touch(tdoa);
+
+    td = MTM_COMPUTE_TDOA(ts);
+
+    // a window initiated by B gives the TDoA of B against A
+    m = &tdoa->last_measurement[!from_b];
+    m->type = TDOA;
+    m->addr_A = tdoa->A_addr;
+    m->addr_B = tdoa->B_addr;
+    m->time = from_b ? td : -td;
+    m->asn = *asn;
+    m->tsch_channel = tsch_channel;
+    m->burst_index = lane;
+
+    notify_user_process_new_measurement(m);
+}
+#endif
+
+static void init_neighbor(struct mtm_neighbor *n, ranging_addr_t addr) {
+    n->neighbor_addr = addr;
+    n->last_observed_direct = 0;
+    n->last_observed_indirect = 0;
+    n->total_found_ours_counter = 0;
+    n->rx_count = 0;
+    n->first_round = round_counter;
+#if TSCH_MTM_DRIFT_TRACKING
+    mtm_drift_init(n);
+#endif
+    for(uint8_t lane = 0; lane < TSCH_MTM_BURST_LEN; lane++) {
+        init_ds_twr_struct(&n->ts[lane]);
+    }
+    neighbor_index[addr] = (n - neighbor_table) + 1;
+}
+
+static struct mtm_neighbor *neighbor_alloc(ranging_addr_t addr) {
+    struct mtm_neighbor *n;
+
+    if(neighbor_table_used >= TSCH_MTM_PROP_MAX_NEIGHBOR_ENTRIES) {
+        return NULL;
+    }
+
+    n = &neighbor_table[neighbor_table_used++];
+    init_neighbor(n, addr);
+    list_add(ranging_neighbor_list, n);
+
+    return n;
+}
+
+static void slot_map_set(struct mtm_slot_map *m, uint8_t timeslot, clock_time_t now) {
+    uint32_t bits;
+    uint8_t w, t;
+
+    if(timeslot >= TSCH_MTM_OCCUPANCY_SLOTS) {
+        return;
+    }
+    // only the set slots are checked for expiry
+    for(w = 0; w < TSCH_MTM_OCCUPANCY_WORDS; w++) {
+        for(bits = m->bits[w]; bits != 0; bits &= bits - 1) {
+            t = w * 32 + __builtin_ctz(bits);
+            if(now - m->last_observed[t] >= TSCH_MTM_OCCUPANCY_TIMEOUT) {
+                m->bits[w] &= ~((uint32_t)1 << (t % 32));
+            }
+        }
+    }
+    m->last_observed[timeslot] = now;
+    m->bits[timeslot / 32] |= (uint32_t)1 << (timeslot % 32);
+}
+
+static void slot_map_get(const struct mtm_slot_map *m, uint32_t *bitmap) {
+    clock_time_t now = clock_time();
+    uint32_t bits;
+    uint8_t w, t;
+
+    for(w = 0; w < TSCH_MTM_OCCUPANCY_WORDS; w++) {
+        bitmap[w] = m->bits[w];
+        for(bits = bitmap[w]; bits != 0; bits &= bits - 1) {
+            t = w * 32 + __builtin_ctz(bits);
+            if(now - m->last_observed[t] >= TSCH_MTM_OCCUPANCY_TIMEOUT) {
+                bitmap[w] &= ~((uint32_t)1 << (t % 32));
+            }
+        }
+    }
+}
+
+static void slot_observed(uint8_t timeslot, ranging_addr_t node) {
+    if(timeslot < TSCH_MTM_OCCUPANCY_SLOTS) {
+        slot_map_set(&slot_occupancy, timeslot, clock_time());
+        slot_owner[timeslot] = node;
+    }
+}
+
+void tsch_prop_get_slot_occupancy(uint32_t *bitmap) {
+    slot_map_get(&slot_occupancy, bitmap);
+}
+
+ranging_addr_t tsch_prop_get_slot_owner(uint8_t timeslot) {
+    uint32_t occupied[TSCH_MTM_OCCUPANCY_WORDS];
+
+    if(timeslot >= TSCH_MTM_OCCUPANCY_SLOTS) {
+        return 0;
+    }
+    slot_map_get(&slot_occupancy, occupied);
+    return (occupied[timeslot / 32] >> (timeslot % 32)) & 1 ? slot_owner[timeslot] : 0;
+}
+
+void mtm_failed_reception(uint8_t timeslot) {
+#if TSCH_MTM_SLOT_CLAIMS
+    slot_map_set(&slot_failed, timeslot, clock_time());
+#endif
+}
+
+#if TSCH_MTM_SLOT_CLAIMS
+// claims holds the received and the failed slots of a neighbor
+static void mtm_claims_observed(const uint32_t *claims) {
+    clock_time_t now = clock_time();
+    uint32_t bits;
+    uint8_t w;
+
+    for(w = 0; w < TSCH_MTM_OCCUPANCY_WORDS; w++) {
+        for(bits = claims[w]; bits != 0; bits &= bits - 1) {
+            slot_map_set(&slot_claimed, w * 32 + __builtin_ctz(bits), now);
+        }
+        for(bits = claims[TSCH_MTM_OCCUPANCY_WORDS + w]; bits != 0; bits &= bits - 1) {
+            slot_map_set(&slot_collided, w * 32 + __builtin_ctz(bits), now);
+        }
+    }
+}
+
+void tsch_prop_get_slot_claims(uint32_t *claimed, uint32_t *collided) {
+    uint32_t failed[TSCH_MTM_OCCUPANCY_WORDS];
+    uint8_t w;
+
+    slot_map_get(&slot_claimed, claimed);
+    slot_map_get(&slot_collided, collided);
+    slot_map_get(&slot_failed, failed);
+    for(w = 0; w < TSCH_MTM_OCCUPANCY_WORDS; w++) {
+        collided[w] |= failed[w];
+    }
+}
+#endif
+
+void mtm_indirect_observed_node(ranging_addr_t neighbor, uint8_t timeslot_offset) {
+    struct mtm_neighbor *n = tsch_prop_get_neighbor(neighbor);
+
     if (n == NULL) {
         // create new neighbor
-        n = memb_alloc(&mtm_prop_neighbor_memb);
+        n = neighbor_alloc(neighbor);
         if (n != NULL) {
-            n->neighbor_addr = neighbor;
             n->type = MTM_TWO_HOP_NEIGHBOR;
-            list_add(ranging_neighbor_list, n);
         }
     }
 
@@ -292,63 +734,56 @@ void mtm_indirect_observed_node(ranging_addr_t neighbor, uint8_t timeslot_offset
         n->last_observed_indirect = clock_time();
         n->observed_timeslot = timeslot_offset;
     }
+    slot_observed(timeslot_offset, neighbor);
 }
 
 void mtm_direct_observed_node(ranging_addr_t node, uint8_t timeslot_offset) {
     /* printf("mtm_direct_observed_node: %d, %d\n", node, timeslot_offset); */
-  // we don't pass this outside so we will just add it here for now
-  // iterate over neighbor table
-  struct mtm_neighbor *n = NULL;
-  for(n = list_head(ranging_neighbor_list); n != NULL; n = list_item_next(n)) {
-      if (n->neighbor_addr == node) {
-          break;
-      }
-  }
+  struct mtm_neighbor *n = tsch_prop_get_neighbor(node);
 
   if(n == NULL) {
         // create new neighbor
-      n = memb_alloc(&mtm_prop_neighbor_memb);
-      if (n != NULL) {
-          list_add(ranging_neighbor_list, n);
-      } else {
-          // in this case we don't have any more memory, so we replace the oldest existing entry
-          struct mtm_neighbor *oldest = NULL;
-          struct mtm_neighbor *curr = NULL;
-          for(curr = list_head(ranging_neighbor_list); curr != NULL; curr = list_item_next(curr)) {
-              if (oldest == NULL) {
-                  oldest = curr;
-              } else {
-                  if (curr->last_observed_direct < oldest->last_observed_direct) {
-                      oldest = curr;
-                  }
+      n = neighbor_alloc(node);
+      if (n == NULL) {
+          // in this case we don't have any more memory, so we replace the oldest existing entry.
+          // This only happens when a new node shows up while the table is full.
+          struct mtm_neighbor *oldest = &neighbor_table[0];
+          for(uint8_t i = 1; i < TSCH_MTM_PROP_MAX_NEIGHBOR_ENTRIES; i++) {
+              if (neighbor_table[i].last_observed_direct < oldest->last_observed_direct) {
+                  oldest = &neighbor_table[i];
               }
           }
 
           // remove all pass tdoa entries with n as address
 #if WITH_PASSIVE_TDOA
-          struct mtm_pas_tdoa *tdoa = NULL;
-            for(tdoa = list_head(pas_tdoa_list); tdoa != NULL; tdoa = list_item_next(tdoa)) {
-                if (tdoa->A_addr == oldest->neighbor_addr || tdoa->B_addr == oldest->neighbor_addr) {
-                    list_remove(pas_tdoa_list, tdoa);
-                    memb_free(&mtm_pas_tdoa_memb, tdoa);
-                }
-            }
+          uint8_t pos = oldest - neighbor_table;
+          for(uint8_t lane = 0; lane < TSCH_MTM_BURST_LEN; lane++) {
+              for(uint8_t i = 0; i < TSCH_MTM_PROP_MAX_NEIGHBOR_ENTRIES; i++) {
+                  uint8_t t;
+                  if(i != pos && (t = tdoa_pair_index[tdoa_pair_key(lane, pos, i)]) != MTM_INDEX_NONE) {
+                      tdoa_free(t - 1);
+                  }
+              }
+          }
 #endif
 
+          neighbor_index[oldest->neighbor_addr] = MTM_INDEX_NONE;
+          TSCH_MTM_STATS_INC(neighbor_evictions);
           n = oldest;
+          init_neighbor(n, node);
       }
-
-      n->total_found_ours_counter = 0;
-      init_ds_twr_struct(&n->ts);
   }
 
   if (n != NULL) {
       // set neighbor type to direct neighbor
-      n->neighbor_addr = node;
       n->type = MTM_DIRECT_NEIGHBOR;
       n->observed_timeslot = timeslot_offset;
       n->last_observed_direct = clock_time();
   }
+  slot_observed(timeslot_offset, node);
+#if TSCH_MTM_SLOT_CLAIMS
+  slot_map_set(&slot_received, timeslot_offset, clock_time());
+#endif
 }
 
 // Our implementation assumes there is just one ranging round per slotframe. Therefore
@@ -398,6 +833,24 @@ void mtm_set_round_slots(uint8_t timeslot_begin, uint8_t timeslot_end) {
     mtm_round_begin = timeslot_begin;
     mtm_round_end = timeslot_end;
     round_counter = 0;
+#if MTM_EVAL_OUTPUT_FRAMES
+    printf("mtms, %u, %u\n", timeslot_begin, timeslot_end);
+#endif
+}
+
+// Version 2 frames do not carry the timeslot of a reception. The receiver derives it from
+// the distance between the reception and the transmission of the frame, which only works
+// if all nodes agree on the slot duration.
+void mtm_set_slot_timing(uint16_t slotframe_size, uint32_t timeslot_length_us) {
+    mtm_slotframe_size = slotframe_size;
+    mtm_set_slot_length(timeslot_length_us);
+}
+
+void mtm_set_slot_length(uint32_t timeslot_length_us) {
+    mtm_slot_ticks = MTM_US_TO_DW_TICKS(timeslot_length_us);
+#if MTM_EVAL_OUTPUT_FRAMES
+    printf("mtmf, %u, %lu\n", mtm_slotframe_size, (unsigned long)timeslot_length_us);
+#endif
 }
 
 
@@ -410,67 +863,54 @@ void add_to_direct_observed_rx_to_queue(uint64_t rx_timestamp, uint8_t neighbor,
     }
 #endif
 
+    struct mtm_rx_queue *q = &rx_send_queue[burst_index];
     struct mtm_rx_queue_item *t = NULL;
 
-    if (list_length (rx_send_queue) > TSCH_MTM_PROP_MAX_MEASUREMENT) {
-        _PRINTF("MTM: RX queue full, dropping received timestamp\n");
-
-        while(list_length(rx_send_queue) > TSCH_MTM_PROP_MAX_MEASUREMENT) {
-            t = list_pop(rx_send_queue);
-            memb_free(&mtm_prop_rx_memb, t);
-        }
-    }
-
     // since we are space constrained if there is already a timestamp for the neighbor, we will replace that entry in our queue
-    for(t = list_head(rx_send_queue); t != NULL; t = list_item_next(t)) {
-        if (t->neighbor_addr == neighbor) {
-            break;
-        }
-    }
-
-    if (t != NULL) {
-        // replace entry
-        t->rx_timestamp = rx_timestamp;
-        t->neighbor_addr = neighbor;
-        t->timeslot_offset = timeslot_offset;
+    if (q->index[neighbor] != MTM_INDEX_NONE) {
+        t = &q->items[q->index[neighbor] - 1];
+    } else if (q->len < TSCH_MTM_PROP_MAX_MEASUREMENT) {
+        t = &q->items[q->len++];
+        q->index[neighbor] = q->len;
     } else {
-        t = memb_alloc(&mtm_prop_rx_memb);
-
-        if (t != NULL) {
-            t->rx_timestamp = rx_timestamp;
-            t->neighbor_addr = neighbor;
-            t->timeslot_offset = timeslot_offset;
-            list_add(rx_send_queue, t);
-        } else {
-            _PRINTF("MTM: Could not allocate memory for reception timestamp\n");
+        _PRINTF("MTM: RX queue full, dropping received timestamp\n");
+        TSCH_MTM_STATS_INC(rx_queue_drops);
 
-            return;
-        }
+        return;
     }
+
+    t->rx_timestamp = rx_timestamp;
+    t->neighbor_addr = neighbor;
+    t->timeslot_offset = timeslot_offset;
 }
 
-void add_mtm_reception_timestamp(
+static void mtm_handle_reception(
     ranging_addr_t neighbor_addr,
     struct tsch_asn_t *asn, // TODO not used yet
+    uint8_t tsch_channel,       // channel the frame was received on
     uint8_t timeslot,
+    uint8_t lane,               // burst lane of the frame
+    uint32_t round,             // round counter at the time of the reception
+    uint64_t own_tx_timestamp,  // our most recent tx timestamp at the time of the reception
     uint64_t rx_timestamp_A,
     uint64_t tx_timestamp_B,
-    struct mtm_packet_timestamp *rx_timestamps,
+    int16_t clock_offset,       // carrier clock offset of the frame or MTM_CLOCK_OFFSET_NONE
+    int32_t carrier_integrator, // carrier integrator of the frame, see dwt_readcarrierintegrator()
+    const struct mtm_packet_timestamp *rx_timestamps,
     uint8_t num_rx_timestamps
     )
 {
     // next update our neighbor table
-    struct mtm_neighbor *n = NULL;
-    for(n = list_head(ranging_neighbor_list); n != NULL; n = list_item_next(n)) {
-        if (n->neighbor_addr == neighbor_addr) {
-            break;
-        }
-    }
+    struct mtm_neighbor *n = tsch_prop_get_neighbor(neighbor_addr);
 
     // will usually not happen
     if( n == NULL ) {
         return;
     }
+    n->rx_count++;
+#if TSCH_MTM_DRIFT_TRACKING
+    mtm_drift_update(n, tx_timestamp_B, rx_timestamp_A, clock_offset);
+#endif
 
 #if WITH_PASSIVE_TDOA
     // if passive tdoa is enabled we will update the passive tdoa structure for all neighbors in the message
@@ -494,53 +934,13 @@ void add_mtm_reception_timestamp(
             continue;
         }
 
-        struct mtm_pas_tdoa *pas_tdoa = NULL;
-
-        // search for a pair with rx_addr and m_addr in the pas_tdoa_list
-        for(pas_tdoa = list_head(pas_tdoa_list);
-            pas_tdoa != NULL; pas_tdoa = list_item_next(pas_tdoa)) {
-            if ((pas_tdoa->B_addr == rx_addr && pas_tdoa->A_addr == m_addr) ||
-                (pas_tdoa->A_addr == rx_addr && pas_tdoa->B_addr == m_addr)) {
-                break;
-            }
-        }
+        // search for a pair with rx_addr and m_addr
+        struct mtm_pas_tdoa *pas_tdoa = tdoa_lookup(lane, rx_addr, m_addr);
 
         if(pas_tdoa == NULL) {
             _PRINTF("MTM: No pas_tdoa found for %u and %u, create new entry\n", rx_addr, m_addr);
-            // create a new entry
-            pas_tdoa = memb_alloc(&mtm_pas_tdoa_memb);
-            if (pas_tdoa != NULL) {
-                list_add(pas_tdoa_list, pas_tdoa);
-            }
-#if WITH_MTM_TDOA_REPLACE_OLDEST
-            else {
-                // else we replace the oldest entry
-
-                struct mtm_pas_tdoa *oldest = NULL;
-                struct mtm_pas_tdoa *curr = NULL;
-                for(curr = list_head(pas_tdoa_list); curr != NULL; curr = list_item_next(curr)) {
-                    if (oldest == NULL) {
-                        oldest = curr;
-                    } else {
-                        if (curr->last_observed < oldest->last_observed) {
-                            oldest = curr;
-                        }
-                    }
-                }
-
-                pas_tdoa = oldest;
-            }
-#elif WITH_MTM_TDOA_REPLACE_AFTER_TIMEOUT // only replace entries that are older than some threshold T_remove, otherwise keep entries
-            else {
-                clock_time_t now = clock_time();
-                struct mtm_pas_tdoa *curr = NULL;
-                for(curr = list_head(pas_tdoa_list); curr != NULL; curr = list_item_next(curr)) {
-                    if(now - curr->last_observed > CLOCK_SECOND*15) {
-                        pas_tdoa = curr;
-                    }
-                }
-            }
-#endif
+            // create a new entry, possibly replacing an old one
+            pas_tdoa = tdoa_alloc(lane, rx_addr, m_addr);
             if(pas_tdoa != NULL) {
                 pas_tdoa->B_addr = rx_addr;
                 pas_tdoa->A_addr = m_addr;
@@ -549,89 +949,9 @@ void add_mtm_reception_timestamp(
         }
 
 
-        // here we do the handling in case we found A in the list as initator
         if(pas_tdoa != NULL) {
-            if (pas_tdoa->A_addr == m_addr) {
-                pas_tdoa->most_recent_tx_A = tx_timestamp_B;
-                pas_tdoa->rx_round_counter_L1 = round_counter;
-                pas_tdoa->rx_timeslot_L1 = timeslot;
-                pas_tdoa->rx_timestamp_L1 = rx_timestamp_A;
-
-                // check whether the other round concluded
-                if (   (timeslot > pas_tdoa->rx_timeslot_L2 && round_counter == pas_tdoa->rx_round_counter_L2    )
-                    || (timeslot < pas_tdoa->rx_timeslot_L2 && round_counter == pas_tdoa->rx_round_counter_L2 + 1)) {
-
-                    pas_tdoa->r_l4 = pas_tdoa->rx_timestamp_L2;
-                    pas_tdoa->ds_ts.t_b2 = pas_tdoa->most_recent_tx_B;
-                    pas_tdoa->ds_ts.r_a2 = rx_timestamp;
-
-                    // TODO we could in theory make another new distance estimation here, but we need to rewrite mtm_compute_tdoa
-                    // so the timestamps for calculation are passed from outside
-
-                    // push back the two rounds
-                    pas_tdoa->r_l1 = pas_tdoa->r_l3;
-                    pas_tdoa->r_l2 = pas_tdoa->r_l4;
-
-                    pas_tdoa->ds_ts.t_b1 = pas_tdoa->ds_ts.t_b2;
-                    pas_tdoa->ds_ts.t_a1 = pas_tdoa->ds_ts.t_a2;
-
-                    pas_tdoa->ds_ts.r_b1 = pas_tdoa->ds_ts.r_b2;
-                    pas_tdoa->ds_ts.r_a1 = pas_tdoa->ds_ts.r_a2;
-
-                    // mark moved uninitialized
-                    pas_tdoa->r_l3 = UINT64_MAX;
-                    pas_tdoa->r_l4 = UINT64_MAX;
-                    pas_tdoa->ds_ts.t_b2 = UINT64_MAX;
-                    pas_tdoa->ds_ts.t_a2 = UINT64_MAX;
-                    pas_tdoa->ds_ts.r_b2 = UINT64_MAX;
-                    pas_tdoa->ds_ts.r_a2 = UINT64_MAX;
-
-                    pas_tdoa->closed_round = 0;
-                }
-            } else if (pas_tdoa->B_addr == m_addr) {
-                pas_tdoa->most_recent_tx_B = tx_timestamp_B;
-                pas_tdoa->rx_round_counter_L2 = round_counter;
-                pas_tdoa->rx_timeslot_L2 = timeslot;
-                pas_tdoa->rx_timestamp_L2 = rx_timestamp_A;
-
-                // check whether the round and timeslot is as expected. In case that timeslot >
-                // rx_timeslot, we expect to be in the same round otherwise our round should be atmost
-                // rx_timeslot + 1
-
-                if (!pas_tdoa->closed_round && (  (timeslot > pas_tdoa->rx_timeslot_L1 && round_counter == pas_tdoa->rx_round_counter_L1    )
-                        || (timeslot < pas_tdoa->rx_timeslot_L1 && round_counter == pas_tdoa->rx_round_counter_L1 + 1))) {
-                    // Success! The round closes succesfully.
-                    pas_tdoa->r_l3 = pas_tdoa->rx_timestamp_L1;
-                    pas_tdoa->ds_ts.t_a2 = pas_tdoa->most_recent_tx_A;
-                    pas_tdoa->ds_ts.r_b2 = rx_timestamp;
-
-                    pas_tdoa->closed_round = 1; // we only want good rounds
-
-                    pas_tdoa->last_observed = clock_time();
-
-                    if(pas_tdoa_all_initialized(pas_tdoa)) {
-                        // this message closes the round
-                        float tdoa;
-
-                        tdoa = mtm_compute_tdoa(pas_tdoa);
-
-                        // update stored most recent measurement and notify user
-                        pas_tdoa->last_measurement.type = TDOA;
-                        pas_tdoa->last_measurement.addr_A = rx_addr;
-                        pas_tdoa->last_measurement.addr_B = m_addr;
-                        pas_tdoa->last_measurement.time = tdoa;
-                        pas_tdoa->last_measurement.asn = *asn;
-
-                        /* #define ERROR_MARGIN 5 */
-                        /* if (time_to_dist(tdoa) < -ERROR_MARGIN || time_to_dist(tdoa) > ERROR_MARGIN) { */
-                        /*     print_tdoa_timestamps(pas_tdoa); */
-                        /* } */
-
-
-                        notify_user_process_new_measurement(&pas_tdoa->last_measurement);
-                    }
-                }
-            }
+            tdoa_add_frame(pas_tdoa, asn, tsch_channel, lane, pas_tdoa->B_addr == m_addr, round, timeslot,
+                    tx_timestamp_B, rx_timestamp_A, rx_timestamp);
         }
     }
 
@@ -642,32 +962,127 @@ void add_mtm_reception_timestamp(
     for(uint8_t i = 0; i < num_rx_timestamps; i++) {
         if(rx_timestamps[i].addr == linkaddr_node_addr.u8[LINKADDR_SIZE - 1]) {
                 uint64_t rx_timestamp_B = rx_timestamps[i].rx_timestamp;
+                struct ds_twr_ts *ts = &n->ts[lane];
                 // we got a return timestamp, so insert new round into our management structure
                 // shift old most recent round to the back
-                n->ts.t_a1 = n->ts.t_a2;
-                n->ts.r_b1 = n->ts.r_b2;
-                n->ts.t_b1 = n->ts.t_b2;
-                n->ts.r_a1 = n->ts.r_a2;
+                ts->t_a1 = ts->t_a2;
+                ts->r_b1 = ts->r_b2;
+                ts->t_b1 = ts->t_b2;
+                ts->r_a1 = ts->r_a2;
 
                 // insert new round that just concluded
-                n->ts.t_a2 = most_recent_tx_timestamp;
-                n->ts.r_b2 = rx_timestamp_B;
-                n->ts.t_b2 = tx_timestamp_B;
-                n->ts.r_a2 = rx_timestamp_A;
-
-                mtm_compute_dstwr(asn, n);
+                ts->t_a2 = own_tx_timestamp;
+                ts->r_b2 = rx_timestamp_B;
+                ts->t_b2 = tx_timestamp_B;
+                ts->r_a2 = rx_timestamp_A;
+
+#if TSCH_MTM_HALF_ROUND_TWR
+                if(n->drift_source == MTM_DRIFT_TIMESTAMPS) {
+                    mtm_compute_half_round_twr(asn, tsch_channel, carrier_integrator, n, lane);
+                } else
+#endif
+                mtm_compute_dstwr(asn, tsch_channel, carrier_integrator, n, lane);
                 found_rx = 1;
                 n->total_found_ours_counter++; // yippie
-                mtm_sucessfull_rounds++;
+                TSCH_MTM_STATS_INC(rounds);
+        }
+    }
+}
+
+void add_mtm_reception_timestamp(
+    ranging_addr_t neighbor_addr,
+    struct tsch_asn_t *asn,
+    uint8_t tsch_channel,
+    uint8_t timeslot,
+    uint64_t rx_timestamp_A,
+    uint64_t tx_timestamp_B,
+    struct mtm_packet_timestamp *rx_timestamps,
+    uint8_t num_rx_timestamps
+    )
+{
+    int16_t clock_offset = rx_clock_offset;
+    // read while the radio still holds the frame, the TWR result is computed later
+    int32_t carrier_integrator = dwt_readcarrierintegrator();
+#if TSCH_MTM_DEFERRED_PROCESSING
+    int16_t pending_index = ringbufindex_peek_put(&mtm_rx_pending_ringbuf);
+    struct mtm_rx_pending *p;
+#endif
+
+    rx_clock_offset = MTM_CLOCK_OFFSET_NONE;
+
+#if TSCH_MTM_DEFERRED_PROCESSING
+    if(pending_index == -1) {
+        _PRINTF("MTM: pending queue full, dropping reception\n");
+        TSCH_MTM_STATS_INC(pending_drops);
+        return;
+    }
+
+    p = &mtm_rx_pending_array[pending_index];
+    p->neighbor_addr = neighbor_addr;
+    p->timeslot = timeslot;
+    p->burst_index = burst_index;
+    p->num_rx_timestamps = num_rx_timestamps;
+    p->asn = *asn;
+    p->tsch_channel = tsch_channel;
+    p->round = round_counter;
+    p->own_tx_timestamp = most_recent_tx_timestamp[burst_index];
+    p->rx_timestamp_A = rx_timestamp_A;
+    p->tx_timestamp_B = tx_timestamp_B;
+    p->clock_offset = clock_offset;
+    p->carrier_integrator = carrier_integrator;
+    memcpy(p->rx_timestamps, rx_timestamps, num_rx_timestamps * sizeof(struct mtm_packet_timestamp));
+#if TSCH_MTM_SLOT_CLAIMS
+    p->has_claims = rx_claims_valid;
+    memcpy(p->claims, rx_claims, sizeof(rx_claims));
+    rx_claims_valid = 0;
+#endif
+
+    ringbufindex_put(&mtm_rx_pending_ringbuf);
+    process_poll(&TSCH_MTM_PROCESS);
+#else
+    rtimer_clock_t start = RTIMER_NOW();
+    mtm_handle_reception(neighbor_addr, asn, tsch_channel, timeslot, burst_index, round_counter, most_recent_tx_timestamp[burst_index],
+            rx_timestamp_A, tx_timestamp_B, clock_offset, carrier_integrator, rx_timestamps, num_rx_timestamps);
+    tsch_mtm_stats_record_processing(start, RTIMER_NOW());
+#endif
+}
+
+#if TSCH_MTM_DEFERRED_PROCESSING
+void tsch_mtm_process_pending() {
+    int16_t pending_index;
+
+    while((pending_index = ringbufindex_peek_get(&mtm_rx_pending_ringbuf)) != -1) {
+        struct mtm_rx_pending *p = &mtm_rx_pending_array[pending_index];
+        rtimer_clock_t start = RTIMER_NOW();
+
+        // neighbor bookkeeping is done here instead of during parsing, so that the
+        // neighbor and TDoA tables are only ever modified outside of the slot operation
+        mtm_direct_observed_node(p->neighbor_addr, p->timeslot);
+        for(uint8_t i = 0; i < p->num_rx_timestamps; i++) {
+            if(p->rx_timestamps[i].addr != linkaddr_node_addr.u8[LINKADDR_SIZE-1]) {
+                mtm_indirect_observed_node(p->rx_timestamps[i].addr, p->rx_timestamps[i].timeslot_offset);
+            }
         }
+#if TSCH_MTM_SLOT_CLAIMS
+        if(p->has_claims) {
+            mtm_claims_observed(p->claims);
+        }
+#endif
+
+        mtm_handle_reception(p->neighbor_addr, &p->asn, p->tsch_channel, p->timeslot, p->burst_index, p->round, p->own_tx_timestamp,
+                p->rx_timestamp_A, p->tx_timestamp_B, p->clock_offset, p->carrier_integrator, p->rx_timestamps, p->num_rx_timestamps);
+        tsch_mtm_stats_record_processing(start, RTIMER_NOW());
+
+        ringbufindex_get(&mtm_rx_pending_ringbuf);
     }
 }
+#endif
 
 void add_mtm_transmission_timestamp(struct tsch_asn_t *asn, uint64_t tx_timestamp) {
     // Update mtm_neighbor list after our own transmission event
     struct mtm_neighbor *n = NULL;
 
-    most_recent_tx_timestamp = tx_timestamp;
+    most_recent_tx_timestamp[burst_index] = tx_timestamp;
 }
 
 void print_ds_twr_durations(struct ds_twr_ts *ts) {
@@ -703,7 +1118,7 @@ void debug_output_ds_twr_timestamps(struct ds_twr_ts *ts, ranging_addr_t neighbo
 
 
 // WARNING might run into timing problems when using standard serial output. Use RTT if available.
-void print_tdoa_timestamps(struct mtm_pas_tdoa *ts) {
+void print_tdoa_timestamps(struct mtm_tdoa_ts *ts) {
 #if WITH_PASSIVE_TDOA
     printf("tdoa, ");
     // Assuming the format of printing the timestamps is similar to the debug_output_ds_twr_timestamps function
@@ -724,6 +1139,16 @@ void print_tdoa_timestamps(struct mtm_pas_tdoa *ts) {
 }
 
 void notify_user_process_new_measurement(struct distance_measurement *measurement) {
+  if(measurement->type == TWR) {
+    TSCH_MTM_STATS_INC(twr_measurements);
+  } else {
+    TSCH_MTM_STATS_INC(tdoa_measurements);
+  }
+
+#ifdef TSCH_CALLBACK_MTM_MEASUREMENT
+  TSCH_CALLBACK_MTM_MEASUREMENT(measurement);
+#endif
+
   /* Send the PROCESS_EVENT_MSG event asynchronously to
   "tsch_loc_operation", with a pointer to the tsch_neighbor. */
   process_post(&TSCH_PROP_PROCESS,
@@ -765,7 +1190,22 @@ uint8_t bus_boarding_timeslot_active(uint8_t timeslot) {
 
 #endif
 
-void mtm_compute_dstwr(struct tsch_asn_t *asn, struct mtm_neighbor *mtm_n) {
+// stores a TWR result towards mtm_n in m and passes it to the user process
+static void mtm_twr_measurement(struct tsch_asn_t *asn, uint8_t tsch_channel, int32_t carrier_integrator, struct mtm_neighbor *mtm_n, uint8_t lane,
+        struct distance_measurement *m, float prop_time) {
+    m->type = TWR;
+    m->addr_A = linkaddr_node_addr.u8[LINKADDR_SIZE-1];
+    m->addr_B = mtm_n->neighbor_addr;
+    m->time = prop_time;
+    m->freq_offset = carrier_integrator;
+    m->asn = *asn;
+    m->tsch_channel = tsch_channel;
+    m->burst_index = lane;
+
+    notify_user_process_new_measurement(m);
+}
+
+void mtm_compute_dstwr(struct tsch_asn_t *asn, uint8_t tsch_channel, int32_t carrier_integrator, struct mtm_neighbor *mtm_n, uint8_t lane) {
     // first check whether neighbor has a valid entry in our list and none of the timestamps are uninitialized, i.e., of value UINT64_MAX;
 
     if (mtm_n == NULL) {
@@ -773,10 +1213,10 @@ void mtm_compute_dstwr(struct tsch_asn_t *asn, struct mtm_neighbor *mtm_n) {
         return;
     }
 
-    if (mtm_n->ts.t_a1 == UINT64_MAX || mtm_n->ts.r_b1 == UINT64_MAX
-        || mtm_n->ts.t_b1 == UINT64_MAX || mtm_n->ts.r_a1 == UINT64_MAX
-        || mtm_n->ts.t_a2 == UINT64_MAX || mtm_n->ts.r_b2 == UINT64_MAX
-        || mtm_n->ts.t_b2 == UINT64_MAX || mtm_n->ts.r_a2 == UINT64_MAX
+    if (mtm_n->ts[lane].t_a1 == UINT64_MAX || mtm_n->ts[lane].r_b1 == UINT64_MAX
+        || mtm_n->ts[lane].t_b1 == UINT64_MAX || mtm_n->ts[lane].r_a1 == UINT64_MAX
+        || mtm_n->ts[lane].t_a2 == UINT64_MAX || mtm_n->ts[lane].r_b2 == UINT64_MAX
+        || mtm_n->ts[lane].t_b2 == UINT64_MAX || mtm_n->ts[lane].r_a2 == UINT64_MAX
         ) {
         _PRINTF("MTM: Neighbor has uninitialized timestamps\n");
 
@@ -784,12 +1224,11 @@ void mtm_compute_dstwr(struct tsch_asn_t *asn, struct mtm_neighbor *mtm_n) {
     }
 
     /* int32_t prop_time  = compute_prop_time(initiator_roundtrip, initiator_reply, replier_roundtrip, replier_reply); */
-    float prop_time  = calculate_propagation_time_alternative(&(mtm_n->ts));
-    /* float prop_time  = (float) correctedExpression(&(mtm_n->ts)); */
-    int32_t carrier_integrator = dwt_readcarrierintegrator();
+    float prop_time  = MTM_PROPAGATION_TIME(&(mtm_n->ts[lane]));
+    /* float prop_time  = (float) correctedExpression(&(mtm_n->ts[lane])); */
 
 #if MTM_EVAL_OUTPUT_TS
-    debug_output_ds_twr_timestamps(&mtm_n->ts, mtm_n->neighbor_addr);
+    debug_output_ds_twr_timestamps(&mtm_n->ts[lane], mtm_n->neighbor_addr);
 #endif
 
     // bias correction in centimeters
@@ -799,15 +1238,43 @@ void mtm_compute_dstwr(struct tsch_asn_t *asn, struct mtm_neighbor *mtm_n) {
     // call into existing methods for passing data to user
 
     // update stored measurement for node
-    mtm_n->last_measurement.type = TWR;
-    mtm_n->last_measurement.addr_A = linkaddr_node_addr.u8[LINKADDR_SIZE-1];
-    mtm_n->last_measurement.addr_B = mtm_n->neighbor_addr;
-    mtm_n->last_measurement.time = prop_time;
-    mtm_n->last_measurement.freq_offset = carrier_integrator;
-    mtm_n->last_measurement.asn = *asn;
+    mtm_twr_measurement(asn, tsch_channel, carrier_integrator, mtm_n, lane, &mtm_n->last_measurement[lane], prop_time);
+}
 
-    notify_user_process_new_measurement(&mtm_n->last_measurement);
+#if TSCH_MTM_HALF_ROUND_TWR
+// Single sided TWR for both half rounds of the newest exchange, the clock drift comes from
+// the tracked estimate of the neighbor instead of the previous exchange:
+//   we initiated:     t_a2 -> r_b2, t_b2 -> r_a2   2 ToF = R_a - D_b * (1 + drift)
+//   it initiated:     t_b1 -> r_a1, t_a2 -> r_b2   2 ToF = R_b * (1 + drift) - D_a
+// drift is (our clock - its clock) / its clock, so (1 + drift) converts its ticks into ours.
+static void mtm_compute_half_round_twr(struct tsch_asn_t *asn, uint8_t tsch_channel, int32_t carrier_integrator, struct mtm_neighbor *mtm_n, uint8_t lane) {
+    const int64_t max_reply = MTM_US_TO_DW_TICKS(TSCH_MTM_HALF_ROUND_MAX_REPLY_US);
+    struct ds_twr_ts *ts = &mtm_n->ts[lane];
+    int64_t round, reply;
+
+    if(ts->t_a2 == UINT64_MAX) {
+        return;
+    }
+
+    round = interval_correct_overflow(ts->r_a2, ts->t_a2);
+    reply = interval_correct_overflow(ts->t_b2, ts->r_b2);
+    if(reply <= max_reply) {
+        mtm_twr_measurement(asn, tsch_channel, carrier_integrator, mtm_n, lane, &mtm_n->last_measurement[lane],
+                ((float) (round - reply - mtm_drift_mul_q(mtm_n->drift_q, reply))) * 0.5);
+    }
+
+    if(ts->t_b1 == UINT64_MAX || ts->r_a1 == UINT64_MAX) {
+        return;
+    }
+
+    round = interval_correct_overflow(ts->r_b2, ts->t_b1);
+    reply = interval_correct_overflow(ts->t_a2, ts->r_a1);
+    if(reply <= max_reply) {
+        mtm_twr_measurement(asn, tsch_channel, carrier_integrator, mtm_n, lane, &mtm_n->last_half_measurement[lane],
+                ((float) (round + mtm_drift_mul_q(mtm_n->drift_q, round) - reply)) * 0.5);
+    }
 }
+#endif
 
 
 void packet_buf_copy_timestamp(uint64_t timestamp, uint8_t *buffer) {
@@ -830,6 +1297,298 @@ void packet_buf_extract_timestamp(uint64_t *timestamp, uint8_t *buffer) {
 }
 
 
+// Multiranging frame payloads, following the 802.15.4 header. Multi byte fields are little endian.
+//
+// Version 1, 6 + 7 * n + 4 bytes:
+//   tx timestamp (5) | n (1) | n * [ addr (1) | timeslot (1) | rx timestamp (5) ] | additive checksum (4)
+//
+// Version 2, 7 + 2..7 * n bytes, typically 7 + 5 * n:
+//   MTM_FRAME_V2 (1) | tx timestamp (5) | n (1) | n * [ addr (1) | delta (varint) ]
+//   The rx timestamps are sorted from the most recent to the oldest one. The first delta is
+//   the distance to the tx timestamp, every following one the distance to the previous
+//   rx timestamp, all modulo 2^40 and coded as unsigned LEB128. The timeslot follows from the
+//   summed up distance (see mtm_set_slot_timing()), the radio already rejects frames with a bad CRC.
+//
+// Version 1 frames are recognized by their length and checksum, there is no version field
+// to stay compatible to deployed nodes.
+//
+// With TSCH_MTM_SLOT_CLAIMS either version is followed by, if it fits into the frame:
+//   MTM_FRAME_CLAIMS (1) | received slots (4 * TSCH_MTM_OCCUPANCY_WORDS) | failed slots (4 * ...)
+#define MTM_FRAME_V1_OVERHEAD (5 + 1 + 4)
+#define MTM_FRAME_V1_ENTRY_LEN (1 + 1 + 5)
+#define MTM_FRAME_V2 0xB2
+#define MTM_FRAME_V2_OVERHEAD (1 + 5 + 1)
+#define MTM_VARINT_MAX_LEN 6 // 40 bit values
+#define MTM_FRAME_CLAIMS 0xC5
+#define MTM_FRAME_CLAIMS_LEN (1 + 2 * 4 * TSCH_MTM_OCCUPANCY_WORDS)
+
+// returns the number of bytes consumed or 0 if the value is truncated or too long
+static int mtm_varint_get(uint64_t *value, const uint8_t *buffer, int buf_size) {
+    *value = 0;
+    for(int i = 0; i < buf_size && i < MTM_VARINT_MAX_LEN; i++) {
+        *value |= ((uint64_t) (buffer[i] & 0x7F)) << (7 * i);
+        if(!(buffer[i] & 0x80)) {
+            return i + 1;
+        }
+    }
+
+    return 0;
+}
+
+#if TSCH_MTM_FRAME_VERSION == 2
+static int mtm_varint_put(uint64_t value, uint8_t *buffer) {
+    int len = 0;
+
+    while(value >= 0x80) {
+        buffer[len++] = (value & 0x7F) | 0x80;
+        value >>= 7;
+    }
+    buffer[len++] = value;
+
+    return len;
+}
+
+static int mtm_varint_len(uint64_t value) {
+    int len = 1;
+
+    while(value >= 0x80) {
+        value >>= 7;
+        len++;
+    }
+
+    return len;
+}
+
+static int mtm_payload_write_v2(uint8_t *buf, int curr_len, int buf_size, uint64_t tx_timestamp) {
+    struct mtm_rx_queue *q = &rx_send_queue[burst_index];
+    uint8_t order[TSCH_MTM_PROP_MAX_MEASUREMENT];
+    uint64_t age[TSCH_MTM_PROP_MAX_MEASUREMENT];
+    uint64_t prev_age = 0, delta;
+    uint8_t amount_of_measurements = 0;
+    int amount_pos;
+
+    if(curr_len + MTM_FRAME_V2_OVERHEAD > buf_size) {
+        return 0;
+    }
+
+    // sort by age, the queue is short so insertion sort is fine
+    for(uint8_t i = 0; i < q->len; i++) {
+        uint8_t j = i;
+
+        age[i] = (tx_timestamp - q->items[i].rx_timestamp) & MTM_DW_TS_MASK;
+        while(j > 0 && age[order[j - 1]] > age[i]) {
+            order[j] = order[j - 1];
+            j--;
+        }
+        order[j] = i;
+    }
+
+    buf[curr_len++] = MTM_FRAME_V2;
+    packet_buf_copy_timestamp(tx_timestamp, &buf[curr_len]);
+    curr_len = curr_len + 5 * sizeof(uint8_t);
+
+    amount_pos = curr_len;
+    curr_len = curr_len + sizeof(uint8_t);
+
+    for(uint8_t i = 0; i < q->len; i++) {
+        struct mtm_rx_queue_item *t = &q->items[order[i]];
+
+        delta = age[order[i]] - prev_age;
+        if(curr_len + 1 + mtm_varint_len(delta) > buf_size) {
+            _PRINTF("MTM: frame full, dropping %u timestamps\n", q->len - i);
+            break;
+        }
+
+        buf[curr_len++] = t->neighbor_addr;
+        curr_len += mtm_varint_put(delta, &buf[curr_len]);
+        prev_age = age[order[i]];
+        amount_of_measurements++;
+    }
+    buf[amount_pos] = amount_of_measurements;
+
+    return curr_len;
+}
+#else
+static int mtm_payload_write_v1(uint8_t *buf, int curr_len, int buf_size, uint64_t tx_timestamp) {
+    struct mtm_rx_queue *q = &rx_send_queue[burst_index];
+    struct mtm_rx_queue_item *t;
+    uint8_t amount_of_measurements = 0;
+    int amount_pos;
+    uint32_t checksum = 0;
+
+    if(curr_len + MTM_FRAME_V1_OVERHEAD > buf_size) {
+        return 0;
+    }
+
+    packet_buf_copy_timestamp(tx_timestamp, &buf[curr_len]);
+    curr_len = curr_len + 5 * sizeof(uint8_t);
+
+    amount_pos = curr_len;
+    curr_len = curr_len + sizeof(uint8_t);
+
+    for(uint8_t i = 0; i < q->len; i++) {
+        if(curr_len + MTM_FRAME_V1_ENTRY_LEN + 4 > buf_size) {
+            _PRINTF("MTM: frame full, dropping %u timestamps\n", q->len - i);
+            break;
+        }
+
+        t = &q->items[i];
+        buf[curr_len++] = t->neighbor_addr;
+        buf[curr_len++] = t->timeslot_offset;
+        packet_buf_copy_timestamp(t->rx_timestamp, &buf[curr_len]);
+        curr_len = curr_len + 5 * sizeof(uint8_t);
+        amount_of_measurements++;
+    }
+    buf[amount_pos] = amount_of_measurements;
+
+    // calculate checksum for buf
+    for(int i = 0; i < curr_len; i++) {
+        checksum += buf[i];
+    }
+
+    // append checksum to end
+    memcpy(&buf[curr_len], &checksum, sizeof(uint32_t));
+    curr_len = curr_len + sizeof(uint32_t);
+
+    return curr_len;
+}
+#endif
+
+// Both start reading at curr_len (the end of the header) and return the length of the
+// whole frame or 0 if it is not a valid frame of that version
+static int mtm_payload_read_v1(uint8_t *buf, int curr_len, int buf_size, uint64_t *tx_timestamp, uint8_t *num_timestamps) {
+    uint8_t amount_of_measurements;
+    uint32_t checksum_calculated = 0, checksum_packet;
+
+    if(curr_len + MTM_FRAME_V1_OVERHEAD > buf_size) {
+        return 0;
+    }
+
+    amount_of_measurements = buf[curr_len + 5];
+    if(amount_of_measurements > TSCH_MTM_PROP_MAX_NEIGHBORS
+       || curr_len + MTM_FRAME_V1_OVERHEAD + amount_of_measurements * MTM_FRAME_V1_ENTRY_LEN > buf_size) {
+        return 0;
+    }
+
+    packet_buf_extract_timestamp(tx_timestamp, &buf[curr_len]);
+    curr_len = curr_len + 5 * sizeof(uint8_t) + sizeof(uint8_t);
+
+    for(int i = 0; i < amount_of_measurements; i++) {
+        return_timestamps[i].addr = buf[curr_len++];
+        return_timestamps[i].timeslot_offset = buf[curr_len++];
+        packet_buf_extract_timestamp(&return_timestamps[i].rx_timestamp, &buf[curr_len]);
+        curr_len = curr_len + 5 * sizeof(uint8_t);
+    }
+
+    // calculate checksum for buf
+    for(int i = 0; i < curr_len; i++) {
+        checksum_calculated += buf[i];
+    }
+
+    memcpy(&checksum_packet, &buf[curr_len], sizeof(uint32_t));
+    curr_len = curr_len + sizeof(uint32_t);
+
+    if(checksum_calculated != checksum_packet) {
+        return 0;
+    }
+
+    *num_timestamps = amount_of_measurements;
+    return curr_len;
+}
+
+static int mtm_payload_read_v2(uint8_t *buf, int curr_len, int buf_size, uint8_t timeslot_offset, uint64_t *tx_timestamp, uint8_t *num_timestamps) {
+    uint8_t amount_of_measurements;
+    int ret;
+    uint64_t age = 0, delta, slot_distance;
+
+    if(curr_len + MTM_FRAME_V2_OVERHEAD > buf_size || buf[curr_len] != MTM_FRAME_V2) {
+        return 0;
+    }
+    curr_len++;
+
+    packet_buf_extract_timestamp(tx_timestamp, &buf[curr_len]);
+    curr_len = curr_len + 5 * sizeof(uint8_t);
+
+    amount_of_measurements = buf[curr_len++];
+    if(amount_of_measurements > TSCH_MTM_PROP_MAX_NEIGHBORS) {
+        return 0;
+    }
+
+    for(int i = 0; i < amount_of_measurements; i++) {
+        if(curr_len >= buf_size) {
+            return 0;
+        }
+        return_timestamps[i].addr = buf[curr_len++];
+
+        if((ret = mtm_varint_get(&delta, &buf[curr_len], buf_size - curr_len)) == 0) {
+            return 0;
+        }
+        curr_len += ret;
+
+        age += delta;
+        return_timestamps[i].rx_timestamp = (*tx_timestamp - age) & MTM_DW_TS_MASK;
+
+        slot_distance = (age + mtm_slot_ticks / 2) / mtm_slot_ticks;
+        if(mtm_slotframe_size > 0) {
+            slot_distance %= mtm_slotframe_size;
+            return_timestamps[i].timeslot_offset = (timeslot_offset + mtm_slotframe_size - slot_distance) % mtm_slotframe_size;
+        } else {
+            return_timestamps[i].timeslot_offset = timeslot_offset - slot_distance;
+        }
+    }
+
+    *num_timestamps = amount_of_measurements;
+    return curr_len;
+}
+
+#if TSCH_MTM_SLOT_CLAIMS
+static void put_le32(uint8_t *p, uint32_t v) {
+    p[0] = v;
+    p[1] = v >> 8;
+    p[2] = v >> 16;
+    p[3] = v >> 24;
+}
+
+static uint32_t get_le32(const uint8_t *p) {
+    return p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// Both return the new length of the frame, the claims are left out if they do not fit
+static int mtm_claims_write(uint8_t *buf, int curr_len, int buf_size) {
+    uint32_t bitmap[TSCH_MTM_OCCUPANCY_WORDS];
+    uint8_t w;
+
+    if(curr_len + MTM_FRAME_CLAIMS_LEN > buf_size) {
+        return curr_len;
+    }
+    buf[curr_len++] = MTM_FRAME_CLAIMS;
+    slot_map_get(&slot_received, bitmap);
+    for(w = 0; w < TSCH_MTM_OCCUPANCY_WORDS; w++, curr_len += 4) {
+        put_le32(&buf[curr_len], bitmap[w]);
+    }
+    slot_map_get(&slot_failed, bitmap);
+    for(w = 0; w < TSCH_MTM_OCCUPANCY_WORDS; w++, curr_len += 4) {
+        put_le32(&buf[curr_len], bitmap[w]);
+    }
+    return curr_len;
+}
+
+static int mtm_claims_read(uint8_t *buf, int curr_len, int buf_size) {
+    uint8_t w;
+
+    rx_claims_valid = 0;
+    if(curr_len + MTM_FRAME_CLAIMS_LEN > buf_size || buf[curr_len] != MTM_FRAME_CLAIMS) {
+        return curr_len;
+    }
+    curr_len++;
+    for(w = 0; w < 2 * TSCH_MTM_OCCUPANCY_WORDS; w++, curr_len += 4) {
+        rx_claims[w] = get_le32(&buf[curr_len]);
+    }
+    rx_claims_valid = 1;
+    return curr_len;
+}
+#endif
+
 // We put functionality regarding package creation here for now. This allows the measurement_list to
 // remain inside this functional unit and not leak out.
 int tsch_packet_create_multiranging_packet(
@@ -840,9 +1599,15 @@ int tsch_packet_create_multiranging_packet(
     uint64_t tx_timestamp
     )
 {
-  uint8_t curr_len = 0;
+  int curr_len = 0;
   frame802154_t p;
 
+  // the sequence number is the position of the frame in its burst and selects the lane
+  if(seqno >= TSCH_MTM_BURST_LEN) {
+    return 0;
+  }
+  burst_index = seqno;
+
   memset(&p, 0, sizeof(p));
   p.fcf.frame_type = FRAME802154_DATAFRAME;
   p.fcf.frame_version = FRAME802154_IEEE802154E_2012;
@@ -878,44 +1643,19 @@ int tsch_packet_create_multiranging_packet(
     return 0;
   }
 
-  // add tx_timestamp
-  packet_buf_copy_timestamp(tx_timestamp, &buf[curr_len]);
-  curr_len = curr_len + 5 * sizeof(uint8_t);
-
-  // iterate over list of measurements and add each timestamp to the packet
-  struct mtm_rx_queue_item *t = NULL;
-
-  // write amount of measurements
-  uint8_t amount_of_measurements = list_length(rx_send_queue);
-
-  /* printf("s %d\n", amount_of_measurements); */
-
-  memcpy(&buf[curr_len], &amount_of_measurements, sizeof(uint8_t));
-  curr_len = curr_len + sizeof(uint8_t);
-
-  // free all allocated memory for all measurements again
-  while((t = list_pop(rx_send_queue)) != NULL) {
-      memcpy(&buf[curr_len], &t->neighbor_addr, sizeof(uint8_t));
-      curr_len = curr_len + sizeof(uint8_t);
-      memcpy(&buf[curr_len], &t->timeslot_offset, sizeof(uint8_t));
-      curr_len = curr_len + sizeof(uint8_t);
-
-      packet_buf_copy_timestamp(t->rx_timestamp, &buf[curr_len]);
-      curr_len = curr_len + 5*sizeof(uint8_t);
-
-      memb_free(&mtm_prop_rx_memb, t);
-  }
-
-
-  uint32_t checksum = 0;
-  // calculate checksum for buf
-  for(int i = 0; i < curr_len; i++) {
-      checksum += buf[i];
+#if TSCH_MTM_FRAME_VERSION == 2
+  curr_len = mtm_payload_write_v2(buf, curr_len, buf_size, tx_timestamp);
+#else
+  curr_len = mtm_payload_write_v1(buf, curr_len, buf_size, tx_timestamp);
+#endif
+#if TSCH_MTM_SLOT_CLAIMS
+  if(curr_len > 0) {
+    curr_len = mtm_claims_write(buf, curr_len, buf_size);
   }
+#endif
 
-  // append checksum to end
-  memcpy(&buf[curr_len], &checksum, sizeof(uint32_t));
-  curr_len = curr_len + sizeof(uint32_t);
+  // empty the queue again, entries which did not fit into the frame are dropped as well
+  rx_queue_clear(&rx_send_queue[burst_index]);
 
 #if WITH_DEV_FILL_MAC_PACKET
   return 120;
@@ -937,7 +1677,7 @@ tsch_packet_parse_multiranging_packet(
     uint8_t *num_timestamps
      )
 {
-  uint8_t curr_len = 0;
+  int curr_len = 0;
   int ret;
   linkaddr_t dest, src;
 
@@ -952,11 +1692,10 @@ tsch_packet_parse_multiranging_packet(
 
   curr_len += ret;
 
-  // printf("frame payload len %d\n", frame->payload_len);
-  /* Check seqno */
-  /* if(seqno != frame->seq) { */
-  /*   return 0; */
-  /* } */
+  /* The sequence number is the position of the frame in its burst */
+  if(frame->seq >= TSCH_MTM_BURST_LEN) {
+    return 0;
+  }
 
   /* Check destination PAN ID */
   if(frame802154_check_dest_panid(frame) == 0) {
@@ -970,61 +1709,35 @@ tsch_packet_parse_multiranging_packet(
     return 0;
   }
 
-  mtm_direct_observed_node( src.u8[LINKADDR_SIZE-1], timeslot_offset );
-
-  /* curr_len = curr_len + sizeof(candidate_bitmask); */
-
-  // if everything is okay we will extract the timestamps
-
-  // extract timestamps
   uint64_t tx_timestamp = 0;
-  // extract rx timestamp amount
   uint8_t amount_of_measurements = 0;
 
-  packet_buf_extract_timestamp(&tx_timestamp, &buf[curr_len]);
-  curr_len = curr_len + 5 * sizeof(uint8_t);
-
-  memcpy(&amount_of_measurements, &buf[curr_len], sizeof(uint8_t));
+  if((ret = mtm_payload_read_v1(buf, curr_len, buf_size, &tx_timestamp, &amount_of_measurements)) == 0
+     && (ret = mtm_payload_read_v2(buf, curr_len, buf_size, timeslot_offset, &tx_timestamp, &amount_of_measurements)) == 0) {
+      return 0;
+  }
+  curr_len = ret;
+  burst_index = frame->seq;
+#if TSCH_MTM_SLOT_CLAIMS
+  curr_len = mtm_claims_read(buf, curr_len, buf_size);
+#endif
 
-  /* printf("am, %d\n", amount_of_measurements); */
+#if !TSCH_MTM_DEFERRED_PROCESSING
+  mtm_direct_observed_node( src.u8[LINKADDR_SIZE-1], timeslot_offset );
 
-  curr_len = curr_len + sizeof(uint8_t);
   for(int i = 0; i < amount_of_measurements; i++) {
-      ranging_addr_t neighbor;
-      uint8_t timeslot_offset = 0;
-      uint64_t rx_timestamp = 0;
-
-      memcpy(&neighbor, &buf[curr_len], sizeof(uint8_t));
-      curr_len = curr_len + sizeof(uint8_t);
-
-      memcpy(&timeslot_offset, &buf[curr_len], sizeof(uint8_t));
-      curr_len = curr_len + sizeof(uint8_t);
-
-      packet_buf_extract_timestamp(&rx_timestamp, &buf[curr_len]);
-      curr_len = curr_len + 5*sizeof(uint8_t);
-
       // update two_hop counter
-      if(neighbor != linkaddr_node_addr.u8[LINKADDR_SIZE-1]) {
-          mtm_indirect_observed_node(neighbor, timeslot_offset);
+      if(return_timestamps[i].addr != linkaddr_node_addr.u8[LINKADDR_SIZE-1]) {
+          mtm_indirect_observed_node(return_timestamps[i].addr, return_timestamps[i].timeslot_offset);
       }
-
-      return_timestamps[i].addr = neighbor;
-      return_timestamps[i].rx_timestamp = rx_timestamp;
   }
-
-  uint32_t checksum_calculated = 0, checksum_packet = 0;
-  // calculate checksum for buf
-  for(int i = 0; i < curr_len; i++) {
-      checksum_calculated += buf[i];
-  }
-
-  // extract checksum to end
-  memcpy(&checksum_packet, &buf[curr_len], sizeof(uint32_t));
-  curr_len = curr_len + sizeof(uint32_t);
-
-  if(checksum_calculated != checksum_packet) {
-      return 0;
+#if TSCH_MTM_SLOT_CLAIMS
+  if(rx_claims_valid) {
+      mtm_claims_observed(rx_claims);
+      rx_claims_valid = 0;
   }
+#endif
+#endif
 
   *num_timestamps = amount_of_measurements;
   *rx_timestamps = return_timestamps;
@@ -1042,7 +1755,7 @@ int32_t fixed_precision_divide(int32_t a, int32_t b) {
 #define TDOA_FLOAT double
 #define PROP_FLOAT double
 #if WITH_PASSIVE_TDOA
-float mtm_compute_tdoa(struct mtm_pas_tdoa *ts) {
+float mtm_compute_tdoa(struct mtm_tdoa_ts *ts) {
     int64_t M_a, M_b, R_a, D_a, R_b, D_b;
 
     // we are in the lucky position that we have a fpu, so we will use them instead of fixed precision.
@@ -1067,29 +1780,49 @@ float mtm_compute_tdoa(struct mtm_pas_tdoa *ts) {
 
     return TD;
 }
+
+// Same as mtm_compute_tdoa(), but the drift coefficient is applied as 1 + e/(R_a + D_a) with
+// e = M_a + M_b - (R_a + D_a), so only the small drift term needs the Q format. The result
+// has a resolution of half a tick, as ToF_ab does.
+float mtm_compute_tdoa_fixed(struct mtm_tdoa_ts *ts) {
+    int64_t M_a, M_b, R_a, D_a, x, two_td;
+
+    M_a = interval_correct_overflow(ts->r_l2 , ts->r_l1);
+    M_b = interval_correct_overflow(ts->r_l3 , ts->r_l2);
+
+    R_a = interval_correct_overflow(ts->ds_ts.r_a1 , ts->ds_ts.t_a1);
+    D_a = interval_correct_overflow(ts->ds_ts.t_a2 , ts->ds_ts.r_a1);
+
+    // x = 2 * (R_a - ToF_ab)
+    x = 2 * R_a - mtm_two_tof_fixed(&ts->ds_ts);
+
+    two_td = x + mtm_drift_mul_q(mtm_drift_ratio_q(M_a + M_b - (R_a + D_a), R_a + D_a), x) - 2 * M_a;
+
+    return ((float) two_td) * 0.5;
+}
 #endif
 
 float time_to_dist(float tof) {
     return (float)tof * SPEED_OF_LIGHT_M_PER_UWB_TU;
 }
 
-PROCESS(TSCH_MTM_PROCESS, "TSCH propagation time process");
+PROCESS(TSCH_MTM_PROCESS, "TSCH MTM ranging process");
   /*---------------------------------------------------------------------------*/
-  /* Protothread for slot operation, called by update_neighbor_prop_time()
-   * function. "data" is a struct tsch_neighbor pointer.*/
+  /* Protothread for the ranging computations, polled by the MTM slot operation
+   * whenever it queued a received frame. */
   PROCESS_THREAD(TSCH_MTM_PROCESS, ev, data)
   {
     PROCESS_BEGIN();
 
+#if TSCH_MTM_DEFERRED_PROCESSING
+    ringbufindex_init(&mtm_rx_pending_ringbuf, TSCH_MTM_RX_PENDING_LEN);
+#endif
+
     while(1) {
-      PROCESS_WAIT_EVENT();
-      if(ev == PROCESS_EVENT_MSG) {
-        printf("New prop time %ld %u %lu %u\n",
-          ((struct tsch_neighbor *) data)->last_prop_time.prop_time,
-          ((struct tsch_neighbor *) data)->last_prop_time.asn.ms1b, /* most significant 1 byte */
-          ((struct tsch_neighbor *) data)->last_prop_time.asn.ls4b, /* least significant 4 bytes */
-          ((struct tsch_neighbor *) data)->last_prop_time.tsch_channel);
-      }
+      PROCESS_YIELD_UNTIL(ev == PROCESS_EVENT_POLL);
+#if TSCH_MTM_DEFERRED_PROCESSING
+      tsch_mtm_process_pending();
+#endif
     }
 
     PROCESS_END();
@@ -1239,6 +1972,147 @@ float calculate_propagation_time_alternative(struct ds_twr_ts *ts) {
     return ((float) two_tof_int) * 0.5;
 }
 
+// Fixed point variants of the kernels above. The relative clock drift is kept as a
+// signed Q(63-MTM_DRIFT_Q).MTM_DRIFT_Q number. Drift ratios are below 1e-4 for any
+// crystal within spec, so the integer part is never used and all of the precision
+// goes to the fraction.
+//
+// Error bound: the ratio is rounded to the nearest Q value, i.e. it is off by at most
+// 2^-(MTM_DRIFT_Q+1). Multiplied with the reply delay D_b this gives D_b * 2^-36 ticks,
+// which is below 0.5 ticks for D_b < 2^35 ticks (~0.54 s). Since both variants round
+// the drift correction to a full tick, the round trip time 2*ToF differs by at most one
+// tick, the ToF by at most half a tick (~2.3 mm). For TDoA the same holds for the ToF
+// term, the drift term adds at most R_a * 2^-36 ticks and the result is rounded to half
+// a tick. For R_a < 2^34 ticks (~0.27 s) this gives TSCH_MTM_FIXED_MAX_ERROR_TICKS.
+//
+// The numerator of the ratio must stay below 2^(62-MTM_DRIFT_Q) ticks (~2.1 ms), which
+// covers about 120 ppm relative drift over the full 17 s range of the DW1000 clock.
+// Larger values only occur with broken timestamps and are saturated.
+#define MTM_DRIFT_Q 35
+
+static int64_t mtm_drift_ratio_q(int64_t num, int64_t den) {
+    const int64_t limit = ((int64_t) 1 << (62 - MTM_DRIFT_Q)) - 1;
+    int64_t n;
+
+    if(den <= 0) {
+        return 0;
+    }
+
+    if(num > limit) {
+        num = limit;
+    } else if(num < -limit) {
+        num = -limit;
+    }
+
+    // round to nearest
+    n = num * ((int64_t) 1 << MTM_DRIFT_Q);
+    return (n >= 0 ? n + den / 2 : n - den / 2) / den;
+}
+
+// ratio_q * x rounded to the nearest integer. x is split into 32 bit halves, so that no
+// intermediate result exceeds 64 bits for any interval between two DW1000 timestamps.
+static int64_t mtm_drift_mul_q(int64_t ratio_q, int64_t x) {
+    int64_t hi, lo;
+
+    hi = ratio_q * (x >> 32);
+    lo = ((hi & (((int64_t) 1 << (MTM_DRIFT_Q - 32)) - 1)) << 32) + ratio_q * (x & 0xFFFFFFFF);
+
+    return (hi >> (MTM_DRIFT_Q - 32)) + ((lo + ((int64_t) 1 << (MTM_DRIFT_Q - 1))) >> MTM_DRIFT_Q);
+}
+
+// 2 * ToF in ticks, see calculate_propagation_time_alternative()
+static int64_t mtm_two_tof_fixed(struct ds_twr_ts *ts) {
+    int64_t other_duration, own_duration;
+    int64_t round_duration_a, delay_duration_b;
+    int64_t relative_drift_offset_q;
+
+    own_duration   = interval_correct_overflow(ts->t_a2, ts->t_a1);
+    other_duration = interval_correct_overflow(ts->r_b2, ts->r_b1);
+
+    relative_drift_offset_q = mtm_drift_ratio_q(own_duration - other_duration, other_duration);
+
+    round_duration_a = interval_correct_overflow(ts->r_a1, ts->t_a1);
+    delay_duration_b = interval_correct_overflow(ts->t_b1, ts->r_b1);
+
+    return round_duration_a - delay_duration_b - mtm_drift_mul_q(relative_drift_offset_q, delay_duration_b);
+}
+
+float calculate_propagation_time_fixed(struct ds_twr_ts *ts) {
+    return ((float) mtm_two_tof_fixed(ts)) * 0.5;
+}
+
+#if TSCH_MTM_DRIFT_TRACKING
+// Drift estimates are kept in the Q format of the kernels above. Samples beyond 100 ppm
+// come from broken or mismatched timestamps and are dropped.
+#define MTM_DRIFT_MAX_Q (((int64_t) 100 << MTM_DRIFT_Q) / 1000000)
+// the reference frame must be recent enough to rule out a wrap of the 17 s DW1000 clock
+#define MTM_DRIFT_MAX_REF_AGE (8 * CLOCK_SECOND)
+
+static void mtm_drift_init(struct mtm_neighbor *n) {
+    n->drift_q = 0;
+    n->drift_ref_tx = UINT64_MAX;
+    n->drift_ref_rx = UINT64_MAX;
+    n->drift_ref_time = 0;
+    n->drift_source = MTM_DRIFT_NONE;
+}
+
+static void mtm_drift_filter(struct mtm_neighbor *n, int64_t sample, uint8_t shift) {
+    if(sample > MTM_DRIFT_MAX_Q || sample < -MTM_DRIFT_MAX_Q) {
+        return;
+    }
+    n->drift_q += (sample - n->drift_q) / ((int64_t) 1 << shift);
+}
+
+// Fuses the carrier clock offset of a received frame and the drift between the frame and the
+// reference frame, as seen in its tx and our rx timestamp, into the estimate of the neighbor.
+// Timestamps taken over a whole round are by far the better source, the first of their
+// samples replaces an estimate that is based on the carrier only.
+static void mtm_drift_update(struct mtm_neighbor *n, uint64_t tx_timestamp_B, uint64_t rx_timestamp_A, int16_t clock_offset) {
+    clock_time_t now = clock_time();
+    int64_t own, other, sample;
+
+    if(clock_offset != MTM_CLOCK_OFFSET_NONE) {
+        // the DW1000 reports (its clock - our clock) / our clock in 0.01 ppm, to first order
+        // the negated drift
+        sample = -(((int64_t) clock_offset * ((int64_t) 1 << MTM_DRIFT_Q)) / 100000000);
+        if(n->drift_source == MTM_DRIFT_NONE) {
+            if(sample <= MTM_DRIFT_MAX_Q && sample >= -MTM_DRIFT_MAX_Q) {
+                n->drift_q = sample;
+                n->drift_source = MTM_DRIFT_CARRIER;
+            }
+        } else {
+            mtm_drift_filter(n, sample, TSCH_MTM_DRIFT_CARRIER_SHIFT);
+        }
+    }
+
+    if(n->drift_ref_tx != UINT64_MAX && now - n->drift_ref_time <= MTM_DRIFT_MAX_REF_AGE) {
+        other = interval_correct_overflow(tx_timestamp_B, n->drift_ref_tx);
+        if(other < (int64_t) MTM_US_TO_DW_TICKS(TSCH_MTM_DRIFT_MIN_INTERVAL_US)) {
+            // keep the reference, e.g. for the following frames of a burst
+            return;
+        }
+        own = interval_correct_overflow(rx_timestamp_A, n->drift_ref_rx);
+        sample = mtm_drift_ratio_q(own - other, other);
+        if(n->drift_source != MTM_DRIFT_TIMESTAMPS) {
+            if(sample <= MTM_DRIFT_MAX_Q && sample >= -MTM_DRIFT_MAX_Q) {
+                n->drift_q = sample;
+                n->drift_source = MTM_DRIFT_TIMESTAMPS;
+            }
+        } else {
+            mtm_drift_filter(n, sample, TSCH_MTM_DRIFT_FILTER_SHIFT);
+        }
+    }
+
+    n->drift_ref_tx = tx_timestamp_B;
+    n->drift_ref_rx = rx_timestamp_A;
+    n->drift_ref_time = now;
+}
+
+float mtm_neighbor_drift_ppm(const struct mtm_neighbor *n) {
+    return (float) ((double) n->drift_q * 1e6 / (double) ((int64_t) 1 << MTM_DRIFT_Q));
+}
+#endif
+
 
 /* float calculate_propagation_time_alternative(struct ds_twr_ts *ts) { */
 /*     int64_t initiator_roundtrip, initiator_reply, replier_roundtrip, replier_reply; */
@@ -54,15 +54,181 @@ PROCESS_NAME(TSCH_MTM_SLOT_END_PROCESS);
 #define TSCH_MTM_PROP_MAX_NEIGHBORS 15
 // defines the maximum amount of measurements we will store
 /* #define TSCH_MTM_PROP_MAX_MEASUREMENT 14 // max capacity for a multi ranging frame */
+#ifdef TSCH_MTM_CONF_PROP_MAX_MEASUREMENT
+#define TSCH_MTM_PROP_MAX_MEASUREMENT TSCH_MTM_CONF_PROP_MAX_MEASUREMENT
+#else
 #define TSCH_MTM_PROP_MAX_MEASUREMENT 14 // max capacity for a multi ranging frame
+#endif
+#if TSCH_MTM_PROP_MAX_MEASUREMENT > TSCH_MTM_PROP_MAX_NEIGHBORS
+#error "TSCH_MTM_PROP_MAX_MEASUREMENT must not exceed TSCH_MTM_PROP_MAX_NEIGHBORS"
+#endif
+
+// Format of the multiranging frames we send, frames of both versions are always accepted.
+// 1: per reception the address, the timeslot and the raw 5 byte timestamp, additive checksum
+// 2: per reception the address and the varint coded distance to the previous timestamp,
+//    the timeslot is derived from the distance, integrity is left to the radio CRC.
+//    Requires mtm_set_slot_timing() on the receivers. See tsch-prop.c for the layout.
+#ifdef TSCH_MTM_CONF_FRAME_VERSION
+#define TSCH_MTM_FRAME_VERSION TSCH_MTM_CONF_FRAME_VERSION
+#else
+#define TSCH_MTM_FRAME_VERSION 1
+#endif
+#if TSCH_MTM_FRAME_VERSION != 1 && TSCH_MTM_FRAME_VERSION != 2
+#error "TSCH_MTM_FRAME_VERSION must be 1 or 2"
+#endif
+
+// Amount of frames the owner of a MTM TX link sends per timeslot. The frames of a burst
+// follow each other in TSCH_MTM_BURST_INTERVAL_US and carry their position in the burst
+// as sequence number. Frames with the same position form an independent lane with its
+// own rx queue, DS-TWR and TDoA state, so every pair of nodes yields up to
+// TSCH_MTM_BURST_LEN measurements per round. The timeslot has to fit
+// loc_tx_offset + (TSCH_MTM_BURST_LEN - 1) * TSCH_MTM_BURST_INTERVAL_US + one frame.
+// Every measurement is posted as event, PROCESS_CONF_NUMEVENTS may have to grow with the burst.
+#ifdef TSCH_MTM_CONF_BURST_LEN
+#define TSCH_MTM_BURST_LEN TSCH_MTM_CONF_BURST_LEN
+#else
+#define TSCH_MTM_BURST_LEN 1
+#endif
+#if TSCH_MTM_BURST_LEN < 1 || TSCH_MTM_BURST_LEN > 8
+#error "TSCH_MTM_BURST_LEN must be within 1..8"
+#endif
+// distance between two frames of a burst, has to cover the airtime of a frame
+// plus preparing the next one (tx) or reading and parsing it (rx)
+#ifdef TSCH_MTM_CONF_BURST_INTERVAL_US
+#define TSCH_MTM_BURST_INTERVAL_US TSCH_MTM_CONF_BURST_INTERVAL_US
+#else
+#define TSCH_MTM_BURST_INTERVAL_US 1000
+#endif
+// once a frame of the burst was received, the following ones are expected within this guard
+#ifdef TSCH_MTM_CONF_BURST_RX_GUARD_US
+#define TSCH_MTM_BURST_RX_GUARD_US TSCH_MTM_CONF_BURST_RX_GUARD_US
+#else
+#define TSCH_MTM_BURST_RX_GUARD_US 100
+#endif
+// take the RX timestamp, first path index and frame quality of every MTM frame from
+// one batch of register reads (dw_get_rx_diagnostics) instead of separate accesses
+#ifdef TSCH_MTM_CONF_RX_DIAGNOSTICS
+#define TSCH_MTM_RX_DIAGNOSTICS TSCH_MTM_CONF_RX_DIAGNOSTICS
+#else
+#define TSCH_MTM_RX_DIAGNOSTICS 0
+#endif
+
+#ifdef TSCH_MTM_CONF_PROP_MAX_NEIGHBOR_ENTRIES
+#define TSCH_MTM_PROP_MAX_NEIGHBOR_ENTRIES TSCH_MTM_CONF_PROP_MAX_NEIGHBOR_ENTRIES
+#else
 #define TSCH_MTM_PROP_MAX_NEIGHBOR_ENTRIES 40
+#endif
+#ifdef TSCH_MTM_CONF_MAX_TDOA_ENTRIES
+#define TSCH_MTM_MAX_TDOA_ENTRIES TSCH_MTM_CONF_MAX_TDOA_ENTRIES
+#else
 #define TSCH_MTM_MAX_TDOA_ENTRIES 120 // enough for a fully-connected cluster of 16 nodes
+#endif
+
+// Ranging computations for received frames are deferred from the slot operation
+// to TSCH_MTM_PROCESS. The slot only parses the frame and queues its timestamps.
+#ifdef TSCH_MTM_CONF_DEFERRED_PROCESSING
+#define TSCH_MTM_DEFERRED_PROCESSING TSCH_MTM_CONF_DEFERRED_PROCESSING
+#else
+#define TSCH_MTM_DEFERRED_PROCESSING 1
+#endif
+// amount of received frames waiting to be processed, must be a power of two
+#ifdef TSCH_MTM_CONF_RX_PENDING_LEN
+#define TSCH_MTM_RX_PENDING_LEN TSCH_MTM_CONF_RX_PENDING_LEN
+#else
+#define TSCH_MTM_RX_PENDING_LEN 8
+#endif
+
+// Compute DS-TWR and passive TDoA with 64 bit integer arithmetic instead of double
+// precision floating point, for targets without (double precision) FPU.
+// The result differs from the double precision computation by at most
+// TSCH_MTM_FIXED_MAX_ERROR_TICKS DW1000 ticks as long as all reply delays stay below
+// 2^34 ticks (about 0.27 s), see MTM_DRIFT_Q in tsch-prop.c for details.
+#ifdef TSCH_MTM_CONF_FIXED_POINT
+#define TSCH_MTM_FIXED_POINT TSCH_MTM_CONF_FIXED_POINT
+#else
+#define TSCH_MTM_FIXED_POINT 0
+#endif
+#define TSCH_MTM_FIXED_MAX_ERROR_TICKS 1.0
+
+// Track the clock drift of every direct neighbor against our own clock. Every received frame
+// gives a sample from its tx timestamp and our rx timestamp, compared to an earlier frame of
+// the same neighbor. With TSCH_MTM_RX_DIAGNOSTICS the clock offset the DW1000 measured on the
+// carrier of the frame is blended in as well, it also gives a first estimate from a single frame.
+#ifdef TSCH_MTM_CONF_DRIFT_TRACKING
+#define TSCH_MTM_DRIFT_TRACKING TSCH_MTM_CONF_DRIFT_TRACKING
+#else
+#define TSCH_MTM_DRIFT_TRACKING 1
+#endif
+// weight of a new timestamp sample is 1 / 2^TSCH_MTM_DRIFT_FILTER_SHIFT
+#ifdef TSCH_MTM_CONF_DRIFT_FILTER_SHIFT
+#define TSCH_MTM_DRIFT_FILTER_SHIFT TSCH_MTM_CONF_DRIFT_FILTER_SHIFT
+#else
+#define TSCH_MTM_DRIFT_FILTER_SHIFT 2
+#endif
+// the carrier estimate is much noisier than the timestamps, its weight is 1 / 2^TSCH_MTM_DRIFT_CARRIER_SHIFT
+#ifdef TSCH_MTM_CONF_DRIFT_CARRIER_SHIFT
+#define TSCH_MTM_DRIFT_CARRIER_SHIFT TSCH_MTM_CONF_DRIFT_CARRIER_SHIFT
+#else
+#define TSCH_MTM_DRIFT_CARRIER_SHIFT 6
+#endif
+// timestamp samples are taken over at least this interval, frames of the same burst are skipped
+#ifdef TSCH_MTM_CONF_DRIFT_MIN_INTERVAL_US
+#define TSCH_MTM_DRIFT_MIN_INTERVAL_US TSCH_MTM_CONF_DRIFT_MIN_INTERVAL_US
+#else
+#define TSCH_MTM_DRIFT_MIN_INTERVAL_US 5000
+#endif
+
+// Compute single sided TWR with the tracked drift of the neighbor instead of DS-TWR. Every
+// exchange then yields two measurements, one for the half round we initiated and one for the
+// half round the neighbor initiated, the first one already after a single exchange. Until the
+// drift of a neighbor is known from its timestamps, DS-TWR is used.
+#ifdef TSCH_MTM_CONF_HALF_ROUND_TWR
+#define TSCH_MTM_HALF_ROUND_TWR TSCH_MTM_CONF_HALF_ROUND_TWR
+#else
+#define TSCH_MTM_HALF_ROUND_TWR 0
+#endif
+#if TSCH_MTM_HALF_ROUND_TWR && !TSCH_MTM_DRIFT_TRACKING
+#error "TSCH_MTM_HALF_ROUND_TWR requires TSCH_MTM_DRIFT_TRACKING"
+#endif
+// the drift error is multiplied with the reply delay, half rounds with longer delays are skipped
+#ifdef TSCH_MTM_CONF_HALF_ROUND_MAX_REPLY_US
+#define TSCH_MTM_HALF_ROUND_MAX_REPLY_US TSCH_MTM_CONF_HALF_ROUND_MAX_REPLY_US
+#else
+#define TSCH_MTM_HALF_ROUND_MAX_REPLY_US 250000
+#endif
+
+// Occupancy of the timeslots, learned from the timeslots in which direct and two hop
+// neighbors send. A slot stays occupied for TSCH_MTM_OCCUPANCY_TIMEOUT after the last
+// observation. Only timeslot offsets below TSCH_MTM_OCCUPANCY_SLOTS are tracked.
+#ifdef TSCH_MTM_CONF_OCCUPANCY_SLOTS
+#define TSCH_MTM_OCCUPANCY_SLOTS TSCH_MTM_CONF_OCCUPANCY_SLOTS
+#else
+#define TSCH_MTM_OCCUPANCY_SLOTS 64
+#endif
+#ifdef TSCH_MTM_CONF_OCCUPANCY_TIMEOUT
+#define TSCH_MTM_OCCUPANCY_TIMEOUT TSCH_MTM_CONF_OCCUPANCY_TIMEOUT
+#else
+#define TSCH_MTM_OCCUPANCY_TIMEOUT CLOCK_SECOND
+#endif
+#define TSCH_MTM_OCCUPANCY_WORDS ((TSCH_MTM_OCCUPANCY_SLOTS + 31) / 32)
+// Appends two bitmaps to every MTM frame, if they fit: the timeslots in which we received
+// frames and the timeslots in which our receptions failed. Receivers learn the slots in use
+// around their neighbors and collisions of hidden nodes from it, see tsch_prop_get_slot_claims().
+// The parsers ignore bytes after the payload, so frames with and without are compatible.
+#ifdef TSCH_MTM_CONF_SLOT_CLAIMS
+#define TSCH_MTM_SLOT_CLAIMS TSCH_MTM_CONF_SLOT_CLAIMS
+#else
+#define TSCH_MTM_SLOT_CLAIMS 0
+#endif
+
+// tables are indexed with uint8_t, zero is reserved for "no entry"
+#if TSCH_MTM_PROP_MAX_NEIGHBOR_ENTRIES > 255 || TSCH_MTM_MAX_TDOA_ENTRIES > 255
+#error "TSCH_MTM_PROP_MAX_NEIGHBOR_ENTRIES and TSCH_MTM_MAX_TDOA_ENTRIES must not exceed 255"
+#endif
 
 // define ranging_addr_t as uint8_t for now
 typedef uint8_t ranging_addr_t;
 
-extern uint32_t mtm_successfull_frame_receptions, mtm_sucessfull_rounds, mtm_failed_frame_receptions, mtm_no_frame_detected;
-
 enum MTM_SLOT_END_TYPE {
     MTM_ROUND_END,
     MTM_SLOT_END
@@ -91,8 +257,16 @@ struct distance_measurement {
     
     float time;
     int32_t freq_offset;
+    uint8_t burst_index; // lane the measurement was taken in, see TSCH_MTM_BURST_LEN
+    uint8_t tsch_channel; // channel of the frame that completed the measurement
 };
 
+// Called with every new measurement before it is posted to TSCH_PROP_PROCESS, in the context
+// of the MTM engine. To use, set e.g. #define TSCH_CALLBACK_MTM_MEASUREMENT mtm_locate_input
+#ifdef TSCH_CALLBACK_MTM_MEASUREMENT
+void TSCH_CALLBACK_MTM_MEASUREMENT(const struct distance_measurement *m);
+#endif
+
 
 // make public for now, should probably later be replaced with a better interface
 struct ds_twr_ts
@@ -101,30 +275,49 @@ struct ds_twr_ts
 };
 
 #if WITH_PASSIVE_TDOA
+// Timestamps of one passive TDoA estimate. The initiator A sends (t_a1), the responder B
+// replies (t_b1) and A sends again (t_a2), r_l1, r_l2 and r_l3 are our receptions of these
+// three frames. t_b2 and r_a2 of ds_ts are not used.
+struct mtm_tdoa_ts
+{
+    struct ds_twr_ts ds_ts;
+    uint64_t r_l1, r_l2, r_l3;
+};
+
 struct mtm_pas_tdoa
 {
     struct mtm_pas_tdoa *next;
 
-    // For internal mangement we will identify with node A the node that initiated a transfer
-    // and with node B the responder. Off course both nodes take either role, but
-    // to not mix up the timestamps we will always use the same notation.
+    // The two nodes of the pair, A is the sender of the frame the entry was created for.
+    // Both nodes take the initiator role in turns: every frame of one node that directly
+    // follows a frame of the other one closes a window of three frames and yields an estimate.
     ranging_addr_t A_addr; 
     ranging_addr_t B_addr;
 
     clock_time_t last_observed;
 
-    struct distance_measurement last_measurement;
+    // most recent measurements, indexed by the initiator of their window, 0 for A and 1 for B.
+    // Both give the TDoA of A against B.
+    struct distance_measurement last_measurement[2];
 
-    // this information is used to detect when a round was successfully received
-    // for this we must get a return message from B which was send in the same
-    // round as the tx timestamp that we extract from A's message
-    uint64_t most_recent_tx_A, rx_timestamp_L1, most_recent_tx_B, rx_timestamp_L2;
-    uint8_t rx_timeslot_L1, rx_timeslot_L2; // stores in which round and timeslot we did receive the message we identify as initiator message at
-    uint32_t rx_round_counter_L1, rx_round_counter_L2;
-    uint8_t closed_round;
+    // sliding window over the last three frames of the pair, in the notation of the initiator
+    struct mtm_tdoa_ts ts;
 
-    struct ds_twr_ts ds_ts;
-    uint64_t r_l1, r_l2, r_l3, r_l4;
+    // the frame after the window, its rx timestamp at the other node comes with the next
+    // frame of the other node
+    uint64_t newest_tx, newest_rx_l;
+    uint32_t newest_round;
+    uint8_t newest_timeslot;
+    uint8_t newest_from_b;
+};
+#endif
+
+#if TSCH_MTM_DRIFT_TRACKING
+// what the drift estimate of a neighbor is based on so far
+enum mtm_drift_source {
+    MTM_DRIFT_NONE,
+    MTM_DRIFT_CARRIER,
+    MTM_DRIFT_TIMESTAMPS
 };
 #endif
 
@@ -137,25 +330,38 @@ struct mtm_neighbor {
     struct mtm_neighbor *next;
 
     ranging_addr_t neighbor_addr;
-    struct ds_twr_ts ts;
+    struct ds_twr_ts ts[TSCH_MTM_BURST_LEN]; // one DS-TWR exchange per burst lane
     
-    struct distance_measurement last_measurement;
+    struct distance_measurement last_measurement[TSCH_MTM_BURST_LEN];
 
     enum mtm_neighbor_type type;
 
     clock_time_t last_observed_direct, last_observed_indirect;
     uint8_t observed_timeslot; // the timeslot we learned that the node sends in
     uint64_t total_found_ours_counter; // counter which tracks how often in total we found our timestamp
+    uint32_t rx_count; // frames received from the neighbor, see tsch-mtm-stats.h
+    uint32_t first_round; // round counter when the neighbor was added
+#if TSCH_MTM_DRIFT_TRACKING
+    int64_t drift_q; // (our clock - its clock) / its clock, fixed point, see mtm_neighbor_drift_ppm()
+    uint64_t drift_ref_tx, drift_ref_rx; // its tx and our rx timestamp of the reference frame
+    clock_time_t drift_ref_time;
+    uint8_t drift_source; // enum mtm_drift_source
+#endif
+#if TSCH_MTM_HALF_ROUND_TWR
+    struct distance_measurement last_half_measurement[TSCH_MTM_BURST_LEN]; // half rounds initiated by the neighbor
+#endif
 };
 
 struct mtm_packet_timestamp {
     ranging_addr_t addr;
+    uint8_t timeslot_offset;
     uint64_t rx_timestamp;
 };
 
 void add_mtm_reception_timestamp(
     ranging_addr_t neighbor_addr,
     struct tsch_asn_t *asn,
+    uint8_t tsch_channel,
     uint8_t timeslot,
     
     uint64_t rx_timestamp_A,    
@@ -168,12 +374,42 @@ void add_mtm_reception_timestamp(
 void add_mtm_transmission_timestamp(struct tsch_asn_t *asn, uint64_t tx_timestamp);
 void add_to_direct_observed_rx_to_queue(uint64_t rx_timestamp, uint8_t neighbor, uint8_t timeslot_offset);
 void mtm_set_round_slots(uint8_t timeslot_begin, uint8_t timeslot_end); // begin and end are inclusive 
+void mtm_set_slot_timing(uint16_t slotframe_size, uint32_t timeslot_length_us); // needed to decode version 2 frames
+void mtm_set_slot_length(uint32_t timeslot_length_us); // keeps the slotframe size, called by TSCH on timing changes
+// Selects the burst lane used by the following add and create calls. Creating or parsing a
+// frame selects the lane given by its sequence number as well.
+void mtm_set_burst_index(uint8_t burst_index);
+// Clock offset of the next reception as given by dw_get_clock_offset() (ppm * 100), consumed
+// by the following add_mtm_reception_timestamp(). Only used by TSCH_MTM_DRIFT_TRACKING.
+void mtm_set_rx_clock_offset(int16_t clock_offset);
+#define MTM_CLOCK_OFFSET_NONE INT16_MIN
+#if TSCH_MTM_DRIFT_TRACKING
+float mtm_neighbor_drift_ppm(const struct mtm_neighbor *n); // (our clock - its clock) / its clock in ppm
+#endif
 void mtm_slot_end_handler(uint16_t timeslot);
 void set_mtm_tx_slot(uint8_t timeslot);
 void mtm_reset_rx_queue();
+uint8_t mtm_get_rx_queue_len(); // timestamps that go out with our next frame of the current lane
+uint32_t mtm_get_round_counter();
 void mtm_reset();
+#if TSCH_MTM_DEFERRED_PROCESSING
+void tsch_mtm_process_pending(); // handle all queued receptions, called by TSCH_MTM_PROCESS
+#endif
 
 list_t tsch_prop_get_neighbor_list();
+struct mtm_neighbor *tsch_prop_get_neighbor(ranging_addr_t addr);
+// Copies the occupied timeslots to bitmap (TSCH_MTM_OCCUPANCY_WORDS words), bit t % 32 of
+// word t / 32 is set for timeslot t
+void tsch_prop_get_slot_occupancy(uint32_t *bitmap);
+// the node last observed sending in the timeslot, 0 if none
+ranging_addr_t tsch_prop_get_slot_owner(uint8_t timeslot);
+// called by the slot operation for every MTM reception that failed
+void mtm_failed_reception(uint8_t timeslot);
+#if TSCH_MTM_SLOT_CLAIMS
+// Bitmaps as above: claimed are the slots in which our neighbors received frames, this
+// includes our own slot. collided are the slots in which our or our neighbors' receptions failed.
+void tsch_prop_get_slot_claims(uint32_t *claimed, uint32_t *collided);
+#endif
 #if WITH_PASSIVE_TDOA
 list_t tsch_prop_get_tdoa_list();
 #endif
@@ -184,12 +420,20 @@ list_t tsch_prop_get_tdoa_list();
 
 float time_to_dist(float tof);
 
+// ranging kernels, both variants are always available, TSCH_MTM_FIXED_POINT selects the one in use
+float calculate_propagation_time_alternative(struct ds_twr_ts *ts);
+float calculate_propagation_time_fixed(struct ds_twr_ts *ts);
+#if WITH_PASSIVE_TDOA
+float mtm_compute_tdoa(struct mtm_tdoa_ts *ts);
+float mtm_compute_tdoa_fixed(struct mtm_tdoa_ts *ts);
+#endif
+
 /* tsch_prop_time is defined in tsch-queue.h to avoid loop in declaration. */
 int tsch_packet_create_multiranging_packet(
     uint8_t *buf,
     int buf_size,
     const linkaddr_t *dest_addr,
-    uint8_t seqno,
+    uint8_t seqno, // position in the burst, must be below TSCH_MTM_BURST_LEN
     uint64_t tx_timestamp);
 
 int
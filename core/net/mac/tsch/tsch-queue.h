@@ -121,6 +121,18 @@ struct tsch_prop_time
   uint8_t tsch_channel;
 };
 
+/* Drift model of a time source neighbor, see tsch-adaptive-timesync.c */
+struct tsch_timesync_drift
+{
+  int32_t drift_ticks[TSCH_ADAPTIVE_TIMESYNC_HISTORY]; /* Drift measured over each interval */
+  uint32_t interval_asn[TSCH_ADAPTIVE_TIMESYNC_HISTORY]; /* Length of each interval */
+  int32_t drift_ppm; /* Estimated drift, ppm multiplied by 256 */
+  uint16_t error_ticks; /* Largest residual of the estimate over the history */
+  int32_t error_ppm; /* Largest residual per interval length, ppm multiplied by 256 */
+  uint8_t pos; /* Next entry of the history to write */
+  uint8_t count; /* Number of valid entries in the history */
+};
+
 /* TSCH packet information */
 struct tsch_packet {
   struct queuebuf *qb;  /* pointer to the queuebuf to be sent */
@@ -151,6 +163,9 @@ struct tsch_neighbor {
   /* Circular buffer of pointers to packet. */
   struct ringbufindex tx_ringbuf;
   struct tsch_prop_time last_prop_time;
+#if TSCH_ADAPTIVE_TIMESYNC
+  struct tsch_timesync_drift timesync_drift;
+#endif /* TSCH_ADAPTIVE_TIMESYNC */
 };
 
 /***** External Variables *****/
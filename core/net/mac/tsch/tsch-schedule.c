@@ -75,6 +75,24 @@ MEMB(slotframe_memb, struct tsch_slotframe, TSCH_SCHEDULE_MAX_SLOTFRAMES);
 /* List of slotframes (each slotframe holds its own list of links) */
 LIST(slotframe_list);
 
+/* Returns the position of the first link of the slotframe with a timeslot
+ * greater or equal to 'timeslot' in links_by_timeslot (links_count if none) */
+static uint16_t
+links_lower_bound(const struct tsch_slotframe *sf, uint16_t timeslot)
+{
+  uint16_t lo = 0;
+  uint16_t hi = sf->links_count;
+  while(lo < hi) {
+    uint16_t mid = lo + (hi - lo) / 2;
+    if(sf->links_by_timeslot[mid]->timeslot < timeslot) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
 /* Adds and returns a slotframe (NULL if failure) */
 struct tsch_slotframe *
 tsch_schedule_add_slotframe(uint16_t handle, uint16_t size)
@@ -119,6 +137,7 @@ tsch_schedule_add_slotframe(uint16_t handle, uint16_t size)
       sf->handle = handle;
       TSCH_ASN_DIVISOR_INIT(sf->size, size);
       LIST_STRUCT_INIT(sf, links_list);
+      sf->links_count = 0;
       /* Add the slotframe to the global list */
       list_add(slotframe_list, sf);
     }
@@ -271,8 +290,16 @@ tsch_schedule_add_link(struct tsch_slotframe *slotframe,
       } else {
         static int current_link_handle = 0;
         struct tsch_neighbor *n;
+        uint16_t pos;
         /* Add the link to the slotframe */
         list_add(slotframe->links_list, l);
+        /* Insert it into the timeslot index. The timeslot is free, any link
+         * previously installed there was removed above */
+        pos = links_lower_bound(slotframe, timeslot);
+        memmove(&slotframe->links_by_timeslot[pos + 1], &slotframe->links_by_timeslot[pos],
+                (slotframe->links_count - pos) * sizeof(struct tsch_link *));
+        slotframe->links_by_timeslot[pos] = l;
+        slotframe->links_count++;
         /* Initialize link */
         l->handle = current_link_handle++;
         l->link_options = link_options;
@@ -344,6 +371,7 @@ tsch_schedule_remove_link(struct tsch_slotframe *slotframe, struct tsch_link *l)
     if(tsch_get_lock()) {
       uint8_t link_options;
       linkaddr_t addr;
+      uint16_t pos;
 
       /* Save link option and addr in local variables as we need them
        * after freeing the link */
@@ -360,6 +388,18 @@ tsch_schedule_remove_link(struct tsch_slotframe *slotframe, struct tsch_link *l)
              TSCH_LOG_ID_FROM_LINKADDR(&l->addr));
 
       list_remove(slotframe->links_list, l);
+      /* Several links (e.g. on different channel offsets) may share the
+       * timeslot, look for l among all of them */
+      pos = links_lower_bound(slotframe, l->timeslot);
+      while(pos < slotframe->links_count && slotframe->links_by_timeslot[pos] != l
+            && slotframe->links_by_timeslot[pos]->timeslot == l->timeslot) {
+        pos++;
+      }
+      if(pos < slotframe->links_count && slotframe->links_by_timeslot[pos] == l) {
+        slotframe->links_count--;
+        memmove(&slotframe->links_by_timeslot[pos], &slotframe->links_by_timeslot[pos + 1],
+                (slotframe->links_count - pos) * sizeof(struct tsch_link *));
+      }
       memb_free(&link_memb, l);
 
       /* Release the lock before we update the neighbor (will take the lock) */
@@ -402,15 +442,13 @@ tsch_schedule_get_link_by_timeslot(struct tsch_slotframe *slotframe, uint16_t ti
 {
   if(!tsch_is_locked()) {
     if(slotframe != NULL) {
-      struct tsch_link *l = list_head(slotframe->links_list);
-      /* Loop over all items. Assume there is max one link per timeslot */
-      while(l != NULL) {
-        if(l->timeslot == timeslot) {
-          return l;
-        }
-        l = list_item_next(l);
+      /* There is max one link per timeslot, look it up in the index */
+      uint16_t pos = links_lower_bound(slotframe, timeslot);
+      if(pos < slotframe->links_count
+         && slotframe->links_by_timeslot[pos]->timeslot == timeslot) {
+        return slotframe->links_by_timeslot[pos];
       }
-      return l;
+      return NULL;
     }
   }
   return NULL;
@@ -433,8 +471,15 @@ tsch_schedule_get_next_active_link(struct tsch_asn_t *asn, uint16_t *time_offset
     while(sf != NULL) {
       /* Get timeslot from ASN, given the slotframe length */
       uint16_t timeslot = TSCH_ASN_MOD(*asn, sf->size);
-      struct tsch_link *l = list_head(sf->links_list);
-      while(l != NULL) {
+      struct tsch_link *l = NULL;
+      if(sf->links_count > 0) {
+        /* There is max one link per timeslot, so the earliest link of this
+         * slotframe is the first one strictly after the current timeslot,
+         * wrapping around to the first link of the slotframe */
+        uint16_t pos = links_lower_bound(sf, timeslot + 1);
+        l = sf->links_by_timeslot[pos < sf->links_count ? pos : 0];
+      }
+      if(l != NULL) {
         uint16_t time_to_timeslot =
           l->timeslot > timeslot ?
           l->timeslot - timeslot :
@@ -476,8 +521,6 @@ tsch_schedule_get_next_active_link(struct tsch_asn_t *asn, uint16_t *time_offset
             curr_best = new_best;
           }
         }
-
-        l = list_item_next(l);
       }
       sf = list_item_next(sf);
     }
@@ -140,6 +140,10 @@ struct tsch_slotframe {
   struct tsch_asn_divisor_t size;
   /* List of links belonging to this slotframe */
   LIST_STRUCT(links_list);
+  /* The same links, sorted by timeslot. Maintained by add_link and
+   * remove_link so that the next active link is found by binary search */
+  struct tsch_link *links_by_timeslot[TSCH_SCHEDULE_MAX_LINKS];
+  uint16_t links_count;
 };
 
 /********** Functions *********/
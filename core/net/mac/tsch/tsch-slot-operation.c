@@ -40,6 +40,9 @@
  *
  */
 
+/* Source file of the message logs in binary trace mode (tsch-log.h) */
+#define TSCH_LOG_FILE_ID TSCH_LOG_FILE_ID_SLOT_OPERATION
+
 #include "contiki.h"
 #include "dev/radio.h"
 #include "dw1000.h"
@@ -56,6 +59,8 @@
 #include "net/mac/tsch/tsch-prop.h"
 #include "net/mac/tsch/tsch-security.h"
 #include "net/mac/tsch/tsch-adaptive-timesync.h"
+#include "net/mac/tsch/tsch-mtm-timing.h"
+#include "net/mac/tsch/tsch-mtm-stats.h"
 #include "tsch-schedule.h"
 #include "watchdog.h"
 #include "random.h"
@@ -189,6 +194,9 @@
   #include "dw1000-driver.h" /* US_TO_RADIO */
   #include "dw1000-arch.h" /* US_TO_RADIO */
   #include "dw1000-util.h"
+  #if !TSCH_CHORUS_RAW_CIR
+  #include "dw1000-cir.h"
+  #endif /* !TSCH_CHORUS_RAW_CIR */
 
 
 #endif /* TSCH_CHORUS */
@@ -406,10 +414,10 @@ tsch_get_lock(void)
       tsch_lock_requested = 0;
       if(busy_wait) {
         /* Issue a log whenever we had to busy wait until getting the lock */
-        TSCH_LOG_ADD(tsch_log_message,
+        TSCH_LOG_ADD_ARGS(tsch_log_message,
             snprintf(log->message, sizeof(log->message),
-                "!get lock delay %u", (unsigned)busy_wait_time);
-        );
+                "!get lock delay %u", (unsigned)busy_wait_time),
+            (unsigned)busy_wait_time, 0, 0);
       }
       return 1;
     }
@@ -478,11 +486,11 @@ tsch_schedule_slot_operation(struct rtimer *tm, rtimer_clock_t ref_time, rtimer_
   _PRINTF("tsch_schedule_slot_operation: now=%lu, ref_time=%lu, offset=%lu\n", now, ref_time, offset);
 
   if(missed) {
-    TSCH_LOG_ADD(tsch_log_message,
+    TSCH_LOG_ADD_TAG(tsch_log_message,
                 snprintf(log->message, sizeof(log->message),
                     "!dl-miss %s %d %d",
-                        str, (int)(now-ref_time), (int)offset);
-    );
+                        str, (int)(now-ref_time), (int)offset),
+                str, (int)(now-ref_time), (int)offset, 0);
 
     return 0;
   }
@@ -881,10 +889,10 @@ PT_THREAD(tsch_tx_slot(struct pt *pt, struct rtimer *t))
                     drift_correction = eack_time_correction;
                   }
                   if(drift_correction != eack_time_correction) {
-                    TSCH_LOG_ADD(tsch_log_message,
+                    TSCH_LOG_ADD_ARGS(tsch_log_message,
                         snprintf(log->message, sizeof(log->message),
-                            "!truncated dr %d %d", (int)eack_time_correction, (int)drift_correction);
-                    );
+                            "!truncated dr %d %d", (int)eack_time_correction, (int)drift_correction),
+                        (int)eack_time_correction, (int)drift_correction, 0);
                   }
                   is_drift_correction_used = 1;
                   tsch_timesync_update(current_neighbor, since_last_timesync, drift_correction);
@@ -969,6 +977,111 @@ PT_THREAD(tsch_tx_slot(struct pt *pt, struct rtimer *t))
   PT_END(pt);
 }
 /*---------------------------------------------------------------------------*/
+#if TSCH_RX_HEADER_FILTER
+/* Header fields parsed by the last call of rx_header_parse */
+static frame802154_t rx_header_frame;
+
+/* Parses the first bytes of a frame into rx_header_frame. Returns 0 if the
+ * header could not be parsed, rx_header_frame is not valid then */
+static int
+rx_header_parse(const void *header, unsigned short header_len)
+{
+  return frame802154_parse((uint8_t *)header, header_len, &rx_header_frame) != 0;
+}
+/*---------------------------------------------------------------------------*/
+/* Keeps frames to our PAN that are addressed to us or broadcast */
+static int
+rx_header_addressed_to_us(void)
+{
+  static linkaddr_t source_address;
+  static linkaddr_t destination_address;
+
+  return frame802154_check_dest_panid(&rx_header_frame) &&
+         frame802154_extract_linkaddr(&rx_header_frame, &source_address, &destination_address) &&
+         (linkaddr_cmp(&destination_address, &linkaddr_node_addr) ||
+          linkaddr_cmp(&destination_address, &linkaddr_null));
+}
+/*---------------------------------------------------------------------------*/
+/* Header filter of the RX slot, called by the radio with the first bytes of
+ * a frame, so that frames not for us are dropped before their payload is
+ * transferred. Frames with a header longer than what was read (e.g. with an
+ * auxiliary security header) are kept, they are checked after the full read */
+static int
+rx_header_filter(const void *header, unsigned short header_len, unsigned short frame_len)
+{
+  if(!rx_header_parse(header, header_len)) {
+    return header_len < frame_len;
+  }
+  return rx_header_addressed_to_us();
+}
+/*---------------------------------------------------------------------------*/
+/* Header filter of the MTM RX slot, additionally drops frames whose sequence
+ * number is not a position in the burst */
+static int
+mtm_rx_header_filter(const void *header, unsigned short header_len, unsigned short frame_len)
+{
+  if(!rx_header_parse(header, header_len)) {
+    return header_len < frame_len;
+  }
+  return rx_header_addressed_to_us() && rx_header_frame.seq < TSCH_MTM_BURST_LEN;
+}
+/*---------------------------------------------------------------------------*/
+/* Arms the radio to check the header of the next frame read */
+static void
+set_rx_header_filter(radio_rx_header_filter_t filter)
+{
+  NETSTACK_RADIO.set_object(RADIO_LOC_RX_HEADER_FILTER, &filter, sizeof(filter));
+}
+#endif /* TSCH_RX_HEADER_FILTER */
+/*---------------------------------------------------------------------------*/
+#if TSCH_DYNAMIC_GUARD_TIME
+/* Guard time needed on each side of the expected TX time, in ticks: the
+ * time since the last sync with our time source times the error rate of
+ * its adaptive timesync drift estimate, plus the timesync measurement
+ * error. The sender is assumed to be synchronized as well as we are,
+ * hence the factor 2.
+ * Returns 0 if the drift of our time source has not been learnt yet. */
+static rtimer_clock_t
+tsch_dynamic_guard_time(void)
+{
+  struct tsch_neighbor *n = tsch_queue_get_time_source();
+  int32_t error_ppm;
+  uint32_t since_sync_ticks;
+
+  if(tsch_is_coordinator || n == NULL
+     || tsch_timesync_get_drift(n, NULL, &error_ppm) < TSCH_ADAPTIVE_TIMESYNC_HISTORY) {
+    return 0;
+  }
+
+  since_sync_ticks = (uint32_t)TSCH_ASN_DIFF(tsch_current_asn, last_sync_asn)
+    * tsch_timing[tsch_ts_timeslot_length];
+  return 2 * ((uint64_t)since_sync_ticks * error_ppm / TSCH_DRIFT_UNIT
+              + TSCH_TIMESYNC_MEASUREMENT_ERROR)
+    + US_TO_RTIMERTICKS(TSCH_DYNAMIC_GUARD_MIN_US);
+}
+/*---------------------------------------------------------------------------*/
+/* Shrink the listening window [*start, *end] (relative to the slot start)
+ * to the dynamic guard time on each side of tx_offset. The early and the
+ * late side are trimmed separately, as the configured window need not be
+ * symmetric around tx_offset, and never grow. A window that ends before
+ * tx_offset is left as it is. */
+static void
+tsch_dynamic_rx_window(rtimer_clock_t tx_offset, rtimer_clock_t *start, rtimer_clock_t *end)
+{
+  rtimer_clock_t guard = tsch_dynamic_guard_time();
+
+  if(guard == 0 || *end <= tx_offset) {
+    return;
+  }
+  if(*start < tx_offset && tx_offset - *start > guard) {
+    *start = tx_offset - guard;
+  }
+  if(*end - tx_offset > guard) {
+    *end = tx_offset + guard;
+  }
+}
+#endif /* TSCH_DYNAMIC_GUARD_TIME */
+/*---------------------------------------------------------------------------*/
 static
 PT_THREAD(tsch_rx_slot(struct pt *pt, struct rtimer *t))
 {
@@ -1000,6 +1113,8 @@ PT_THREAD(tsch_rx_slot(struct pt *pt, struct rtimer *t))
     /* Rx timestamps */
     static rtimer_clock_t rx_start_time;
     static rtimer_clock_t expected_rx_time;
+    /* Listening window, relative to the slot start */
+    static rtimer_clock_t rx_window_start, rx_window_end;
     static rtimer_clock_t packet_duration;
     uint8_t packet_seen;
 
@@ -1011,7 +1126,13 @@ PT_THREAD(tsch_rx_slot(struct pt *pt, struct rtimer *t))
 
 
     /* Wait before starting to listen */
-    TSCH_SCHEDULE_AND_YIELD(pt, t, current_slot_start, tsch_timing[tsch_ts_rx_offset] - RADIO_DELAY_BEFORE_RX, "RxBeforeListen");
+    rx_window_start = tsch_timing[tsch_ts_rx_offset];
+    rx_window_end = tsch_timing[tsch_ts_rx_offset] + tsch_timing[tsch_ts_rx_wait];
+#if TSCH_DYNAMIC_GUARD_TIME
+    tsch_dynamic_rx_window(tsch_timing[tsch_ts_tx_offset], &rx_window_start, &rx_window_end);
+#endif /* TSCH_DYNAMIC_GUARD_TIME */
+
+    TSCH_SCHEDULE_AND_YIELD(pt, t, current_slot_start, rx_window_start - RADIO_DELAY_BEFORE_RX, "RxBeforeListen");
     TSCH_DEBUG_RX_EVENT();
 
     /* Start radio for at least guard time */
@@ -1020,7 +1141,7 @@ PT_THREAD(tsch_rx_slot(struct pt *pt, struct rtimer *t))
     if(!packet_seen) {
       /* Check if receiving within guard time */
       BUSYWAIT_UNTIL_ABS((packet_seen = NETSTACK_RADIO.receiving_packet()),
-          current_slot_start, tsch_timing[tsch_ts_rx_offset] + tsch_timing[tsch_ts_rx_wait] + RADIO_DELAY_BEFORE_DETECT);
+          current_slot_start, rx_window_end + RADIO_DELAY_BEFORE_DETECT);
     }
     if(!packet_seen) {
       /* no packets on air */
@@ -1043,7 +1164,10 @@ PT_THREAD(tsch_rx_slot(struct pt *pt, struct rtimer *t))
         radio_value_t radio_last_rssi;
 
 
-        /* Read packet */
+        /* Read packet, straight into its slot of the input ringbuf */
+#if TSCH_RX_HEADER_FILTER
+        set_rx_header_filter(rx_header_filter);
+#endif
         current_input->len = NETSTACK_RADIO.read((void *)current_input->payload, TSCH_PACKET_MAX_LEN);
         NETSTACK_RADIO.get_value(RADIO_PARAM_LAST_RSSI, &radio_last_rssi);
         current_input->rx_asn = tsch_current_asn;
@@ -1070,15 +1194,17 @@ PT_THREAD(tsch_rx_slot(struct pt *pt, struct rtimer *t))
                &frame, &source_address, &tsch_current_asn)) {
             current_input->len -= tsch_security_mic_len(&frame);
           } else {
-            TSCH_LOG_ADD(tsch_log_message,
+            TSCH_LOG_ADD_ARGS(tsch_log_message,
                 snprintf(log->message, sizeof(log->message),
-                "!failed to authenticate frame %u", current_input->len));
+                "!failed to authenticate frame %u", current_input->len),
+                current_input->len, 0, 0);
             frame_valid = 0;
           }
         } else {
-          TSCH_LOG_ADD(tsch_log_message,
+          TSCH_LOG_ADD_ARGS(tsch_log_message,
               snprintf(log->message, sizeof(log->message),
-              "!failed to parse frame %u %u", header_len, current_input->len));
+              "!failed to parse frame %u %u", header_len, current_input->len),
+              header_len, current_input->len, 0);
           frame_valid = 0;
         }
 #endif /* LLSEC802154_ENABLED */
@@ -1152,6 +1278,12 @@ PT_THREAD(tsch_rx_slot(struct pt *pt, struct rtimer *t))
             }
 
 
+            /* Keep the parsed header for tsch_rx_process_pending.
+             * The MIC, if any, has been removed from the payload */
+            current_input->frame = frame;
+            current_input->frame.payload_len = current_input->len - header_len;
+            current_input->header_len = header_len;
+
             /* Add current input to ringbuf */
             ringbufindex_put(&input_ringbuf);
 
@@ -1178,10 +1310,10 @@ PT_THREAD(tsch_rx_slot(struct pt *pt, struct rtimer *t))
     }
 
     if(input_queue_drop != 0) {
-      TSCH_LOG_ADD(tsch_log_message,
+      TSCH_LOG_ADD_ARGS(tsch_log_message,
           snprintf(log->message, sizeof(log->message),
-              "!queue full skipped %u", input_queue_drop);
-      );
+              "!queue full skipped %u", input_queue_drop),
+          input_queue_drop, 0, 0);
       input_queue_drop = 0;
     }
   }
@@ -1226,13 +1358,13 @@ PT_THREAD(tsch_slot_operation(struct rtimer *t, void *ptr))
     if(current_link == NULL || tsch_lock_requested) { /* Skip slot operation if there is no link
                                                           or if there is a pending request for getting the lock */
       /* Issue a log whenever skipping a slot */
-      TSCH_LOG_ADD(tsch_log_message,
+      TSCH_LOG_ADD_ARGS(tsch_log_message,
                       snprintf(log->message, sizeof(log->message),
                           "!skipped slot %u %u %u",
                             tsch_locked,
                             tsch_lock_requested,
-                            current_link == NULL);
-      );
+                            current_link == NULL),
+                      tsch_locked, tsch_lock_requested, current_link == NULL);
     } else {
       int is_active_slot;
       tsch_in_slot_operation = 1;
@@ -1259,10 +1391,10 @@ PT_THREAD(tsch_slot_operation(struct rtimer *t, void *ptr))
           radio_value_t radio_state = RADIO_RESULT_NOT_SUPPORTED;
 
           if(NETSTACK_RADIO.get_value(RADIO_SLEEP_STATE, &radio_state) == RADIO_RESULT_OK){
-                              TSCH_LOG_ADD(tsch_log_message,
+                              TSCH_LOG_ADD_ARGS(tsch_log_message,
                           snprintf(log->message, sizeof(log->message),
-                              "radio_state %d %d ",radio_state,RADIO_SLEEP);
-                          );
+                              "radio_state %d %d ",radio_state,RADIO_SLEEP),
+                          radio_state, RADIO_SLEEP, 0);
             if(radio_state == (radio_value_t) RADIO_SLEEP){
               // printf("radio state sleep\n");
               if(NETSTACK_RADIO.set_value(RADIO_SLEEP_STATE, RADIO_REQUEST_WAKEUP) == RADIO_RESULT_OK){
@@ -1271,13 +1403,13 @@ PT_THREAD(tsch_slot_operation(struct rtimer *t, void *ptr))
                               "Wake up requested");
                           );
                     rtimer_now = RTIMER_NOW();
-                    TSCH_LOG_ADD(tsch_log_message,
+                    TSCH_LOG_ADD_ARGS(tsch_log_message,
                           snprintf(log->message, sizeof(log->message),
                               "Wake up ref time %lu, offset %ld, now %lu",
                               current_slot_start-TSCH_SLOT_START_BEFOREHAND,
                               US_TO_RTIMERTICKS(3000),
-                              rtimer_now);
-                          );
+                              rtimer_now),
+                          current_slot_start-TSCH_SLOT_START_BEFOREHAND, US_TO_RTIMERTICKS(3000), rtimer_now);
 
                 TSCH_SCHEDULE_AND_YIELD(&slot_operation_pt, t, current_slot_start- US_TO_RTIMERTICKS(150), 0, "wait");
 
@@ -1384,11 +1516,11 @@ PT_THREAD(tsch_slot_operation(struct rtimer *t, void *ptr))
     /* Do we need to resynchronize? i.e., wait for EB again */
     if(!tsch_is_coordinator && (TSCH_ASN_DIFF(tsch_current_asn, last_sync_asn) >
         (100 * TSCH_CLOCK_TO_SLOTS(TSCH_DESYNC_THRESHOLD / 100, tsch_timing[tsch_ts_timeslot_length])))) {
-      TSCH_LOG_ADD(tsch_log_message,
+      TSCH_LOG_ADD_ARGS(tsch_log_message,
             snprintf(log->message, sizeof(log->message),
                 "! leaving the network, last sync %u",
-                          (unsigned)TSCH_ASN_DIFF(tsch_current_asn, last_sync_asn));
-      );
+                          (unsigned)TSCH_ASN_DIFF(tsch_current_asn, last_sync_asn)),
+            (unsigned)TSCH_ASN_DIFF(tsch_current_asn, last_sync_asn), 0, 0);
 
     printf("! leaving the network, last sync %u\n",
                           (unsigned)TSCH_ASN_DIFF(tsch_current_asn, last_sync_asn));
@@ -1436,13 +1568,13 @@ PT_THREAD(tsch_slot_operation(struct rtimer *t, void *ptr))
         current_slot_start += tsch_timesync_adaptive_compensate(time_to_next_active_slot);
 
                 rtimer_now = RTIMER_NOW();
-                TSCH_LOG_ADD(tsch_log_message,
+                TSCH_LOG_ADD_ARGS(tsch_log_message,
                       snprintf(log->message, sizeof(log->message),
                           "slot time %lu, offset %ld, now %lu",
                           prev_slot_start,
                           time_to_next_active_slot-TSCH_SLOT_START_BEFOREHAND,
-                          rtimer_now);
-                      );
+                          rtimer_now),
+                      prev_slot_start, time_to_next_active_slot-TSCH_SLOT_START_BEFOREHAND, rtimer_now);
 
       } while(!tsch_schedule_slot_operation(t, prev_slot_start-TSCH_SLOT_START_BEFOREHAND, time_to_next_active_slot, "main"));
     }
@@ -1633,10 +1765,10 @@ PT_THREAD(tsch_tx_prop_slot(struct pt *pt, struct rtimer *t))
               drift_correction = eack_time_correction;
             }
             if(drift_correction != eack_time_correction) {
-              TSCH_LOG_ADD(tsch_log_message,
+              TSCH_LOG_ADD_ARGS(tsch_log_message,
                   snprintf(log->message, sizeof(log->message),
-                      "!truncated dr %d %d", (int)eack_time_correction, (int)drift_correction);
-              );
+                      "!truncated dr %d %d", (int)eack_time_correction, (int)drift_correction),
+                  (int)eack_time_correction, (int)drift_correction, 0);
             }
             is_drift_correction_used = 1;
             tsch_timesync_update(current_neighbor, since_last_timesync, drift_correction);
@@ -2079,14 +2211,37 @@ PT_THREAD(tsch_rx_prop_slot(struct pt *pt, struct rtimer *t))
 
 
 #if TSCH_MTM_LOCALISATION
+/* Phase timestamps are taken for the printed slot durations and the timing statistics */
+#define MTM_SLOT_TIMESTAMPS (MTM_SLOT_DURATIONS_EVAL || TSCH_MTM_TIMING_STATS)
+
+#if MTM_EVAL_OUTPUT_FRAMES
+/* Print one line per MTM slot event. The output can be replayed on the host
+ * with examples/dwm1001/mtm-replay. Note that this might require an increase
+ * of the tsch timeslot length. */
+static void
+mtm_eval_output_frame(const char *type, uint8_t timeslot, uint64_t ts, const uint8_t *buf, int len)
+{
+  int i;
+  printf("%s, %u, %02x%08x", type, timeslot, (uint32_t)(ts >> 32), (uint32_t)ts);
+  if(buf != NULL) {
+    printf(", ");
+    for(i = 0; i < len; i++) {
+      printf("%02x", buf[i]);
+    }
+  }
+  printf("\n");
+}
+#endif
+
 static
 PT_THREAD(tsch_mtm_tx_slot(struct pt *pt, struct rtimer *t))
 {
   /**
    * MTM measurement slot:
-   * Basically only broadcast one TX message for now
-   * Optionally can be extended later by repeated
-   * transmissions in order to derive more measurements.
+   * Broadcast a burst of TSCH_MTM_BURST_LEN delayed TX messages.
+   * The first one leaves at loc_tx_offset, every following one
+   * TSCH_MTM_BURST_INTERVAL_US after its predecessor. Each frame
+   * carries its position in the burst as sequence number.
    *
    **/
 
@@ -2104,20 +2259,23 @@ PT_THREAD(tsch_mtm_tx_slot(struct pt *pt, struct rtimer *t))
   /* packet constructino */
   static uint8_t packet_buf[TSCH_PACKET_MAX_LEN];
   static uint8_t packet_len;
-  static uint8_t seqno;
+  static uint8_t burst;
 
-  #if MTM_SLOT_DURATIONS_EVAL
+  #if MTM_SLOT_TIMESTAMPS
   static rtimer_clock_t slot_start_time, prepare_end_time, tx_start_time, tx_end_time, prop_handling_end_time;
+  static uint8_t tx_entries, tx_handled;
   #endif
 
   static uint16_t mtm_delay_us;
+  static uint16_t burst_interval_us = TSCH_MTM_BURST_INTERVAL_US;
 
   /* timestamp of transmitted messages */
   static uint64_t timestamp_tx;
   static uint16_t tx_antenna_delay;
 
-#if MTM_SLOT_DURATIONS_EVAL
+#if MTM_SLOT_TIMESTAMPS
   slot_start_time = RTIMER_NOW();
+  tx_handled = 0;
 #endif
 
   mtm_delay_us = RTIMERTICKS_TO_US(tsch_timing[tsch_ts_loc_tx_offset]);
@@ -2128,80 +2286,107 @@ PT_THREAD(tsch_mtm_tx_slot(struct pt *pt, struct rtimer *t))
 
   /* printf("%u", RTIMERTICKS_TO_US(mtm_delay_us)); */
 
-  /* Schedule a delayed transmission */
-  NETSTACK_RADIO.set_object(RADIO_LOC_TX_DELAYED_US_MTM, &mtm_delay_us, sizeof(uint16_t));
-
-  // calculate corrected timestamp
   NETSTACK_RADIO.get_object(RADIO_LOC_TX_ANTENNA_DELAY, &tx_antenna_delay, sizeof(uint16_t));
 
-  timestamp_tx = dw_get_dx_timestamp() + tx_antenna_delay;
-  /* timestamp_tx = (((uint64_t)(dw_get_dx_timestamp() & 0xFFFFFFFEUL)) << 8) + tx_antenna_delay; */
-  /* create payload */
-  packet_len = tsch_packet_create_multiranging_packet(packet_buf,
-      TSCH_PACKET_MAX_LEN,
-      &tsch_broadcast_address,
-      seqno,
-      timestamp_tx
-  );
+  current_neighbor = tsch_queue_add_nbr(&(current_link->addr));
 
+  for(burst = 0; burst < TSCH_MTM_BURST_LEN; burst++) {
+    mtm_set_burst_index(burst);
+#if MTM_SLOT_TIMESTAMPS
+    tx_entries = mtm_get_rx_queue_len();
+#endif
 
-  current_neighbor = tsch_queue_add_nbr(&(current_link->addr));
+    /* Schedule a delayed transmission, the following frames of the burst relative to the previous one */
+    if(burst == 0) {
+      NETSTACK_RADIO.set_object(RADIO_LOC_TX_DELAYED_US_MTM, &mtm_delay_us, sizeof(uint16_t));
+    } else {
+      NETSTACK_RADIO.set_object(RADIO_LOC_TX_DELAYED_US_MTM_BURST, &burst_interval_us, sizeof(uint16_t));
+    }
 
-  if(NETSTACK_RADIO.prepare(packet_buf, packet_len) == 0) { /* 0 means success */
+    // calculate corrected timestamp
+    timestamp_tx = dw_get_dx_timestamp() + tx_antenna_delay;
+    /* timestamp_tx = (((uint64_t)(dw_get_dx_timestamp() & 0xFFFFFFFEUL)) << 8) + tx_antenna_delay; */
+    /* create payload */
+    packet_len = tsch_packet_create_multiranging_packet(packet_buf,
+        TSCH_PACKET_MAX_LEN,
+        &tsch_broadcast_address,
+        burst,
+        timestamp_tx
+    );
 
-#if MTM_SLOT_DURATIONS_EVAL
-      prepare_end_time = RTIMER_NOW();
+    if(NETSTACK_RADIO.prepare(packet_buf, packet_len) == 0) { /* 0 means success */
+
+#if MTM_SLOT_TIMESTAMPS
+      if(burst == 0) {
+        prepare_end_time = RTIMER_NOW();
+        tsch_mtm_timing_record(TSCH_MTM_TIMING_TX_PREPARE, current_slot_start, prepare_end_time, tx_entries);
+      }
 #endif
 
       QUICK_TOGGLE_GPIO();
 
-    TSCH_WAIT(pt, t, current_slot_start, tsch_timing[tsch_ts_loc_tx_offset] - RADIO_DELAY_BEFORE_TX, "msg1TX");
+      if(burst == 0) {
+        TSCH_WAIT(pt, t, current_slot_start, tsch_timing[tsch_ts_loc_tx_offset] - RADIO_DELAY_BEFORE_TX, "msg1TX");
+      }
 
-    TOGGLE_DEBUG_GPIO();
+      TOGGLE_DEBUG_GPIO();
 
-    TSCH_DEBUG_TX_EVENT();
+      TSCH_DEBUG_TX_EVENT();
 
-#if MTM_SLOT_DURATIONS_EVAL
-    tx_start_time = RTIMER_NOW();
+#if MTM_SLOT_TIMESTAMPS
+      tx_start_time = RTIMER_NOW();
 #endif
-    mac_status = NETSTACK_RADIO.transmit(packet_len);
-#if MTM_SLOT_DURATIONS_EVAL
-    tx_end_time = RTIMER_NOW();
+      mac_status = NETSTACK_RADIO.transmit(packet_len);
+#if MTM_SLOT_TIMESTAMPS
+      tx_end_time = RTIMER_NOW();
+      tsch_mtm_timing_record(TSCH_MTM_TIMING_TX, tx_start_time, tx_end_time, tx_entries);
 #endif
-    tsch_radio_off(TSCH_RADIO_CMD_OFF_WITHIN_TIMESLOT);
+      tsch_radio_off(TSCH_RADIO_CMD_OFF_WITHIN_TIMESLOT);
 
-    TOGGLE_DEBUG_GPIO();
+      TOGGLE_DEBUG_GPIO();
 
-    if(mac_status == RADIO_TX_OK) {
-      // pass asn and timestamp
-        add_mtm_transmission_timestamp(&tsch_current_asn, timestamp_tx);
-    } else {
-        add_mtm_transmission_timestamp(&tsch_current_asn, UINT64_MAX);
-        _PRINTF("MTM: TX failed: 1\n");
-    }
+      if(mac_status == RADIO_TX_OK) {
+        // pass asn and timestamp
+          add_mtm_transmission_timestamp(&tsch_current_asn, timestamp_tx);
+#if MTM_EVAL_OUTPUT_FRAMES
+          mtm_eval_output_frame("mtmt", current_link->timeslot, timestamp_tx, packet_buf, packet_len);
+#endif
+      } else {
+          add_mtm_transmission_timestamp(&tsch_current_asn, UINT64_MAX);
+          _PRINTF("MTM: TX failed: 1\n");
+      }
 
-#if MTM_SLOT_DURATIONS_EVAL
-    prop_handling_end_time = RTIMER_NOW();
+#if MTM_SLOT_TIMESTAMPS
+      prop_handling_end_time = RTIMER_NOW();
+      tsch_mtm_timing_record(TSCH_MTM_TIMING_TX_HANDLING, tx_end_time, prop_handling_end_time, tx_entries);
+      tx_handled = 1;
 #endif
 
-    /* printf("ppl, %u\n", packet_len); */
+      /* printf("ppl, %u\n", packet_len); */
 
-    // last read out tx_timestamp and compare with the timestamp we set in the delayed send
-    uint64_t reference_tx = 0x0;
-    NETSTACK_RADIO.get_object(RADIO_LOC_LAST_TX_TIMESPTAMP, &reference_tx, sizeof(uint64_t));
+      // last read out tx_timestamp and compare with the timestamp we set in the delayed send
+      uint64_t reference_tx = 0x0;
+      NETSTACK_RADIO.get_object(RADIO_LOC_LAST_TX_TIMESPTAMP, &reference_tx, sizeof(uint64_t));
 
 #if MTM_SLOT_DURATIONS_EVAL
-    /* printf("txd, %u, %u, %u, %u\n", */
-    /*     RTIMERTICKS_TO_US(prepare_end_time) - RTIMERTICKS_TO_US(slot_start_time), RTIMERTICKS_TO_US(tx_start_time) - RTIMERTICKS_TO_US(prepare_end_time), RTIMERTICKS_TO_US(tx_end_time) - RTIMERTICKS_TO_US(tx_start_time), */
-    /*     RTIMERTICKS_TO_US(prop_handling_end_time) - RTIMERTICKS_TO_US(tx_end_time)); */
+      /* printf("txd, %u, %u, %u, %u\n", */
+      /*     RTIMERTICKS_TO_US(prepare_end_time) - RTIMERTICKS_TO_US(slot_start_time), RTIMERTICKS_TO_US(tx_start_time) - RTIMERTICKS_TO_US(prepare_end_time), RTIMERTICKS_TO_US(tx_end_time) - RTIMERTICKS_TO_US(tx_start_time), */
+      /*     RTIMERTICKS_TO_US(prop_handling_end_time) - RTIMERTICKS_TO_US(tx_end_time)); */
 #endif
 
-    if(reference_tx != timestamp_tx) {
-      printf("txmm\n");
+      if(reference_tx != timestamp_tx) {
+        printf("txmm\n");
+      }
+    } else {
+       add_mtm_transmission_timestamp(&tsch_current_asn, UINT64_MAX);
+       _PRINTF("MTM: TX failed: 2\n");
+       mac_status = RADIO_TX_ERR;
+    }
+
+    if(mac_status != RADIO_TX_OK) {
+      /* the following frames are scheduled relative to this one, give up on the rest of the burst */
+      break;
     }
-  } else {
-     add_mtm_transmission_timestamp(&tsch_current_asn, UINT64_MAX);
-     _PRINTF("MTM: TX failed: 2\n");
   }
 
   tsch_radio_off(TSCH_RADIO_CMD_OFF_END_OF_TIMESLOT);
@@ -2212,6 +2397,12 @@ PT_THREAD(tsch_mtm_tx_slot(struct pt *pt, struct rtimer *t))
 
   mtm_slot_end_handler(current_link->timeslot);
 
+#if MTM_SLOT_TIMESTAMPS
+  if(tx_handled) {
+    tsch_mtm_timing_record(TSCH_MTM_TIMING_SLOT_END, prop_handling_end_time, RTIMER_NOW(), tx_entries);
+  }
+#endif
+
   TSCH_DEBUG_TX_EVENT();
 
   #if TSCH_SLEEP
@@ -2226,8 +2417,9 @@ PT_THREAD(tsch_mtm_rx_slot(struct pt *pt, struct rtimer *t))
 {
   /**
    * MTM measurement slot:
-   * Basically only listens for one TX message from the currently broadcasting node.
-   * Optionally can be extended later by repeated transmissions in order to derive more measurements.
+   * Listens for the burst of TSCH_MTM_BURST_LEN TX messages of the currently broadcasting node.
+   * Once a frame of the burst was received, the following ones are only expected within
+   * TSCH_MTM_BURST_RX_GUARD_US around their scheduled time.
    *
    **/
 
@@ -2247,10 +2439,18 @@ PT_THREAD(tsch_mtm_rx_slot(struct pt *pt, struct rtimer *t))
   /* static uint8_t seqno; */
 
   static rtimer_clock_t expected_rx_time, rx_start_time;
+  /* Listening window of the first frame, relative to the slot start */
+  static rtimer_clock_t rx_window_start, rx_window_end;
   static int32_t estimated_drift;
 
-#if MTM_SLOT_DURATIONS_EVAL
+  /* burst reception */
+  static uint8_t burst, burst_synced;
+  /* burst_start_time is the SFD of the first frame of the burst */
+  static rtimer_clock_t burst_start_time, burst_interval, listen_ref, listen_end;
+
+#if MTM_SLOT_TIMESTAMPS
   static rtimer_clock_t slot_start_time, eval_rx_start_time, eval_rx_end_time, prop_handling_end_time;
+  static uint8_t rx_handled, rx_entries;
 #endif
 
   /* timestamp of transmitted messages */
@@ -2261,129 +2461,214 @@ PT_THREAD(tsch_mtm_rx_slot(struct pt *pt, struct rtimer *t))
   static uint64_t timestamp_rx_A, timestamp_tx_B;
   static uint8_t packet_seen;
 
-#if MTM_SLOT_DURATIONS_EVAL
+#if MTM_SLOT_TIMESTAMPS
     slot_start_time = RTIMER_NOW();
+    rx_handled = 0;
 #endif
 
 
   expected_rx_time = current_slot_start + tsch_timing[tsch_ts_loc_rx_offset];
 
   /* TSCH_SCHEDULE_AND_YIELD(pt, t, current_slot_start, tsch_timing[tsch_ts_loc_rx_offset] - RADIO_DELAY_BEFORE_RX, "RxBeforeListen"); */
-  TSCH_WAIT(pt, t, current_slot_start, tsch_timing[tsch_ts_loc_rx_offset] - RADIO_DELAY_BEFORE_RX, "RxBeforeListen");
+  rx_window_start = tsch_timing[tsch_ts_loc_rx_offset];
+  rx_window_end = tsch_timing[tsch_ts_loc_rx_offset] + tsch_timing[tsch_ts_loc_rx_wait];
+#if TSCH_DYNAMIC_GUARD_TIME
+  tsch_dynamic_rx_window(tsch_timing[tsch_ts_loc_tx_offset], &rx_window_start, &rx_window_end);
+#endif /* TSCH_DYNAMIC_GUARD_TIME */
+
+  TSCH_WAIT(pt, t, current_slot_start, rx_window_start - RADIO_DELAY_BEFORE_RX, "RxBeforeListen");
   /* write_byte('r'); */
 
 
-  TOGGLE_DEBUG_GPIO();
+  burst_synced = 0;
+  burst_interval = US_TO_RTIMERTICKS(TSCH_MTM_BURST_INTERVAL_US);
 
-  tsch_radio_on(TSCH_RADIO_CMD_ON_WITHIN_TIMESLOT);
+  for(burst = 0; burst < TSCH_MTM_BURST_LEN; burst++) {
+    if(burst == 0) {
+      listen_ref = current_slot_start;
+      listen_end = rx_window_end;
+    } else {
+      /* without a frame of this burst so far, listen as long as for the first one */
+      if(burst_synced) {
+        /* the preamble starts one SHR duration before the SFD */
+        listen_ref = burst_start_time - tsch_timing[tsch_ts_loc_uwb_t_shr];
+        listen_end = burst * burst_interval + US_TO_RTIMERTICKS(TSCH_MTM_BURST_RX_GUARD_US);
+        TSCH_WAIT(pt, t, listen_ref, burst * burst_interval - US_TO_RTIMERTICKS(TSCH_MTM_BURST_RX_GUARD_US) - RADIO_DELAY_BEFORE_RX, "RxBurst");
+      } else {
+        listen_ref = current_slot_start;
+        listen_end = rx_window_end + burst * burst_interval;
+        TSCH_WAIT(pt, t, listen_ref, rx_window_start + burst * burst_interval - RADIO_DELAY_BEFORE_RX, "RxBurst");
+      }
+    }
 
-  packet_seen = NETSTACK_RADIO.receiving_packet() || NETSTACK_RADIO.pending_packet();
+    TOGGLE_DEBUG_GPIO();
 
-  if(!packet_seen) {
-      /* Check if receiving within guard time */
-      BUSYWAIT_UNTIL_ABS((packet_seen = NETSTACK_RADIO.receiving_packet()),
-          current_slot_start, tsch_timing[tsch_ts_loc_rx_offset] + tsch_timing[tsch_ts_loc_rx_wait] + RADIO_DELAY_BEFORE_DETECT);
-  }
+    tsch_radio_on(TSCH_RADIO_CMD_ON_WITHIN_TIMESLOT);
 
-  TOGGLE_DEBUG_GPIO();
+    packet_seen = NETSTACK_RADIO.receiving_packet() || NETSTACK_RADIO.pending_packet();
 
-#if MTM_SLOT_DURATIONS_EVAL
-  eval_rx_start_time = RTIMER_NOW();
+    if(!packet_seen) {
+        /* Check if receiving within guard time */
+        BUSYWAIT_UNTIL_ABS((packet_seen = NETSTACK_RADIO.receiving_packet()),
+            listen_ref, listen_end + RADIO_DELAY_BEFORE_DETECT);
+    }
+
+    TOGGLE_DEBUG_GPIO();
+
+#if MTM_SLOT_TIMESTAMPS
+    eval_rx_start_time = RTIMER_NOW();
 #endif
 
-  if(!packet_seen) {
-      /* no packets on air */
-      /* write_byte('s'); */
-      tsch_radio_off(TSCH_RADIO_CMD_OFF_FORCE);
-      _PRINTF("mtm missed\n");
-      mtm_no_frame_detected++;
-  } else {
-      rx_start_time = RTIMER_NOW() - RADIO_DELAY_BEFORE_DETECT;
-      TOGGLE_DEBUG_GPIO();
+    if(!packet_seen) {
+        /* no packets on air */
+        /* write_byte('s'); */
+        tsch_radio_off(TSCH_RADIO_CMD_OFF_FORCE);
+        _PRINTF("mtm missed\n");
+        TSCH_MTM_STATS_INC(no_frame_detected);
+    } else {
+        rx_start_time = RTIMER_NOW() - RADIO_DELAY_BEFORE_DETECT;
+        TOGGLE_DEBUG_GPIO();
+
+#if MTM_SLOT_TIMESTAMPS
+        /* arrival relative to the start of the rx window */
+        if(burst > 0) {
+          /* the following frames of a burst are not subject to the guard time */
+        } else if(RTIMER_CLOCK_LT(rx_start_time, current_slot_start + tsch_timing[tsch_ts_loc_rx_offset])) {
+          tsch_mtm_timing_record_us(TSCH_MTM_TIMING_RX_ARRIVAL, 0, 0);
+        } else {
+          tsch_mtm_timing_record(TSCH_MTM_TIMING_RX_ARRIVAL, current_slot_start + tsch_timing[tsch_ts_loc_rx_offset], rx_start_time, 0);
+        }
+#endif
 
-      BUSYWAIT_UNTIL_ABS(NETSTACK_RADIO.pending_packet(),
-          current_slot_start, tsch_timing[tsch_ts_rx_offset] + tsch_timing[tsch_ts_rx_wait] + tsch_timing[tsch_ts_max_tx]);
+        if(burst == 0) {
+            BUSYWAIT_UNTIL_ABS(NETSTACK_RADIO.pending_packet(),
+                current_slot_start, tsch_timing[tsch_ts_rx_offset] + tsch_timing[tsch_ts_rx_wait] + tsch_timing[tsch_ts_max_tx]);
+        } else {
+            BUSYWAIT_UNTIL_ABS(NETSTACK_RADIO.pending_packet(),
+                listen_ref, listen_end + tsch_timing[tsch_ts_max_tx]);
+        }
 
-      tsch_radio_off(TSCH_RADIO_CMD_OFF_WITHIN_TIMESLOT);
-      TOGGLE_DEBUG_GPIO();
+        tsch_radio_off(TSCH_RADIO_CMD_OFF_WITHIN_TIMESLOT);
+        TOGGLE_DEBUG_GPIO();
 
 
-      if(NETSTACK_RADIO.pending_packet()) {
-          static frame802154_t frame;
-          static int header_len, frame_valid;
-          static linkaddr_t source_address;
-          static linkaddr_t destination_address;
+        if(NETSTACK_RADIO.pending_packet()) {
+            static frame802154_t frame;
+            static int header_len, frame_valid;
+            static linkaddr_t source_address;
+            static linkaddr_t destination_address;
 
-          static struct mtm_packet_timestamp *rx_timestamps;
-          static uint8_t num_rx_timestamps;
+            static struct mtm_packet_timestamp *rx_timestamps;
+            static uint8_t num_rx_timestamps;
+#if TSCH_MTM_RX_DIAGNOSTICS
+            static dw1000_rx_diagnostics rx_diag;
+#endif
 
-          timestamp_tx_B = 0;
-          timestamp_rx_A = 0;
+            timestamp_tx_B = 0;
+            timestamp_rx_A = 0;
 
-#if MTM_SLOT_DURATIONS_EVAL
-          eval_rx_end_time = RTIMER_NOW();
+#if MTM_SLOT_TIMESTAMPS
+            eval_rx_end_time = RTIMER_NOW();
 #endif
 
-          // get rx_timestamp
-          NETSTACK_RADIO.get_object(RADIO_LOC_LAST_RX_TIMESPTAMP, &timestamp_rx_A, sizeof(uint64_t));
+            // get rx_timestamp
+#if TSCH_MTM_RX_DIAGNOSTICS
+            dw_get_rx_diagnostics(&rx_diag);
+            timestamp_rx_A = rx_diag.rx_stamp;
+#else
+            NETSTACK_RADIO.get_object(RADIO_LOC_LAST_RX_TIMESPTAMP, &timestamp_rx_A, sizeof(uint64_t));
+#endif
 
-          packet_len = NETSTACK_RADIO.read((void *) packet_buf, TSCH_PACKET_MAX_LEN);
-          header_len = frame802154_parse((uint8_t *)packet_buf, packet_len, &frame);
+#if TSCH_RX_HEADER_FILTER && !MTM_EVAL_OUTPUT_FRAMES
+            /* The trace of MTM_EVAL_OUTPUT_FRAMES has all frames, dropped ones included */
+            set_rx_header_filter(mtm_rx_header_filter);
+#endif
+            packet_len = NETSTACK_RADIO.read((void *) packet_buf, TSCH_PACKET_MAX_LEN);
+#if MTM_EVAL_OUTPUT_FRAMES
+            mtm_eval_output_frame("mtmr", current_link->timeslot, timestamp_rx_A, packet_buf, packet_len);
+#endif
+            header_len = frame802154_parse((uint8_t *)packet_buf, packet_len, &frame);
 
-          frame_valid = header_len > 0 &&
-              frame802154_check_dest_panid(&frame) &&
-              frame802154_extract_linkaddr(&frame, &source_address, &destination_address);
+            frame_valid = header_len > 0 &&
+                frame802154_check_dest_panid(&frame) &&
+                frame802154_extract_linkaddr(&frame, &source_address, &destination_address);
 
 #if TSCH_RESYNC_WITH_SFD_TIMESTAMPS
-          /* At the end of the reception, get an more accurate estimate of SFD arrival time */
-          NETSTACK_RADIO.get_object(RADIO_PARAM_LAST_PACKET_TIMESTAMP, &rx_start_time, sizeof(rtimer_clock_t));
+            /* At the end of the reception, get an more accurate estimate of SFD arrival time */
+            NETSTACK_RADIO.get_object(RADIO_PARAM_LAST_PACKET_TIMESTAMP, &rx_start_time, sizeof(rtimer_clock_t));
 #endif
 
-          // Ranging Related Management
-          num_rx_timestamps = 0;
-          rx_timestamps = NULL;
+            // Ranging Related Management
+            num_rx_timestamps = 0;
+            rx_timestamps = NULL;
 
 #if TSCH_MTM_REJECT_BY_FP_INDEX
-          uint16_t fp_index = dw_get_fp_index();
-          if((int32_t) 750 - ((int32_t) fp_index >> 6) > 40
-              || (int32_t) 750 - ((int32_t) fp_index >> 6) < -40
-              ) {
-              frame_valid = 0;
-          }
+#if TSCH_MTM_RX_DIAGNOSTICS
+            uint16_t fp_index = rx_diag.fp_index;
+#else
+            uint16_t fp_index = dw_get_fp_index();
+#endif
+            if((int32_t) 750 - ((int32_t) fp_index >> 6) > 40
+                || (int32_t) 750 - ((int32_t) fp_index >> 6) < -40
+                ) {
+                frame_valid = 0;
+            }
 #endif
 
 
-          // parse ranging packet
-          if(frame_valid && tsch_packet_parse_multiranging_packet(packet_buf, packet_len, current_link->timeslot, &frame, &timestamp_tx_B, &rx_timestamps, &num_rx_timestamps)) {
-              uint8_t neighbor = source_address.u8[LINKADDR_SIZE-1];
-              uint8_t timeslot_offset = current_link->timeslot;
-              add_to_direct_observed_rx_to_queue(timestamp_rx_A, neighbor, timeslot_offset);
-              add_mtm_reception_timestamp(neighbor, &tsch_current_asn, timeslot_offset, timestamp_rx_A, timestamp_tx_B, rx_timestamps, num_rx_timestamps);
-              mtm_successfull_frame_receptions++;
-          } else {
-              /* printf("mtm parse failed\n"); */
-              mtm_failed_frame_receptions++;
-          }
+            // parse ranging packet
+            if(frame_valid && tsch_packet_parse_multiranging_packet(packet_buf, packet_len, current_link->timeslot, &frame, &timestamp_tx_B, &rx_timestamps, &num_rx_timestamps)) {
+                uint8_t neighbor = source_address.u8[LINKADDR_SIZE-1];
+                uint8_t timeslot_offset = current_link->timeslot;
+                add_to_direct_observed_rx_to_queue(timestamp_rx_A, neighbor, timeslot_offset);
+#if TSCH_MTM_RX_DIAGNOSTICS
+                mtm_set_rx_clock_offset(rx_diag.quality.clock_offset);
+#endif
+                add_mtm_reception_timestamp(neighbor, &tsch_current_asn, current_channel, timeslot_offset, timestamp_rx_A, timestamp_tx_B, rx_timestamps, num_rx_timestamps);
+                TSCH_MTM_STATS_INC(frame_receptions);
 
-#if MTM_SLOT_DURATIONS_EVAL
-          prop_handling_end_time = RTIMER_NOW();
+                /* the remaining frames of the burst are expected relative to this one */
+                if(frame.seq >= burst) {
+                    burst = frame.seq;
+#if TSCH_RESYNC_WITH_SFD_TIMESTAMPS
+                    burst_start_time = rx_start_time - burst * burst_interval;
+#else
+                    /* rx_start_time is the start of the preamble here */
+                    burst_start_time = rx_start_time + tsch_timing[tsch_ts_loc_uwb_t_shr] - burst * burst_interval;
+#endif
+                    burst_synced = 1;
+                }
+            } else {
+                /* printf("mtm parse failed\n"); */
+                TSCH_MTM_STATS_INC(failed_frame_receptions);
+                mtm_failed_reception(current_link->timeslot);
+            }
+
+#if MTM_SLOT_TIMESTAMPS
+            prop_handling_end_time = RTIMER_NOW();
+            rx_entries = num_rx_timestamps;
+            tsch_mtm_timing_record(TSCH_MTM_TIMING_RX, eval_rx_start_time, eval_rx_end_time, rx_entries);
+            tsch_mtm_timing_record(TSCH_MTM_TIMING_RX_HANDLING, eval_rx_end_time, prop_handling_end_time, rx_entries);
+            rx_handled = 1;
 #endif
 
 #if MTM_SLOT_DURATIONS_EVAL
-          printf("rxd, %u, %u, %u, %u, %u\n",
-              RTIMERTICKS_TO_US(eval_rx_start_time) - RTIMERTICKS_TO_US(slot_start_time),       /// initial wait period
-              RTIMERTICKS_TO_US(eval_rx_end_time) - RTIMERTICKS_TO_US(eval_rx_start_time),      // reception/transmission time
-              RTIMERTICKS_TO_US(prop_handling_end_time) - RTIMERTICKS_TO_US(eval_rx_end_time),
-              num_rx_timestamps,
-              packet_len
-              ); // processing time
+            printf("rxd, %u, %u, %u, %u, %u\n",
+                RTIMERTICKS_TO_US(eval_rx_start_time) - RTIMERTICKS_TO_US(slot_start_time),       /// initial wait period
+                RTIMERTICKS_TO_US(eval_rx_end_time) - RTIMERTICKS_TO_US(eval_rx_start_time),      // reception/transmission time
+                RTIMERTICKS_TO_US(prop_handling_end_time) - RTIMERTICKS_TO_US(eval_rx_end_time),
+                num_rx_timestamps,
+                packet_len
+                ); // processing time
 #endif
 
-          _PRINTF("--------------Finished----------------\n");
+            _PRINTF("--------------Finished----------------\n");
 
-      } else {
-          mtm_failed_frame_receptions++;
-      }
+        } else {
+            TSCH_MTM_STATS_INC(failed_frame_receptions);
+            mtm_failed_reception(current_link->timeslot);
+        }
+    }
   }
   tsch_radio_off(TSCH_RADIO_CMD_OFF_END_OF_TIMESLOT);
 
@@ -2393,6 +2678,12 @@ PT_THREAD(tsch_mtm_rx_slot(struct pt *pt, struct rtimer *t))
 
   mtm_slot_end_handler(current_link->timeslot);
 
+#if MTM_SLOT_TIMESTAMPS
+  if(rx_handled) {
+    tsch_mtm_timing_record(TSCH_MTM_TIMING_SLOT_END, prop_handling_end_time, RTIMER_NOW(), rx_entries);
+  }
+#endif
+
   #if TSCH_SLEEP
     NETSTACK_RADIO.set_value(RADIO_SLEEP_STATE, RADIO_SLEEP);
   #endif /* TSCH_SLEEP */
@@ -2406,6 +2697,7 @@ PT_THREAD(tsch_mtm_rx_slot(struct pt *pt, struct rtimer *t))
 
 /*---------------------------------------------------------------------------*/
 #if TSCH_CHORUS
+#if TSCH_CHORUS_RAW_CIR
 static uint8_t cir[DW_LEN_ACC_MEM];
 
 /* Read the Channel Inpulse Response of the
@@ -2454,6 +2746,38 @@ void tsch_chorus_output_anchors_cir(linkaddr_t* source_address){
 
   write_byte((uint8_t) '\n');
 }
+#else /* TSCH_CHORUS_RAW_CIR */
+static struct dw1000_cir_features cir_features;
+
+/* Find the peaks of the Channel Impulse Response of the
+ * received message (one per anchor) and write them on the serial line,
+ * instead of the whole accumulator.
+ * Disable Accumulation memory after the read.
+ * Format: "cirf, <src>, <fp_index>, <lde_threshold>, <n>" followed
+ * by ", <offset>, <magnitude>" for each peak, offsets are in 1/64 of
+ * a sample relative to the first path.
+ * */
+void tsch_chorus_output_anchors_cir(linkaddr_t* source_address){
+  uint8_t i;
+
+  dw1000_cir_extract(&cir_features, 8, TSCH_CHORUS_CIR_WINDOW,
+                     TSCH_CHORUS_CIR_PEAKS);
+
+  NETSTACK_RADIO.set_value(RADIO_ACCUMULATOR_MEMORY, RADIO_POWER_MODE_OFF);
+
+  NETSTACK_RADIO.off();
+
+  printf("cirf, %u, %u, %u, %u",
+         ((uint16_t)source_address->u8[6] << 8) | source_address->u8[7],
+         cir_features.fp_index, cir_features.lde_threshold,
+         cir_features.num_peaks);
+  for(i = 0; i < cir_features.num_peaks; i++) {
+    printf(", %ld, %u", (long)cir_features.peaks[i].offset,
+           cir_features.peaks[i].magnitude);
+  }
+  printf("\n");
+}
+#endif /* TSCH_CHORUS_RAW_CIR */
 
 #if TSCH_CHORUS_NODE_TYPE == CHORUS_INITIATOR_NODE
 static
@@ -74,6 +74,14 @@
 #define TSCH_MAX_INCOMING_PACKETS 4
 #endif
 
+/* Check the 802.15.4 header of a received frame before the radio transfers
+ * its payload, and drop frames that are not for us without reading them */
+#ifdef TSCH_CONF_RX_HEADER_FILTER
+#define TSCH_RX_HEADER_FILTER TSCH_CONF_RX_HEADER_FILTER
+#else
+#define TSCH_RX_HEADER_FILTER 1
+#endif
+
 /*********** Callbacks *********/
 
 /* Called by TSCH form interrupt after receiving a frame, enabled upper-layer to decide
@@ -91,6 +99,8 @@ struct input_packet {
   int len; /* Packet len */
   int16_t rssi; /* RSSI for this packet */
   uint8_t channel; /* Channel we received the packet on */
+  frame802154_t frame; /* Header as parsed at RX time */
+  int header_len; /* Length of the parsed header, 0 if not parsed */
 };
 
 /***** External Variables *****/
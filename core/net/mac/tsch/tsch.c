@@ -169,6 +169,7 @@ PROCESS(tsch_pending_events_process, "TSCH: pending events process");
 
 /* Other function prototypes */
 static void packet_input(void);
+static void packet_input_frame(const frame802154_t *frame, int hdr_len);
 
 /* Getters and setters */
 
@@ -228,6 +229,7 @@ tsch_reset(void)
   for(i = 0; i < tsch_ts_elements_count; i++) {
     tsch_timing[i] = US_TO_RTIMERTICKS(tsch_default_timing_us[i]);
   }
+  mtm_set_slot_length(RTIMERTICKS_TO_US(tsch_timing[tsch_ts_timeslot_length]));
 #ifdef TSCH_CALLBACK_LEAVING_NETWORK
   TSCH_CALLBACK_LEAVING_NETWORK();
 #endif
@@ -284,21 +286,21 @@ static void
 eb_input(struct input_packet *current_input)
 {
   /* PRINTF("TSCH: EB received\n"); */
-  frame802154_t frame;
+  const frame802154_t *frame = &current_input->frame;
   /* Verify incoming EB (does its ASN match our Rx time?),
    * and update our join priority. */
   struct ieee802154_ies eb_ies;
 
-  if(tsch_packet_parse_eb(current_input->payload, current_input->len,
-                          &frame, &eb_ies, NULL, 1)) {
+  if(tsch_packet_parse_eb_frame(current_input->payload, current_input->len,
+                                frame, current_input->header_len, &eb_ies, NULL, 1)) {
     /* PAN ID check and authentication done at rx time */
 
 #if TSCH_AUTOSELECT_TIME_SOURCE
     if(!tsch_is_coordinator) {
       /* Maintain EB received counter for every neighbor */
-      struct eb_stat *stat = (struct eb_stat *)nbr_table_get_from_lladdr(eb_stats, (linkaddr_t *)&frame.src_addr);
+      struct eb_stat *stat = (struct eb_stat *)nbr_table_get_from_lladdr(eb_stats, (linkaddr_t *)&frame->src_addr);
       if(stat == NULL) {
-        stat = (struct eb_stat *)nbr_table_add_lladdr(eb_stats, (linkaddr_t *)&frame.src_addr, NBR_TABLE_REASON_MAC, NULL);
+        stat = (struct eb_stat *)nbr_table_add_lladdr(eb_stats, (linkaddr_t *)&frame->src_addr, NBR_TABLE_REASON_MAC, NULL);
       }
       if(stat != NULL) {
         stat->rx_count++;
@@ -328,7 +330,7 @@ eb_input(struct input_packet *current_input)
 
     struct tsch_neighbor *n = tsch_queue_get_time_source();
     /* Did the EB come from our time source? */
-    if(n != NULL && linkaddr_cmp((linkaddr_t *)&frame.src_addr, &n->addr)) {
+    if(n != NULL && linkaddr_cmp((linkaddr_t *)&frame->src_addr, &n->addr)) {
       /* Check for ASN drift */
       int32_t asn_diff = TSCH_ASN_DIFF(current_input->rx_asn, eb_ies.ie_asn);
       if(asn_diff != 0) {
@@ -337,6 +339,19 @@ eb_input(struct input_packet *current_input)
         tsch_disassociate();
       }
 
+      if(eb_ies.ie_tsch_timeslot_id != 0) {
+        int i;
+        for(i = 0; i < tsch_ts_elements_count; i++) {
+          if(US_TO_RTIMERTICKS(eb_ies.ie_tsch_timeslot[i]) != tsch_timing[i]) {
+            /* The coordinator applied a new timeslot timing (see
+             * tsch_mtm_timing_apply), leave and join again with it */
+            PRINTF("TSCH:! timeslot timing changed, leaving the network\n");
+            tsch_disassociate();
+            break;
+          }
+        }
+      }
+
       if(eb_ies.ie_join_priority >= TSCH_MAX_JOIN_PRIORITY) {
         /* Join priority unacceptable. Leave network. */
         PRINTF("TSCH:! EB JP too high %u, leaving the network\n",
@@ -365,12 +380,17 @@ tsch_rx_process_pending()
   /* Loop on accessing (without removing) a pending input packet */
   while((input_index = ringbufindex_peek_get(&input_ringbuf)) != -1) {
     struct input_packet *current_input = &input_array[input_index];
-    frame802154_t frame;
-    uint8_t ret = frame802154_parse(current_input->payload, current_input->len, &frame);
-    int is_data = ret && frame.fcf.frame_type == FRAME802154_DATAFRAME;
+    /* The header was parsed at RX time, parse it here only if it was not */
+    if(current_input->header_len <= 0) {
+      current_input->header_len = frame802154_parse(current_input->payload,
+          current_input->len, &current_input->frame);
+    }
+    frame802154_t *frame = &current_input->frame;
+    int ret = current_input->header_len > 0;
+    int is_data = ret && frame->fcf.frame_type == FRAME802154_DATAFRAME;
     int is_eb = ret
-      && frame.fcf.frame_version == FRAME802154_IEEE802154E_2012
-      && frame.fcf.frame_type == FRAME802154_BEACONFRAME;
+      && frame->fcf.frame_version == FRAME802154_IEEE802154E_2012
+      && frame->fcf.frame_type == FRAME802154_BEACONFRAME;
 
     if(is_data) {
       /* Skip EBs and other control messages */
@@ -380,15 +400,16 @@ tsch_rx_process_pending()
       packetbuf_set_attr(PACKETBUF_ATTR_CHANNEL, current_input->channel);
     }
 
-    /* Remove input from ringbuf */
-    ringbufindex_get(&input_ringbuf);
-
     if(is_data) {
-      /* Pass to upper layers */
-      packet_input();
+      /* Pass to upper layers. The ringbuf slot is still ours until
+       * ringbufindex_get, so the parsed header can be used in place */
+      packet_input_frame(frame, current_input->header_len);
     } else if(is_eb) {
       eb_input(current_input);
     }
+
+    /* Remove input from ringbuf */
+    ringbufindex_get(&input_ringbuf);
   }
 }
 
@@ -518,6 +539,7 @@ tsch_associate(const struct input_packet *input_eb, rtimer_clock_t timestamp)
       tsch_timing[i] = US_TO_RTIMERTICKS(ies.ie_tsch_timeslot[i]);
     }
   }
+  mtm_set_slot_length(RTIMERTICKS_TO_US(tsch_timing[tsch_ts_timeslot_length]));
 
   /* TSCH hopping sequence */
   if(ies.ie_channel_hopping_sequence_id == 0) {
@@ -898,6 +920,10 @@ tsch_init(void)
 
   /* Start the propagation time process */
   process_start(&TSCH_PROP_PROCESS, NULL);
+#if TSCH_MTM_LOCALISATION && TSCH_MTM_DEFERRED_PROCESSING
+  /* Start the process handling the ranging computations of MTM slots */
+  process_start(&TSCH_MTM_PROCESS, NULL);
+#endif
 
   tsch_is_initialized = 1;
 
@@ -998,9 +1024,22 @@ send_packet(mac_callback_t sent, void *ptr)
 static void
 packet_input(void)
 {
+  packet_input_frame(NULL, 0);
+}
+/*---------------------------------------------------------------------------*/
+/* Pass the packet in packetbuf to upper layers. When frame is not NULL, it
+ * holds the header parsed at RX time and the framer does not parse it again */
+static void
+packet_input_frame(const frame802154_t *frame, int hdr_len)
+{
+  const struct framer *framer = &NETSTACK_FRAMER;
   int frame_parsed = 1;
 
-  frame_parsed = NETSTACK_FRAMER.parse();
+  if(frame != NULL && framer == &framer_802154) {
+    frame_parsed = framer_802154_parse_frame(frame, hdr_len);
+  } else {
+    frame_parsed = framer->parse();
+  }
 
   if(frame_parsed < 0) {
     PRINTF("TSCH:! failed to parse %u\n", packetbuf_datalen());
@@ -101,6 +101,27 @@ uart0_writeb(unsigned char c)
   }
 }
 /*---------------------------------------------------------------------------*/
+int
+uart0_write(const uint8_t *buf, int len)
+{
+  int i;
+
+  /* All or nothing: a partly written buffer could have other output
+   * inserted in its middle before the rest follows */
+  if(len > ringbuf_size(&txbuf) - 1 - ringbuf_elements(&txbuf)) {
+    return 0;
+  }
+
+  for(i = 0; i < len; i++) {
+    if (nrfx_uart_tx(&m_uart, &buf[i], 1) == NRF_ERROR_BUSY) {
+      if (ringbuf_put(&txbuf, buf[i]) == 0) {
+        break;
+      }
+    }
+  }
+  return i;
+}
+/*---------------------------------------------------------------------------*/
 /**
  * Initialize the RS232 port.
  *
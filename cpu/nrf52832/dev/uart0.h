@@ -47,6 +47,9 @@
 
 void uart0_init();
 void uart0_writeb(uint8_t byte);
+/* Writes buf without blocking if the TX buffer takes all of it, nothing
+ * otherwise. Returns the number of bytes written (len or 0) */
+int uart0_write(const uint8_t *buf, int len);
 
 void uart0_set_input(int (* input)(unsigned char c));
 
@@ -93,6 +93,45 @@ void dw_read_subreg(uint32_t reg_addr, uint16_t subreg_addr,
 void dw_write_subreg(uint32_t reg_addr, uint16_t subreg_addr,
             uint16_t subreg_len, const uint8_t *write_buf);
 /*---------------------------------------------------------------------------*/
+/**
+ * Platforms able to transfer over SPI in the background (DMA) define
+ * DW1000_ARCH_CONF_SPI_ASYNC and implement the functions below.
+ **/
+#ifdef DW1000_ARCH_CONF_SPI_ASYNC
+#define DW1000_ARCH_SPI_ASYNC DW1000_ARCH_CONF_SPI_ASYNC
+#else
+#define DW1000_ARCH_SPI_ASYNC 0
+#endif
+
+/** Completion callback of an asynchronous sub-register access. */
+typedef void (*dw1000_arch_spi_done_t)(void *ptr);
+/**
+ * \brief                 Starts reading a sub-register and returns before the
+ *                        transfer is over. Any following access to the
+ *                        DW1000 waits for the transfer first.
+ *
+ * \param[out] read_buf   Must stay valid until the transfer has completed.
+ * \param[in] done        Called when the transfer has completed, from
+ *                        dw1000_arch_spi_poll() or from the next access.
+ *                        May be NULL.
+ */
+void dw_read_subreg_async(uint32_t reg_addr, uint16_t subreg_addr,
+            uint16_t subreg_len, uint8_t *read_buf,
+            dw1000_arch_spi_done_t done, void *ptr);
+/**
+ * \brief                 Starts writing a sub-register and returns before the
+ *                        transfer is over. write_buf is copied and can be
+ *                        reused at once.
+ */
+void dw_write_subreg_async(uint32_t reg_addr, uint16_t subreg_addr,
+            uint16_t subreg_len, const uint8_t *write_buf,
+            dw1000_arch_spi_done_t done, void *ptr);
+/**
+ * Completes the asynchronous transfer if it is over.
+ * Returns 1 while it is still in progress.
+ **/
+int dw1000_arch_spi_poll(void);
+/*---------------------------------------------------------------------------*/
 /**
  * Configure port IRQ for GPIO8.
  *
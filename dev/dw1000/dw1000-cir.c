@@ -0,0 +1,292 @@
+/*
+ * Copyright (c) 2016, Charlier Maximilien, UMons University.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/**
+ * \file
+ *         Feature extraction from the channel impulse response (CIR) in the
+ *         accumulator memory of the DW1000.
+ */
+
+#include <math.h>
+#include <stdlib.h>
+
+#include "dw1000.h"
+#include "dw1000-arch.h"
+#include "dw1000-const.h"
+#include "dw1000-cir.h"
+
+/* Samples per SPI read */
+#define CIR_CHUNK 32
+/* Taps of the interpolation filter, the interpolated position lies between
+ * the taps SINC_TAPS / 2 - 1 and SINC_TAPS / 2 */
+#define SINC_TAPS 8
+/* Fixed point format of the filter coefficients */
+#define SINC_SHIFT 14
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+static uint16_t magnitude[DW1000_CIR_MAX_WINDOW];
+
+#if DW1000_CIR_UPSAMPLE > 1
+static int16_t sinc_table[DW1000_CIR_UPSAMPLE][SINC_TAPS];
+static uint8_t sinc_table_ready;
+#endif
+/*---------------------------------------------------------------------------*/
+static uint16_t
+isqrt32(uint32_t v)
+{
+  uint32_t root = 0, bit = (uint32_t)1 << 30;
+
+  while(bit > v) {
+    bit >>= 2;
+  }
+  while(bit != 0) {
+    if(v >= root + bit) {
+      v -= root + bit;
+      root = (root >> 1) + bit;
+    } else {
+      root >>= 1;
+    }
+    bit >>= 2;
+  }
+  return root;
+}
+/*---------------------------------------------------------------------------*/
+/* Reads count (at most CIR_CHUNK) complex samples from index on. The
+ * accumulator returns a dummy byte ahead of the samples. */
+static void
+read_samples(uint16_t index, uint16_t count, int16_t *samples)
+{
+  uint8_t buf[1 + CIR_CHUNK * DW1000_CIR_SAMPLE_LEN];
+  uint8_t *p = &buf[1];
+  uint16_t i;
+
+  dw_read_subreg(DW_REG_ACC_MEM, index * DW1000_CIR_SAMPLE_LEN,
+                 1 + count * DW1000_CIR_SAMPLE_LEN, buf);
+  for(i = 0; i < 2 * count; i++, p += 2) {
+    samples[i] = (int16_t)(p[0] | (p[1] << 8));
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Position of the maximum of the parabola through three magnitudes, relative
+ * to the middle one, in 1/64 of their distance */
+static int16_t
+parabolic_offset(uint32_t left, uint32_t center, uint32_t right)
+{
+  int32_t den = 2 * (2 * (int32_t)center - (int32_t)left - (int32_t)right);
+
+  if(den <= 0) {
+    return 0;
+  }
+  return (int16_t)((((int32_t)right - (int32_t)left) * 64) / den);
+}
+/*---------------------------------------------------------------------------*/
+/* Adds a local maximum to the peaks, which are sorted by magnitude. Of peaks
+ * closer than DW1000_CIR_PEAK_SEPARATION only the strongest is kept. Returns
+ * the new number of peaks. */
+static uint8_t
+add_peak(uint16_t *index, uint16_t *mag, uint8_t n, uint8_t max,
+         uint16_t i, uint16_t m)
+{
+  uint8_t j, k;
+
+  for(j = 0; j < n; j++) {
+    if(abs((int)index[j] - (int)i) < DW1000_CIR_PEAK_SEPARATION) {
+      if(mag[j] >= m) {
+        return n;
+      }
+      for(k = j + 1; k < n; k++) {
+        index[k - 1] = index[k];
+        mag[k - 1] = mag[k];
+      }
+      n--;
+      j--;
+    }
+  }
+  if(n == max) {
+    if(mag[n - 1] >= m) {
+      return n;
+    }
+    n--;
+  }
+  for(j = n; j > 0 && mag[j - 1] < m; j--) {
+    index[j] = index[j - 1];
+    mag[j] = mag[j - 1];
+  }
+  index[j] = i;
+  mag[j] = m;
+  return n + 1;
+}
+/*---------------------------------------------------------------------------*/
+#if DW1000_CIR_UPSAMPLE > 1
+/* Hann windowed sinc for the positions p / DW1000_CIR_UPSAMPLE behind the
+ * sample SINC_TAPS / 2 - 1 */
+static void
+init_sinc_table(void)
+{
+  uint8_t p, t;
+  float x, h;
+
+  for(p = 0; p < DW1000_CIR_UPSAMPLE; p++) {
+    for(t = 0; t < SINC_TAPS; t++) {
+      x = (float)t - (SINC_TAPS / 2 - 1) - (float)p / DW1000_CIR_UPSAMPLE;
+      h = x == 0.0f ? 1.0f : sinf((float)M_PI * x) / ((float)M_PI * x);
+      h *= 0.5f * (1.0f + cosf((float)M_PI * x / (SINC_TAPS / 2)));
+      sinc_table[p][t] = (int16_t)lrintf(h * (1 << SINC_SHIFT));
+    }
+  }
+  sinc_table_ready = 1;
+}
+/*---------------------------------------------------------------------------*/
+/* Squared magnitude of the CIR at s[SINC_TAPS / 2 - 1] + p / DW1000_CIR_UPSAMPLE.
+ * The result is scaled down by 4 to fit. */
+static uint32_t
+interpolate(const int16_t *s, uint8_t p)
+{
+  int32_t re = 0, im = 0;
+  uint8_t t;
+
+  for(t = 0; t < SINC_TAPS; t++) {
+    re += (int32_t)sinc_table[p][t] * s[2 * t];
+    im += (int32_t)sinc_table[p][t] * s[2 * t + 1];
+  }
+  re >>= SINC_SHIFT + 1;
+  im >>= SINC_SHIFT + 1;
+  return (uint32_t)(re * re) + (uint32_t)(im * im);
+}
+/*---------------------------------------------------------------------------*/
+/* Position of the peak at sample i in 1/64 samples, from the upsampled CIR
+ * between the samples i - 1 and i + 1. Returns 0 if the samples around i are
+ * not in the accumulator. */
+static int32_t
+upsampled_position(uint16_t i, uint16_t *mag)
+{
+  /* samples for the positions i - 1 to i + 1 */
+  int16_t s[2 * (SINC_TAPS + 2)];
+  uint32_t grid[2 * DW1000_CIR_UPSAMPLE + 1];
+  uint8_t g, best = 0;
+  int16_t refine = 0;
+
+  if(i < SINC_TAPS / 2 || i + SINC_TAPS / 2 + 1 >= DW1000_CIR_LEN) {
+    return 0;
+  }
+  if(!sinc_table_ready) {
+    init_sinc_table();
+  }
+  read_samples(i - SINC_TAPS / 2, SINC_TAPS + 2, s);
+
+  for(g = 0; g <= 2 * DW1000_CIR_UPSAMPLE; g++) {
+    grid[g] = interpolate(&s[2 * (g / DW1000_CIR_UPSAMPLE)], g % DW1000_CIR_UPSAMPLE);
+    if(grid[g] > grid[best]) {
+      best = g;
+    }
+  }
+  if(best > 0 && best < 2 * DW1000_CIR_UPSAMPLE) {
+    refine = parabolic_offset(isqrt32(grid[best - 1]), isqrt32(grid[best]),
+                              isqrt32(grid[best + 1]));
+  }
+  *mag = isqrt32(grid[best]) << 1;
+  return (int32_t)(i - 1) * 64 + (best * 64 + refine) / DW1000_CIR_UPSAMPLE;
+}
+#endif
+/*---------------------------------------------------------------------------*/
+int
+dw1000_cir_extract(struct dw1000_cir_features *f, uint16_t before,
+                   uint16_t after, uint8_t max_peaks)
+{
+  int16_t samples[2 * CIR_CHUNK];
+  uint16_t peak_index[DW1000_CIR_MAX_PEAKS], peak_mag[DW1000_CIR_MAX_PEAKS];
+  uint16_t fp, start, len, i, j, n;
+  uint8_t num_peaks = 0, k;
+  int32_t pos;
+
+  f->fp_index = dw_get_fp_index();
+  f->lde_threshold = dx_get_lde_threshold();
+  f->num_peaks = 0;
+
+  fp = f->fp_index >> 6;
+  if(fp >= DW1000_CIR_LEN || max_peaks == 0) {
+    return 0;
+  }
+  if(max_peaks > DW1000_CIR_MAX_PEAKS) {
+    max_peaks = DW1000_CIR_MAX_PEAKS;
+  }
+  start = fp > before ? fp - before : 0;
+  len = (uint32_t)fp + after + 1 > DW1000_CIR_LEN ? DW1000_CIR_LEN - start : fp + after + 1 - start;
+  if(len > DW1000_CIR_MAX_WINDOW) {
+    len = DW1000_CIR_MAX_WINDOW;
+  }
+
+  for(i = 0; i < len; i += n) {
+    n = len - i < CIR_CHUNK ? len - i : CIR_CHUNK;
+    read_samples(start + i, n, samples);
+    for(j = 0; j < n; j++) {
+      magnitude[i + j] = isqrt32((uint32_t)((int32_t)samples[2 * j] * samples[2 * j])
+                                 + (uint32_t)((int32_t)samples[2 * j + 1] * samples[2 * j + 1]));
+    }
+  }
+
+  for(i = 1; i + 1 < len; i++) {
+    if(magnitude[i] >= f->lde_threshold && magnitude[i] > magnitude[i - 1]
+       && magnitude[i] >= magnitude[i + 1]) {
+      num_peaks = add_peak(peak_index, peak_mag, num_peaks, max_peaks, i, magnitude[i]);
+    }
+  }
+
+  /* the strongest peaks in the order of their arrival */
+  for(k = 0; k < num_peaks; k++) {
+    uint8_t first = k;
+    for(j = k + 1; j < num_peaks; j++) {
+      if(peak_index[j] < peak_index[first]) {
+        first = j;
+      }
+    }
+    i = peak_index[first];
+    peak_index[first] = peak_index[k];
+
+    pos = 0;
+#if DW1000_CIR_UPSAMPLE > 1
+    pos = upsampled_position(start + i, &f->peaks[k].magnitude);
+#endif
+    if(pos == 0) {
+      pos = (int32_t)(start + i) * 64
+        + parabolic_offset(magnitude[i - 1], magnitude[i], magnitude[i + 1]);
+      f->peaks[k].magnitude = magnitude[i];
+    }
+    f->peaks[k].offset = pos - f->fp_index;
+  }
+  f->num_peaks = num_peaks;
+  return num_peaks;
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,110 @@
+/*
+ * Copyright (c) 2016, Charlier Maximilien, UMons University.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/**
+ * \file
+ *         Feature extraction from the channel impulse response (CIR) in the
+ *         accumulator memory of the DW1000.
+ *
+ *         Instead of the whole accumulator (4064 bytes) only a window
+ *         following the first path is read. The extraction returns the
+ *         strongest peaks of the window with sub-sample precision, e.g. the
+ *         responses of the anchors in Chorus.
+ */
+
+#ifndef _DW1000_CIR_H_
+#define _DW1000_CIR_H_
+
+#include <inttypes.h>
+
+/* Complex samples in the accumulator at 64 MHz PRF, 992 at 16 MHz PRF.
+ * A sample is 4 bytes, the real and the imaginary part as int16_t. The
+ * samples are about 1 ns apart. */
+#define DW1000_CIR_LEN        1016
+#define DW1000_CIR_SAMPLE_LEN 4
+
+/* Largest window in samples, the magnitudes of the window are kept in RAM
+ * (2 bytes per sample) */
+#ifdef DW1000_CIR_CONF_MAX_WINDOW
+#define DW1000_CIR_MAX_WINDOW DW1000_CIR_CONF_MAX_WINDOW
+#else
+#define DW1000_CIR_MAX_WINDOW DW1000_CIR_LEN
+#endif
+
+#ifdef DW1000_CIR_CONF_MAX_PEAKS
+#define DW1000_CIR_MAX_PEAKS DW1000_CIR_CONF_MAX_PEAKS
+#else
+#define DW1000_CIR_MAX_PEAKS 8
+#endif
+
+/* Peaks closer than this many samples to a stronger one are side lobes of
+ * the same path and are skipped */
+#ifdef DW1000_CIR_CONF_PEAK_SEPARATION
+#define DW1000_CIR_PEAK_SEPARATION DW1000_CIR_CONF_PEAK_SEPARATION
+#else
+#define DW1000_CIR_PEAK_SEPARATION 3
+#endif
+
+/* Upsampling factor for the peak positions, 1 to interpolate the position
+ * from the magnitudes of the peak and its neighbors only. Above 1 the
+ * complex samples around every peak are read once more and interpolated
+ * on a grid of 1/DW1000_CIR_UPSAMPLE samples (windowed sinc). */
+#ifdef DW1000_CIR_CONF_UPSAMPLE
+#define DW1000_CIR_UPSAMPLE DW1000_CIR_CONF_UPSAMPLE
+#else
+#define DW1000_CIR_UPSAMPLE 1
+#endif
+#if DW1000_CIR_UPSAMPLE < 1 || DW1000_CIR_UPSAMPLE > 16
+#error "DW1000_CIR_UPSAMPLE must be within 1..16"
+#endif
+
+/* Positions are given in 1/64 samples, as the first path index of the LDE */
+struct dw1000_cir_peak {
+  int32_t offset;     /* to the first path index */
+  uint16_t magnitude;
+};
+
+struct dw1000_cir_features {
+  uint16_t fp_index;       /* first path index of the LDE, 10.6 fixed point */
+  uint16_t lde_threshold;  /* peaks below are ignored */
+  uint8_t num_peaks;
+  struct dw1000_cir_peak peaks[DW1000_CIR_MAX_PEAKS]; /* ordered by arrival */
+};
+
+/* Reads the CIR from before samples ahead of the first path up to after
+ * samples behind it and returns the max_peaks strongest peaks in it. Needs
+ * the accumulator memory enabled during the reception. Returns the number of
+ * peaks, 0 if there is none above the LDE threshold */
+int dw1000_cir_extract(struct dw1000_cir_features *f, uint16_t before,
+                       uint16_t after, uint8_t max_peaks);
+
+#endif /* _DW1000_CIR_H_ */
@@ -83,6 +83,13 @@
 
 #define FOOTER_LEN                2
 
+/* Number of bytes read before a RADIO_LOC_RX_HEADER_FILTER is asked whether
+ * the frame is worth the SPI transfer of its payload. Covers the 802.15.4
+ * header with long source and destination addresses. */
+#ifndef DW1000_CONF_RX_HEADER_LEN
+#define DW1000_CONF_RX_HEADER_LEN 23
+#endif /* DW1000_CONF_RX_HEADER_LEN */
+
 #ifndef DW1000_CHANNEL
 #define DW1000_CHANNEL          5
 #endif /* DW1000_CHANNEL */
@@ -240,6 +247,9 @@ static int volatile dw1000_is_delayed_tx = 0;
 static uint16_t dw1000_antenna_delay_prf_64 = 16450u;
 static uint16_t dw1000_antenna_delay_prf_16 = 16450u;
 
+/* One-shot header filter of the next read, see RADIO_LOC_RX_HEADER_FILTER */
+static radio_rx_header_filter_t rx_header_filter = NULL;
+
 
 /* store the current DW1000 configuration */
 static dw1000_base_conf_t dw1000_conf;
@@ -284,6 +294,7 @@ static volatile uint16_t last_packet_timestamp = 0;
 /* start private function */
 void dw1000_schedule_tx(uint16_t delay_us);
 void dw1000_schedule_tx_mtm(uint16_t delay_us);
+void dw1000_schedule_tx_mtm_burst(uint16_t delay_us);
 void dw1000_schedule_tx_to_rx(uint16_t delay_us);
 void dw1000_schedule_rx_to_rx(uint16_t delay_us);
 void dw1000_update_frame_quality(void);
@@ -482,7 +493,13 @@ dw1000_driver_prepare(const void *payload,
 
   if(payload_len > 0) {
     /* Copy data to DW1000 */
+#if DW1000_ARCH_SPI_ASYNC
+    /* Last access of the prepare: the caller goes on while the frame is
+     * uploaded, the next access to the DW1000 waits for the upload */
+    dw_write_subreg_async(DW_REG_TX_BUFFER, 0x0, payload_len, (const uint8_t *)payload, NULL, NULL);
+#else
     dw_write_reg(DW_REG_TX_BUFFER, payload_len, (uint8_t *)payload);
+#endif
   }
 
 #if DEBUG_VERBOSE
@@ -728,6 +745,11 @@ void driver_flush_receive_buffer(void){
 static int
 dw1000_driver_read(void *buf, unsigned short bufsize)
 {
+  /* The header filter only applies to this read */
+  radio_rx_header_filter_t header_filter = rx_header_filter;
+  unsigned short header_len;
+  rx_header_filter = NULL;
+
   PRINTF("dw1000_driver_read\r\n");
   if(poll_mode){
 #ifdef DOUBLE_BUFFERING
@@ -774,7 +796,22 @@ dw1000_driver_read(void *buf, unsigned short bufsize)
 
   /* Store rx data in buf */
   TOGGLE_DEBUG_GPIO();
-  dw_read_reg(DW_REG_RX_BUFFER, len, (uint8_t *)buf);
+  if(header_filter != NULL) {
+    /* Read the header first, the payload only if the frame is kept */
+    header_len = len < DW1000_CONF_RX_HEADER_LEN ? len : DW1000_CONF_RX_HEADER_LEN;
+    dw_read_reg(DW_REG_RX_BUFFER, header_len, (uint8_t *)buf);
+    if(!header_filter(buf, header_len, len)) {
+      TOGGLE_DEBUG_GPIO();
+      driver_flush_receive_buffer();
+      return 0;
+    }
+    if(len > header_len) {
+      dw_read_subreg(DW_REG_RX_BUFFER, header_len, len - header_len,
+                     (uint8_t *)buf + header_len);
+    }
+  } else {
+    dw_read_reg(DW_REG_RX_BUFFER, len, (uint8_t *)buf);
+  }
   TOGGLE_DEBUG_GPIO();
 
   RIMESTATS_ADD(llrx);
@@ -1429,6 +1466,23 @@ dw1000_driver_set_object(radio_param_t param,
 
     return RADIO_RESULT_OK;
   }
+  else if(param == RADIO_LOC_TX_DELAYED_US_MTM_BURST){
+    if(size != 2 || !src) {
+      return RADIO_RESULT_INVALID_VALUE;
+    }
+    uint16_t delay = ((uint8_t *)src)[0] | ((uint8_t *)src)[1] << 8;
+    dw1000_schedule_tx_mtm_burst(delay);
+
+    return RADIO_RESULT_OK;
+  }
+  else if(param == RADIO_LOC_RX_HEADER_FILTER){
+    if(size != sizeof(radio_rx_header_filter_t) || !src) {
+      return RADIO_RESULT_INVALID_VALUE;
+    }
+    memcpy(&rx_header_filter, src, sizeof(radio_rx_header_filter_t));
+
+    return RADIO_RESULT_OK;
+  }
   else if(param == RADIO_LOC_RX_DELAYED_US){
     if(size != 2 || !src) {
       return RADIO_RESULT_INVALID_VALUE;
@@ -2012,6 +2066,27 @@ dw1000_schedule_tx_mtm(uint16_t delay_us)
   dw_init_tx(0,1);
 }
 
+/**
+ * \brief Create delayed transmission based on the previous delayed transmission.
+ *        Keeps the frames of a MTM burst at a fixed distance to each other,
+ *        independent of when the MCU gets to schedule them.
+ *
+ * NOTE: The transceiver need to be in IDLE when invocking a delayed transmition.
+ */
+void
+dw1000_schedule_tx_mtm_burst(uint16_t delay_us)
+{
+  uint64_t schedule_time = dw_get_dx_timestamp();
+
+  /* the previous dx timestamp has its low order nine bits already cleared */
+  schedule_time = (schedule_time + US_TO_RADIO(delay_us)) & DW_TIMESTAMP_CLEAR_LOW_9;
+
+  dw_set_dx_timestamp(schedule_time);
+
+  dw1000_is_delayed_tx = 1;
+  dw_init_tx(0,1);
+}
+
 
 /**
  * \brief Configures the DW1000 to be ready to receive a ranging response
@@ -651,15 +651,86 @@ const uint8_t range25cm64PRFwb[2][NUM_64M_OFFSETWB] =
 }; /* end range25cm64PRFwb */
 
 
+static struct dw1000_bias_lut bias_luts[DW1000_BIAS_LUT_CACHE];
+static uint8_t bias_luts_used;
+static uint8_t bias_luts_next; /* entry replaced when all are in use */
+
+/**
+ * \brief Fills the lookup table of a TSCH channel from the 25 cm tables
+ *        of its channel and PRF.
+ *
+ *        The tables hold, for every centimeter of correction, the largest
+ *        range (in 25 cm units) that still needs it. A single walk through
+ *        the table gives the correction of every 25 cm step.
+ */
+static void
+bias_lut_build(struct dw1000_bias_lut *lut, uint8_t tsch_channel)
+{
+  uint8_t prf = dw1000_get_tsch_channel_prf(tsch_channel);
+  uint8_t channel = dw1000_get_tsch_channel_phy_channel(tsch_channel);
+  const uint8_t *table;
+  int8_t cm_offset;
+  uint16_t range25cm;
+  uint8_t i = 0;
+
+  if(prf == DW_PRF_16_MHZ) {
+    if(channel == 4 || channel == 7) {
+      table = range25cm16PRFwb[chan_idxwb[channel]];
+      cm_offset = CM_OFFSET_16M_WB;
+    } else {
+      table = range25cm16PRFnb[chan_idxnb[channel]];
+      cm_offset = CM_OFFSET_16M_NB;
+    }
+  } else {
+    if(channel == 4 || channel == 7) {
+      table = range25cm64PRFwb[chan_idxwb[channel]];
+      cm_offset = CM_OFFSET_64M_WB;
+    } else {
+      table = range25cm64PRFnb[chan_idxnb[channel]];
+      cm_offset = CM_OFFSET_64M_NB;
+    }
+  }
+
+  lut->tsch_channel = tsch_channel;
+  for(range25cm = 0; range25cm < DW1000_BIAS_LUT_LEN; range25cm++) {
+    /* all tables end in 255 */
+    while(range25cm > table[i]) {
+      i++;
+    }
+    lut->bias[range25cm] = (int32_t) ((double) CENTIMETER_TO_DWTIME * (i + cm_offset));
+  }
+}
+/*---------------------------------------------------------------------------*/
+const struct dw1000_bias_lut *
+dw1000_bias_get_lut(uint8_t tsch_channel)
+{
+  struct dw1000_bias_lut *lut;
+  uint8_t i;
+
+  for(i = 0; i < bias_luts_used; i++) {
+    if(bias_luts[i].tsch_channel == tsch_channel) {
+      return &bias_luts[i];
+    }
+  }
+
+  if(bias_luts_used < DW1000_BIAS_LUT_CACHE) {
+    lut = &bias_luts[bias_luts_used++];
+  } else {
+    lut = &bias_luts[bias_luts_next];
+    bias_luts_next = (bias_luts_next + 1) % DW1000_BIAS_LUT_CACHE;
+  }
+  bias_lut_build(lut, tsch_channel);
+  return lut;
+}
+/*---------------------------------------------------------------------------*/
 /**
  * \brief This function is used to return the range bias correction
  *        need for TWR with DW1000 units.
  *
- * \param[in]  channel   Specifies the operating channel
- *                        (e.g. 1, 2, 3, 4, 5, 6 or 7)
+ * \param[in]  tsch_channel  The TSCH channel, which selects the operating
+ *                           channel and PRF
  * \param[in]  range  The calculated distance before correction
  *                      (in DecaWave time unit)
- * \param[in]  prf    This is the PRF e.g. DW_PRF_16_MHZ or DW_PRF_64_MHZ
  *
  * \return The correction needed in DecaWave time unit.
  *          The final ranging value can be compute has follow: range - output
@@ -667,76 +738,49 @@ const uint8_t range25cm64PRFwb[2][NUM_64M_OFFSETWB] =
 int32_t
 dw1000_getrangebias(uint8_t tsch_channel, uint16_t range)
 {
-  /* first get the lookup index that corresponds to given range for
-   *  a particular channel at 16M PRF */
-  uint8_t i = 0;
-  uint8_t chanIdx = 0;
-  int8_t cmoffseti = 0;  /* integer number of CM offset */
-  int16_t offset = 0;  /* final offset result in metres */
-  uint8_t prf = dw1000_get_tsch_channel_prf(tsch_channel);
-  uint8_t channel = dw1000_get_tsch_channel_phy_channel(tsch_channel);
-
   /* NB: note we may get some small negitive values e.g. up to -50 cm. */
+  uint16_t range25cm = range / DW1000_BIAS_LUT_STEP;
 
-  /* convert range to integer number of 25cm values. */
-  uint8_t rangeint25cm = (uint8_t) (range / 53);
-
-  if (rangeint25cm > 255)
-    /* make sure it matches largest value in table
-        (all tables end in 255 !!!!) */
-    rangeint25cm = 255;
+  if(range25cm >= DW1000_BIAS_LUT_LEN) {
+    range25cm = DW1000_BIAS_LUT_LEN - 1;
+  }
+  return dw1000_bias_get_lut(tsch_channel)->bias[range25cm];
+}
+/*---------------------------------------------------------------------------*/
+int32_t
+dw1000_bias_lookup(const struct dw1000_bias_lut *lut, uint32_t range, int8_t rssi)
+{
+  /* interpolate between the centers of the 25 cm steps */
+  uint32_t x = range > DW1000_BIAS_LUT_STEP / 2 ? range - DW1000_BIAS_LUT_STEP / 2 : 0;
+  uint32_t step = x / DW1000_BIAS_LUT_STEP;
+  int32_t bias;
+
+  if(step >= DW1000_BIAS_LUT_LEN - 1) {
+    bias = lut->bias[DW1000_BIAS_LUT_LEN - 1];
+  } else {
+    int32_t frac = x - step * DW1000_BIAS_LUT_STEP;
+    bias = lut->bias[step]
+      + ((lut->bias[step + 1] - lut->bias[step]) * frac) / DW1000_BIAS_LUT_STEP;
+  }
 
-  if (prf == DW_PRF_16_MHZ)
-  {
-    switch(channel)
-    {
-      case 4:
-      case 7:
-      {
-        chanIdx = chan_idxwb[channel];
-        /* find index in table corresponding to range*/
-        while (rangeint25cm > range25cm16PRFwb[chanIdx][i]) i++;
-        cmoffseti = i + CM_OFFSET_16M_WB; /* nearest centimeter correction */
-      }
-      break;
-      default:
-      {
-        chanIdx = chan_idxnb[channel];
-        /* find index in table corresponding to range */
-        while (rangeint25cm > range25cm16PRFnb[chanIdx][i]) i++;
-        cmoffseti = i + CM_OFFSET_16M_NB; /* nearest centimeter correction */
-      }
-    } /* end of switch */
+  if(rssi != DW1000_BIAS_NO_RSSI) {
+    bias += dw_get_rssi_timestamp_bias(rssi);
   }
-  else /* 64M PRF */
-  {
-    switch(channel)
-    {
-      case 4:
-      case 7:
-      {
-        chanIdx = chan_idxwb[channel];
-        /* find index in table corresponding to range */
-        while (rangeint25cm > range25cm64PRFwb[chanIdx][i]) i++;
-        cmoffseti = i + CM_OFFSET_64M_WB; /* nearest centimeter correction */
-      }
-      break;
-      default:
-      {
-        chanIdx = chan_idxnb[channel];
-        /* find index in table corresponding to range */
-        while (rangeint25cm > range25cm64PRFnb[chanIdx][i]) i++;
-        cmoffseti = i + CM_OFFSET_64M_NB; /* nearest centimeter correction */
-      }
-    } /* end of switch */
-  } /* end else */
-
-  /* offset result in centimetres */
-  offset = (int32_t) ((double) CENTIMETER_TO_DWTIME * cmoffseti);
-
-  return (offset);
+  return bias;
 }
+/*---------------------------------------------------------------------------*/
+void
+dw1000_bias_correct_batch(uint8_t tsch_channel, float *range, const int8_t *rssi, uint16_t count)
+{
+  const struct dw1000_bias_lut *lut = dw1000_bias_get_lut(tsch_channel);
+  uint16_t i;
 
+  for(i = 0; i < count; i++) {
+    uint32_t r = range[i] > 0 ? (uint32_t) range[i] : 0;
+    range[i] -= dw1000_bias_lookup(lut, r, rssi != NULL ? rssi[i] : DW1000_BIAS_NO_RSSI);
+  }
+}
+/*---------------------------------------------------------------------------*/
 #define RANGE_CORR_MAX_RSSI (-61)
 #define RANGE_CORR_MIN_RSSI (-93)
 
@@ -35,7 +35,37 @@
 
 #include <inttypes.h>
 
+/* Number of channel/PRF lookup tables kept in RAM. A table is built on the
+ * first lookup for a TSCH channel, the least recently built is replaced */
+#ifdef DW1000_CONF_BIAS_LUT_CACHE
+#define DW1000_BIAS_LUT_CACHE DW1000_CONF_BIAS_LUT_CACHE
+#else
+#define DW1000_BIAS_LUT_CACHE 2
+#endif
+
+/* Ranges are looked up in steps of 25 cm (53 DecaWave time units) */
+#define DW1000_BIAS_LUT_STEP 53
+#define DW1000_BIAS_LUT_LEN  256
+
+/* Pass instead of a RSSI to leave out the RSSI dependent bias */
+#define DW1000_BIAS_NO_RSSI  INT8_MIN
+
+/* Range bias of one TSCH channel (channel and PRF), in DecaWave time units
+ * for every 25 cm step of the range */
+struct dw1000_bias_lut {
+  uint8_t tsch_channel;
+  int16_t bias[DW1000_BIAS_LUT_LEN];
+};
+
 int32_t dw1000_getrangebias(uint8_t tsch_channel, uint16_t range);
 int8_t dw_get_rssi_timestamp_bias(int8_t reception_rssi);
 
+/* Returns the lookup table of a TSCH channel, builds it if necessary */
+const struct dw1000_bias_lut *dw1000_bias_get_lut(uint8_t tsch_channel);
+/* Range and RSSI bias of a range in DecaWave time units, linearly interpolated
+ * between the 25 cm steps. The corrected range is range - bias */
+int32_t dw1000_bias_lookup(const struct dw1000_bias_lut *lut, uint32_t range, int8_t rssi);
+/* Corrects count ranges (in DecaWave time units) in place. rssi may be NULL */
+void dw1000_bias_correct_batch(uint8_t tsch_channel, float *range, const int8_t *rssi, uint16_t count);
+
 #endif /* _DW1000_RANGING_BIAS_H_ */
@@ -2014,48 +2014,71 @@ dw_get_fp_ampl()
 void
 dw_get_receive_quality(dw1000_frame_quality* quality)
 {
-  uint16_t rx_pacc_nosat = 0;
-  /* Read FP_AMPL1 */
-  dw_read_subreg(DW_REG_RX_TIME, DW_SUBREG_FP_AMPL1,
-                                  DW_SUBLEN_FP_AMPL1,
-                                  (uint8_t*) &(quality->fp_ampl1));
-
-  /* Read FP_AMPL2 */
-  dw_read_subreg(DW_REG_RX_FQUAL, DW_SUBREG_FP_AMPL2,
-                                  DW_SUBLEN_FP_AMPL2,
-                                  (uint8_t*) &(quality->fp_ampl2));
-
-  /* Read STD_NOISE */
-  dw_read_subreg(DW_REG_RX_FQUAL, 0, 2, (uint8_t*) &(quality->std_noise));
-
-  /* Read FP_AMPL3 */
-  dw_read_subreg(DW_REG_RX_FQUAL, DW_SUBREG_FP_AMPL3,
-                                  DW_SUBLEN_FP_AMPL3,
-                                  (uint8_t*) &(quality->fp_ampl3));
+  dw1000_rx_diagnostics diag;
+  dw_get_rx_diagnostics(&diag);
+  *quality = diag.quality;
+}
 
-  /* Read RXPACC */
-  /* N = the Preamble Accumulation Count value reported in the RXPACC */
-  /* we read only 2 bytes in place of the all register */
-  dw_read_subreg(DW_REG_RX_FINFO, 2, 2, (uint8_t*) &(quality->rx_pacc));
-  quality->rx_pacc = quality->rx_pacc >> (DW_RXPACC - 16);
-  quality->rx_pacc &= (DW_RXPACC_MASK >> DW_RXPACC);
+/* Little endian fields of a register file read as a byte stream */
+#define DW_LE16(p) ((uint16_t)(p)[0] | (uint16_t)(p)[1] << 8)
+#define DW_LE40(p) ((uint64_t)DW_LE16(p) | (uint64_t)DW_LE16((p) + 2) << 16 \
+                    | (uint64_t)(p)[4] << 32)
 
-  /* read RXPACC_NOSAT */
+/**
+ * \brief Get the diagnostics of the last received frame: its RX timestamp,
+ *        its First Path Index and the quality of dw_get_receive_quality().
+ *        RX_TIME and RX_FQUAL are each read in a single burst and decoded in
+ *        memory. With RX_FINFO, RX_TTCKO and RXPACC_NOSAT this takes five SPI
+ *        transactions in place of the nine of the separate reads. RX_TTCKI
+ *        is not read, it only depends on the PRF reported in RX_FINFO.
+ */
+void
+dw_get_rx_diagnostics(dw1000_rx_diagnostics* diag)
+{
+  uint8_t rx_time[DW_LEN_RX_TIME];
+  uint8_t rx_fqual[DW_LEN_RX_FQUAL];
+  uint32_t rx_finfo;
+  uint32_t rx_ttcki;
+  int32_t rx_tofs = 0L;
+  uint16_t rx_pacc_nosat = 0;
+  dw1000_frame_quality* quality = &diag->quality;
+
+  /* RX_STAMP, FP_INDEX, FP_AMPL1 */
+  dw_read_reg(DW_REG_RX_TIME, DW_LEN_RX_TIME, rx_time);
+  /* STD_NOISE, FP_AMPL2, FP_AMPL3, CIR_PWR */
+  dw_read_reg(DW_REG_RX_FQUAL, DW_LEN_RX_FQUAL, rx_fqual);
+  /* RXPACC, RXPRFR */
+  rx_finfo = dw_read_reg_32(DW_REG_RX_FINFO, DW_LEN_RX_FINFO);
+  /* RX TOFS is a signed 19-bit number, the 19nd bit is the sign */
+  dw_read_subreg(DW_REG_RX_TTCKO, 0x0, 3, (uint8_t *) &rx_tofs);
   dw_read_subreg(DW_REG_DRX_CONF, DW_SUBREG_RXPACC_NOSAT,
                         DW_SUBLEN_RXPACC_NOSAT, (uint8_t*) &rx_pacc_nosat);
 
-  /* CIR_PWR */
-  /* C = the Channel Impulse Response Power value reported in the CIR_PWR */
-  dw_read_subreg(DW_REG_RX_FQUAL, DW_SUBREG_CIR_PWR,
-                                  DW_SUBLEN_CIR_PWR,
-                                  (uint8_t*) &(quality->cir_pwr));
+  diag->rx_stamp = DW_LE40(&rx_time[DW_SUBREG_RX_STAMP]);
+  diag->fp_index = DW_LE16(&rx_time[DW_SUBREG_FP_INDEX]);
+  quality->fp_ampl1 = DW_LE16(&rx_time[DW_SUBREG_FP_AMPL1]);
+  quality->std_noise = DW_LE16(&rx_fqual[0]);
+  quality->fp_ampl2 = DW_LE16(&rx_fqual[DW_SUBREG_FP_AMPL2]);
+  quality->fp_ampl3 = DW_LE16(&rx_fqual[DW_SUBREG_FP_AMPL3]);
+  quality->cir_pwr = DW_LE16(&rx_fqual[DW_SUBREG_CIR_PWR]);
 
+  /* N = the Preamble Accumulation Count value reported in the RXPACC */
+  quality->rx_pacc = (rx_finfo & DW_RXPACC_MASK) >> DW_RXPACC;
   /* check if RXPACC is saturated and need to be corrected */
-  if(quality->rx_pacc == rx_pacc_nosat)
-    quality->n_correction = 0x01;
-  else
-    quality->n_correction = 0x00;
-  quality->clock_offset = dw_get_clock_offset();
+  quality->n_correction = quality->rx_pacc == rx_pacc_nosat ? 0x01 : 0x00;
+
+  switch((rx_finfo & DW_RXPRFR_MASK) >> DW_RXPRFR) {
+  case 0x1: /* 16 MHz PRF */
+    rx_ttcki = 0x01F00000UL;
+    break;
+  case 0x2: /* 64 MHz PRF */
+    rx_ttcki = 0x01FC0000UL;
+    break;
+  default:
+    rx_ttcki = dw_read_reg_32(DW_REG_RX_TTCKI, DW_LEN_RX_TTCKI);
+    break;
+  }
+  quality->clock_offset = dw_compute_clock_offset(rx_tofs, rx_ttcki);
 }
 
 /**
@@ -2573,11 +2596,21 @@ dw_get_clock_offset(void){
 
   /* RX TOFS is a signed 19-bit number, the 19nd bit is the sign */
   dw_read_subreg(DW_REG_RX_TTCKO, 0x0, 3, (uint8_t *) &rx_tofs);
-  rx_tofs &= DW_RXTOFS_MASK;
 
-  /*
-  printf("clock offset1 0x%.2X%.4X\n", (unsigned int) (rx_tofs >> 16),
-                                      (unsigned int) rx_tofs); */
+  /* brief dummy : The value in RXTTCKI will take just one of two values
+      depending on the PRF: 0x01F00000 @ 16 MHz PRF,
+      and 0x01FC0000 @ 64 MHz PRF. */
+  rx_ttcki = dw_read_reg_32(DW_REG_RX_TTCKI, DW_LEN_RX_TTCKI);
+
+  return dw_compute_clock_offset(rx_tofs, rx_ttcki);
+}
+/**
+ *  \brief Compute the clock offset of dw_get_clock_offset() from the values
+ *      read in the RX TTCKO (RXTOFS, 3 bytes) and RX TTCKI registers.
+ */
+int16_t
+dw_compute_clock_offset(int32_t rx_tofs, uint32_t rx_ttcki){
+  rx_tofs &= DW_RXTOFS_MASK;
 
   /* convert a 19 signed bit number to a 32 bits signed number */
   if((rx_tofs & (0x1UL << 18)) != 0){ /* the 19th bit is 1 => negative number */
@@ -2585,19 +2618,6 @@ dw_get_clock_offset(void){
     rx_tofs |= ~DW_RXTOFS_MASK; /* all bit between 31 and 19 are set to 1 */
   }
 
-  /*
-  printf("clock offset2 0x%.2X%.4X\n", (unsigned int) (rx_tofs >> 16),
-                                      (unsigned int) rx_tofs); */
-
-  /* brief dummy : The value in RXTTCKI will take just one of two values
-      depending on the PRF: 0x01F00000 @ 16 MHz PRF,
-      and 0x01FC0000 @ 64 MHz PRF. */
-  rx_ttcki = dw_read_reg_32(DW_REG_RX_TTCKI, DW_LEN_RX_TTCKI);
-
-  /*
-  printf("RX TOFS %ld\n", (long int) rx_tofs);
-  printf("RX TTCKI %lu\n", (long unsigned int) rx_ttcki);
-  */
   int32_t clock_full = (rx_tofs * (1000000LL * 100LL)) / rx_ttcki;
   int16_t clock_offset = clock_full & 0x7FFF;
   /* copy the sign of clock_full */
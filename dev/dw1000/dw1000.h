@@ -611,6 +611,24 @@ typedef struct {
   uint8_t n_correction;
 } dw1000_frame_quality;
 
+/**
+ * \brief Diagnostics of a received frame, read in a few bursts.
+ */
+typedef struct {
+  /**
+   * \Brief The RX timestamp (RX_STAMP, 40 bits).
+   */
+  uint64_t rx_stamp;
+  /**
+   * \Brief The First Path Index, 10.6 bits fixed point.
+   */
+  uint16_t fp_index;
+  /**
+   * \Brief The frame quality, as given by dw_get_receive_quality().
+   */
+  dw1000_frame_quality quality;
+} dw1000_rx_diagnostics;
+
 extern dw1000_base_driver dw1000;
 
 /*===========================================================================*/
@@ -678,6 +696,7 @@ float   dw_get_voltage(dw_adc_src_t voltage_source);
 float dw_get_noise_level(void);
 float dw_get_fp_ampl(void);
 void dw_get_receive_quality(dw1000_frame_quality* quality);
+void dw_get_rx_diagnostics(dw1000_rx_diagnostics* diag);
 void print_receive_quality(dw1000_frame_quality quality);
 
 /* Error counter*/
@@ -726,6 +745,7 @@ void     dw_enable_ranging_frame(void);
 void     dw_disable_ranging_frame(void);
 uint8_t dw_is_ranging_frame(void);
 int16_t dw_get_clock_offset();
+int16_t dw_compute_clock_offset(int32_t rx_tofs, uint32_t rx_ttcki);
 
 
 void dw_clear_pending_interrupt(uint64_t mask);
@@ -0,0 +1,274 @@
+/*
+ * Copyright (c) 2015, SICS Swedish ICT.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+
+/**
+ * \file
+ *         Compares the fixed point DS-TWR and passive TDoA kernels of
+ *         tsch-prop.c with their double precision counterparts. Sweeps
+ *         clock drifts, reply delays, distances and clock offsets (including
+ *         wraps of the 40 bit DW1000 clock) and checks that the deviation
+ *         stays within TSCH_MTM_FIXED_MAX_ERROR_TICKS.
+ *
+ *         Usage: mtm-fixed-sweep.native [-s seed]
+ */
+
+#include "contiki.h"
+#include "net/mac/tsch/tsch-prop.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+/* DW1000 time unit: 1 / (128 * 499.2 MHz) */
+#define DW_TICK_S (1.0 / (128.0 * 499.2e6))
+#define DW_TS_MASK 0xFFFFFFFFFFULL
+#define SPEED_OF_LIGHT_M_PER_S 299702547.236
+
+extern int contiki_argc;
+extern char **contiki_argv;
+
+PROCESS(sweep_process, "MTM fixed point sweep");
+/* tsch-prop.c posts measurements here, the sweep calls the kernels directly */
+PROCESS(TSCH_PROP_PROCESS, "MTM measurement sink");
+AUTOSTART_PROCESSES(&sweep_process);
+
+/*---------------------------------------------------------------------------*/
+/* clock drifts of A, B and the listener L in ppm */
+static const double drifts_ppm[] = { -40.0, -20.0, -5.0, 0.0, 5.0, 20.0, 40.0 };
+/* reply delays D_a and D_b in seconds, the largest is just below 2^34 ticks */
+static const double delays_s[] = { 100e-6, 500e-6, 2e-3, 10e-3, 50e-3, 250e-3 };
+/* distances A-B, A-L and B-L in meters */
+static const double geometry_m[][3] = {
+  { 0.5, 0.5, 0.5 },
+  { 5.0, 20.0, 18.0 },
+  { 30.0, 50.0, 40.0 },
+  { 100.0, 5.0, 100.0 },
+};
+
+#define NUM(a) (sizeof(a) / sizeof((a)[0]))
+
+struct sweep_stats {
+  uint32_t count;
+  double max_dev;
+  uint64_t cycles_double, cycles_fixed;
+};
+
+static struct sweep_stats twr_stats[NUM(delays_s)], tdoa_stats[NUM(delays_s)];
+static uint32_t violations;
+static uint32_t seed = 1;
+static uint64_t rng_state;
+
+static inline uint64_t
+cycles_now(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+static uint64_t
+sweep_rand(void)
+{
+  /* xorshift64* */
+  rng_state ^= rng_state >> 12;
+  rng_state ^= rng_state << 25;
+  rng_state ^= rng_state >> 27;
+  return rng_state * 2685821657736338717ULL;
+}
+
+/* local DW1000 timestamp of a clock with given drift and offset at global time t */
+static uint64_t
+local_ts(double t, double drift, uint64_t offset)
+{
+  return (offset + (uint64_t)llround(t * (1.0 + drift))) & DW_TS_MASK;
+}
+
+static double
+dist_to_ticks(double m)
+{
+  return m / SPEED_OF_LIGHT_M_PER_S / DW_TICK_S;
+}
+/*---------------------------------------------------------------------------*/
+static void
+sweep_case(uint8_t delay_index, double d_a, double drift_a, double drift_b,
+           double drift_l, const double *geometry)
+{
+  static struct mtm_tdoa_ts p;
+  static volatile float ref, fixed;
+  double tof_ab = dist_to_ticks(geometry[0]);
+  double tof_al = dist_to_ticks(geometry[1]);
+  double tof_bl = dist_to_ticks(geometry[2]);
+  double d_b = delays_s[delay_index] / DW_TICK_S;
+  uint64_t off_a, off_b, off_l, start;
+  double t_a1, r_b1, t_b1, r_a1, t_a2, r_b2;
+  double dev;
+
+  /* random offsets, every few cases close to the wrap of the DW1000 clock */
+  off_a = sweep_rand() & DW_TS_MASK;
+  off_b = sweep_rand() & DW_TS_MASK;
+  off_l = sweep_rand() & DW_TS_MASK;
+  if((sweep_rand() & 3) == 0) {
+    off_a = DW_TS_MASK - (uint64_t)(d_b / 2);
+  }
+
+  /* global times, replies are scheduled by the local clock of the replier */
+  t_a1 = 0.0;
+  r_b1 = t_a1 + tof_ab;
+  t_b1 = r_b1 + d_b / (1.0 + drift_b);
+  r_a1 = t_b1 + tof_ab;
+  t_a2 = r_a1 + d_a / (1.0 + drift_a);
+  r_b2 = t_a2 + tof_ab;
+
+  memset(&p, 0, sizeof(p));
+  p.ds_ts.t_a1 = local_ts(t_a1, drift_a, off_a);
+  p.ds_ts.r_b1 = local_ts(r_b1, drift_b, off_b);
+  p.ds_ts.t_b1 = local_ts(t_b1, drift_b, off_b);
+  p.ds_ts.r_a1 = local_ts(r_a1, drift_a, off_a);
+  p.ds_ts.t_a2 = local_ts(t_a2, drift_a, off_a);
+  p.ds_ts.r_b2 = local_ts(r_b2, drift_b, off_b);
+  p.r_l1 = local_ts(t_a1 + tof_al, drift_l, off_l);
+  p.r_l2 = local_ts(t_b1 + tof_bl, drift_l, off_l);
+  p.r_l3 = local_ts(t_a2 + tof_al, drift_l, off_l);
+
+  start = cycles_now();
+  ref = calculate_propagation_time_alternative(&p.ds_ts);
+  twr_stats[delay_index].cycles_double += cycles_now() - start;
+  start = cycles_now();
+  fixed = calculate_propagation_time_fixed(&p.ds_ts);
+  twr_stats[delay_index].cycles_fixed += cycles_now() - start;
+  twr_stats[delay_index].count++;
+  dev = fabs((double)ref - fixed);
+  if(dev > twr_stats[delay_index].max_dev) {
+    twr_stats[delay_index].max_dev = dev;
+  }
+  if(dev > TSCH_MTM_FIXED_MAX_ERROR_TICKS) {
+    violations++;
+  }
+
+  start = cycles_now();
+  ref = mtm_compute_tdoa(&p);
+  tdoa_stats[delay_index].cycles_double += cycles_now() - start;
+  start = cycles_now();
+  fixed = mtm_compute_tdoa_fixed(&p);
+  tdoa_stats[delay_index].cycles_fixed += cycles_now() - start;
+  tdoa_stats[delay_index].count++;
+  dev = fabs((double)ref - fixed);
+  if(dev > tdoa_stats[delay_index].max_dev) {
+    tdoa_stats[delay_index].max_dev = dev;
+  }
+  if(dev > TSCH_MTM_FIXED_MAX_ERROR_TICKS) {
+    violations++;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+report(void)
+{
+  uint8_t i;
+
+  printf("=MTM fixed point sweep=\n");
+  printf(";; seed = %lu, bound = %.2f ticks\n", (unsigned long)seed,
+         (double)TSCH_MTM_FIXED_MAX_ERROR_TICKS);
+#if defined(__x86_64__) || defined(__i386__)
+  printf(";; unit = tsc cycles\n");
+#else
+  printf(";; unit = ns\n");
+#endif
+  printf("%-10s %8s %12s %10s %10s %12s %10s %10s\n", "delay", "cases",
+         "twr |dev|", "double", "fixed", "tdoa |dev|", "double", "fixed");
+  for(i = 0; i < NUM(delays_s); i++) {
+    printf("%8.1fms %8lu %12.3f %10.1f %10.1f %12.3f %10.1f %10.1f\n",
+           delays_s[i] * 1e3, (unsigned long)twr_stats[i].count,
+           twr_stats[i].max_dev,
+           (double)twr_stats[i].cycles_double / twr_stats[i].count,
+           (double)twr_stats[i].cycles_fixed / twr_stats[i].count,
+           tdoa_stats[i].max_dev,
+           (double)tdoa_stats[i].cycles_double / tdoa_stats[i].count,
+           (double)tdoa_stats[i].cycles_fixed / tdoa_stats[i].count);
+  }
+  printf("violations: %lu\n", (unsigned long)violations);
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(TSCH_PROP_PROCESS, ev, data)
+{
+  PROCESS_BEGIN();
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(sweep_process, ev, data)
+{
+  uint8_t a, b, l, g, i, j;
+  int c;
+
+  PROCESS_BEGIN();
+
+  while((c = getopt(contiki_argc, contiki_argv, "s:")) != -1) {
+    if(c == 's') {
+      seed = strtoul(optarg, NULL, 0);
+    } else {
+      printf("usage: %s [-s seed]\n", contiki_argv[0]);
+      exit(2);
+    }
+  }
+  rng_state = 0x9E3779B97F4A7C15ULL ^ seed;
+
+  for(i = 0; i < NUM(delays_s); i++) {
+    for(j = 0; j < NUM(delays_s); j++) {
+      for(a = 0; a < NUM(drifts_ppm); a++) {
+        for(b = 0; b < NUM(drifts_ppm); b++) {
+          for(l = 0; l < NUM(drifts_ppm); l++) {
+            for(g = 0; g < NUM(geometry_m); g++) {
+              sweep_case(i, delays_s[j] / DW_TICK_S, drifts_ppm[a] * 1e-6,
+                         drifts_ppm[b] * 1e-6, drifts_ppm[l] * 1e-6, geometry_m[g]);
+            }
+          }
+        }
+      }
+    }
+  }
+
+  report();
+  exit(violations != 0);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,988 @@
+/*
+ * Copyright (c) 2015, SICS Swedish ICT.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+
+/**
+ * \file
+ *         Host-side replay of multiranging frames through the MTM ranging
+ *         engine of tsch-prop.c: frame parsing, neighbor/TDoA table update
+ *         and the DS-TWR/TDoA kernels. Frames are either synthesized from a
+ *         simulated cluster with known geometry and clock drifts, or read
+ *         from a trace recorded with MTM_EVAL_OUTPUT_FRAMES.
+ *
+ *         Every measurement the engine reports is recomputed with the
+ *         double precision reference formulas and compared bit by bit
+ *         (within TSCH_MTM_FIXED_MAX_ERROR_TICKS with TSCH_MTM_FIXED_POINT).
+ *         The program exits with a non-zero status on any mismatch, so it
+ *         can be used as a regression check for the slot-time budget.
+ *
+ *         Usage: mtm-replay.native [-n nodes] [-r rounds] [-s seed]
+ *                                  [-j jitter_ticks] [-a own_addr]
+ *                                  [-v frame_version] [-f trace]
+ */
+
+#include "contiki.h"
+#include "linkaddr.h"
+#include "net/mac/frame802154.h"
+#include "net/mac/tsch/tsch-asn.h"
+#include "net/mac/tsch/tsch-prop.h"
+#include "net/mac/tsch/tsch-mtm-stats.h"
+#if REPLAY_WITH_LOCATE
+#include "mtm-locate.h"
+#endif
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+/* DW1000 time unit: 1 / (128 * 499.2 MHz) */
+#define DW_TICK_S (1.0 / (128.0 * 499.2e6))
+#define DW_TS_MASK 0xFFFFFFFFFFULL
+#define SPEED_OF_LIGHT_M_PER_S 299702547.236
+
+#define REPLAY_MAX_NODES TSCH_MTM_PROP_MAX_NEIGHBORS
+#define REPLAY_BURST_INTERVAL_S (TSCH_MTM_BURST_INTERVAL_US * 1e-6)
+#define REPLAY_SLOT_S (0.002 + (TSCH_MTM_BURST_LEN - 1) * REPLAY_BURST_INTERVAL_S)
+#define REPLAY_TX_OFFSET_S 0.0008
+#define REPLAY_AREA_M 30.0
+#define REPLAY_MAX_DRIFT_PPM 20.0
+#define REPLAY_KERNEL_SAMPLES 256
+#define REPLAY_KERNEL_ITERATIONS 200
+#define REPLAY_LINE_LEN 512
+
+extern int contiki_argc;
+extern char **contiki_argv;
+
+PROCESS(replay_process, "MTM replay");
+PROCESS(TSCH_PROP_PROCESS, "MTM replay measurement checker");
+#if TSCH_MTM_DEFERRED_PROCESSING
+AUTOSTART_PROCESSES(&TSCH_MTM_PROCESS, &replay_process, &TSCH_PROP_PROCESS);
+#else
+AUTOSTART_PROCESSES(&replay_process, &TSCH_PROP_PROCESS);
+#endif
+
+/*---------------------------------------------------------------------------*/
+/* per-stage cycle accounting */
+enum replay_stage {
+  STAGE_PARSE,
+  STAGE_RX_QUEUE,
+  STAGE_UPDATE,
+  STAGE_DEFERRED,
+  STAGE_CREATE,
+  STAGE_KERNEL_DSTWR,
+  STAGE_KERNEL_TDOA,
+  STAGE_KERNEL_DSTWR_FIXED,
+  STAGE_KERNEL_TDOA_FIXED,
+  STAGE_COUNT
+};
+
+struct stage_stats {
+  const char *name;
+  uint32_t calls;
+  uint64_t total;
+  uint64_t max;
+};
+
+static struct stage_stats stages[STAGE_COUNT] = {
+  { "parse" },
+  { "rx-queue" },
+  { "update" },
+  { "deferred" },
+  { "create" },
+  { "kernel-dstwr" },
+  { "kernel-tdoa" },
+  { "kernel-dstwr-q" },
+  { "kernel-tdoa-q" },
+};
+
+static inline uint64_t
+cycles_now(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+static inline void
+stage_account(enum replay_stage stage, uint64_t start)
+{
+  uint64_t d = cycles_now() - start;
+  stages[stage].calls++;
+  stages[stage].total += d;
+  if(d > stages[stage].max) {
+    stages[stage].max = d;
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* simulated cluster */
+struct sim_node {
+  ranging_addr_t addr;
+  double x, y;
+  double drift;       /* relative clock speed error, e.g. 10e-6 */
+  uint64_t offset;    /* clock offset in DW ticks */
+  /* most recent reception per burst lane and neighbor, sent with the next
+   * transmission in the same lane */
+  uint8_t rx_valid[TSCH_MTM_BURST_LEN][REPLAY_MAX_NODES];
+  uint8_t rx_slot[TSCH_MTM_BURST_LEN][REPLAY_MAX_NODES];
+  uint64_t rx_ts[TSCH_MTM_BURST_LEN][REPLAY_MAX_NODES];
+};
+
+static struct sim_node nodes[REPLAY_MAX_NODES];
+static uint8_t num_nodes = 8;
+static uint32_t num_rounds = 2000;
+static uint32_t seed = 1;
+static double jitter_ticks = 0.0;
+static ranging_addr_t own_addr = 1;
+static uint8_t frame_version = TSCH_MTM_FRAME_VERSION;
+static const char *trace_path;
+
+static uint64_t rng_state;
+
+static uint32_t
+sim_rand(void)
+{
+  /* xorshift64*, keeps runs reproducible across libc versions */
+  rng_state ^= rng_state >> 12;
+  rng_state ^= rng_state << 25;
+  rng_state ^= rng_state >> 27;
+  return (uint32_t)((rng_state * 2685821657736338717ULL) >> 32);
+}
+
+static double
+sim_uniform(double lo, double hi)
+{
+  return lo + (hi - lo) * ((double)sim_rand() / 4294967296.0);
+}
+
+static double
+sim_gauss(double sigma)
+{
+  double u1, u2;
+  if(sigma <= 0.0) {
+    return 0.0;
+  }
+  u1 = sim_uniform(1e-12, 1.0);
+  u2 = sim_uniform(0.0, 1.0);
+  return sigma * sqrt(-2.0 * log(u1)) * cos(2.0 * M_PI * u2);
+}
+
+/* time of flight between two simulated nodes in DW ticks */
+static double
+sim_tof(uint8_t a, uint8_t b)
+{
+  double dx = nodes[a].x - nodes[b].x;
+  double dy = nodes[a].y - nodes[b].y;
+  return sqrt(dx * dx + dy * dy) / SPEED_OF_LIGHT_M_PER_S / DW_TICK_S;
+}
+
+/* local DW1000 timestamp of node i at global time t (in ticks) */
+static uint64_t
+sim_local_ts(uint8_t i, double t)
+{
+  int64_t local = (int64_t)llround(t * (1.0 + nodes[i].drift));
+  return (nodes[i].offset + (uint64_t)local) & DW_TS_MASK;
+}
+
+static int8_t
+sim_index(ranging_addr_t addr)
+{
+  uint8_t i;
+  for(i = 0; i < num_nodes; i++) {
+    if(nodes[i].addr == addr) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+#if REPLAY_WITH_LOCATE
+/* all other nodes serve as anchors */
+static struct anchor_db_anchor sim_anchors[REPLAY_MAX_NODES];
+static struct anchor_db sim_anchor_db;
+static struct anchor_db_storage sim_anchor_db_storage;
+#endif
+
+static void
+sim_init(void)
+{
+  uint8_t i;
+  rng_state = 0x9E3779B97F4A7C15ULL ^ seed;
+  for(i = 0; i < num_nodes; i++) {
+    memset(&nodes[i], 0, sizeof(nodes[i]));
+    nodes[i].addr = own_addr + i;
+    nodes[i].x = sim_uniform(0.0, REPLAY_AREA_M);
+    nodes[i].y = sim_uniform(0.0, REPLAY_AREA_M);
+    nodes[i].drift = sim_uniform(-REPLAY_MAX_DRIFT_PPM, REPLAY_MAX_DRIFT_PPM) * 1e-6;
+    nodes[i].offset = ((uint64_t)sim_rand() << 8) & DW_TS_MASK;
+#if REPLAY_WITH_LOCATE
+    if(i > 0) {
+      sim_anchors[i - 1].addr = nodes[i].addr;
+      sim_anchors[i - 1].x = (int16_t)lround(nodes[i].x * 100.0);
+      sim_anchors[i - 1].y = (int16_t)lround(nodes[i].y * 100.0);
+      sim_anchors[i - 1].z = 0;
+    }
+#endif
+  }
+#if REPLAY_WITH_LOCATE
+  anchor_db_build(&sim_anchor_db, &sim_anchor_db_storage, sim_anchors, num_nodes - 1, 500);
+  mtm_locate_init(&sim_anchor_db);
+#endif
+}
+/*---------------------------------------------------------------------------*/
+/* frame construction for the other nodes, same layouts as
+ * tsch_packet_create_multiranging_packet(). The entries are kept to check
+ * what the parser makes of them. */
+#define SIM_FRAME_V2 0xB2
+
+static struct mtm_packet_timestamp sim_sent[REPLAY_MAX_NODES];
+static uint8_t sim_sent_count;
+
+static void
+put_ts40(uint8_t *buf, uint64_t ts)
+{
+  int i;
+  for(i = 0; i < 5; i++) {
+    buf[i] = (ts >> (8 * i)) & 0xFF;
+  }
+}
+
+static int
+put_varint(uint8_t *buf, uint64_t v)
+{
+  int len = 0;
+  while(v >= 0x80) {
+    buf[len++] = (v & 0x7F) | 0x80;
+    v >>= 7;
+  }
+  buf[len++] = v;
+  return len;
+}
+
+static int
+sim_payload_v1(uint8_t *buf, int len, struct sim_node *node, uint8_t lane, uint64_t tx_ts)
+{
+  uint8_t j;
+  int count_pos, i;
+  uint32_t checksum = 0;
+
+  put_ts40(&buf[len], tx_ts);
+  len += 5;
+  count_pos = len++;
+
+  for(j = 0; j < num_nodes && sim_sent_count < TSCH_MTM_PROP_MAX_MEASUREMENT; j++) {
+    if(!node->rx_valid[lane][j] || len + 7 + 4 > TSCH_PACKET_MAX_LEN) {
+      continue;
+    }
+    buf[len++] = nodes[j].addr;
+    buf[len++] = node->rx_slot[lane][j];
+    put_ts40(&buf[len], node->rx_ts[lane][j]);
+    len += 5;
+    sim_sent[sim_sent_count].addr = nodes[j].addr;
+    sim_sent[sim_sent_count].timeslot_offset = node->rx_slot[lane][j];
+    sim_sent[sim_sent_count++].rx_timestamp = node->rx_ts[lane][j];
+  }
+  buf[count_pos] = sim_sent_count;
+
+  for(i = 0; i < len; i++) {
+    checksum += buf[i];
+  }
+  memcpy(&buf[len], &checksum, sizeof(uint32_t));
+  return len + sizeof(uint32_t);
+}
+
+static int
+sim_payload_v2(uint8_t *buf, int len, struct sim_node *node, uint8_t lane, uint64_t tx_ts)
+{
+  uint8_t order[REPLAY_MAX_NODES], n = 0, i, j, best;
+  uint64_t age, best_age, prev_age = 0;
+  int count_pos;
+
+  buf[len++] = SIM_FRAME_V2;
+  put_ts40(&buf[len], tx_ts);
+  len += 5;
+  count_pos = len++;
+
+  for(j = 0; j < num_nodes; j++) {
+    if(node->rx_valid[lane][j]) {
+      order[n++] = j;
+    }
+  }
+  /* most recent first, selection sort on the age */
+  for(i = 0; i < n && sim_sent_count < TSCH_MTM_PROP_MAX_MEASUREMENT; i++) {
+    best = i;
+    best_age = (tx_ts - node->rx_ts[lane][order[i]]) & DW_TS_MASK;
+    for(j = i + 1; j < n; j++) {
+      age = (tx_ts - node->rx_ts[lane][order[j]]) & DW_TS_MASK;
+      if(age < best_age) {
+        best = j;
+        best_age = age;
+      }
+    }
+    j = order[best];
+    order[best] = order[i];
+    order[i] = j;
+
+    if(len + 1 + 6 > TSCH_PACKET_MAX_LEN) {
+      break;
+    }
+    buf[len++] = nodes[j].addr;
+    len += put_varint(&buf[len], best_age - prev_age);
+    prev_age = best_age;
+    sim_sent[sim_sent_count].addr = nodes[j].addr;
+    sim_sent[sim_sent_count].timeslot_offset = node->rx_slot[lane][j];
+    sim_sent[sim_sent_count++].rx_timestamp = node->rx_ts[lane][j];
+  }
+  buf[count_pos] = sim_sent_count;
+  return len;
+}
+
+/* the sequence number is the position of the frame in the burst, like on the nodes */
+static int
+sim_create_frame(uint8_t *buf, uint8_t idx, uint8_t lane, uint64_t tx_ts)
+{
+  frame802154_t p;
+  uint8_t j;
+  int len;
+  struct sim_node *node = &nodes[idx];
+
+  memset(&p, 0, sizeof(p));
+  p.fcf.frame_type = FRAME802154_DATAFRAME;
+  p.fcf.frame_version = FRAME802154_IEEE802154E_2012;
+  p.dest_pid = IEEE802154_PANID;
+  p.src_pid = IEEE802154_PANID;
+  p.seq = lane;
+  p.fcf.dest_addr_mode = LINKADDR_SIZE > 2 ? FRAME802154_LONGADDRMODE : FRAME802154_SHORTADDRMODE;
+  p.fcf.src_addr_mode = p.fcf.dest_addr_mode;
+  memset(p.dest_addr, 0xff, LINKADDR_SIZE);
+  p.src_addr[LINKADDR_SIZE - 1] = node->addr;
+
+  if((len = frame802154_create(&p, buf)) == 0) {
+    return 0;
+  }
+
+  sim_sent_count = 0;
+  if(frame_version == 2) {
+    len = sim_payload_v2(buf, len, node, lane, tx_ts);
+  } else {
+    len = sim_payload_v1(buf, len, node, lane, tx_ts);
+  }
+  /* whatever did not fit is dropped, like the node does */
+  for(j = 0; j < num_nodes; j++) {
+    node->rx_valid[lane][j] = 0;
+  }
+  return len;
+}
+/*---------------------------------------------------------------------------*/
+/* pipeline of tsch_mtm_rx_slot()/tsch_mtm_tx_slot() without the radio */
+static struct tsch_asn_t replay_asn;
+static uint32_t frames_total, frames_parsed, decode_errors;
+static uint64_t frame_bytes;
+static struct mtm_packet_timestamp *last_rx_timestamps;
+static uint8_t last_num_rx_timestamps;
+static uint64_t pipeline_cycles;
+
+static void
+replay_rx_frame(uint8_t *buf, int len, uint8_t timeslot, uint64_t rx_ts)
+{
+  frame802154_t frame;
+  linkaddr_t src, dest;
+  uint64_t tx_ts_B = 0;
+  struct mtm_packet_timestamp *rx_timestamps = NULL;
+  uint8_t num_rx_timestamps = 0;
+  uint64_t start, frame_start;
+  int ok;
+
+  frames_total++;
+  frame_bytes += len;
+  last_num_rx_timestamps = 0;
+  frame_start = start = cycles_now();
+  ok = frame802154_parse(buf, len, &frame) > 0
+    && frame802154_check_dest_panid(&frame)
+    && frame802154_extract_linkaddr(&frame, &src, &dest)
+    && tsch_packet_parse_multiranging_packet(buf, len, timeslot, &frame,
+                                             &tx_ts_B, &rx_timestamps, &num_rx_timestamps);
+  stage_account(STAGE_PARSE, start);
+
+  if(ok) {
+    ranging_addr_t neighbor = src.u8[LINKADDR_SIZE - 1];
+    frames_parsed++;
+    last_rx_timestamps = rx_timestamps;
+    last_num_rx_timestamps = num_rx_timestamps;
+
+    start = cycles_now();
+    add_to_direct_observed_rx_to_queue(rx_ts, neighbor, timeslot);
+    stage_account(STAGE_RX_QUEUE, start);
+
+    start = cycles_now();
+    /* the trace does not record the channel, it is only passed through */
+    add_mtm_reception_timestamp(neighbor, &replay_asn, 0, timeslot, rx_ts, tx_ts_B,
+                                rx_timestamps, num_rx_timestamps);
+    stage_account(STAGE_UPDATE, start);
+
+#if TSCH_MTM_DEFERRED_PROCESSING
+    /* what TSCH_MTM_PROCESS does once polled, outside of the slot */
+    start = cycles_now();
+    tsch_mtm_process_pending();
+    stage_account(STAGE_DEFERRED, start);
+#endif
+  }
+  pipeline_cycles += cycles_now() - frame_start;
+}
+
+static void
+replay_tx_frame(uint8_t lane, uint64_t tx_ts)
+{
+  static uint8_t buf[TSCH_PACKET_MAX_LEN];
+  linkaddr_t bcast;
+  uint64_t start;
+
+  memset(&bcast, 0xff, sizeof(bcast));
+  start = cycles_now();
+  mtm_set_burst_index(lane);
+  frame_bytes += tsch_packet_create_multiranging_packet(buf, sizeof(buf), &bcast, lane, tx_ts);
+  add_mtm_transmission_timestamp(&replay_asn, tx_ts);
+  stage_account(STAGE_CREATE, start);
+  pipeline_cycles += cycles_now() - start;
+}
+
+/* end of a timeslot, after all frames of its burst */
+static void
+replay_slot_end(uint8_t timeslot)
+{
+  mtm_slot_end_handler(timeslot);
+  TSCH_ASN_INC(replay_asn, 1);
+}
+
+/* one slot of the simulated cluster, node at index slot transmits a burst */
+static void
+sim_slot(uint32_t round, uint8_t slot)
+{
+  static uint8_t buf[TSCH_PACKET_MAX_LEN];
+  double t;
+  uint64_t tx_ts;
+  uint8_t k, lane;
+  int len;
+  struct mtm_packet_timestamp *ts;
+
+  for(lane = 0; lane < TSCH_MTM_BURST_LEN; lane++) {
+    t = ((double)round * num_nodes + slot) * (REPLAY_SLOT_S / DW_TICK_S)
+      + (REPLAY_TX_OFFSET_S + lane * REPLAY_BURST_INTERVAL_S) / DW_TICK_S;
+    tx_ts = sim_local_ts(slot, t);
+
+    /* every simulated listener timestamps the frame */
+    for(k = 1; k < num_nodes; k++) {
+      if(k != slot) {
+        nodes[k].rx_ts[lane][slot] = sim_local_ts(k, t + sim_tof(slot, k) + sim_gauss(jitter_ticks));
+        nodes[k].rx_slot[lane][slot] = slot;
+        nodes[k].rx_valid[lane][slot] = 1;
+      }
+    }
+
+    if(slot == 0) {
+      replay_tx_frame(lane, tx_ts);
+      continue;
+    }
+
+    len = sim_create_frame(buf, slot, lane, tx_ts);
+    replay_rx_frame(buf, len, slot,
+                    sim_local_ts(0, t + sim_tof(slot, 0) + sim_gauss(jitter_ticks)));
+
+    /* the parser has to restore exactly what was sent, including the timeslots of v2 */
+    if(last_num_rx_timestamps != sim_sent_count) {
+      decode_errors++;
+    }
+    for(k = 0; k < last_num_rx_timestamps && k < sim_sent_count; k++) {
+      for(ts = last_rx_timestamps; ts < last_rx_timestamps + last_num_rx_timestamps; ts++) {
+        if(ts->addr == sim_sent[k].addr) {
+          break;
+        }
+      }
+      if(ts == last_rx_timestamps + last_num_rx_timestamps
+         || ts->rx_timestamp != sim_sent[k].rx_timestamp
+         || ts->timeslot_offset != sim_sent[k].timeslot_offset) {
+        decode_errors++;
+      }
+    }
+  }
+  replay_slot_end(slot);
+}
+/*---------------------------------------------------------------------------*/
+/* recorded traces, one event per line as printed by MTM_EVAL_OUTPUT_FRAMES:
+ *   mtmt, <timeslot>, <tx timestamp hex>[, <frame hex>]
+ *   mtmr, <timeslot>, <rx timestamp hex>, <frame hex>
+ *   mtms, <round begin>, <round end>
+ *   mtmf, <slotframe size>, <timeslot length in us>
+ * other lines are ignored, so raw node logs can be replayed directly.
+ * The frames of a burst share their timeslot, a new slot starts with a
+ * different timeslot or a sequence number that does not increase. */
+static FILE *trace;
+static int trace_slot = -1, trace_seq;
+
+static int
+hex_nibble(char c)
+{
+  if(c >= '0' && c <= '9') {
+    return c - '0';
+  }
+  if(c >= 'a' && c <= 'f') {
+    return c - 'a' + 10;
+  }
+  if(c >= 'A' && c <= 'F') {
+    return c - 'A' + 10;
+  }
+  return -1;
+}
+
+/* reads the frame following the last comma of line into buf, returns its length */
+static int
+trace_frame(char *line, uint8_t *buf)
+{
+  char *hex = strrchr(line, ',') + 1;
+  int len, hi, lo;
+
+  while(*hex == ' ') {
+    hex++;
+  }
+  for(len = 0; len < TSCH_PACKET_MAX_LEN; len++) {
+    if((hi = hex_nibble(hex[2 * len])) < 0 || (lo = hex_nibble(hex[2 * len + 1])) < 0) {
+      break;
+    }
+    buf[len] = (hi << 4) | lo;
+  }
+  return len;
+}
+
+static void
+trace_flush_slot(void)
+{
+  if(trace_slot >= 0) {
+    replay_slot_end(trace_slot);
+    trace_slot = -1;
+  }
+}
+
+/* ends the pending slot if the frame (slot, seq) belongs to a new one */
+static void
+trace_next_frame(int slot, int seq)
+{
+  if(slot != trace_slot || seq <= trace_seq) {
+    trace_flush_slot();
+  }
+  trace_slot = slot;
+  trace_seq = seq;
+}
+
+static int
+trace_step(void)
+{
+  static char line[REPLAY_LINE_LEN];
+  static uint8_t buf[TSCH_PACKET_MAX_LEN];
+  unsigned int slot, begin, end;
+  unsigned long slot_us;
+  unsigned long long ts;
+  frame802154_t frame;
+  int len, seq;
+
+  if(fgets(line, sizeof(line), trace) == NULL) {
+    trace_flush_slot();
+    return 0;
+  }
+
+  if(sscanf(line, "mtms, %u, %u", &begin, &end) == 2) {
+    trace_flush_slot();
+    mtm_set_round_slots(begin, end);
+  } else if(sscanf(line, "mtmf, %u, %lu", &begin, &slot_us) == 2) {
+    trace_flush_slot();
+    mtm_set_slot_timing(begin, slot_us);
+  } else if(sscanf(line, "mtmt, %u, %llx", &slot, &ts) == 2) {
+    /* older traces do not contain the frame, all of their frames are in lane 0 */
+    seq = 0;
+    if(strchr(strchr(line, ',') + 1, ',') != strrchr(line, ',')
+       && (len = trace_frame(line, buf)) > 0 && frame802154_parse(buf, len, &frame) > 0) {
+      seq = frame.seq;
+    }
+    trace_next_frame(slot, seq);
+    mtm_set_burst_index(seq);
+    add_mtm_transmission_timestamp(&replay_asn, ts);
+  } else if(sscanf(line, "mtmr, %u, %llx, ", &slot, &ts) == 2) {
+    len = trace_frame(line, buf);
+    seq = frame802154_parse(buf, len, &frame) > 0 ? frame.seq : 0;
+    trace_next_frame(slot, seq);
+    replay_rx_frame(buf, len, slot, ts);
+  }
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+/* reference results, kept identical to the double precision formulas */
+static inline int64_t
+ref_interval(uint64_t high_ts, uint64_t low_ts)
+{
+  if((int64_t)high_ts < (int64_t)low_ts) {
+    return DW_TS_MASK - low_ts + high_ts + 1;
+  }
+  return (int64_t)high_ts - (int64_t)low_ts;
+}
+
+static double
+ref_dstwr(const struct ds_twr_ts *ts)
+{
+  int64_t own, other, round_a, delay_b, drift_offset;
+  double relative_drift;
+
+  own = ref_interval(ts->t_a2, ts->t_a1);
+  other = ref_interval(ts->r_b2, ts->r_b1);
+  relative_drift = (double)(own - other) / (double)other;
+  round_a = ref_interval(ts->r_a1, ts->t_a1);
+  delay_b = ref_interval(ts->t_b1, ts->r_b1);
+  drift_offset = round(-relative_drift * (double)delay_b);
+
+  return (float)(round_a - delay_b + drift_offset) * 0.5;
+}
+
+static double
+ref_tdoa(const struct mtm_tdoa_ts *p)
+{
+  int64_t M_a, M_b, R_a, D_a;
+  double k, tof;
+
+  M_a = ref_interval(p->r_l2, p->r_l1);
+  M_b = ref_interval(p->r_l3, p->r_l2);
+  R_a = ref_interval(p->ds_ts.r_a1, p->ds_ts.t_a1);
+  D_a = ref_interval(p->ds_ts.t_a2, p->ds_ts.r_a1);
+
+  k = (double)(M_a + M_b) / (double)(R_a + D_a);
+  tof = (float)ref_dstwr(&p->ds_ts);
+
+  return k * ((double)R_a - tof) - (double)M_a;
+}
+
+static uint32_t checked[2], exact[2];
+static double max_dev[2], truth_abs_err[2];
+static uint32_t truth_count[2];
+
+static struct ds_twr_ts kernel_twr[REPLAY_KERNEL_SAMPLES];
+static struct mtm_tdoa_ts kernel_tdoa[REPLAY_KERNEL_SAMPLES];
+static uint16_t kernel_twr_count, kernel_tdoa_count;
+
+static void
+check_measurement(struct distance_measurement *m)
+{
+  float ref;
+  double truth = NAN;
+  int8_t a, b, self;
+
+  if(m->type == TWR) {
+#if TSCH_MTM_HALF_ROUND_TWR
+    /* single sided TWR with the tracked drift has no reference formula,
+     * these results are only compared with the geometry */
+    ref = m->time;
+#else
+    /* m is the last_measurement of its lane */
+    struct mtm_neighbor *n = (struct mtm_neighbor *)
+      ((uint8_t *)(m - m->burst_index) - offsetof(struct mtm_neighbor, last_measurement));
+    ref = (float)ref_dstwr(&n->ts[m->burst_index]);
+    if(kernel_twr_count < REPLAY_KERNEL_SAMPLES) {
+      kernel_twr[kernel_twr_count++] = n->ts[m->burst_index];
+    }
+#endif
+  } else {
+    /* m is one of the two last_measurements of its pair, the one of index 1
+     * comes from a window initiated by B and is negated */
+    struct mtm_pas_tdoa *p;
+    for(p = list_head(tsch_prop_get_tdoa_list()); p != NULL; p = list_item_next(p)) {
+      if(m == &p->last_measurement[0] || m == &p->last_measurement[1]) {
+        break;
+      }
+    }
+    if(p == NULL) {
+      return;
+    }
+    ref = (float)ref_tdoa(&p->ts);
+    if(m == &p->last_measurement[1]) {
+      ref = -ref;
+    }
+    if(kernel_tdoa_count < REPLAY_KERNEL_SAMPLES) {
+      kernel_tdoa[kernel_tdoa_count++] = p->ts;
+    }
+  }
+
+  checked[m->type]++;
+#if TSCH_MTM_FIXED_POINT
+  if(fabs((double)ref - m->time) <= TSCH_MTM_FIXED_MAX_ERROR_TICKS) {
+    exact[m->type]++;
+  }
+#else
+  if(memcmp(&ref, &m->time, sizeof(float)) == 0) {
+    exact[m->type]++;
+  }
+#endif
+  if(fabs((double)ref - m->time) > max_dev[m->type]) {
+    max_dev[m->type] = fabs((double)ref - m->time);
+  }
+
+  if(trace_path == NULL) {
+    a = sim_index(m->addr_A);
+    b = sim_index(m->addr_B);
+    self = sim_index(own_addr);
+    if(a >= 0 && b >= 0) {
+      truth = m->type == TWR ? sim_tof(a, b) : sim_tof(a, self) - sim_tof(b, self);
+      truth_abs_err[m->type] += fabs(time_to_dist(m->time - truth));
+      truth_count[m->type]++;
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+kernel_benchmark(void)
+{
+  static volatile float sink;
+  uint16_t i, it;
+  uint64_t start;
+
+  for(it = 0; it < REPLAY_KERNEL_ITERATIONS; it++) {
+    for(i = 0; i < kernel_twr_count; i++) {
+      start = cycles_now();
+      sink = calculate_propagation_time_alternative(&kernel_twr[i]);
+      stage_account(STAGE_KERNEL_DSTWR, start);
+      start = cycles_now();
+      sink = calculate_propagation_time_fixed(&kernel_twr[i]);
+      stage_account(STAGE_KERNEL_DSTWR_FIXED, start);
+    }
+    for(i = 0; i < kernel_tdoa_count; i++) {
+      start = cycles_now();
+      sink = mtm_compute_tdoa(&kernel_tdoa[i]);
+      stage_account(STAGE_KERNEL_TDOA, start);
+      start = cycles_now();
+      sink = mtm_compute_tdoa_fixed(&kernel_tdoa[i]);
+      stage_account(STAGE_KERNEL_TDOA_FIXED, start);
+    }
+  }
+  (void)sink;
+}
+
+static void
+report(double wall_s, uint64_t wall_cycles)
+{
+  uint8_t i;
+  static const char *type_name[2] = { "tdoa", "twr" };
+
+  printf("=MTM replay=\n");
+  printf(";; source = %s\n", trace_path != NULL ? trace_path : "synthetic");
+  if(trace_path == NULL) {
+    printf(";; nodes = %u, rounds = %lu, seed = %lu, jitter = %.2f ticks, burst = %u\n",
+           num_nodes, (unsigned long)num_rounds, (unsigned long)seed, jitter_ticks,
+           TSCH_MTM_BURST_LEN);
+  }
+  printf(";; frames = %lu, parsed = %lu, avg length = %.1f bytes\n",
+         (unsigned long)frames_total, (unsigned long)frames_parsed,
+         frames_total ? (double)frame_bytes / (frames_total + stages[STAGE_CREATE].calls) : 0.0);
+  if(trace_path == NULL) {
+    printf(";; frame version = %u, decode errors = %lu\n", frame_version,
+           (unsigned long)decode_errors);
+  }
+#if defined(__x86_64__) || defined(__i386__)
+  printf(";; unit = tsc cycles\n");
+#else
+  printf(";; unit = ns\n");
+#endif
+  if(pipeline_cycles > 0 && wall_s > 0.0) {
+    /* convert pipeline cycles to seconds with the rate observed over the run */
+    double pipeline_s = (double)pipeline_cycles / ((double)wall_cycles / wall_s);
+    printf(";; pipeline = %.0f frames/s (%.1f%% of wall time)\n",
+           frames_total / pipeline_s, 100.0 * pipeline_s / wall_s);
+  }
+
+  printf("%-14s %10s %12s %12s\n", "stage", "calls", "avg", "max");
+  for(i = 0; i < STAGE_COUNT; i++) {
+    printf("%-14s %10lu %12.1f %12llu\n", stages[i].name,
+           (unsigned long)stages[i].calls,
+           stages[i].calls ? (double)stages[i].total / stages[i].calls : 0.0,
+           (unsigned long long)stages[i].max);
+  }
+
+  for(i = 0; i < 2; i++) {
+    printf("%s: %lu measurements, %lu %s, max |dev| %g ticks",
+           type_name[i], (unsigned long)checked[i], (unsigned long)exact[i],
+           TSCH_MTM_FIXED_POINT ? "within bound" : "bit-exact", max_dev[i]);
+    if(truth_count[i] > 0) {
+      printf(", mean |err| vs geometry %.3f m", truth_abs_err[i] / truth_count[i]);
+    }
+    printf("\n");
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+parse_args(void)
+{
+  int c;
+
+  optind = 1;
+  while((c = getopt(contiki_argc, contiki_argv, "n:r:s:j:a:v:f:")) != -1) {
+    switch(c) {
+    case 'n':
+      num_nodes = atoi(optarg);
+      if(num_nodes < 2 || num_nodes > REPLAY_MAX_NODES) {
+        printf("nodes must be within 2..%u\n", REPLAY_MAX_NODES);
+        exit(2);
+      }
+      break;
+    case 'r':
+      num_rounds = strtoul(optarg, NULL, 0);
+      break;
+    case 's':
+      seed = strtoul(optarg, NULL, 0);
+      break;
+    case 'j':
+      jitter_ticks = atof(optarg);
+      break;
+    case 'a':
+      own_addr = atoi(optarg);
+      break;
+    case 'v':
+      frame_version = atoi(optarg);
+      if(frame_version != 1 && frame_version != 2) {
+        printf("frame version must be 1 or 2\n");
+        exit(2);
+      }
+      break;
+    case 'f':
+      trace_path = optarg;
+      break;
+    default:
+      printf("usage: %s [-n nodes] [-r rounds] [-s seed] [-j jitter] [-a addr] [-v version]\n"
+             "       [-f trace]\n",
+             contiki_argv[0]);
+      exit(2);
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(TSCH_PROP_PROCESS, ev, data)
+{
+  PROCESS_BEGIN();
+
+  while(1) {
+    PROCESS_YIELD();
+    if(ev == PROCESS_EVENT_MSG) {
+      check_measurement((struct distance_measurement *)data);
+    }
+  }
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(replay_process, ev, data)
+{
+  static uint32_t round;
+  static uint8_t slot;
+  static struct timespec wall_start, wall_end;
+  static uint64_t cycles_start, report_cycles;
+  linkaddr_t addr;
+
+  PROCESS_BEGIN();
+
+  parse_args();
+
+  memset(&addr, 0, sizeof(addr));
+  addr.u8[LINKADDR_SIZE - 1] = own_addr;
+  linkaddr_set_node_addr(&addr);
+
+  mtm_reset();
+  TSCH_ASN_INIT(replay_asn, 0, 0);
+  clock_gettime(CLOCK_MONOTONIC, &wall_start);
+  cycles_start = cycles_now();
+
+  if(trace_path != NULL) {
+    if((trace = fopen(trace_path, "r")) == NULL) {
+      perror(trace_path);
+      exit(2);
+    }
+    while(trace_step()) {
+      /* let the checker consume the measurements of this frame */
+      PROCESS_PAUSE();
+    }
+    fclose(trace);
+  } else {
+    sim_init();
+    mtm_set_round_slots(0, num_nodes - 1);
+    mtm_set_slot_timing(num_nodes, REPLAY_SLOT_S * 1e6);
+    for(round = 0; round < num_rounds; round++) {
+      for(slot = 0; slot < num_nodes; slot++) {
+        sim_slot(round, slot);
+        PROCESS_PAUSE();
+      }
+    }
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &wall_end);
+  report_cycles = cycles_now() - cycles_start;
+  kernel_benchmark();
+  report((wall_end.tv_sec - wall_start.tv_sec) + (wall_end.tv_nsec - wall_start.tv_nsec) * 1e-9,
+         report_cycles);
+#if TSCH_MTM_STATS
+  tsch_mtm_stats_print();
+#endif
+#if REPLAY_WITH_LOCATE
+  if(trace_path == NULL) {
+    struct mtm_locate_position pos;
+    struct mtm_locate_stats locate_stats;
+
+    mtm_locate_get_stats(&locate_stats);
+    if(mtm_locate_get_position(&pos)) {
+      printf("position: %.3f %.3f m, std %.3f m, error %.3f m",
+             pos.x, pos.y, pos.std, hypot(pos.x - nodes[0].x, pos.y - nodes[0].y));
+    } else {
+      printf("position: none");
+    }
+    printf(" (%lu used, %lu gated, %lu ignored, %lu restarts, %lu dropped)\n",
+           (unsigned long)locate_stats.accepted, (unsigned long)locate_stats.gated,
+           (unsigned long)locate_stats.ignored, (unsigned long)locate_stats.restarts,
+           (unsigned long)locate_stats.dropped);
+  }
+#endif
+
+  exit(decode_errors != 0 || (checked[TWR] + checked[TDOA] > 0
+       && (exact[TWR] != checked[TWR] || exact[TDOA] != checked[TDOA])));
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,11 @@
+/*
+ * Host replacement for the nRF SDK logging header. Only the float
+ * formatting helpers are used by the MTM engine.
+ */
+#ifndef NRFX_LOG_H_
+#define NRFX_LOG_H_
+
+#define NRF_LOG_FLOAT_MARKER "%f"
+#define NRF_LOG_FLOAT(val) ((double)(val))
+
+#endif /* NRFX_LOG_H_ */
@@ -0,0 +1,4 @@
+/*
+ * newlib-only header included by tsch-prop.c, maps to glibc on the host.
+ */
+#include <stdint.h>
@@ -0,0 +1,11 @@
+/*
+ * Host replacement for the dwm1001 UART driver header.
+ */
+#ifndef UART0_H_
+#define UART0_H_
+
+#include <stdio.h>
+
+#define uart0_writeb(b) putchar(b)
+
+#endif /* UART0_H_ */
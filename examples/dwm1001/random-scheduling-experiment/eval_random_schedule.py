@@ -22,6 +22,7 @@ total_measurements = {}
 initial_timestamp = {}
 initial_asn = {}
 max_package_lengths = {}
+convergence = {} # identifier -> list of (timeslot, ms, rounds, used slots, max slots, claims, releases)
 
 tsch_timesyncs = {}
 
@@ -45,6 +46,10 @@ def read_line(identifier, line):
     # elif line.startswith("tschass"):
     #     associated[identifier] = int(line.split()[-1])
 
+    # slot settled, printed by rand-sched
+    elif line.startswith("rss,"):
+        convergence.setdefault(identifier, []).append(tuple(int(v) for v in line.split(',')[1:8]))
+
     elif line.startswith("ppl,"):
         if identifier not in max_package_lengths:
             max_package_lengths[identifier] = int(line.split(',')[1])
@@ -155,6 +160,11 @@ def main():
                 print(total_measurements)
                 print("")
                 print(max_package_lengths)
+                if convergence:
+                    last = [c[-1] for c in convergence.values()]
+                    print("")
+                    print(f"settled: {len(last)}, max convergence: {max(c[1] for c in last)} ms / {max(c[2] for c in last)} rounds, "
+                          f"claims: {sum(c[5] for c in last)}, releases: {sum(c[6] for c in last)}")
 
 
             except KeyboardInterrupt:
@@ -173,6 +183,10 @@ def main():
             # save as pickle
             pickle.dump(twr_measurements, f)
 
+        with open("convergence.pkl", "wb") as f:
+            # save as pickle
+            pickle.dump(convergence, f)
+
         with open("tsch_timesyncs.pkl", "wb") as f:
             # save as pickle
             pickle.dump(tsch_timesyncs, f)
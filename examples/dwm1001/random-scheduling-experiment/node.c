@@ -61,6 +61,10 @@
 #include "net/mac/tsch/tsch.h"
 
 #include "tsch-prop.h"
+#include "tsch-prop-export.h"
+#include "tsch-mtm-stats.h"
+#include "dw1000-ranging-bias.h"
+#include "d3s_dw1000-arch.h"
 #include <stdio.h>
 
 #include "nodes.h"
@@ -160,6 +164,9 @@ PROCESS_THREAD(TSCH_PROP_PROCESS, ev, data)
 
   static struct distance_measurement *m = NULL;
 
+#if WITH_UART_OUTPUT_RANGE && TSCH_PROP_EXPORT
+  tsch_prop_export_init();
+#endif
 
   while(1) {
     PROCESS_YIELD();
@@ -167,7 +174,21 @@ PROCESS_THREAD(TSCH_PROP_PROCESS, ev, data)
     if(ev == PROCESS_EVENT_MSG) {
         measurement_count++;
         m = (struct distance_measurement *) data;
-#if WITH_UART_OUTPUT_RANGE
+#if WITH_RANGING_BIAS_CORRECTION
+        if(m->type == TWR) {
+            // the engine owns *m, correct a copy
+            static struct distance_measurement corrected;
+
+            corrected = *m;
+            // the radio may have hopped since, use the channel of the exchange
+            dw1000_bias_correct_batch(m->tsch_channel, &corrected.time, NULL, 1);
+            m = &corrected;
+        }
+#endif
+#if WITH_UART_OUTPUT_RANGE && TSCH_PROP_EXPORT
+        /* binary records, decoded by tools/dwm1001/measurement-decode.py */
+        tsch_prop_export_measurement(m);
+#elif WITH_UART_OUTPUT_RANGE
         float dist = time_to_dist(m->time);
         struct tsch_asn_t asn = m->asn;
         if(m->type == TWR) {
@@ -290,6 +311,16 @@ PROCESS_THREAD(node_process, ev, data)
                   printf("invalid timeslot\n");
               }
               rand_sched_set_timeslot((uint8_t) timeslot);
+          } else if (serial_data[0] == 'm') {
+              // MTM statistics, as text lines or as binary record
+#if TSCH_MTM_STATS
+              tsch_mtm_stats_print();
+#endif
+#if DW1000_ARCH_SPI_ASYNC_STATS
+              dw1000_spi_print_async_stats();
+#endif
+          } else if (serial_data[0] == 'M') {
+              tsch_prop_export_mtm_stats();
           } else if (serial_data[0] == 's') {
               role = get_node_role_entry(&linkaddr_node_addr);              
               switch(role->role) {
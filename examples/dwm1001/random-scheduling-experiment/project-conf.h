@@ -52,6 +52,7 @@
 /************* Experiment Configuration **************/
 /*******************************************************/
 #define MTM_EVAL_OUTPUT_TS 0 // Whether to output raw timestamps. Note that this might require an increase of the tsch timeslot length.
+#define MTM_EVAL_OUTPUT_FRAMES 0 // Whether to output received frames for examples/dwm1001/mtm-replay. Note that this might require an increase of the tsch timeslot length.
 #define DWM1001_LOAD_OTP_ANTENNA_DELAY 0
 #define RAND_SCHED_RULES_WITH_PLANARITY_CHECK 0
 #define RAND_SCHED_RULES_MIN_NEIGHBORS 3
@@ -60,6 +61,8 @@
 #define PROJECT_WITH_REDUCED_RANGE 0
 #define WITH_UART_OUTPUT_RANGE 0
 #define WITH_UART_OUTPUT_COUNTS 1
+#define WITH_RANGING_BIAS_CORRECTION 1 // correct the TWR range bias of the channel on the node
+#define TSCH_PROP_CONF_EXPORT 1 // WITH_UART_OUTPUT_RANGE writes binary records instead of text lines, decode with tools/dwm1001/measurement-decode.py
 #define MTM_SLOT_DURATIONS_EVAL 0
 #define WITH_PASSIVE_TDOA 1
 #define WITH_MTM_BUS_BOARDING 0
@@ -68,6 +71,8 @@
 #define WITH_MTM_TDOA_REPLACE_AFTER_TIMEOUT 1
 /* #define WITH_MTM_SLOT_END_PROCESS 0 */
 #define WITH_MTM_SLOT_END_PROCESS 1
+#define RAND_SCHED_CONF_ALLOCATOR 0 // 0 lottery, 1 claims in bounded rounds. Both print "rss" lines once a slot settled
+#define TSCH_MTM_CONF_SLOT_CLAIMS 0 // announce received and collided slots in the MTM frames, used by both allocators
 
 #undef TSCH_CONF_AUTOSELECT_TIME_SOURCE
 #define TSCH_CONF_AUTOSELECT_TIME_SOURCE 1
@@ -188,6 +188,7 @@ void generate_slotframe_with_distance(uint8_t slotframe_distance) {
 
 
         mtm_set_round_slots(round_start, round_start + 1 + slotframe_distance);
+        mtm_set_slot_timing(slotframe_length, RTIMERTICKS_TO_US(tsch_timing[tsch_ts_timeslot_length]));
 
 // interleave some rx slots, to wake up radio
 /* #define WITH_ADD_ADDITIONAL_SHARED 1 */
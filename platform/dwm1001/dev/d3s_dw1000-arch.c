@@ -99,6 +99,22 @@ static const nrfx_spim_t spim = NRFX_SPIM_INSTANCE(DW1000_SPIM_INSTANCE);
 void dw1000_spi_set_slow_rate(void);
 void dw1000_spi_set_fast_rate(void);
 /*---------------------------------------------------------------------------*/
+/* State of the asynchronous transfer in progress (at most one at a time).
+ * EasyDMA needs its buffers in RAM and can move at most 255 bytes */
+#define ASYNC_BUF_LEN 255
+static uint8_t async_tx_buf[ASYNC_BUF_LEN];
+static uint8_t async_rx_buf[ASYNC_BUF_LEN];
+static volatile uint8_t async_busy;
+static uint16_t async_header_len;
+static uint32_t async_read_len;
+static uint8_t *async_read_buf;
+static dw1000_spi_done_t async_done;
+static void *async_ptr;
+#if DW1000_ARCH_SPI_ASYNC_STATS
+static struct dw1000_spi_async_stats async_stats;
+static uint32_t async_start_cycles;
+#endif
+/*---------------------------------------------------------------------------*/
 static dw1000_isr_t dw1000_isr = NULL; // no ISR by default
 static volatile int dw1000_irqn_status;
 /*---------------------------------------------------------------------------*/
@@ -148,6 +164,7 @@ void
 dw1000_spi_set_slow_rate(void)
 {
   nrfx_spim_config_t spi_config = NRFX_SPIM_DEFAULT_CONFIG_2M;
+  dw1000_spi_async_wait();
   nrfx_spim_uninit(&spim);
   APP_ERROR_CHECK(nrfx_spim_init(&spim, &spi_config, NULL, NULL));
 }
@@ -156,6 +173,7 @@ void
 dw1000_spi_set_fast_rate(void)
 {
   nrfx_spim_config_t spi_config = NRFX_SPIM_DEFAULT_CONFIG_8M;
+  dw1000_spi_async_wait();
   nrfx_spim_uninit(&spim);
   APP_ERROR_CHECK(nrfx_spim_init(&spim, &spi_config, NULL, NULL));
 }
@@ -184,6 +202,7 @@ dw1000_spi_read(uint16_t  headerLength,
                 uint32_t  readLength,
                 uint8_t   *readBuffer)
 {
+  dw1000_spi_async_wait();
   nrf_gpio_pin_clear(DW1000_SPI_CS_PIN);
   if (headerLength + readLength <= BUF_JOIN_THR) {  // combine header and body for short xfers
     uint8_t buf[headerLength + readLength];
@@ -240,6 +259,7 @@ dw1000_spi_write(uint16_t       headerLength,
                  uint32_t       bodyLength,
                  const uint8_t  *bodyBuffer)
 {
+  dw1000_spi_async_wait();
   nrf_gpio_pin_clear(DW1000_SPI_CS_PIN);
 
   if (!bodyLength) { // no body, send only the header
@@ -297,6 +317,162 @@ dw1000_spi_write(uint16_t       headerLength,
   return 0;
 }
 /*---------------------------------------------------------------------------*/
+/* Asynchronous transfers are started through the EasyDMA registers of the
+ * SPIM and their END event is polled rather than taken as an interrupt: the
+ * slot operation runs in the rtimer interrupt, which the SPIM interrupt could
+ * not preempt to complete a transfer the slot operation waits for. */
+static void
+async_start(uint32_t tx_length, uint32_t rx_length)
+{
+  async_busy = 1;
+#if DW1000_ARCH_SPI_ASYNC_STATS
+  async_stats.transfers++;
+  async_stats.bytes += tx_length > rx_length ? tx_length : rx_length;
+  async_start_cycles = DWT->CYCCNT;
+#endif
+
+  nrf_gpio_pin_clear(DW1000_SPI_CS_PIN);
+  nrf_spim_tx_buffer_set(spim.p_reg, async_tx_buf, tx_length);
+  nrf_spim_rx_buffer_set(spim.p_reg, async_rx_buf, rx_length);
+  nrf_spim_event_clear(spim.p_reg, NRF_SPIM_EVENT_END);
+  nrf_spim_task_trigger(spim.p_reg, NRF_SPIM_TASK_START);
+}
+/*---------------------------------------------------------------------------*/
+int
+dw1000_spi_read_async(uint16_t           headerLength,
+                      const uint8_t      *headerBuffer,
+                      uint32_t           readLength,
+                      uint8_t            *readBuffer,
+                      dw1000_spi_done_t  done,
+                      void               *ptr)
+{
+  int irqn_status;
+
+  if(headerLength + readLength > ASYNC_BUF_LEN) {
+    dw1000_spi_read(headerLength, headerBuffer, readLength, readBuffer);
+    if(done != NULL) {
+      done(ptr);
+    }
+    return 0;
+  }
+
+  dw1000_spi_async_wait();
+  /* The DW1000 interrupt must not access the SPI between CS and START */
+  irqn_status = dw1000_disable_interrupt();
+  memcpy(async_tx_buf, headerBuffer, headerLength);
+  async_header_len = headerLength;
+  async_read_len = readLength;
+  async_read_buf = readBuffer;
+  async_done = done;
+  async_ptr = ptr;
+  async_start(headerLength, headerLength + readLength);
+  dw1000_enable_interrupt(irqn_status);
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+int
+dw1000_spi_write_async(uint16_t           headerLength,
+                       const uint8_t      *headerBuffer,
+                       uint32_t           bodyLength,
+                       const uint8_t      *bodyBuffer,
+                       dw1000_spi_done_t  done,
+                       void               *ptr)
+{
+  int irqn_status;
+
+  if(headerLength + bodyLength > ASYNC_BUF_LEN) {
+    dw1000_spi_write(headerLength, headerBuffer, bodyLength, bodyBuffer);
+    if(done != NULL) {
+      done(ptr);
+    }
+    return 0;
+  }
+
+  dw1000_spi_async_wait();
+  irqn_status = dw1000_disable_interrupt();
+  memcpy(async_tx_buf, headerBuffer, headerLength);
+  memcpy(async_tx_buf + headerLength, bodyBuffer, bodyLength);
+  async_read_buf = NULL;
+  async_done = done;
+  async_ptr = ptr;
+  async_start(headerLength + bodyLength, 0);
+  dw1000_enable_interrupt(irqn_status);
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+int
+dw1000_spi_async_poll(void)
+{
+  dw1000_spi_done_t done = NULL;
+  int irqn_status;
+
+  if(!async_busy || !nrf_spim_event_check(spim.p_reg, NRF_SPIM_EVENT_END)) {
+    return async_busy;
+  }
+
+  irqn_status = dw1000_disable_interrupt();
+  if(async_busy) {
+    nrf_spim_event_clear(spim.p_reg, NRF_SPIM_EVENT_END);
+    nrf_gpio_pin_set(DW1000_SPI_CS_PIN);
+#if DW1000_ARCH_SPI_ASYNC_STATS
+    async_stats.busy_cycles += DWT->CYCCNT - async_start_cycles;
+#endif
+    if(async_read_buf != NULL) {
+      memcpy(async_read_buf, async_rx_buf + async_header_len, async_read_len);
+    }
+    done = async_done;
+    async_busy = 0;
+  }
+  dw1000_enable_interrupt(irqn_status);
+
+  if(done != NULL) {
+    done(async_ptr);
+  }
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+void
+dw1000_spi_async_wait(void)
+{
+#if DW1000_ARCH_SPI_ASYNC_STATS
+  uint32_t start;
+
+  if(!async_busy) {
+    return;
+  }
+  start = DWT->CYCCNT;
+  while(dw1000_spi_async_poll());
+  async_stats.wait_cycles += DWT->CYCCNT - start;
+#else
+  while(dw1000_spi_async_poll());
+#endif
+}
+/*---------------------------------------------------------------------------*/
+#if DW1000_ARCH_SPI_ASYNC_STATS
+void
+dw1000_spi_get_async_stats(struct dw1000_spi_async_stats *stats)
+{
+  int irqn_status = dw1000_disable_interrupt();
+  *stats = async_stats;
+  dw1000_enable_interrupt(irqn_status);
+}
+/*---------------------------------------------------------------------------*/
+void
+dw1000_spi_print_async_stats(void)
+{
+  struct dw1000_spi_async_stats stats;
+  uint32_t saved;
+
+  dw1000_spi_get_async_stats(&stats);
+  saved = stats.busy_cycles > stats.wait_cycles ? stats.busy_cycles - stats.wait_cycles : 0;
+  printf("spiasync transfers %lu bytes %lu busy %lu wait %lu saved %lu per_transfer %lu\n",
+         (unsigned long)stats.transfers, (unsigned long)stats.bytes,
+         (unsigned long)stats.busy_cycles, (unsigned long)stats.wait_cycles,
+         (unsigned long)saved,
+         (unsigned long)(stats.transfers ? saved / stats.transfers : 0));
+}
+#endif /* DW1000_ARCH_SPI_ASYNC_STATS */
+/*---------------------------------------------------------------------------*/
 void
 d3s_dw1000_arch_init()
 {
@@ -312,6 +488,12 @@ d3s_dw1000_arch_init()
   nrfx_spim_config_t spi_config = NRFX_SPIM_DEFAULT_CONFIG_2M;
   APP_ERROR_CHECK(nrfx_spim_init(&spim, &spi_config, NULL, NULL));
 
+#if DW1000_ARCH_SPI_ASYNC_STATS
+  /* Cycle counter of the asynchronous transfer stats */
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+#endif
+
   if (dwt_readdevid() != DWT_DEVICE_ID) {
     printf("Radio sleeping?\n");
     dw1000_arch_wakeup_nowait();
@@ -54,6 +54,49 @@ int dw1000_spi_read(uint16 hdrlen, const uint8 *hdrbuf, uint32 len, uint8 *buf);
 int dw1000_spi_write(uint16 hdrlen, const uint8 *hdrbuf, uint32 len, const uint8 *buf);
 void dw1000_spi_set_slow_rate(void);
 void dw1000_spi_set_fast_rate(void);
+/*---------------------------------------------------------------------------*/
+/* Asynchronous (EasyDMA) transfers. They return 1 once the transfer has
+ * started, or 0 if it was too long for the DMA buffer and was done
+ * synchronously. Only one transfer is in progress at a time: any further
+ * SPI access first waits for it. done (may be NULL) is called when the
+ * transfer has completed, from dw1000_spi_async_poll() or from the access
+ * that waited, possibly in interrupt context. The write data is copied, the
+ * read buffer must stay valid until done. */
+typedef void (*dw1000_spi_done_t)(void *ptr);
+int dw1000_spi_read_async(uint16 hdrlen, const uint8 *hdrbuf, uint32 len, uint8 *buf,
+                          dw1000_spi_done_t done, void *ptr);
+int dw1000_spi_write_async(uint16 hdrlen, const uint8 *hdrbuf, uint32 len, const uint8 *buf,
+                           dw1000_spi_done_t done, void *ptr);
+/* Completes the transfer if it is over. Returns 1 while it is in progress */
+int dw1000_spi_async_poll(void);
+/* Busy-waits until the transfer in progress, if any, has completed */
+void dw1000_spi_async_wait(void);
+
+/* Keep the statistics of the asynchronous transfers */
+#ifdef DW1000_ARCH_CONF_SPI_ASYNC_STATS
+#define DW1000_ARCH_SPI_ASYNC_STATS DW1000_ARCH_CONF_SPI_ASYNC_STATS
+#else
+#define DW1000_ARCH_SPI_ASYNC_STATS 1
+#endif
+
+#if DW1000_ARCH_SPI_ASYNC_STATS
+/* CPU cycles (DWT cycle counter) around the transfers. busy_cycles run from
+ * the start of a transfer until it is seen complete, the CPU is free during
+ * them except for the wait_cycles it spends in dw1000_spi_async_wait(): the
+ * cycles saved are busy_cycles - wait_cycles. The TSCH slot operation makes
+ * one transfer per TX slot, the upload of the frame in the prepare. */
+struct dw1000_spi_async_stats {
+  uint32_t transfers;
+  uint32_t bytes;
+  uint32_t busy_cycles;
+  uint32_t wait_cycles;
+};
+void dw1000_spi_get_async_stats(struct dw1000_spi_async_stats *stats);
+/* Prints the statistics as a text line, prefix "spiasync", with the cycles
+ * saved in total and per transfer */
+void dw1000_spi_print_async_stats(void);
+#endif /* DW1000_ARCH_SPI_ASYNC_STATS */
+/*---------------------------------------------------------------------------*/
 int dw1000_disable_interrupt(void);
 void dw1000_enable_interrupt(int irqn_status);
 
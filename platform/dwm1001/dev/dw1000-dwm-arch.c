@@ -28,6 +28,49 @@ void dw_read_subreg(uint32_t reg_addr, uint16_t subreg_addr,
     dwt_readfromdevice(reg_addr, subreg_addr, subreg_len, read_buf);
 }
 
+/*---------------------------------------------------------------------------*/
+// SPI transaction header, as composed by dwt_writetodevice/dwt_readfromdevice
+static int spi_header(uint8_t write, uint32_t reg_addr, uint16_t subreg_addr,
+                      uint8_t *header)
+{
+    int cnt = 0;
+    if(subreg_addr == 0) {
+        header[cnt++] = (write ? 0x80 : 0x00) | reg_addr;
+    } else {
+        header[cnt++] = (write ? 0xC0 : 0x40) | reg_addr;
+        if(subreg_addr <= 127) {
+            header[cnt++] = (uint8_t) subreg_addr;
+        } else {
+            header[cnt++] = 0x80 | (uint8_t) subreg_addr;
+            header[cnt++] = (uint8_t) (subreg_addr >> 7);
+        }
+    }
+    return cnt;
+}
+
+void dw_write_subreg_async(uint32_t reg_addr, uint16_t subreg_addr,
+                           uint16_t subreg_len, const uint8_t *write_buf,
+                           dw1000_arch_spi_done_t done, void *ptr)
+{
+    uint8_t header[3];
+    int cnt = spi_header(1, reg_addr, subreg_addr, header);
+    dw1000_spi_write_async(cnt, header, subreg_len, write_buf, done, ptr);
+}
+
+void dw_read_subreg_async(uint32_t reg_addr, uint16_t subreg_addr,
+                          uint16_t subreg_len, uint8_t *read_buf,
+                          dw1000_arch_spi_done_t done, void *ptr)
+{
+    uint8_t header[3];
+    int cnt = spi_header(0, reg_addr, subreg_addr, header);
+    dw1000_spi_read_async(cnt, header, subreg_len, read_buf, done, ptr);
+}
+
+int dw1000_arch_spi_poll(void)
+{
+    return dw1000_spi_async_poll();
+}
+
 /*---------------------------------------------------------------------------*/
 void
 dw1000_arch_gpio8_setup_irq(void)
@@ -134,6 +134,16 @@ typedef uint32_t rtimer_clock_t;
 #define DW1000_CONF_TX_ANT_DLY 16455 // TODO: needs calibration
 #endif
 
+/* Upload the TX buffer over EasyDMA while the slot operation goes on */
+#ifndef DW1000_ARCH_CONF_SPI_ASYNC
+#define DW1000_ARCH_CONF_SPI_ASYNC 1
+#endif
+
+/* Binary measurement export goes to the UART without blocking */
+#ifndef TSCH_PROP_CONF_EXPORT_WRITE
+#define TSCH_PROP_CONF_EXPORT_WRITE uart0_write
+#endif
+
 /** @} */
 
 
@@ -0,0 +1,137 @@
+#!/usr/bin/env python3
+"""Generates the constant anchor tables of apps/anchor-db for an IoT-lab site.
+
+The node positions come from the IoT-lab API through
+examples/dwm1001/python_common/iotlab_tools.py, which caches the node list in
+node_list.txt of the working directory. The ranging address of dwm1001-<n> is
+<n>, the last byte of its link address.
+
+    anchor-db-gen.py [--cell-cm CM] [--name NAME] [-o FILE] site [node ...]
+
+Without nodes all nodes of the site are anchors. The output defines
+`const struct anchor_db <name>`, anchor_db_<site> by default, to be added to
+PROJECT_SOURCEFILES of the example and declared extern where it is used.
+"""
+
+from __future__ import print_function
+import argparse
+import os
+import sys
+
+# ANCHOR_DB_ADDR_SPACE for a uint8_t ranging_addr_t
+ADDR_SPACE = 256
+INT16_RANGE = (-32768, 32767)
+
+
+def load_positions(site, archi):
+    """Returns {ranging address: (node id, x, y, z in cm)}"""
+    sys.path.append(os.path.join(os.path.dirname(os.path.abspath(__file__)),
+                                 '../../examples/dwm1001/python_common'))
+    from iotlab_tools import get_node_list, get_position_mapping
+
+    anchors = {}
+    for node_id, pos in get_position_mapping(get_node_list(site, archi)).items():
+        addr = int(node_id.split('-')[-1])
+        if addr <= 0 or addr >= ADDR_SPACE:
+            sys.exit("%s: no ranging address" % node_id)
+        cm = tuple(int(round(v * 100.0)) for v in pos)
+        if any(v < INT16_RANGE[0] or v > INT16_RANGE[1] for v in cm):
+            sys.exit("%s: position out of range" % node_id)
+        anchors[addr] = (node_id,) + cm
+    return anchors
+
+
+def build_grid(anchors, cell_cm):
+    """Counting sort of the anchors into grid cells, as anchor_db_build()"""
+    min_x = min(a[1] for a in anchors)
+    min_y = min(a[2] for a in anchors)
+    grid_w = (max(a[1] for a in anchors) - min_x) // cell_cm + 1
+    grid_h = (max(a[2] for a in anchors) - min_y) // cell_cm + 1
+    if grid_w > 255 or grid_h > 255:
+        sys.exit("grid of %dx%d cells, increase --cell-cm" % (grid_w, grid_h))
+
+    cells = [[] for _ in range(grid_w * grid_h)]
+    for i, a in enumerate(anchors):
+        cells[(a[2] - min_y) // cell_cm * grid_w + (a[1] - min_x) // cell_cm].append(i)
+    cell_start = [0]
+    for c in cells:
+        cell_start.append(cell_start[-1] + len(c))
+    return min_x, min_y, grid_w, grid_h, cell_start, [i for c in cells for i in c]
+
+
+def format_array(values, per_line=16):
+    lines = []
+    for i in range(0, len(values), per_line):
+        lines.append('    ' + ', '.join(str(v) for v in values[i:i + per_line]) + ',')
+    return '\n'.join(lines)
+
+
+def generate(site, name, anchors, cell_cm):
+    addrs = sorted(anchors)
+    table = [anchors[addr] for addr in addrs]
+    grid_x, grid_y, grid_w, grid_h, cell_start, cell_anchors = build_grid(table, cell_cm)
+
+    out = []
+    out.append("/* Generated by tools/dwm1001/anchor-db-gen.py for %s, do not edit */" % site)
+    out.append('')
+    out.append('#include "anchor-db.h"')
+    out.append('')
+    out.append("static const struct anchor_db_anchor anchors[] = {")
+    for addr, a in zip(addrs, table):
+        out.append("    { %d, %d, %d, %d }, // %s" % (addr, a[1], a[2], a[3], a[0]))
+    out.append("};")
+    out.append('')
+    out.append("static const uint8_t addr_index[ANCHOR_DB_ADDR_SPACE] = {")
+    for i, addr in enumerate(addrs):
+        out.append("    [%d] = %d," % (addr, i + 1))
+    out.append("};")
+    out.append('')
+    out.append("static const uint8_t cell_start[] = {")
+    out.append(format_array(cell_start))
+    out.append("};")
+    out.append('')
+    out.append("static const uint8_t cell_anchors[] = {")
+    out.append(format_array(cell_anchors))
+    out.append("};")
+    out.append('')
+    out.append("const struct anchor_db %s = {" % name)
+    out.append("    anchors, %d, addr_index," % len(table))
+    out.append("    %d, %d, %d, %d, %d," % (grid_x, grid_y, cell_cm, grid_w, grid_h))
+    out.append("    cell_start, cell_anchors")
+    out.append("};")
+    return '\n'.join(out) + '\n'
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument('site', help="IoT-lab site, e.g. toulouse")
+    parser.add_argument('nodes', nargs='*', help="node ids (dwm1001-<n>) to include, all by default")
+    parser.add_argument('--archi', default='dwm1001:dw1000', help="node architecture")
+    parser.add_argument('--cell-cm', type=int, default=500, help="edge of the grid cells in cm")
+    parser.add_argument('--name', help="name of the table, anchor_db_<site> by default")
+    parser.add_argument('-o', '--output', help="output file, stdout by default")
+    args = parser.parse_args()
+
+    anchors = load_positions(args.site, args.archi)
+    if args.nodes:
+        missing = set(args.nodes) - set(a[0] for a in anchors.values())
+        if missing:
+            sys.exit("unknown nodes: %s" % ', '.join(sorted(missing)))
+        anchors = dict((addr, a) for addr, a in anchors.items() if a[0] in args.nodes)
+    if not anchors:
+        sys.exit("no nodes for %s" % args.site)
+    if len(anchors) >= ADDR_SPACE:
+        sys.exit("too many nodes")
+    if args.cell_cm <= 0 or args.cell_cm > 65535:
+        sys.exit("--cell-cm out of range")
+
+    text = generate(args.site, args.name or "anchor_db_" + args.site, anchors, args.cell_cm)
+    if args.output:
+        with open(args.output, 'w') as f:
+            f.write(text)
+    else:
+        sys.stdout.write(text)
+
+
+if __name__ == '__main__':
+    main()
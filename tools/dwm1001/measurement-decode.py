@@ -0,0 +1,283 @@
+#!/usr/bin/env python3
+"""Decodes the binary records of core/net/mac/tsch/tsch-prop-export.c.
+
+The records share the serial line with the regular text output. Both are
+separated by 0x00 bytes: every chunk between two delimiters is either a COBS
+encoded record or plain text. Records are printed in the text format of the
+examples ("TW, ..." and "TD, ...") so the existing evaluation scripts keep
+working, MTM statistics as "MS, ..." lines. Text is passed through unchanged.
+
+The binary trace mode of tsch-log.c (TSCH_LOG_CONF_BINARY) uses the same
+framing. Its records are printed like the text logs of tsch-log.c, message
+logs with the format string found at their call site in the sources, filled
+in with the values and the %s tag recorded by TSCH_LOG_ADD_ARGS and
+TSCH_LOG_ADD_TAG. Both go through the queue of the export and share its
+sequence numbers.
+
+    measurement-decode.py [--raw] [--source DIR] [input]
+
+input is a file or serial device, stdin by default. With --raw all record
+fields are printed instead. DIR is the Contiki tree the node was built
+from, by default the one of this script.
+"""
+
+from __future__ import print_function
+import argparse
+import os
+import re
+import struct
+import sys
+
+RECORD_VERSION = 1
+RECORD_OVERHEAD = 4
+TYPE_TDOA = 0
+TYPE_TWR = 1
+TYPE_MTM_STATS = 2
+TYPE_TSCH_LOG = 3
+PAYLOAD_LEN = {TYPE_TDOA: 16, TYPE_TWR: 16, TYPE_MTM_STATS: 54, TYPE_TSCH_LOG: 33}
+MAX_RECORD_LEN = max(PAYLOAD_LEN.values()) + RECORD_OVERHEAD
+
+# order of the counters of struct tsch_mtm_stats
+MTM_STATS_FIELDS = ('frame_receptions', 'failed_frame_receptions', 'no_frame_detected', 'rounds',
+                    'twr_measurements', 'tdoa_measurements', 'rx_queue_drops', 'pending_drops',
+                    'neighbor_evictions', 'tdoa_evictions', 'tdoa_alloc_failures')
+
+# type of struct tsch_log_t
+TSCH_LOG_TX = 0
+TSCH_LOG_RX = 1
+TSCH_LOG_MESSAGE = 2
+# TSCH_LOG_FILE_ID_* of tsch-log.h
+TSCH_LOG_FILES = {
+    1: 'core/net/mac/tsch/tsch-slot-operation.c',
+    2: 'core/net/mac/tsch/tsch-adaptive-timesync.c',
+}
+
+# SPEED_OF_LIGHT_M_PER_UWB_TU of tsch-prop.c
+SPEED_OF_LIGHT_M_PER_UWB_TU = 299702547.236 * 1.0E-15 * 15650.0
+
+
+def crc16_add(b, acc):
+    """core/lib/crc16.c"""
+    acc ^= b
+    acc = ((acc >> 8) | (acc << 8)) & 0xffff
+    acc ^= (acc & 0xff00) << 4
+    acc &= 0xffff
+    acc ^= (acc >> 8) >> 4
+    acc ^= (acc & 0xff00) >> 5
+    return acc & 0xffff
+
+
+def crc16_data(data, acc=0):
+    for b in data:
+        acc = crc16_add(b, acc)
+    return acc
+
+
+def cobs_decode(data):
+    out = bytearray()
+    i = 0
+    while i < len(data):
+        code = data[i]
+        if code == 0 or i + code > len(data) + 1:
+            return None
+        out += data[i + 1:i + code]
+        i += code
+        if code < 0xff and i < len(data):
+            out.append(0)
+    return bytes(out)
+
+
+def parse_record(chunk):
+    """Returns the fields of a record, or None if chunk is no record"""
+    record = cobs_decode(chunk)
+    if record is None or len(record) < RECORD_OVERHEAD:
+        return None
+    crc, = struct.unpack_from('<H', record, len(record) - 2)
+    if crc16_data(bytearray(record[:-2])) != crc:
+        return None
+    version_type, seqno = struct.unpack_from('<BB', record)
+    record_type = version_type & 0x0f
+    if version_type >> 4 != RECORD_VERSION or len(record) != PAYLOAD_LEN.get(record_type, -1) + RECORD_OVERHEAD:
+        return None
+    r = {'type': record_type, 'seqno': seqno}
+    if record_type == TYPE_MTM_STATS:
+        values = struct.unpack_from('<%dIIHHH' % len(MTM_STATS_FIELDS), record, 2)
+        r.update(zip(MTM_STATS_FIELDS, values))
+        r['elapsed_ms'], r['processing_p50_us'], r['processing_p99_us'], r['processing_max_us'] = \
+            values[len(MTM_STATS_FIELDS):]
+        return r
+    if record_type == TYPE_TSCH_LOG:
+        asn_ls4b, asn_ms1b, sf, timeslot, choff, log_type = struct.unpack_from('<IBBHBB', record, 2)
+        r.update({'asn': asn_ms1b << 32 | asn_ls4b, 'slotframe': sf, 'timeslot': timeslot,
+                  'channel_offset': choff, 'log_type': log_type})
+        if log_type == TSCH_LOG_TX:
+            keys = ('dest', 'status', 'num_tx', 'datalen', 'flags', 'drift')
+            r.update(zip(keys, struct.unpack_from('<BBBBBh', record, 12)))
+            r['is_data'], r['drift_used'], r['sec_level'] = r['flags'] & 1, (r['flags'] >> 1) & 1, r['flags'] >> 2
+        elif log_type == TSCH_LOG_RX:
+            keys = ('src', 'datalen', 'flags', 'drift', 'estimated_drift')
+            r.update(zip(keys, struct.unpack_from('<BBBhh', record, 12)))
+            r['is_data'], r['drift_used'] = r['flags'] & 1, (r['flags'] >> 1) & 1
+            r['is_unicast'], r['sec_level'] = (r['flags'] >> 2) & 1, r['flags'] >> 3
+        else:
+            values = struct.unpack_from('<BHiii', record, 12)
+            r['file'], r['line'], r['args'] = values[0], values[1], values[2:]
+            r['tag'] = record[27:35].rstrip(b'\0').decode('ascii', 'replace')
+        return r
+    asn_ls4b, asn_ms1b, addr_a, addr_b, time, freq_offset, burst_index = \
+        struct.unpack_from('<IBBBfiB', record, 2)
+    r.update({
+        'asn': asn_ms1b << 32 | asn_ls4b,
+        'addr_A': addr_a,
+        'addr_B': addr_b,
+        'time': time,
+        'freq_offset': freq_offset,
+        'burst_index': burst_index,
+    })
+    return r
+
+
+class SourceLookup(object):
+    """Finds the message of a TSCH_LOG_ADD(_ARGS, _TAG) call site in the sources"""
+
+    def __init__(self, root):
+        self.root = root
+        self.files = {}
+
+    def message(self, file_id, line):
+        path = TSCH_LOG_FILES.get(file_id)
+        if path is None:
+            return None
+        if path not in self.files:
+            try:
+                with open(os.path.join(self.root, path)) as f:
+                    self.files[path] = f.read().splitlines()
+            except IOError:
+                self.files[path] = None
+        lines = self.files[path]
+        if not lines:
+            return None
+        # __LINE__ is a line of the (multi-line) macro call, look for its start
+        for start in range(min(line, len(lines)) - 1, max(line - 12, 0) - 1, -1):
+            if re.search(r'TSCH_LOG_ADD(_ARGS|_TAG)?\(', lines[start]):
+                m = re.search(r'"((?:[^"\\]|\\.)*)"', " ".join(lines[start:start + 8]))
+                return m.group(1) if m else None
+        return None
+
+
+def format_message(fmt, args, tag=''):
+    """Fills in the numeric conversions of a printf format with args, in order,
+    and the string conversions with tag"""
+    args = list(args)
+
+    def conversion(m):
+        if m.group(0) == '%%':
+            return '%'
+        if m.group(2) == 's':
+            return tag or '?'
+        if not args:
+            return '?'
+        value = args.pop(0)
+        if m.group(2) in 'uxX':
+            value &= 0xffffffff
+        return ('%' + m.group(1) + ('d' if m.group(2) == 'i' else m.group(2))) % value
+    return re.sub(r'%%|%([-+ 0#]*[0-9]*)(?:\.[0-9]+)?(?:hh|h|ll|l|z)?([diuxXs])', conversion, fmt)
+
+
+def format_tsch_log(r, raw, sources):
+    if r['slotframe'] == 0xff:
+        head = "TSCH: {asn-%x.%x link-NULL} " % (r['asn'] >> 32, r['asn'] & 0xffffffff)
+    else:
+        head = "TSCH: {asn-%x.%x link-%u-%u-%u} " % (r['asn'] >> 32, r['asn'] & 0xffffffff,
+                                                   r['slotframe'], r['timeslot'], r['channel_offset'])
+    if r['log_type'] == TSCH_LOG_TX:
+        s = "%s-%u-%u %u tx %d, st %d-%d" % ("bc" if r['dest'] == 0 else "uc", r['is_data'], r['sec_level'],
+                                           r['datalen'], r['dest'], r['status'], r['num_tx'])
+        if r['drift_used']:
+            s += ", dr %d" % r['drift']
+    elif r['log_type'] == TSCH_LOG_RX:
+        s = "%s-%u-%u %u rx %d" % ("uc" if r['is_unicast'] else "bc", r['is_data'], r['sec_level'],
+                                  r['datalen'], r['src'])
+        if r['drift_used']:
+            s += ", dr %d" % r['drift']
+        s += ", edr %d" % r['estimated_drift']
+    else:
+        message = None if raw else sources.message(r['file'], r['line'])
+        path = TSCH_LOG_FILES.get(r['file'], "file-%u" % r['file'])
+        s = "%s:%u" % (os.path.basename(path), r['line'])
+        if message is not None:
+            s += " %s" % format_message(message, r['args'], r['tag'])
+        else:
+            s += " " + " ".join("%d" % a for a in r['args'])
+            if r['tag']:
+                s += " " + r['tag']
+    return head + s
+
+
+def format_record(r, raw, sources=None):
+    if r['type'] == TYPE_TSCH_LOG:
+        return format_tsch_log(r, raw, sources)
+    if r['type'] == TYPE_MTM_STATS:
+        fields = MTM_STATS_FIELDS + ('elapsed_ms', 'processing_p50_us', 'processing_p99_us', 'processing_max_us')
+        return "MS, " + ", ".join(str(r[f]) for f in fields)
+    if raw:
+        return "R, %u, %u, %u, %u, %u, %.3f, %d, %u" % (
+            r['type'], r['seqno'], r['asn'], r['addr_A'], r['addr_B'],
+            r['time'], r['freq_offset'], r['burst_index'])
+    # same fields as output_range_via_serial_snprintf and output_tdoa_via_serial
+    dist_cm = r['time'] * SPEED_OF_LIGHT_M_PER_UWB_TU * 100
+    asn = r['asn'] & 0xffffffff
+    if r['type'] == TYPE_TWR:
+        return "TW, %u, %u, %.2f" % (r['addr_B'], asn, dist_cm)
+    return "TD, %u, %u, %u, %.2f" % (r['addr_A'], r['addr_B'], asn, dist_cm)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument('input', nargs='?', help="file or serial device, stdin by default")
+    parser.add_argument('--raw', action='store_true', help="print all record fields")
+    parser.add_argument('--source', default=os.path.join(os.path.dirname(os.path.abspath(__file__)), '..', '..'),
+                        help="Contiki tree to look up TSCH log messages in")
+    args = parser.parse_args()
+    sources = SourceLookup(args.source)
+
+    stream = open(args.input, 'rb', buffering=0) if args.input else getattr(sys.stdin, 'buffer', sys.stdin)
+    # return whatever is available instead of waiting for a full block
+    read = getattr(stream, 'read1', stream.read)
+
+    records = lost = invalid = 0
+    # the TSCH logs are numbered apart from the measurements
+    last_seqno = None
+    chunk = bytearray()
+    while True:
+        data = read(1024)
+        if not data:
+            break
+        for b in bytearray(data):
+            if b != 0:
+                chunk.append(b)
+                continue
+            if not chunk:
+                continue
+            r = parse_record(bytes(chunk))
+            if r is not None:
+                if last_seqno is not None:
+                    lost += (r['seqno'] - last_seqno - 1) & 0xff
+                last_seqno = r['seqno']
+                records += 1
+                print(format_record(r, args.raw, sources))
+            elif len(chunk) <= MAX_RECORD_LEN + 1 and b'\n' not in chunk:
+                # record sized but broken, e.g. interleaved with printf output
+                invalid += 1
+            else:
+                sys.stdout.write(chunk.decode('ascii', 'replace'))
+            chunk = bytearray()
+        sys.stdout.flush()
+
+    if chunk:
+        sys.stdout.write(chunk.decode('ascii', 'replace'))
+    print("%u records, %u lost, %u invalid" % (records, lost, invalid), file=sys.stderr)
+
+
+if __name__ == '__main__':
+    main()